@@ -3,15 +3,43 @@
 layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedoSpec;
 
-uniform mat4 g_invViewProj;
-uniform mat4 g_decalInvWorld;
-uniform vec4 g_rtSize;
-uniform mat4 g_world;
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
+// Must match struct DrawConstants
+layout (std140) uniform DrawConstants {
+    mat4 g_world;
+    mat4 g_decalInvWorld;
+    vec3 g_posScale;
+    int g_vertexFormat;
+    vec3 g_posBias;
+};
 
 uniform sampler2D g_depth;
+uniform sampler2D g_gbufferNormal;
+
+#ifdef INSTANCED
+flat in mat3 DecalBasis;
+flat in mat4 DecalInvWorld;
+flat in float DecalLayer;
+uniform sampler2DArray g_albedo;
+uniform sampler2DArray g_normal;
+#define SAMPLE_DECAL(tex, uv) texture(tex, vec3(uv, DecalLayer))
+#else
+#define DecalBasis mat3(g_world)
+#define DecalInvWorld g_decalInvWorld
 uniform sampler2D g_albedo;
 uniform sampler2D g_normal;
-uniform sampler2D g_gbufferNormal;
+#define SAMPLE_DECAL(tex, uv) texture(tex, uv)
+#endif
 
 in vec3 WorldPos;
 in vec2 TexCoords;
@@ -40,14 +68,14 @@ void main()
 	vec2 uv = screenPos * 0.5 + 0.5;
     float depth = texture(g_depth, uv).x;
     vec3  worldPos = WorldPosFromDepth(screenPos, depth);
-	vec3 localPos = (g_decalInvWorld * vec4(worldPos, 1.0)).xyz;
+	vec3 localPos = (DecalInvWorld * vec4(worldPos, 1.0)).xyz;
 	vec2 decalUV = localPos.xz * 0.5 + 0.5;
     vec3 gbufferNormal = texture(g_gbufferNormal, uv).xyz;
 	vec3 T = vec3(1.0, 0.0, 0.0);
     vec3 B = vec3(0.0, 0.0, 1.0);
     vec3 N = vec3(0.0, 1.0, 0.0);
 
-    vec3 projectionDirectionWS = mat3(g_world) * N; 
+    vec3 projectionDirectionWS = DecalBasis * N; 
     // discard pixels in case angle between axis of projection and
     // normal from GBuffer is greater than 0
     if (dot(projectionDirectionWS, normalize(gbufferNormal)) < 0.9f) {
@@ -60,10 +88,10 @@ void main()
 	}
 
     mat3 localTBN = mat3(T, B, N);
-    vec3 normalTS = texture(g_normal, decalUV).xyz * 2.0 - 1.0;
+    vec3 normalTS = SAMPLE_DECAL(g_normal, decalUV).xyz * 2.0 - 1.0;
     vec3 normal = localTBN * normalTS;
-    normal = mat3(g_world) * normalize(normal);
-    vec3 albedo = texture(g_albedo, decalUV).rgb;
+    normal = DecalBasis * normalize(normal);
+    vec3 albedo = SAMPLE_DECAL(g_albedo, decalUV).rgb;
     float roughness = 1.0;
     gAlbedoSpec = vec4(albedo, roughness);
     gNormal = normalize(normal + gbufferNormal);
@@ -8,9 +8,131 @@ uniform sampler2D g_position;
 uniform sampler2D g_normal;
 uniform sampler2D g_albedo;
 
-uniform vec3 g_cameraPos;
-uniform vec3 g_lightPos;
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
 uniform int g_gbufferDebugMode;
+// 1 when light_volume_frag.glsl adds the lights afterwards
+uniform int g_isAmbientOnly;
+
+// Must match CLUSTER_* defines
+#define CLUSTER_TILE_SIZE 64
+#define CLUSTER_DEPTH_SLICES 16
+// Must match LIGHT_TEXELS, texels of a light are its position and radius
+// then its color
+#define LIGHT_TEXELS 2
+
+// numTilesX, numTilesY, sliceScale, sliceBias, light and decal grids have
+// the same dimensions
+uniform vec4 g_clusterGrid;
+// first index and number of lights of every cluster
+uniform usamplerBuffer g_lightClusters;
+uniform usamplerBuffer g_lightItems;
+uniform samplerBuffer g_lights;
+
+int GetCluster(vec3 worldPos)
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy) / CLUSTER_TILE_SIZE;
+    float viewZ = (g_view * vec4(worldPos, 1.0)).z;
+    int slice = clamp(int(log(viewZ) * g_clusterGrid.z + g_clusterGrid.w),
+                      0, CLUSTER_DEPTH_SLICES - 1);
+    return (slice * int(g_clusterGrid.y) + tile.y) * int(g_clusterGrid.x)
+           + tile.x;
+}
+
+// Phong of the lights of the cluster, falloff is inverse square windowed to
+// reach zero at the light's radius
+vec3 ShadeClusteredLights(int cluster, vec3 worldPos, vec3 n, vec4 albedo)
+{
+    uvec2 range = texelFetch(g_lightClusters, cluster).xy;
+    vec3 v = normalize(g_cameraPos - worldPos);
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int first = int(texelFetch(g_lightItems, int(range.x + i)).x)
+                    * LIGHT_TEXELS;
+        vec4 light = texelFetch(g_lights, first);
+        vec3 lightColor = texelFetch(g_lights, first + 1).rgb;
+        vec3 toLight = light.xyz - worldPos;
+        float distSq = dot(toLight, toLight);
+        float falloff = clamp(1.0 - distSq * distSq
+                                  / (light.w * light.w * light.w * light.w),
+                              0.0, 1.0);
+        float atten = falloff * falloff / max(distSq, 0.0001);
+        vec3 l = toLight * inversesqrt(max(distSq, 0.0001));
+        float NdotL = max(dot(n, l), 0.0);
+        vec3 diffuse = NdotL * lightColor * albedo.rgb;
+
+        vec3 h = normalize(l + v);
+        float VdotR = max(dot(n, h), 0.0);
+        float spec = pow(VdotR, 8.0);
+        vec3 specular = albedo.a * spec * lightColor;
+        result += (diffuse + specular) * atten;
+    }
+    return result;
+}
+
+#ifdef CLUSTERED_DECALS
+// Must match DECAL_TEXELS, texels of a decal are its inverse world, the
+// upper 3x3 of its world and its texture layer in x
+#define DECAL_TEXELS 8
+
+// first index and number of decals of every cluster
+uniform usamplerBuffer g_clusters;
+uniform usamplerBuffer g_clusterItems;
+uniform samplerBuffer g_decals;
+uniform sampler2DArray g_decalAlbedo;
+uniform sampler2DArray g_decalNormal;
+
+// Same projection as deferred_decal.glsl for every decal of the pixel's
+// cluster, instead of rasterizing decal boxes
+void ApplyClusteredDecals(int cluster, vec3 worldPos, inout vec4 albedo,
+                          inout vec3 normal)
+{
+    uvec2 range = texelFetch(g_clusters, cluster).xy;
+    // derivatives are taken outside of the loop's divergent control flow
+    vec3 worldPosDx = dFdx(worldPos);
+    vec3 worldPosDy = dFdy(worldPos);
+    vec3 gbufferNormal = normal;
+    const vec3 T = vec3(1.0, 0.0, 0.0);
+    const vec3 B = vec3(0.0, 0.0, 1.0);
+    const vec3 N = vec3(0.0, 1.0, 0.0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int first = int(texelFetch(g_clusterItems, int(range.x + i)).x)
+                    * DECAL_TEXELS;
+        mat4 invWorld = mat4(texelFetch(g_decals, first),
+                             texelFetch(g_decals, first + 1),
+                             texelFetch(g_decals, first + 2),
+                             texelFetch(g_decals, first + 3));
+        vec3 localPos = (invWorld * vec4(worldPos, 1.0)).xyz;
+        if (any(greaterThan(abs(localPos), vec3(1.0)))) {
+            continue;
+        }
+        mat3 basis = mat3(texelFetch(g_decals, first + 4).xyz,
+                          texelFetch(g_decals, first + 5).xyz,
+                          texelFetch(g_decals, first + 6).xyz);
+        if (dot(basis * N, normalize(gbufferNormal)) < 0.9) {
+            continue;
+        }
+        float layer = texelFetch(g_decals, first + 7).x;
+        vec3 uv = vec3(localPos.xz * 0.5 + 0.5, layer);
+        vec2 uvDx = (invWorld * vec4(worldPosDx, 0.0)).xz * 0.5;
+        vec2 uvDy = (invWorld * vec4(worldPosDy, 0.0)).xz * 0.5;
+        vec3 normalTS
+            = textureGrad(g_decalNormal, uv, uvDx, uvDy).xyz * 2.0 - 1.0;
+        vec3 decalNormal = basis * normalize(mat3(T, B, N) * normalTS);
+        albedo = vec4(textureGrad(g_decalAlbedo, uv, uvDx, uvDy).rgb, 1.0);
+        normal = normalize(decalNormal + gbufferNormal);
+    }
+}
+#endif
 
 #define GDM_VERTEX_NORMAL 1
 #define GDM_TANGENT 2
@@ -22,40 +144,31 @@ uniform int g_gbufferDebugMode;
 void main()
 {             
     vec4 albedo = texture(g_albedo, TexCoords).rgba;
+	vec3 Normal = texture(g_normal, TexCoords).rgb;
+	vec3 WorldPos = texture(g_position, TexCoords).rgb;
+	int cluster = GetCluster(WorldPos);
+#ifdef CLUSTERED_DECALS
+	ApplyClusteredDecals(cluster, WorldPos, albedo, Normal);
+#endif
 	if (g_gbufferDebugMode != 0) {
 		if (g_gbufferDebugMode == GDM_NORMAL_MAP) {
-			color.rgb = normalize(texture(g_normal, TexCoords).xyz);
+			color.rgb = normalize(Normal);
 		}
 		else if (g_gbufferDebugMode == GDM_POSITION) {
-			color.rgb = texture(g_position, TexCoords).xyz;
+			color.rgb = WorldPos;
 		}
 		else if (g_gbufferDebugMode == GDM_ALBEDO) {
 			color.rgb = albedo.rgb;
 		}
 	}
 	else {
-		// retrieve data from gbuffer
-		vec3 WorldPos = texture(g_position, TexCoords).rgb;
-		vec3 Normal = texture(g_normal, TexCoords).rgb;
-		float Specular = albedo.a;
-
 		vec3 ambient = vec3(0.1);
-		
-		vec3 lightColor = vec3(50.0);
-		float distToLight = distance(g_lightPos, WorldPos);
-		float atten = 1.0 / (distToLight * distToLight);
-		vec3 l = normalize(g_lightPos - WorldPos);
 		vec3 n = normalize(Normal);
-		float NdotL = max(dot(n, l), 0.0);
-		vec3 diffuse = NdotL * lightColor * albedo.rgb;
-
-		vec3 v = normalize(g_cameraPos - WorldPos);
-		vec3 h = normalize(l + v);
-		float VdotR = max(dot(n, h), 0.0);
-		float spec = pow(VdotR, 8.0);
-		vec3 specular = Specular * spec * lightColor;
 
 		color = vec4(1.0);
-		color.rgb = ambient + (diffuse + specular) * atten;
+		color.rgb = ambient;
+		if (g_isAmbientOnly == 0) {
+			color.rgb += ShadeClusteredLights(cluster, WorldPos, n, albedo);
+		}
 	}
 }
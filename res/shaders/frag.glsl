@@ -2,8 +2,17 @@
 
 out vec4 color;
 
-uniform vec3 g_lightPos; 
-uniform vec3 g_cameraPos;
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
 uniform bool g_wireframe;
 uniform vec3 g_color;
 
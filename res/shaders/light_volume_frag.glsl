@@ -0,0 +1,56 @@
+#version 330 core
+
+out vec4 color;
+
+#ifndef STENCIL_PASS
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
+uniform sampler2D g_position;
+uniform sampler2D g_normal;
+uniform sampler2D g_albedo;
+
+// position and radius
+uniform vec4 g_light;
+uniform vec3 g_lightColor;
+#endif
+
+// One point light over the pixels the stencil pass found inside its volume,
+// blended additively. Same shading as ShadeClusteredLights of
+// deferred_frag.glsl.
+void main()
+{
+#ifdef STENCIL_PASS
+	color = vec4(0.0);
+#else
+	vec2 uv = gl_FragCoord.xy * g_rtSize.zw;
+	vec3 worldPos = texture(g_position, uv).rgb;
+	vec3 n = normalize(texture(g_normal, uv).rgb);
+	vec4 albedo = texture(g_albedo, uv);
+
+	vec3 toLight = g_light.xyz - worldPos;
+	float distSq = dot(toLight, toLight);
+	float falloff = clamp(1.0 - distSq * distSq
+	                          / (g_light.w * g_light.w * g_light.w * g_light.w),
+	                      0.0, 1.0);
+	float atten = falloff * falloff / max(distSq, 0.0001);
+	vec3 l = toLight * inversesqrt(max(distSq, 0.0001));
+	float NdotL = max(dot(n, l), 0.0);
+	vec3 diffuse = NdotL * g_lightColor * albedo.rgb;
+
+	vec3 v = normalize(g_cameraPos - worldPos);
+	vec3 h = normalize(l + v);
+	float VdotR = max(dot(n, h), 0.0);
+	float spec = pow(VdotR, 8.0);
+	vec3 specular = albedo.a * spec * g_lightColor;
+	color = vec4((diffuse + specular) * atten, 1.0);
+#endif
+}
@@ -0,0 +1,31 @@
+#version 330 core
+
+// xyz are quantized position with VF_PACKED
+layout (location = 0) in vec4 inPos;
+
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
+// Must match struct DrawConstants, g_world scales the sphere by the light's
+// radius and moves it to the light
+layout (std140) uniform DrawConstants {
+    mat4 g_world;
+    mat4 g_decalInvWorld;
+    vec3 g_posScale;
+    int g_vertexFormat;
+    vec3 g_posBias;
+};
+
+void main()
+{
+	vec3 pos = inPos.xyz * g_posScale + g_posBias;
+	gl_Position = g_viewProj * (g_world * vec4(pos, 1.0));
+}
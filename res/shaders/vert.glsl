@@ -1,28 +1,89 @@
 #version 330 core
 
-layout (location = 0) in vec3 inPos;
+// Must match enum VertexFormat
+#define VF_FLOAT 0
+#define VF_PACKED 1
+
+// VF_PACKED: xyz are quantized position, w is 1 if tangent sign is negative
+layout (location = 0) in vec4 inPos;
+// VF_PACKED: xy are octahedral snorm16
 layout (location = 1) in vec3 inNorm;
 layout (location = 2) in vec2 inTexCoords;
+// VF_PACKED: xy are octahedral snorm16
 layout (location = 3) in vec4 inTangent;
 
-uniform mat4 g_view;
-uniform mat4 g_proj;
-uniform mat4 g_world;
+// Must match struct FrameConstants
+layout (std140) uniform FrameConstants {
+    mat4 g_view;
+    mat4 g_proj;
+    mat4 g_viewProj;
+    mat4 g_invViewProj;
+    vec3 g_cameraPos;
+    vec3 g_lightPos;
+    vec4 g_rtSize;
+};
+
+// Must match struct DrawConstants
+layout (std140) uniform DrawConstants {
+    mat4 g_world;
+    mat4 g_decalInvWorld;
+    vec3 g_posScale;
+    int g_vertexFormat;
+    vec3 g_posBias;
+};
+
+#ifdef INSTANCED
+// Must match struct DrawInstance, replaces g_world and g_decalInvWorld
+layout (location = 4) in mat4 inWorld;
+layout (location = 8) in mat4 inInvWorld;
+// x is the layer of decal texture arrays
+layout (location = 12) in vec4 inParams;
+#define WORLD inWorld
+// upper 3x3 of world, keeps varyings within the GL 3.3 minimum
+flat out mat3 DecalBasis;
+flat out mat4 DecalInvWorld;
+flat out float DecalLayer;
+#else
+#define WORLD g_world
+#endif
 
 out vec3 WorldPos;
 out vec2 TexCoords;
 out mat3 TBN;
 out vec4 ClipPos;
 
+vec3 OctDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main()
 {
-	gl_Position = g_proj * g_view * g_world * vec4(inPos, 1.0);
-	WorldPos = (g_world * vec4(inPos, 1.0)).xyz;
-	vec3 N = normalize((g_world * vec4(inNorm, 0.0)).xyz);
+	vec3 pos = inPos.xyz * g_posScale + g_posBias;
+	vec3 norm = inNorm;
+	vec4 tangent = inTangent;
+	if (g_vertexFormat == VF_PACKED) {
+		norm = OctDecode(max(inNorm.xy / 32767.0, -1.0));
+		tangent.xyz = OctDecode(max(inTangent.xy / 32767.0, -1.0));
+		tangent.w = inPos.w > 0.5 ? -1.0 : 1.0;
+	}
+
+	WorldPos = (WORLD * vec4(pos, 1.0)).xyz;
+	gl_Position = g_viewProj * vec4(WorldPos, 1.0);
+	vec3 N = normalize((WORLD * vec4(norm, 0.0)).xyz);
 	TexCoords = inTexCoords;
-	vec3 T = normalize((g_world * vec4(inTangent.xyz, 0.0)).xyz);
+	vec3 T = normalize((WORLD * vec4(tangent.xyz, 0.0)).xyz);
 	T = normalize(T - dot(T, N) * N);
-	vec3 B = cross(N, T) * inTangent.w;
+	vec3 B = cross(N, T) * tangent.w;
 	TBN = mat3(T, B, N);
 	ClipPos = gl_Position;
+#ifdef INSTANCED
+	DecalBasis = mat3(inWorld);
+	DecalInvWorld = inInvWorld;
+	DecalLayer = inParams.x;
+#endif
 }
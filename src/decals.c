@@ -25,6 +25,22 @@
 #define MAX_VERTEX_BUFFER 512 * 1024
 #define MAX_ELEMENT_BUFFER 128 * 1024
 
+// Bytes of streamed model data uploaded per frame
+#define MODEL_UPLOAD_BUDGET (4 * 1024 * 1024)
+// Screen space error of mesh LODs that is considered invisible
+#define DEFAULT_LOD_PIXEL_ERROR 1.0f
+// Uniform block data of one frame, room for about 32000 draws, enough for
+// MAX_DECALS decals drawn one by one
+#define UNIFORM_RING_FRAME_SIZE (8 * 1024 * 1024)
+// Decals beyond the ones edited in the UI are scattered over the floor to
+// benchmark the decal modes
+#define MAX_DECALS 10000
+// Must match DECAL_TEXELS of deferred_frag.glsl
+#define DECAL_TEXELS 8
+#define MAX_LIGHTS 4096
+// Must match LIGHT_TEXELS of deferred_frag.glsl
+#define LIGHT_TEXELS 2
+
 #if _WIN32 // Force descrete GPU on Windows
 __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
 __declspec(dllexport) i32 AmdPowerXpressRequestHighPerformance = 1;
@@ -32,7 +48,7 @@ __declspec(dllexport) i32 AmdPowerXpressRequestHighPerformance = 1;
 
 struct Transform {
     Vec3D translation;
-    Vec3D rotation;
+    Quat rotation;
     Vec3D scale;
 };
 
@@ -67,8 +83,148 @@ struct Camera {
     Mat4X4 view;
     Mat4X4 proj;
     Vec3D position;
+    Quat orientation;
+    // derived from orientation
     Vec3D right;
     Vec3D front;
+    // vertical, in radians
+    f32 fov;
+    f32 zNear;
+    f32 zFar;
+};
+
+// Frustum culling results of the current frame
+struct SceneCullStats {
+    u32 numMeshes;
+    u32 numVisibleMeshes;
+    u32 numDecals;
+    u32 numVisibleDecals;
+};
+
+// Uniforms that passes set, handles are resolved for every material once.
+// Camera, light and per draw data live in uniform blocks.
+enum GameUniform {
+    GU_GBUFFER_DEBUG_MODE,
+    GU_WIREFRAME,
+    GU_ALBEDO_TEX,
+    GU_NORMAL_TEX,
+    GU_ROUGHNESS_TEX,
+    GU_DEPTH,
+    GU_GBUFFER_NORMAL,
+    GU_POSITION,
+    GU_ALBEDO,
+    GU_NORMAL,
+    GU_CLUSTER_GRID,
+    GU_CLUSTERS,
+    GU_CLUSTER_ITEMS,
+    GU_DECALS,
+    GU_DECAL_ALBEDO,
+    GU_DECAL_NORMAL,
+    GU_LIGHT_CLUSTERS,
+    GU_LIGHT_ITEMS,
+    GU_LIGHTS,
+    GU_LIGHT,
+    GU_LIGHT_COLOR,
+    GU_AMBIENT_ONLY,
+    GU_COUNT,
+};
+
+static const i8 *const GAME_UNIFORM_NAMES[GU_COUNT] = {
+    [GU_GBUFFER_DEBUG_MODE] = "g_gbufferDebugMode",
+    [GU_WIREFRAME] = "g_wireframe",
+    [GU_ALBEDO_TEX] = "g_albedoTex",
+    [GU_NORMAL_TEX] = "g_normalTex",
+    [GU_ROUGHNESS_TEX] = "g_roughnessTex",
+    [GU_DEPTH] = "g_depth",
+    [GU_GBUFFER_NORMAL] = "g_gbufferNormal",
+    [GU_POSITION] = "g_position",
+    [GU_ALBEDO] = "g_albedo",
+    [GU_NORMAL] = "g_normal",
+    [GU_CLUSTER_GRID] = "g_clusterGrid",
+    [GU_CLUSTERS] = "g_clusters",
+    [GU_CLUSTER_ITEMS] = "g_clusterItems",
+    [GU_DECALS] = "g_decals",
+    [GU_DECAL_ALBEDO] = "g_decalAlbedo",
+    [GU_DECAL_NORMAL] = "g_decalNormal",
+    [GU_LIGHT_CLUSTERS] = "g_lightClusters",
+    [GU_LIGHT_ITEMS] = "g_lightItems",
+    [GU_LIGHTS] = "g_lights",
+    [GU_LIGHT] = "g_light",
+    [GU_LIGHT_COLOR] = "g_lightColor",
+    [GU_AMBIENT_ONLY] = "g_isAmbientOnly",
+};
+
+// Materials in the order LoadMaterials creates them
+enum GameMaterialId {
+    GM_PHONG,
+    GM_DECAL,
+    GM_GBUFFER,
+    GM_DEFERRED,
+    // INSTANCED variants of Phong and Decal
+    GM_PHONG_INSTANCED,
+    GM_DECAL_INSTANCED,
+    // Deferred that applies decals of its cluster
+    GM_DEFERRED_CLUSTERED,
+    // one point light over the stencil marked pixels of its volume, and the
+    // stencil pass that marks them
+    GM_LIGHT_VOLUME,
+    GM_LIGHT_VOLUME_STENCIL,
+    GM_COUNT,
+};
+
+// How the decal and wireframe passes draw decal volumes
+enum DecalMode {
+    // one render queue packet with its own DrawConstants per decal
+    DM_PER_DRAW,
+    // one instanced draw of all visible decals, textures in arrays
+    DM_INSTANCED,
+    // no decal pass, deferred shading applies the decals of each pixel's
+    // cluster. Wireframes are drawn instanced.
+    DM_CLUSTERED,
+    DM_COUNT,
+};
+
+static const i8 *DECAL_MODE_NAMES[DM_COUNT] = {
+    [DM_PER_DRAW] = "Per draw decals",
+    [DM_INSTANCED] = "Instanced decals",
+    [DM_CLUSTERED] = "Clustered decals",
+};
+
+static const i8 *DECAL_COUNT_NAMES[] = { "2 decals", "10 decals",
+                                         "1000 decals", "10000 decals" };
+static const u32 DECAL_COUNTS[ARRAY_COUNT(DECAL_COUNT_NAMES)]
+    = { 2, 10, 1000, MAX_DECALS };
+
+enum LightingMode {
+    // deferred shading loops over the lights of each pixel's cluster
+    LM_CLUSTERED,
+    // deferred shading adds ambient only, then every visible light draws its
+    // sphere with a two pass stencil test and additive blending
+    LM_LIGHT_VOLUMES,
+    LM_COUNT,
+};
+
+static const i8 *LIGHTING_MODE_NAMES[LM_COUNT] = {
+    [LM_CLUSTERED] = "Clustered lighting",
+    [LM_LIGHT_VOLUMES] = "Stencil light volumes",
+};
+
+static const i8 *LIGHT_COUNT_NAMES[] = { "1 light", "64 lights",
+                                         "1024 lights", "4096 lights" };
+static const u32 LIGHT_COUNTS[ARRAY_COUNT(LIGHT_COUNT_NAMES)]
+    = { 1, 64, 1024, MAX_LIGHTS };
+
+struct GameMaterial {
+    struct Material *material;
+    // MATERIAL_INVALID_UNIFORM where the program does not use the uniform
+    i32 uniforms[GU_COUNT];
+};
+
+// Passes drawn from the render queue, in sort key order
+enum RenderPass {
+    RP_GBUFFER,
+    RP_DECAL,
+    RP_WIREFRAME,
 };
 
 struct MeshTextureMapping {
@@ -77,6 +233,53 @@ struct MeshTextureMapping {
     const i8 *textureName;
 };
 
+// What an interned name refers to, -1 where it refers to nothing
+struct NameBinding {
+    i32 material;
+    // index into albedo, normal and roughness textures
+    i32 textureSet;
+};
+
+// Textures of a decal, resolved once at startup
+struct DecalBinding {
+    struct Texture2D *albedo;
+    struct Texture2D *normal;
+    // layer of decalAlbedoArray and decalNormalArray with the same textures
+    u32 textureLayer;
+};
+
+// Decal benchmark in milliseconds, averaged over recent frames
+struct DecalTimings {
+    // RecordFramePackets, decal instances and clusters
+    f64 record;
+    // decal and wireframe pass submission
+    f64 submit;
+    f64 frame;
+};
+
+// Point lights, one array per component so culling projects four lights at
+// a time
+struct LightList {
+    f32 *x;
+    f32 *y;
+    f32 *z;
+    f32 *radius;
+    f32 *red;
+    f32 *green;
+    f32 *blue;
+    u32 numLights;
+    u32 capacity;
+};
+
+// Pixels shaded by light volumes, from GL_SAMPLES_PASSED of a recent frame
+struct LightVolumeStats {
+    u32 numLights;
+    u64 numSamples;
+    u32 maxSamples;
+    // lights whose volume was on screen but hidden
+    u32 numEmpty;
+};
+
 struct Game {
     struct GBuffer gbuffer;
     struct FramebufferSize framebufferSize;
@@ -85,13 +288,78 @@ struct Game {
     struct Texture2D *normalTextures;
     struct Texture2D *roughnessTextures;
     u32 numTextures;
+    // layer i holds albedo and normal texture i
+    struct Texture2DArray decalAlbedoArray;
+    struct Texture2DArray decalNormalArray;
     struct Camera camera;
     struct nk_glfw nuklear;
-    struct Material **materials;
+    struct GameMaterial *materials;
     u32 numMaterials;
+    // material, mesh and texture names, nameBindings is indexed by name id
+    struct UtilsStringTable names;
+    struct NameBinding *nameBindings;
+    u32 numNameBindings;
+    // room meshes stream in, the first ones already have their material and
+    // textures
+    u32 numBoundRoomMeshes;
     struct ModelProxy **models;
     u32 numModels;
     GLFWwindow *window;
+    struct UtilsThreadPool *threadPool;
+    struct GeometryBuffer *geometry;
+    f32 lodPixelError;
+    // geometry pass of the last frame
+    u64 numSubmittedTriangles;
+    u64 numFullDetailTriangles;
+    nk_bool isMeshletCullingEnabled;
+    // LOD 0 draws of a frame gather visible meshlets into meshletEbo, which
+    // is orphaned every frame
+    u32 meshletEbo;
+    u64 meshletEboOffset;
+    void *meshletIndices;
+    u64 meshletIndicesSize;
+    struct MeshletCullStats meshletStats;
+    struct SceneCullStats cullStats;
+    // per frame temporaries, released at the start of every frame
+    struct UtilsArena frameArena;
+    // frame constants and DrawConstants of every draw
+    struct UniformRing *uniformRing;
+    // packets of all objects without per frame data, rebuilt when meshes are
+    // added or the room is reloaded. userData is the mesh or decal index.
+    struct RenderQueue scenePackets;
+    boolean isScenePacketsDirty;
+    u32 numScenePacketRoomMeshes;
+    u32 numScenePacketCubeMeshes;
+    u32 numScenePacketDecals;
+    // visible scene packets with LOD, depth and DrawConstants of the frame
+    struct RenderQueue framePackets;
+    enum DecalMode decalMode;
+    struct DecalTimings decalTimings;
+    // GPU time of the decal pass including depth and normal copies
+    struct GpuTimer decalTimer;
+    // GPU time of the deferred shading pass
+    struct GpuTimer shadingTimer;
+    // visible decals by cluster and DECAL_TEXELS texels per visible decal
+    struct ClusterGrid decalClusters;
+    struct BufferTexture decalData;
+    // light 0 is the ceiling light, the others are scattered for stress
+    // tests
+    struct LightList lights;
+    // visible lights by cluster and LIGHT_TEXELS texels per visible light
+    struct ClusterGrid lightClusters;
+    struct BufferTexture lightData;
+    u32 numVisibleLights;
+    // CullLights in milliseconds, averaged like DecalTimings
+    f64 lightCullTime;
+    enum LightingMode lightingMode;
+    // one counter per visible light of LM_LIGHT_VOLUMES
+    struct GpuSampleCounters lightSamples;
+    struct LightVolumeStats lightVolumeStats;
+};
+
+struct GeometryPassContext {
+    struct Game *game;
+    const Frustum *frustum;
 };
 
 struct Game *Game_Create();
@@ -107,6 +375,11 @@ void ProcessInput(GLFWwindow *window);
 void Camera_Init(struct Camera *camera, const Vec3D *position, f32 fov,
                  f32 aspectRatio, f32 zNear, f32 zFar);
 
+// Turns about world up by yaw and about camera right by pitch, in radians
+void Camera_Rotate(struct Camera *camera, f32 yaw, f32 pitch);
+
+void Camera_UpdateView(struct Camera *camera);
+
 void Game_Update(struct Game *game);
 
 void PushRenderPassAnnotation(const i8 *passName);
@@ -117,6 +390,10 @@ void UpdateDecalTransforms(Mat4X4 *decalWorlds, Mat4X4 *decalInvWorlds,
                            const struct Transform *decalTransforms,
                            u32 numDecals);
 
+// Converts pitch, yaw and roll in degrees to rotations of decalTransforms
+void UpdateDecalRotations(struct Transform *decalTransforms,
+                          const Vec3D *decalAngles, u32 numDecals);
+
 void InitNuklear(GLFWwindow *window);
 
 void DeinitNuklear(GLFWwindow *window);
@@ -128,11 +405,102 @@ void GLAPIENTRY MessageCallback(GLenum source, GLenum type, GLuint id,
 i32 InitGBuffer(struct GBuffer *gbuffer, const i32 fbWidth,
                 const i32 fbHeight);
 
-struct Material *Game_FindMaterialByName(struct Game *game, const i8 *name);
+struct GameMaterial *Game_FindMaterialByName(struct Game *game,
+                                             const i8 *name);
+
+struct NameBinding *Game_BindName(struct Game *game, const i8 *name);
+
+const struct NameBinding *Game_FindNameBinding(const struct Game *game,
+                                               const i8 *name);
 
-i32 FindTextureIdxForMesh(const struct Game *game,
-                          const struct MeshTextureMapping *mappings,
-                          u32 numMappings, const i8 *meshName);
+void BindTextureMappings(struct Game *game,
+                         const struct MeshTextureMapping *mappings,
+                         u32 numMappings);
+
+i32 FindTextureSet(const struct Game *game, const i8 *name);
+
+void BindRoomMeshes(struct Game *game);
+
+void BindDecals(const struct Game *game, struct DecalBinding *decals,
+                u32 numDecals);
+
+void ScatterDecals(const struct Game *game, Mat4X4 *decalWorlds,
+                   Mat4X4 *decalInvWorlds, struct DecalBinding *decals,
+                   u32 first, u32 numDecals);
+
+u32 WriteDecalInstances(struct Game *game, const Mat4X4 *decalWorlds,
+                        const Mat4X4 *decalInvWorlds,
+                        const struct DecalBinding *decals,
+                        const u8 *decalVisibility, u32 numDecals,
+                        u32 numVisibleDecals);
+
+void DrawDecalInstances(struct Game *game, u32 numInstances);
+
+void BuildDecalClusters(struct Game *game, const Mat4X4 *decalWorlds,
+                        const Mat4X4 *decalInvWorlds,
+                        const struct DecalBinding *decals,
+                        const u8 *decalVisibility, u32 numDecals,
+                        u32 numVisibleDecals);
+
+f64 AverageMilliseconds(f64 average, f64 seconds);
+
+void LightList_Init(struct LightList *list, u32 capacity);
+
+void LightList_Deinit(struct LightList *list);
+
+void LightList_Add(struct LightList *list, const Vec3D *position, f32 radius,
+                   const Vec3D *color);
+
+void ScatterLights(struct LightList *list, u32 numLights);
+
+const u8 *CullLights(struct Game *game, u32 numLights);
+
+void DrawLightVolumes(struct Game *game, const u8 *lightVisibility,
+                      u32 numLights);
+
+void UpdateLightVolumeStats(struct Game *game);
+
+boolean UsesLightVolumes(const struct Game *game);
+
+void UploadFrameConstants(struct Game *game, const Mat4X4 *viewProj,
+                          const Vec3D *cameraPos, const Vec3D *lightPos);
+
+void WriteDrawConstants(struct DrawConstants *out,
+                        const struct MeshProxy *mesh, const Mat4X4 *world,
+                        const Mat4X4 *decalInvWorld);
+
+void InitScenePacket(struct DrawPacket *packet, const struct Game *game,
+                     enum RenderPass pass, enum GameMaterialId material,
+                     const struct MeshProxy *mesh,
+                     const struct Texture2D *textureSet, u32 userData);
+
+void AddPacketTexture(struct DrawPacket *packet, i32 sampler,
+                      const struct Texture2D *texture);
+
+void UpdateScenePackets(struct Game *game, const struct DecalBinding *decals,
+                        u32 numDecals);
+
+void RecordFramePackets(struct Game *game, const u8 *meshVisibility,
+                        const u8 *decalVisibility, const Mat4X4 *decalWorlds,
+                        const Mat4X4 *decalInvWorlds);
+
+void RecordPacketsChunk(void *arg, u32 chunk, u32 threadIndex);
+
+void DrawGeometryPacket(const struct DrawPacket *packet, void *userData);
+
+struct ModelProxy *LoadRoom(struct Game *game);
+
+void BeginMeshletCulling(struct Game *game, const struct ModelProxy *model);
+
+u32 DrawMeshletsCulled(struct Game *game, const struct MeshProxy *mesh,
+                       const Frustum *frustum);
+
+const u8 *CullMeshes(struct Game *game, const struct ModelProxy *model,
+                     const Frustum *frustum);
+
+u32 CullDecals(struct Game *game, const struct ModelProxy *unitCube,
+               const Mat4X4 *decalWorlds, u32 numDecals,
+               const Frustum *frustum, u8 *visible);
 
 i32
 main(void)
@@ -146,13 +514,18 @@ main(void)
     glEnable(GL_DEBUG_OUTPUT);
     glDebugMessageCallback(MessageCallback, 0);
 
-    Mat4X4 decalWorlds[2] = { 0 };
-    Mat4X4 decalInvWorlds[2] = { 0 };
+    Mat4X4 *decalWorlds = malloc(sizeof *decalWorlds * MAX_DECALS);
+    Mat4X4 *decalInvWorlds = malloc(sizeof *decalInvWorlds * MAX_DECALS);
+    u8 *decalVisibility = malloc(MAX_DECALS);
     struct Transform decalTransforms[]
         = { { .scale = { 2.0f, 2.0f, 2.0f }, .translation.Y = 2.0f },
             { .scale = { 2.0f, 2.0f, 2.0f },
-              .translation = { 2.0f, 5.0f, -9.0f },
-              .rotation.X = 90.0f } };
+              .translation = { 2.0f, 5.0f, -9.0f } } };
+    // edited in the UI, decalTransforms only keep the rotations
+    Vec3D decalAngles[ARRAY_COUNT(decalTransforms)] = { { 0 },
+                                                        { .X = 90.0f } };
+    UpdateDecalRotations(decalTransforms, decalAngles,
+                         ARRAY_COUNT(decalTransforms));
     UpdateDecalTransforms(decalWorlds, decalInvWorlds, decalTransforms,
                           ARRAY_COUNT(decalTransforms));
 
@@ -165,6 +538,11 @@ main(void)
                 zNear, zFar);
 
     const Vec3D g_lightPos = { 0.0, 10.0, 0.0 };
+    const Vec3D lightColor = { 50.0f, 50.0f, 50.0f };
+    LightList_Add(&game->lights, &g_lightPos, 30.0f, &lightColor);
+    ScatterLights(&game->lights, MAX_LIGHTS);
+    i32 lightCountIdx = 0;
+    u32 numLights = LIGHT_COUNTS[lightCountIdx];
 
     InitGBuffer(&game->gbuffer, game->framebufferSize.width,
                 game->framebufferSize.height);
@@ -188,8 +566,15 @@ main(void)
             { .meshNames = { "Decal1" },
               .numMeshNames = 1,
               .textureName = "Bricks" } };
-
-    const i32 C_DEFAULT_TEX_IDX = 0;
+    BindTextureMappings(game, textureMappings, ARRAY_COUNT(textureMappings));
+    struct DecalBinding *decalBindings
+        = malloc(sizeof *decalBindings * MAX_DECALS);
+    BindDecals(game, decalBindings, ARRAY_COUNT(decalTransforms));
+    ScatterDecals(game, decalWorlds, decalInvWorlds, decalBindings,
+                  ARRAY_COUNT(decalTransforms), MAX_DECALS);
+    i32 decalCountIdx = 0;
+    u32 numDecals = DECAL_COUNTS[decalCountIdx];
+    f64 lastFrameTime = UtilsGetTimeInSeconds();
 
 #if _WIN32 // On Windows GLFW window won't start maximazed. We force it.
     glfwMaximizeWindow(game->window);
@@ -199,163 +584,143 @@ main(void)
 
     /* Loop until the user closes the window */
     while (!glfwWindowShouldClose(game->window)) {
+        const f64 frameTime = UtilsGetTimeInSeconds();
+        struct DecalTimings *timings = &game->decalTimings;
+        timings->frame
+            = AverageMilliseconds(timings->frame, frameTime - lastFrameTime);
+        lastFrameTime = frameTime;
         nk_glfw3_new_frame(&game->nuklear);
         ProcessInput(game->window);
         Game_Update(game);
+        GLState_BeginFrame();
+        const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(
+            &game->camera.view, &game->camera.proj);
+        const Frustum frustum = MathFrustumFromViewProj(&viewProj);
+        const u8 *meshVisibility = CullMeshes(game, game->models[0], &frustum);
+        const u32 numVisibleDecals
+            = CullDecals(game, game->models[1], decalWorlds, numDecals,
+                         &frustum, decalVisibility);
+        const boolean isInstanced = game->decalMode == DM_INSTANCED;
+        const boolean isClustered = game->decalMode == DM_CLUSTERED;
+        UniformRing_BeginFrame(game->uniformRing);
+        UploadFrameConstants(game, &viewProj, &eyePos, &g_lightPos);
+        const f64 lightCullStart = UtilsGetTimeInSeconds();
+        const u8 *lightVisibility = CullLights(game, numLights);
+        game->lightCullTime = AverageMilliseconds(
+            game->lightCullTime, UtilsGetTimeInSeconds() - lightCullStart);
+        // instanced and clustered decals have no packets
+        UpdateScenePackets(game, decalBindings,
+                           game->decalMode == DM_PER_DRAW ? numDecals : 0);
+        const f64 recordStart = UtilsGetTimeInSeconds();
+        RecordFramePackets(game, meshVisibility, decalVisibility,
+                           decalWorlds, decalInvWorlds);
+        u32 numDecalInstances = 0;
+        if (game->decalMode != DM_PER_DRAW && numVisibleDecals > 0) {
+            numDecalInstances = WriteDecalInstances(
+                game, decalWorlds, decalInvWorlds, decalBindings,
+                decalVisibility, numDecals, numVisibleDecals);
+        }
+        if (isClustered) {
+            BuildDecalClusters(game, decalWorlds, decalInvWorlds,
+                               decalBindings, decalVisibility, numDecals,
+                               numVisibleDecals);
+        }
+        timings->record = AverageMilliseconds(
+            timings->record, UtilsGetTimeInSeconds() - recordStart);
+        f64 submitSeconds = 0.0;
+        RenderQueue_Sort(&game->framePackets);
         // GBuffer Pass
         {
             PushRenderPassAnnotation("GBuffer Pass");
             {
                 PushRenderPassAnnotation("Geometry Pass");
-                struct Material *m = Game_FindMaterialByName(game, "GBuffer");
-                GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER,
-                                          game->gbuffer.framebuffer));
+                GLState_BindFramebuffer(GL_FRAMEBUFFER,
+                                        game->gbuffer.framebuffer);
                 GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-                GLCHECK(glUseProgram(Material_GetHandle(m)));
-
-                Material_SetUniform(m, "g_view", sizeof(Mat4X4),
-                                    &game->camera.view, UT_MAT4);
-                Material_SetUniform(m, "g_proj", sizeof(Mat4X4),
-                                    &game->camera.proj, UT_MAT4);
-                Material_SetUniform(m, "g_lightPos", sizeof(Vec3D),
-                                    &g_lightPos, UT_VEC3F);
-                Material_SetUniform(m, "g_cameraPos", sizeof(Vec3D), &eyePos,
-                                    UT_VEC3F);
-
+                game->numSubmittedTriangles = 0;
+                game->numFullDetailTriangles = 0;
                 const struct ModelProxy *room = game->models[0];
                 for (u32 i = 0; i < room->numMeshes; ++i) {
-                    const i32 texIdx = FindTextureIdxForMesh(
-                        game, textureMappings, ARRAY_COUNT(textureMappings),
-                        room->meshes[i].name);
-                    Material_SetTexture(m, "g_albedoTex",
-                                        &game->albedoTextures[texIdx]);
-                    Material_SetTexture(m, "g_normalTex",
-                                        &game->normalTextures[texIdx]);
-                    Material_SetTexture(m, "g_roughnessTex",
-                                        &game->roughnessTextures[texIdx]);
-
-                    GLCHECK(glBindVertexArray(room->meshes[i].vao));
-                    Material_SetUniform(m, "g_world", sizeof(Mat4X4),
-                                        &room->meshes[i].world, UT_MAT4);
-                    GLCHECK(glDrawElements(GL_TRIANGLES,
-                                           room->meshes[i].numIndices,
-                                           GL_UNSIGNED_INT, NULL));
+                    game->numFullDetailTriangles
+                        += room->meshes[i].lods[0].numIndices / 3;
                 }
+                BeginMeshletCulling(game, room);
+                struct GeometryPassContext context = { game, &frustum };
+                RenderQueue_Execute(&game->framePackets, RP_GBUFFER,
+                                    game->uniformRing, DrawGeometryPacket,
+                                    &context);
                 PopRenderPassAnnotation();
             }
 
-            // Decal pass
-            {
+            // Decal pass, depth and normal copies are skipped too when no
+            // decal is visible
+            GpuTimer_Begin(&game->decalTimer);
+            if (numVisibleDecals > 0 && !isClustered) {
                 PushRenderPassAnnotation("Decal Pass");
-                struct Material *m = Game_FindMaterialByName(game, "Decal");
+                const f64 submitStart = UtilsGetTimeInSeconds();
+                const enum GameMaterialId material
+                    = isInstanced ? GM_DECAL_INSTANCED : GM_DECAL;
+                const struct GameMaterial *gm = &game->materials[material];
+                struct Material *m = gm->material;
+                const i32 *u = gm->uniforms;
                 // Set read only depth
-                glDepthFunc(GL_GREATER);
-                glDepthMask(GL_FALSE);
-                glCullFace(GL_FRONT);
+                GLState_DepthFunc(GL_GREATER);
+                GLState_DepthMask(0);
+                GLState_CullFace(GL_FRONT);
                 // Copy gbuffer depth
                 {
-                    GLCHECK(glBindTexture(GL_TEXTURE_2D,
-                                          game->gbuffer.depthTex.handle));
+                    GLState_BindTexture(0, GL_TEXTURE_2D,
+                                        game->gbuffer.depthTex.handle);
                     GLCHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0,
                                                 game->framebufferSize.width,
                                                 game->framebufferSize.height));
-                    GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
                 }
                 // Copy gbuffer normal
                 {
                     GLCHECK(glReadBuffer(GL_COLOR_ATTACHMENT1));
-                    GLCHECK(glBindTexture(GL_TEXTURE_2D,
-                                          game->gbuffer.normalCopyTex.handle));
+                    GLState_BindTexture(0, GL_TEXTURE_2D,
+                                        game->gbuffer.normalCopyTex.handle);
                     GLCHECK(glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0,
                                                 game->framebufferSize.width,
                                                 game->framebufferSize.height));
-                    GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
                 }
-                const struct ModelProxy *unitCube = game->models[1];
-                for (u32 i = 0; i < unitCube->numMeshes; ++i) {
-                    GLCHECK(glUseProgram(Material_GetHandle(m)));
-                    Material_SetTexture(m, "g_depth", &game->gbuffer.depthTex);
-                    Material_SetTexture(m, "g_gbufferNormal",
-                                        &game->gbuffer.normalCopyTex);
-                    const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(
-                        &game->camera.view, &game->camera.proj);
-                    const Mat4X4 invViewProj = MathMat4X4Inverse(&viewProj);
-                    const Vec4D rtSize
-                        = { (float)game->framebufferSize.width,
-                            (float)game->framebufferSize.height,
-                            1.0f / game->framebufferSize.width,
-                            1.0f / game->framebufferSize.height };
-
-                    Material_SetUniform(m, "g_lightPos", sizeof(Vec3D),
-                                        &g_lightPos, UT_VEC3F);
-                    Material_SetUniform(m, "g_rtSize", sizeof(Vec4D), &rtSize,
-                                        UT_VEC4F);
-                    Material_SetUniform(m, "g_view", sizeof(Mat4X4),
-                                        &game->camera.view, UT_MAT4);
-                    Material_SetUniform(m, "g_proj", sizeof(Mat4X4),
-                                        &game->camera.proj, UT_MAT4);
-                    Material_SetUniform(m, "g_invViewProj", sizeof(Mat4X4),
-                                        &invViewProj, UT_MAT4);
-                    Material_SetUniform(m, "g_lightPos", sizeof(Vec3D),
-                                        &g_lightPos, UT_VEC3F);
-                    Material_SetUniform(m, "g_cameraPos", sizeof(Vec3D),
-                                        &eyePos, UT_VEC3F);
-                    GLCHECK(glBindVertexArray(unitCube->meshes[i].vao));
-                    for (u32 n = 0; n < ARRAY_COUNT(decalWorlds); ++n) {
-                        Material_SetUniform(m, "g_world", sizeof(Mat4X4),
-                                            &decalWorlds[n], UT_MAT4);
-                        Material_SetUniform(m, "g_decalInvWorld",
-                                            sizeof(Mat4X4), &decalInvWorlds[n],
-                                            UT_MAT4);
-                        const i32 texIdx = FindTextureIdxForMesh(
-                            game, textureMappings,
-                            ARRAY_COUNT(textureMappings),
-                            UtilsFormatStr("Decal%d", n));
-                        Material_SetTexture(m, "g_albedo",
-                                            &game->albedoTextures[texIdx]);
-                        Material_SetTexture(m, "g_normal",
-                                            &game->normalTextures[texIdx]);
-                        GLCHECK(glDrawElements(GL_TRIANGLES,
-                                               unitCube->meshes[i].numIndices,
-                                               GL_UNSIGNED_INT, NULL));
-                    }
+                Material_SetTexture(m, u[GU_DEPTH], &game->gbuffer.depthTex);
+                Material_SetTexture(m, u[GU_GBUFFER_NORMAL],
+                                    &game->gbuffer.normalCopyTex);
+                if (isInstanced) {
+                    GLState_UseProgram(Material_GetHandle(m));
+                    Material_SetTextureArray(m, u[GU_ALBEDO],
+                                             &game->decalAlbedoArray);
+                    Material_SetTextureArray(m, u[GU_NORMAL],
+                                             &game->decalNormalArray);
+                    DrawDecalInstances(game, numDecalInstances);
+                } else {
+                    RenderQueue_Execute(&game->framePackets, RP_DECAL,
+                                        game->uniformRing, NULL, NULL);
                 }
                 // Reset state
-                glDepthFunc(GL_LESS);
-                glDepthMask(GL_TRUE);
-                glCullFace(GL_BACK);
+                GLState_DepthFunc(GL_LESS);
+                GLState_DepthMask(1);
+                GLState_CullFace(GL_BACK);
+                submitSeconds += UtilsGetTimeInSeconds() - submitStart;
                 PopRenderPassAnnotation();
             }
+            GpuTimer_End(&game->decalTimer);
 
-            GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-            PopRenderPassAnnotation();
-        }
-
-        // Deferred Shading Pass
-        {
-            PushRenderPassAnnotation("Deferred Shading Pass");
-            struct Material *m = Game_FindMaterialByName(game, "Deferred");
-            GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-            GLCHECK(glUseProgram(Material_GetHandle(m)));
-            Material_SetTexture(m, "g_position", &game->gbuffer.positionTex);
-            Material_SetTexture(m, "g_normal", &game->gbuffer.normalTex);
-            Material_SetTexture(m, "g_albedo", &game->gbuffer.albedoTex);
-            Material_SetUniform(m, "g_lightPos", sizeof(Vec3D), &g_lightPos,
-                                UT_VEC3F);
-            Material_SetUniform(m, "g_cameraPos", sizeof(Vec3D), &eyePos,
-                                UT_VEC3F);
-            Material_SetUniform(m, "g_gbufferDebugMode", sizeof(i32),
-                                &game->gbufferDebugMode, UT_INT);
-            RenderQuad(&fsqPass);
+            GLState_BindFramebuffer(GL_FRAMEBUFFER, 0);
             PopRenderPassAnnotation();
         }
 
-        // Copy gbuffer depth to default framebuffer's depth
+        // Copy gbuffer depth to default framebuffer's depth, before shading
+        // because light volumes are depth tested against it
         {
             PushRenderPassAnnotation("Copy GBuffer Depth Pass");
-            glBindFramebuffer(GL_READ_FRAMEBUFFER, game->gbuffer.framebuffer);
+            GLState_BindFramebuffer(GL_READ_FRAMEBUFFER,
+                                    game->gbuffer.framebuffer);
             // write to default framebuffer
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            GLState_BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            // light volumes leave the stencil cleared
+            GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
             // blit to default framebuffer. Note that this may or may not work
             // as the internal formats of both the FBO and default framebuffer
             // have to match.
@@ -369,40 +734,86 @@ main(void)
                               game->framebufferSize.width,
                               game->framebufferSize.height,
                               GL_DEPTH_BUFFER_BIT, GL_NEAREST);
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState_BindFramebuffer(GL_FRAMEBUFFER, 0);
+            PopRenderPassAnnotation();
+        }
+
+        // Deferred Shading Pass
+        {
+            PushRenderPassAnnotation("Deferred Shading Pass");
+            GpuTimer_Begin(&game->shadingTimer);
+            const struct GameMaterial *gm
+                = &game->materials[isClustered ? GM_DEFERRED_CLUSTERED
+                                               : GM_DEFERRED];
+            struct Material *m = gm->material;
+            const i32 *u = gm->uniforms;
+            const boolean isLightVolumes = UsesLightVolumes(game);
+            const i32 isAmbientOnly = isLightVolumes;
+            GLState_Enable(GL_DEPTH_TEST, 0);
+            GLState_UseProgram(Material_GetHandle(m));
+            Material_SetUniform(m, u[GU_AMBIENT_ONLY], &isAmbientOnly);
+            Material_SetTexture(m, u[GU_POSITION], &game->gbuffer.positionTex);
+            Material_SetTexture(m, u[GU_NORMAL], &game->gbuffer.normalTex);
+            Material_SetTexture(m, u[GU_ALBEDO], &game->gbuffer.albedoTex);
+            Material_SetUniform(m, u[GU_GBUFFER_DEBUG_MODE],
+                                &game->gbufferDebugMode);
+            const struct ClusterGrid *lightGrid = &game->lightClusters;
+            const Vec4D gridParams = ClusterGrid_GetShaderParams(lightGrid);
+            Material_SetUniform(m, u[GU_CLUSTER_GRID], &gridParams);
+            Material_SetBufferTexture(m, u[GU_LIGHT_CLUSTERS],
+                                      &lightGrid->clusterTexture);
+            Material_SetBufferTexture(m, u[GU_LIGHT_ITEMS],
+                                      &lightGrid->indexTexture);
+            Material_SetBufferTexture(m, u[GU_LIGHTS], &game->lightData);
+            if (isClustered) {
+                // same dimensions as lightGrid, g_clusterGrid is shared
+                const struct ClusterGrid *grid = &game->decalClusters;
+                Material_SetBufferTexture(m, u[GU_CLUSTERS],
+                                          &grid->clusterTexture);
+                Material_SetBufferTexture(m, u[GU_CLUSTER_ITEMS],
+                                          &grid->indexTexture);
+                Material_SetBufferTexture(m, u[GU_DECALS], &game->decalData);
+                Material_SetTextureArray(m, u[GU_DECAL_ALBEDO],
+                                         &game->decalAlbedoArray);
+                Material_SetTextureArray(m, u[GU_DECAL_NORMAL],
+                                         &game->decalNormalArray);
+            }
+            RenderQuad(&fsqPass);
+            if (isLightVolumes) {
+                DrawLightVolumes(game, lightVisibility, numLights);
+            } else {
+                ZERO_MEMORY(&game->lightVolumeStats);
+            }
+            GLState_Enable(GL_DEPTH_TEST, 1);
+            GpuTimer_End(&game->shadingTimer);
             PopRenderPassAnnotation();
         }
 
         // Wireframe pass
         {
             PushRenderPassAnnotation("Wireframe Pass");
-            struct Material *m = Game_FindMaterialByName(game, "Phong");
-            glUseProgram(Material_GetHandle(m));
-            Material_SetUniform(m, "g_view", sizeof(Mat4X4),
-                                &game->camera.view, UT_MAT4);
-            Material_SetUniform(m, "g_proj", sizeof(Mat4X4),
-                                &game->camera.proj, UT_MAT4);
-            Material_SetUniform(m, "g_lightPos", sizeof(Vec3D), &g_lightPos,
-                                UT_VEC3F);
-            Material_SetUniform(m, "g_cameraPos", sizeof(Vec3D), &eyePos,
-                                UT_VEC3F);
+            const f64 submitStart = UtilsGetTimeInSeconds();
+            const boolean isPerDraw = game->decalMode == DM_PER_DRAW;
+            const enum GameMaterialId material
+                = isPerDraw ? GM_PHONG : GM_PHONG_INSTANCED;
+            const struct GameMaterial *gm = &game->materials[material];
+            struct Material *m = gm->material;
+            const i32 *u = gm->uniforms;
+            GLState_UseProgram(Material_GetHandle(m));
             static const i32 isWireframe = 1;
-            Material_SetUniform(m, "g_wireframe", sizeof(i32), &isWireframe,
-                                UT_INT);
+            Material_SetUniform(m, u[GU_WIREFRAME], &isWireframe);
 
             glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-            const struct ModelProxy *unitCube = game->models[1];
-            for (u32 i = 0; i < unitCube->numMeshes; ++i) {
-                glBindVertexArray(unitCube->meshes[i].vao);
-                for (u32 n = 0; n < ARRAY_COUNT(decalWorlds); ++n) {
-                    Material_SetUniform(m, "g_world", sizeof(Mat4X4),
-                                        &decalWorlds[n], UT_MAT4);
-                    glDrawElements(GL_TRIANGLES,
-                                   unitCube->meshes[i].numIndices,
-                                   GL_UNSIGNED_INT, NULL);
-                }
+            if (!isPerDraw) {
+                DrawDecalInstances(game, numDecalInstances);
+            } else {
+                RenderQueue_Execute(&game->framePackets, RP_WIREFRAME,
+                                    game->uniformRing, NULL, NULL);
             }
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            submitSeconds += UtilsGetTimeInSeconds() - submitStart;
+            timings->submit
+                = AverageMilliseconds(timings->submit, submitSeconds);
             PopRenderPassAnnotation();
         }
 
@@ -415,6 +826,173 @@ main(void)
                              | NK_WINDOW_SCALABLE | NK_WINDOW_MINIMIZABLE
                              | NK_WINDOW_TITLE)) {
                 nk_layout_row_dynamic(ctx, 30, 1);
+                for (u32 i = 0; i < game->numModels; ++i) {
+                    if (game->models[i]->stream) {
+                        nk_label(ctx,
+                                 UtilsFormatStr("Loading model %u: %u meshes",
+                                                i, game->models[i]->numMeshes),
+                                 NK_TEXT_ALIGN_LEFT);
+                    }
+                }
+                nk_property_float(ctx, "#LOD pixel error", 0.0f,
+                                  &game->lodPixelError, 64.0f, 0.5f, 0.1f);
+                const f64 lodPercent
+                    = game->numFullDetailTriangles
+                          ? 100.0 * game->numSubmittedTriangles
+                                / game->numFullDetailTriangles
+                          : 0.0;
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Triangles: %llu of %llu (%.1f%%)",
+                             (unsigned long long)game->numSubmittedTriangles,
+                             (unsigned long long)game->numFullDetailTriangles,
+                             lodPercent),
+                         NK_TEXT_ALIGN_LEFT);
+                struct GeometryBufferStats geometryStats;
+                GeometryBuffer_GetStats(game->geometry, &geometryStats);
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Geometry: VB %.2f of %.2f MB, IB %.2f of %.2f "
+                             "MB, %u ranges",
+                             geometryStats.vertexBytes / (1024.0 * 1024.0),
+                             geometryStats.vertexCapacity / (1024.0 * 1024.0),
+                             geometryStats.indexBytes / (1024.0 * 1024.0),
+                             geometryStats.indexCapacity / (1024.0 * 1024.0),
+                             geometryStats.numAllocations),
+                         NK_TEXT_ALIGN_LEFT);
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Fragmentation: VB %.1f%%, IB %.1f%%, %u free "
+                             "ranges",
+                             100.0f * geometryStats.vertexFragmentation,
+                             100.0f * geometryStats.indexFragmentation,
+                             geometryStats.numFreeRanges),
+                         NK_TEXT_ALIGN_LEFT);
+                if (nk_button_label(ctx, "Reload room")) {
+                    ModelProxy_Destroy(game->models[0]);
+                    game->models[0] = LoadRoom(game);
+                    game->numBoundRoomMeshes = 0;
+                    game->isScenePacketsDirty = 1;
+                }
+                const struct SceneCullStats *cullStats = &game->cullStats;
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Meshes: %u visible, %u culled",
+                             cullStats->numVisibleMeshes,
+                             cullStats->numMeshes
+                                 - cullStats->numVisibleMeshes),
+                         NK_TEXT_ALIGN_LEFT);
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Decals: %u visible, %u culled",
+                             cullStats->numVisibleDecals,
+                             cullStats->numDecals
+                                 - cullStats->numVisibleDecals),
+                         NK_TEXT_ALIGN_LEFT);
+                const i32 decalMode
+                    = nk_combo(ctx, DECAL_MODE_NAMES, DM_COUNT,
+                               game->decalMode, 25, nk_vec2(200, 200));
+                game->decalMode = (enum DecalMode)decalMode;
+                decalCountIdx
+                    = nk_combo(ctx, DECAL_COUNT_NAMES,
+                               ARRAY_COUNT(DECAL_COUNT_NAMES), decalCountIdx,
+                               25, nk_vec2(200, 200));
+                numDecals = DECAL_COUNTS[decalCountIdx];
+                lightCountIdx
+                    = nk_combo(ctx, LIGHT_COUNT_NAMES,
+                               ARRAY_COUNT(LIGHT_COUNT_NAMES), lightCountIdx,
+                               25, nk_vec2(200, 200));
+                numLights = LIGHT_COUNTS[lightCountIdx];
+                const i32 lightingMode
+                    = nk_combo(ctx, LIGHTING_MODE_NAMES, LM_COUNT,
+                               game->lightingMode, 25, nk_vec2(200, 200));
+                game->lightingMode = (enum LightingMode)lightingMode;
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Lights: %u visible, %u culled, %u cluster "
+                             "entries, culling %.3f ms",
+                             game->numVisibleLights,
+                             numLights - game->numVisibleLights,
+                             game->lightClusters.numIndices,
+                             game->lightCullTime),
+                         NK_TEXT_ALIGN_LEFT);
+                if (game->lightingMode == LM_LIGHT_VOLUMES
+                    && game->decalMode == DM_CLUSTERED) {
+                    nk_label(ctx,
+                             "Light volumes need raster decals, "
+                             "using clustered lighting",
+                             NK_TEXT_ALIGN_LEFT);
+                } else if (game->lightingMode == LM_LIGHT_VOLUMES) {
+                    const struct LightVolumeStats *volumeStats
+                        = &game->lightVolumeStats;
+                    const f64 screenPixels
+                        = (f64)game->framebufferSize.width
+                          * game->framebufferSize.height;
+                    nk_label(
+                        ctx,
+                        UtilsFormatStr(
+                            "Light volume pixels: %.2f screens, %.0f per "
+                            "light, max %u, %u lights hidden",
+                            volumeStats->numSamples / screenPixels,
+                            volumeStats->numLights
+                                ? (f64)volumeStats->numSamples
+                                      / volumeStats->numLights
+                                : 0.0,
+                            volumeStats->maxSamples, volumeStats->numEmpty),
+                        NK_TEXT_ALIGN_LEFT);
+                }
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "Decal timings: record %.3f ms, submit %.3f ms, "
+                             "GPU decals %.3f ms, shading %.3f ms, frame "
+                             "%.2f ms",
+                             timings->record, timings->submit,
+                             game->decalTimer.milliseconds,
+                             game->shadingTimer.milliseconds, timings->frame),
+                         NK_TEXT_ALIGN_LEFT);
+                struct GLStateStats glStats;
+                GLState_GetStats(&glStats);
+                u32 numIssued = 0;
+                u32 numFiltered = 0;
+                for (u32 i = 0; i < GSC_COUNT; ++i) {
+                    numIssued += glStats.numIssued[i];
+                    numFiltered += glStats.numFiltered[i];
+                }
+                nk_label(ctx,
+                         UtilsFormatStr(
+                             "GL state calls: %u issued, %u filtered, "
+                             "uniforms %u of %u",
+                             numIssued, numFiltered,
+                             glStats.numIssued[GSC_UNIFORM],
+                             glStats.numIssued[GSC_UNIFORM]
+                                 + glStats.numFiltered[GSC_UNIFORM]),
+                         NK_TEXT_ALIGN_LEFT);
+                nk_checkbox_label(ctx, "Meshlet culling",
+                                  &game->isMeshletCullingEnabled);
+                if (game->isMeshletCullingEnabled) {
+                    const struct MeshletCullStats *stats
+                        = &game->meshletStats;
+                    const u32 numCulled
+                        = stats->numFrustumCulled + stats->numBackfaceCulled;
+                    nk_label(ctx,
+                             UtilsFormatStr(
+                                 "Meshlets culled: %u of %u (%.1f%%), "
+                                 "frustum %u, backface %u",
+                                 numCulled, stats->numMeshlets,
+                                 stats->numMeshlets
+                                     ? 100.0 * numCulled / stats->numMeshlets
+                                     : 0.0,
+                                 stats->numFrustumCulled,
+                                 stats->numBackfaceCulled),
+                             NK_TEXT_ALIGN_LEFT);
+                    nk_label(ctx,
+                             UtilsFormatStr(
+                                 "Triangles saved: %llu of %llu",
+                                 (unsigned long long)
+                                     stats->numCulledTriangles,
+                                 (unsigned long long)stats->numTriangles),
+                             NK_TEXT_ALIGN_LEFT);
+                }
                 for (u32 i = 0; i < ARRAY_COUNT(decalTransforms); ++i) {
                     nk_label(ctx, UtilsFormatStr("Decal %u:", i),
                              NK_TEXT_ALIGN_LEFT);
@@ -431,13 +1009,13 @@ main(void)
                                       0.1f, 0.0f);
                     nk_label(ctx, "Rotation:", NK_TEXT_ALIGN_LEFT);
                     nk_property_float(ctx, "#Pitch", -89.0f,
-                                      &decalTransforms[i].rotation.X, 89.0f,
+                                      &decalAngles[i].X, 89.0f,
                                       1.0f, 0.0f);
                     nk_property_float(ctx, "#Yaw", -180.0f,
-                                      &decalTransforms[i].rotation.Y, 180.0f,
+                                      &decalAngles[i].Y, 180.0f,
                                       1.0f, 0.0f);
                     nk_property_float(ctx, "#Roll", -89.0f,
-                                      &decalTransforms[i].rotation.Z, 89.0f,
+                                      &decalAngles[i].Z, 89.0f,
                                       1.0f, 0.0f);
                     nk_label(ctx, "Scale:", NK_TEXT_ALIGN_LEFT);
                     nk_property_float(ctx, "#X", 1.0f,
@@ -451,6 +1029,8 @@ main(void)
                                       0.0f);
                 }
                 if (nk_button_label(ctx, "Apply Transform")) {
+                    UpdateDecalRotations(decalTransforms, decalAngles,
+                                         ARRAY_COUNT(decalTransforms));
                     UpdateDecalTransforms(decalWorlds, decalInvWorlds,
                                           decalTransforms,
                                           ARRAY_COUNT(decalTransforms));
@@ -461,13 +1041,17 @@ main(void)
 
             nk_glfw3_render(&game->nuklear, NK_ANTI_ALIASING_ON,
                             MAX_VERTEX_BUFFER, MAX_ELEMENT_BUFFER);
-            glDisable(GL_BLEND);
-            glEnable(GL_CULL_FACE);
-            glEnable(GL_DEPTH_TEST);
-            glDisable(GL_SCISSOR_TEST);
+            // nuklear changes state behind the cache's back
+            GLState_Invalidate();
+            GLState_Enable(GL_BLEND, 0);
+            GLState_Enable(GL_CULL_FACE, 1);
+            GLState_Enable(GL_DEPTH_TEST, 1);
+            GLState_Enable(GL_SCISSOR_TEST, 0);
             PopRenderPassAnnotation();
         }
 
+        UniformRing_EndFrame(game->uniformRing);
+
         /* Swap front and back buffers */
         glfwSwapBuffers(game->window);
 
@@ -476,6 +1060,33 @@ main(void)
     }
 
     DeinitNuklear(game->window);
+    GLCHECK(glDeleteBuffers(1, &game->meshletEbo));
+    for (u32 i = 0; i < game->numModels; ++i) {
+        ModelProxy_Destroy(game->models[i]);
+    }
+    GeometryBuffer_Destroy(game->geometry);
+    free(game->meshletIndices);
+    UtilsArenaDeinit(&game->frameArena);
+    UniformRing_Destroy(game->uniformRing);
+    RenderQueue_Deinit(&game->scenePackets);
+    RenderQueue_Deinit(&game->framePackets);
+    GpuTimer_Deinit(&game->decalTimer);
+    GpuTimer_Deinit(&game->shadingTimer);
+    ClusterGrid_Deinit(&game->decalClusters);
+    BufferTexture_Deinit(&game->decalData);
+    ClusterGrid_Deinit(&game->lightClusters);
+    BufferTexture_Deinit(&game->lightData);
+    LightList_Deinit(&game->lights);
+    GpuSampleCounters_Deinit(&game->lightSamples);
+    Texture2DArray_Deinit(&game->decalAlbedoArray);
+    Texture2DArray_Deinit(&game->decalNormalArray);
+    free(decalWorlds);
+    free(decalInvWorlds);
+    free(decalVisibility);
+    free(decalBindings);
+    UtilsStringTableDeinit(&game->names);
+    free(game->nameBindings);
+    UtilsThreadPoolDestroy(game->threadPool);
     glfwTerminate();
     return 0;
 }
@@ -516,9 +1127,8 @@ InitQuadPass(struct FullscreenQuadPass *fsqPass)
 void
 RenderQuad(const struct FullscreenQuadPass *fsqPass)
 {
-    GLCHECK(glBindVertexArray(fsqPass->vao));
+    GLState_BindVertexArray(fsqPass->vao);
     GLCHECK(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-    GLCHECK(glBindVertexArray(0));
 }
 
 i32
@@ -594,9 +1204,10 @@ InitGBuffer(struct GBuffer *gbuffer, const i32 fbWidth, const i32 fbHeight)
 
     GLCHECK(glGenRenderbuffers(1, &gbuffer->depthRenderBuffer));
     GLCHECK(glBindRenderbuffer(GL_RENDERBUFFER, gbuffer->depthRenderBuffer));
-    GLCHECK(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, fbWidth,
-                                  fbHeight));
-    GLCHECK(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+    GLCHECK(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
+                                  fbWidth, fbHeight));
+    GLCHECK(glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                                      GL_DEPTH_STENCIL_ATTACHMENT,
                                       GL_RENDERBUFFER,
                                       gbuffer->depthRenderBuffer));
 
@@ -643,57 +1254,16 @@ ProcessInput(GLFWwindow *window)
         game->camera.position
             = MathVec3DAddition(&game->camera.position, &game->camera.right);
     } else if (IsKeyPressed(window, GLFW_KEY_LEFT)) {
-        const Mat4X4 rotation = MathMat4X4RotateY(MathToRadians(1.0f));
-        Vec4D tmp = { game->camera.front.X, game->camera.front.Y,
-                      game->camera.front.Z, 0.0f };
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &rotation);
-        game->camera.front.X = tmp.X;
-        game->camera.front.Y = tmp.Y;
-        game->camera.front.Z = tmp.Z;
-        const Vec3D up = { .Y = 1.0f };
-        game->camera.right = MathVec3DCross(&up, &game->camera.front);
+        Camera_Rotate(&game->camera, MathToRadians(-1.0f), 0.0f);
     } else if (IsKeyPressed(window, GLFW_KEY_RIGHT)) {
-        const Mat4X4 rotation = MathMat4X4RotateY(MathToRadians(-1.0f));
-        Vec4D tmp = { game->camera.front.X, game->camera.front.Y,
-                      game->camera.front.Z, 0.0f };
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &rotation);
-        game->camera.front.X = tmp.X;
-        game->camera.front.Y = tmp.Y;
-        game->camera.front.Z = tmp.Z;
-        const Vec3D up = { .Y = 1.0f };
-        game->camera.right = MathVec3DCross(&up, &game->camera.front);
+        Camera_Rotate(&game->camera, MathToRadians(1.0f), 0.0f);
     }
     // TODO: Fix pitch, currently front follows circle, if W is pressed
     // continuously
     else if (IsKeyPressed(window, GLFW_KEY_UP)) {
-        const Mat4X4 rotation = MathMat4X4RotateX(MathToRadians(1.0f));
-        Vec4D tmp = { game->camera.front.X, game->camera.front.Y,
-                      game->camera.front.Z, 0.0f };
-        const Mat4X4 invView = MathMat4X4Inverse(&game->camera.view);
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &game->camera.view);
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &rotation);
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &invView);
-        game->camera.front.X = tmp.X;
-        game->camera.front.Y = tmp.Y;
-        game->camera.front.Z = tmp.Z;
-        const Vec3D up = { .Y = 1.0f };
-        game->camera.right = MathVec3DCross(&up, &game->camera.front);
+        Camera_Rotate(&game->camera, 0.0f, MathToRadians(-1.0f));
     } else if (IsKeyPressed(window, GLFW_KEY_DOWN)) {
-        const Mat4X4 invView = MathMat4X4Inverse(&game->camera.view);
-        const Mat4X4 rotation = MathMat4X4RotateX(MathToRadians(-1.0f));
-        Vec4D tmp = { game->camera.front.X, game->camera.front.Y,
-                      game->camera.front.Z, 0.0f };
-
-        // Move front vector from world space to camera
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &game->camera.view);
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &rotation);
-        tmp = MathMat4X4MultVec4DByMat4X4(&tmp, &invView);
-
-        game->camera.front.X = tmp.X;
-        game->camera.front.Y = tmp.Y;
-        game->camera.front.Z = tmp.Z;
-        const Vec3D up = { .Y = 1.0f };
-        game->camera.right = MathVec3DCross(&up, &game->camera.front);
+        Camera_Rotate(&game->camera, 0.0f, MathToRadians(1.0f));
     }
 }
 
@@ -702,24 +1272,58 @@ Camera_Init(struct Camera *camera, const Vec3D *position, f32 fov,
             f32 aspectRatio, f32 zNear, f32 zFar)
 {
     const Vec3D front = { -0.390251f, -0.463592f, -0.795480f };
-    const Vec3D up = { 0.0f, 1.0f, 0.0f };
-    const Vec3D right = MathVec3DCross(&up, &front);
+    // front of pitch and yaw is (cos(pitch) sin(yaw), -sin(pitch),
+    // cos(pitch) cos(yaw))
+    const Vec3D angles = { asinf(-front.Y), atan2f(front.X, front.Z), 0.0f };
     camera->position = *position;
-    camera->front = front;
-    camera->right = right;
+    camera->orientation = MathQuatFromEuler(&angles);
+    camera->fov = fov;
+    camera->zNear = zNear;
+    camera->zFar = zFar;
     camera->proj = MathMat4X4PerspectiveFov(fov, aspectRatio, zNear, zFar);
-    const Vec3D focusPos = MathVec3DAddition(&camera->position, &front);
-    camera->view = MathMat4X4ViewAt(&camera->position, &focusPos, &up);
+    Camera_UpdateView(camera);
 }
 
 void
-Game_Update(struct Game *game)
+Camera_Rotate(struct Camera *camera, f32 yaw, f32 pitch)
 {
-    const Vec3D focusPos
-        = MathVec3DAddition(&game->camera.position, &game->camera.front);
     const Vec3D up = { 0.0f, 1.0f, 0.0f };
-    game->camera.view
-        = MathMat4X4ViewAt(&game->camera.position, &focusPos, &up);
+    const Vec3D right = { 1.0f, 0.0f, 0.0f };
+    const Quat yawRotation = MathQuatFromAxisAngle(&up, yaw);
+    const Quat pitchRotation = MathQuatFromAxisAngle(&right, pitch);
+    // pitch in camera space, then world space yaw
+    Quat orientation
+        = MathQuatMultiply(&pitchRotation, &camera->orientation);
+    orientation = MathQuatMultiply(&orientation, &yawRotation);
+    MathQuatNormalize(&orientation);
+    camera->orientation = orientation;
+    Camera_UpdateView(camera);
+}
+
+void
+Camera_UpdateView(struct Camera *camera)
+{
+    // rows of the camera world matrix are right, up and front
+    Mat4X4 world = MathQuatToMat4X4(&camera->orientation);
+    camera->right = MathVec3DFromXYZ(world.A00, world.A01, world.A02);
+    camera->front = MathVec3DFromXYZ(world.A20, world.A21, world.A22);
+    world.A30 = camera->position.X;
+    world.A31 = camera->position.Y;
+    world.A32 = camera->position.Z;
+    camera->view = MathMat4X4InverseRigid(&world);
+}
+
+void
+Game_Update(struct Game *game)
+{
+    const struct UtilsArenaMarker frameStart = { 0 };
+    UtilsArenaPopToMarker(&game->frameArena, frameStart);
+    Camera_UpdateView(&game->camera);
+
+    for (u32 i = 0; i < game->numModels; ++i) {
+        ModelProxy_Update(game->models[i], MODEL_UPLOAD_BUDGET);
+    }
+    BindRoomMeshes(game);
 }
 
 void
@@ -738,12 +1342,8 @@ PopRenderPassAnnotation(void)
 Mat4X4
 TransformToMat4X4(const struct Transform *t)
 {
-    const Mat4X4 translation = MathMat4X4TranslateFromVec3D(&t->translation);
-    const Mat4X4 rotation = MathMat4X4RotateFromVec3D(&t->rotation);
-    const Mat4X4 scale = MathMat4X4ScaleFromVec3D(&t->scale);
-    Mat4X4 ret = MathMat4X4MultMat4X4ByMat4X4(&translation, &rotation);
-    ret = MathMat4X4MultMat4X4ByMat4X4(&ret, &scale);
-    return ret;
+    const Mat4X4 rotation = MathQuatToMat4X4(&t->rotation);
+    return MathMat4X4ComposeTRS(&t->translation, &rotation, &t->scale);
 }
 
 void
@@ -751,18 +1351,24 @@ UpdateDecalTransforms(Mat4X4 *decalWorlds, Mat4X4 *decalInvWorlds,
                       const struct Transform *decalTransforms, u32 numDecals)
 {
     for (u32 i = 0; i < numDecals; ++i) {
-        const Mat4X4 translation
-            = MathMat4X4TranslateFromVec3D(&decalTransforms[i].translation);
-        const Vec3D angles = { MathToRadians(decalTransforms[i].rotation.X),
-                               MathToRadians(decalTransforms[i].rotation.Y),
-                               MathToRadians(decalTransforms[i].rotation.Z) };
-        const Mat4X4 rotation = MathMat4X4RotateFromVec3D(&angles);
-        const Mat4X4 scale
-            = MathMat4X4ScaleFromVec3D(&decalTransforms[i].scale);
-        Mat4X4 world = MathMat4X4MultMat4X4ByMat4X4(&scale, &rotation);
-        world = MathMat4X4MultMat4X4ByMat4X4(&world, &translation);
-        decalWorlds[i] = world;
-        decalInvWorlds[i] = MathMat4X4Inverse(&decalWorlds[i]);
+        const struct Transform *t = &decalTransforms[i];
+        const Mat4X4 rotation = MathQuatToMat4X4(&t->rotation);
+        decalWorlds[i]
+            = MathMat4X4ComposeTRS(&t->translation, &rotation, &t->scale);
+        decalInvWorlds[i]
+            = MathMat4X4InverseTRS(&t->translation, &rotation, &t->scale);
+    }
+}
+
+void
+UpdateDecalRotations(struct Transform *decalTransforms,
+                     const Vec3D *decalAngles, u32 numDecals)
+{
+    for (u32 i = 0; i < numDecals; ++i) {
+        const Vec3D angles = { MathToRadians(decalAngles[i].X),
+                               MathToRadians(decalAngles[i].Y),
+                               MathToRadians(decalAngles[i].Z) };
+        decalTransforms[i].rotation = MathQuatFromEuler(&angles);
     }
 }
 
@@ -808,6 +1414,10 @@ InitGLFW(i32 width, i32 height, const i8 *title)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // light volumes need stencil, and the GBuffer depth is blitted here, so
+    // the formats must match GL_DEPTH24_STENCIL8 of the GBuffer
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8);
 
     /* Create a windowed mode window and its OpenGL context */
     GLFWwindow *window = glfwCreateWindow(width, height, title, NULL, NULL);
@@ -832,48 +1442,79 @@ InitGLFW(i32 width, i32 height, const i8 *title)
 void
 LoadMaterials(struct Game *game)
 {
-    const struct MaterialCreateInfo materialCreateInfos[]
-        = { { "shaders/vert.glsl", "shaders/frag.glsl", "Phong" },
-            { "shaders/vert.glsl",
-              "shaders/deferred_decal.glsl",
-              "Decal",
-              { "g_depth", "g_albedo", "g_normal", "g_gbufferNormal" },
-              4 },
-            { "shaders/vert.glsl",
-              "shaders/gbuffer_frag.glsl",
-              "GBuffer",
-              { "g_albedoTex", "g_normalTex", "g_roughnessTex" },
-              3 },
-            { "shaders/deferred_vert.glsl",
-              "shaders/deferred_frag.glsl",
-              "Deferred",
-              { "g_position", "g_normal", "g_albedo" },
-              3 } };
-
-    game->materials
-        = malloc(sizeof(struct Material *) * ARRAY_COUNT(materialCreateInfos));
-    game->numMaterials = ARRAY_COUNT(materialCreateInfos);
+    const struct MaterialCreateInfo materialCreateInfos[GM_COUNT] = {
+        [GM_PHONG] = { "shaders/vert.glsl", "shaders/frag.glsl", "Phong" },
+        [GM_DECAL]
+        = { "shaders/vert.glsl", "shaders/deferred_decal.glsl", "Decal" },
+        [GM_GBUFFER]
+        = { "shaders/vert.glsl", "shaders/gbuffer_frag.glsl", "GBuffer" },
+        [GM_DEFERRED] = { "shaders/deferred_vert.glsl",
+                          "shaders/deferred_frag.glsl", "Deferred" },
+        [GM_PHONG_INSTANCED] = { "shaders/vert.glsl", "shaders/frag.glsl",
+                                 "PhongInstanced", "#define INSTANCED\n" },
+        [GM_DECAL_INSTANCED]
+        = { "shaders/vert.glsl", "shaders/deferred_decal.glsl",
+            "DecalInstanced", "#define INSTANCED\n" },
+        [GM_DEFERRED_CLUSTERED]
+        = { "shaders/deferred_vert.glsl", "shaders/deferred_frag.glsl",
+            "DeferredClustered", "#define CLUSTERED_DECALS\n" },
+        [GM_LIGHT_VOLUME] = { "shaders/light_volume_vert.glsl",
+                              "shaders/light_volume_frag.glsl",
+                              "LightVolume" },
+        [GM_LIGHT_VOLUME_STENCIL]
+        = { "shaders/light_volume_vert.glsl",
+            "shaders/light_volume_frag.glsl", "LightVolumeStencil",
+            "#define STENCIL_PASS\n" }
+    };
+
+    game->materials = malloc(sizeof(struct GameMaterial) * GM_COUNT);
+    game->numMaterials = GM_COUNT;
 
     for (u32 i = 0; i < game->numMaterials; ++i) {
-        game->materials[i] = Material_Create(&materialCreateInfos[i]);
+        struct GameMaterial *gm = game->materials + i;
+        gm->material = Material_Create(&materialCreateInfos[i]);
+        for (u32 n = 0; n < GU_COUNT; ++n) {
+            gm->uniforms[n] = Material_GetUniformHandle(
+                gm->material, GAME_UNIFORM_NAMES[n]);
+        }
+        Game_BindName(game, materialCreateInfos[i].name)->material = (i32)i;
     }
 }
 
+struct ModelProxy *
+LoadRoom(struct Game *game)
+{
+    // room streams in while frames are rendered
+    const Mat4X4 rotate90 = MathMat4X4RotateY(MathToRadians(-90.0f));
+    const struct ModelProxyCreateInfo roomInfo
+        = { .path = "assets/room.obj",
+            .vertexFormat = VF_PACKED,
+            .geometry = game->geometry,
+            .world = &rotate90 };
+    return ModelProxy_CreateAsync(&roomInfo);
+}
+
 void
 LoadMeshes(struct Game *game)
 {
-    struct ModelProxy *room = ModelProxy_Create("assets/room.obj");
-    {
-        Mat4X4 rotate90 = MathMat4X4RotateY(MathToRadians(-90.0f));
-        for (u32 i = 0; i < room->numMeshes; ++i) {
-            room->meshes[i].world = rotate90;
-        }
-    }
-    struct ModelProxy *unitCube = ModelProxy_Create("assets/unit_cube.obj");
-    game->models = malloc(sizeof(struct ModelProxy *) * 2);
-    game->numModels = 2;
+    struct ModelProxy *room = LoadRoom(game);
+    const struct ModelProxyCreateInfo unitCubeInfo
+        = { .path = "assets/unit_cube.obj",
+            .vertexFormat = VF_PACKED,
+            .geometry = game->geometry,
+            .threadPool = game->threadPool };
+    struct ModelProxy *unitCube = ModelProxy_Create(&unitCubeInfo);
+    const struct ModelProxyCreateInfo lightSphereInfo
+        = { .path = "assets/light_sphere.obj",
+            .vertexFormat = VF_PACKED,
+            .geometry = game->geometry,
+            .threadPool = game->threadPool };
+    struct ModelProxy *lightSphere = ModelProxy_Create(&lightSphereInfo);
+    game->models = malloc(sizeof(struct ModelProxy *) * 3);
+    game->numModels = 3;
     game->models[0] = room;
     game->models[1] = unitCube;
+    game->models[2] = lightSphere;
 }
 
 void GLAPIENTRY
@@ -893,13 +1534,14 @@ MessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
     }
 }
 
-struct Material *
+// Passes use materials by GameMaterialId, this is for names known only at
+// runtime
+struct GameMaterial *
 Game_FindMaterialByName(struct Game *game, const i8 *name)
 {
-    for (u32 i = 0; i < game->numMaterials; ++i) {
-        if (strcmp(name, Material_GetName(game->materials[i])) == 0) {
-            return game->materials[i];
-        }
+    const struct NameBinding *binding = Game_FindNameBinding(game, name);
+    if (binding && binding->material >= 0) {
+        return game->materials + binding->material;
     }
     UtilsDebugPrint("WARN: Failed to find material with name %s", name);
     return NULL;
@@ -957,6 +1599,10 @@ LoadTextures(struct Game *game)
         Texture2D_Load(game->albedoTextures + i, albedoTexturePaths[i],
                        GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE);
     }
+    Texture2DArray_Init(&game->decalAlbedoArray, game->albedoTextures,
+                        game->numTextures, "DecalAlbedo");
+    Texture2DArray_Init(&game->decalNormalArray, game->normalTextures,
+                        game->numTextures, "DecalNormal");
 }
 
 struct Game *
@@ -970,6 +1616,25 @@ Game_Create(void)
                            &game->framebufferSize.height);
     glfwSetWindowUserPointer(window, game);
     glfwSetFramebufferSizeCallback(window, OnFramebufferResize);
+    game->threadPool = UtilsThreadPoolCreate(0);
+    game->geometry = GeometryBuffer_Create();
+    game->lodPixelError = DEFAULT_LOD_PIXEL_ERROR;
+    game->isMeshletCullingEnabled = nk_true;
+    GLCHECK(glGenBuffers(1, &game->meshletEbo));
+    UtilsArenaInit(&game->frameArena, 64 * 1024);
+    game->uniformRing = UniformRing_Create(UNIFORM_RING_FRAME_SIZE);
+    RenderQueue_Init(&game->scenePackets);
+    RenderQueue_Init(&game->framePackets);
+    game->isScenePacketsDirty = 1;
+    GpuTimer_Init(&game->decalTimer, "DecalPass");
+    GpuTimer_Init(&game->shadingTimer, "DeferredShadingPass");
+    ClusterGrid_Init(&game->decalClusters, "Decal");
+    BufferTexture_Init(&game->decalData, GL_RGBA32F, "DecalData");
+    LightList_Init(&game->lights, MAX_LIGHTS);
+    GpuSampleCounters_Init(&game->lightSamples, MAX_LIGHTS);
+    ClusterGrid_Init(&game->lightClusters, "Light");
+    BufferTexture_Init(&game->lightData, GL_RGBA32F, "LightData");
+    UtilsStringTableInit(&game->names);
 
     LoadMaterials(game);
     LoadMeshes(game);
@@ -978,24 +1643,838 @@ Game_Create(void)
     return game;
 }
 
-i32
-FindTextureIdxForMesh(const struct Game *game,
-                      const struct MeshTextureMapping *mappings,
-                      u32 numMappings, const i8 *meshName)
+// Returns binding of name, adds an empty one if the name is new
+struct NameBinding *
+Game_BindName(struct Game *game, const i8 *name)
+{
+    const u32 id = UtilsStringTableIntern(&game->names, name);
+    if (id >= game->numNameBindings) {
+        game->nameBindings = realloc(game->nameBindings,
+                                     sizeof *game->nameBindings * (id + 1));
+        for (u32 i = game->numNameBindings; i <= id; ++i) {
+            game->nameBindings[i].material = -1;
+            game->nameBindings[i].textureSet = -1;
+        }
+        game->numNameBindings = id + 1;
+    }
+    return game->nameBindings + id;
+}
+
+const struct NameBinding *
+Game_FindNameBinding(const struct Game *game, const i8 *name)
+{
+    const u32 id = UtilsStringTableFind(&game->names, name);
+    return id < game->numNameBindings ? game->nameBindings + id : NULL;
+}
+
+// Resolves the texture set of every mapping once and binds it to the mapped
+// mesh names
+void
+BindTextureMappings(struct Game *game,
+                    const struct MeshTextureMapping *mappings,
+                    u32 numMappings)
 {
     for (u32 i = 0; i < numMappings; ++i) {
-        for (u32 j = 0; j < mappings[i].numMeshNames; ++j) {
-            if (strcmp(mappings[i].meshNames[j], meshName) != 0) {
-                continue;
-            }
-            for (u32 k = 0; k < game->numTextures; ++k) {
-                if (strstr(game->albedoTextures[k].name,
-                           mappings[i].textureName)) {
-                    return (i32)k;
-                }
+        i32 textureSet = -1;
+        for (u32 k = 0; k < game->numTextures; ++k) {
+            if (strstr(game->albedoTextures[k].name,
+                       mappings[i].textureName)) {
+                textureSet = (i32)k;
+                break;
             }
         }
+        if (textureSet < 0) {
+            UtilsFatalError("ERROR: Failed to find textures %s",
+                            mappings[i].textureName);
+        }
+        for (u32 j = 0; j < mappings[i].numMeshNames; ++j) {
+            Game_BindName(game, mappings[i].meshNames[j])->textureSet
+                = textureSet;
+        }
+    }
+}
+
+i32
+FindTextureSet(const struct Game *game, const i8 *name)
+{
+    const struct NameBinding *binding = Game_FindNameBinding(game, name);
+    if (!binding || binding->textureSet < 0) {
+        UtilsFatalError("ERROR: Failed to find textures for mesh %s", name);
+        return -1;
+    }
+    return binding->textureSet;
+}
+
+// Gives room meshes that arrived since the last call their material and
+// textures, so drawing them needs no name lookups
+void
+BindRoomMeshes(struct Game *game)
+{
+    struct ModelProxy *room = game->models[0];
+    for (u32 i = game->numBoundRoomMeshes; i < room->numMeshes; ++i) {
+        struct MeshProxy *mesh = room->meshes + i;
+        const i32 textureSet = FindTextureSet(game, mesh->name);
+        mesh->material = GM_GBUFFER;
+        mesh->albedo = game->albedoTextures + textureSet;
+        mesh->normal = game->normalTextures + textureSet;
+        mesh->specular = game->roughnessTextures + textureSet;
+    }
+    game->numBoundRoomMeshes = room->numMeshes;
+}
+
+// Decal n uses the textures mapped to the name Decal<n>
+void
+BindDecals(const struct Game *game, struct DecalBinding *decals,
+           u32 numDecals)
+{
+    for (u32 i = 0; i < numDecals; ++i) {
+        const i32 textureSet
+            = FindTextureSet(game, UtilsFormatStr("Decal%u", i));
+        decals[i].albedo = game->albedoTextures + textureSet;
+        decals[i].normal = game->normalTextures + textureSet;
+        decals[i].textureLayer = (u32)textureSet;
+    }
+}
+
+// Places decals first to numDecals - 1 on the floor with random yaw, size
+// and textures. Seeded, so every run benchmarks the same decals.
+void
+ScatterDecals(const struct Game *game, Mat4X4 *decalWorlds,
+              Mat4X4 *decalInvWorlds, struct DecalBinding *decals, u32 first,
+              u32 numDecals)
+{
+    const u32 count = numDecals - first;
+    struct Transform *transforms = malloc(sizeof *transforms * count);
+    Vec3D *angles = malloc(sizeof *angles * count);
+    srand(first);
+    for (u32 i = 0; i < count; ++i) {
+        const f32 size = MathRandom(0.5f, 1.5f);
+        transforms[i].translation = MathVec3DFromXYZ(
+            MathRandom(-8.0f, 8.0f), 0.0f, MathRandom(-8.0f, 8.0f));
+        transforms[i].scale = MathVec3DFromXYZ(size, 1.0f, size);
+        angles[i] = MathVec3DFromXYZ(0.0f, MathRandom(-180.0f, 180.0f), 0.0f);
+        const u32 textureSet = (first + i) % game->numTextures;
+        decals[first + i].albedo = game->albedoTextures + textureSet;
+        decals[first + i].normal = game->normalTextures + textureSet;
+        decals[first + i].textureLayer = textureSet;
+    }
+    UpdateDecalRotations(transforms, angles, count);
+    UpdateDecalTransforms(decalWorlds + first, decalInvWorlds + first,
+                          transforms, count);
+    free(transforms);
+    free(angles);
+}
+
+// Writes the numVisibleDecals > 0 visible decals to the instance buffer,
+// returns their number
+u32
+WriteDecalInstances(struct Game *game, const Mat4X4 *decalWorlds,
+                    const Mat4X4 *decalInvWorlds,
+                    const struct DecalBinding *decals,
+                    const u8 *decalVisibility, u32 numDecals,
+                    u32 numVisibleDecals)
+{
+    struct DrawInstance *instances
+        = GeometryBuffer_MapInstances(game->geometry, numVisibleDecals);
+    u32 n = 0;
+    for (u32 i = 0; i < numDecals; ++i) {
+        if (!decalVisibility[i]) {
+            continue;
+        }
+        // mapped memory may be write combined, write whole instances
+        const struct DrawInstance instance
+            = { .world = decalWorlds[i],
+                .invWorld = decalInvWorlds[i],
+                .params = { (f32)decals[i].textureLayer, 0.0f, 0.0f, 0.0f } };
+        instances[n++] = instance;
+    }
+    GeometryBuffer_UnmapInstances(game->geometry);
+    assert(n == numVisibleDecals);
+    return n;
+}
+
+void
+LightList_Init(struct LightList *list, u32 capacity)
+{
+    ZERO_MEMORY(list);
+    // one allocation, the arrays follow each other
+    f32 *data = malloc(sizeof(f32) * 7 * capacity);
+    list->x = data;
+    list->y = data + capacity;
+    list->z = data + 2 * capacity;
+    list->radius = data + 3 * capacity;
+    list->red = data + 4 * capacity;
+    list->green = data + 5 * capacity;
+    list->blue = data + 6 * capacity;
+    list->capacity = capacity;
+}
+
+void
+LightList_Deinit(struct LightList *list)
+{
+    free(list->x);
+    ZERO_MEMORY(list);
+}
+
+void
+LightList_Add(struct LightList *list, const Vec3D *position, f32 radius,
+              const Vec3D *color)
+{
+    assert(list->numLights < list->capacity);
+    const u32 i = list->numLights++;
+    list->x[i] = position->X;
+    list->y[i] = position->Y;
+    list->z[i] = position->Z;
+    list->radius[i] = radius;
+    list->red[i] = color->X;
+    list->green[i] = color->Y;
+    list->blue[i] = color->Z;
+}
+
+// Fills the list up to numLights with small lights of random color in the
+// room. Seeded, so every run benchmarks the same lights.
+void
+ScatterLights(struct LightList *list, u32 numLights)
+{
+    srand(list->numLights);
+    while (list->numLights < numLights) {
+        const Vec3D position
+            = MathVec3DFromXYZ(MathRandom(-9.0f, 9.0f), MathRandom(0.5f, 8.0f),
+                               MathRandom(-9.0f, 9.0f));
+        const Vec3D color
+            = MathVec3DFromXYZ(MathRandom(0.5f, 4.0f), MathRandom(0.5f, 4.0f),
+                               MathRandom(0.5f, 4.0f));
+        LightList_Add(list, &position, MathRandom(1.0f, 3.0f), &color);
+    }
+}
+
+// Culls the first numLights lights and bins the visible ones into
+// lightClusters, uploads their data for the deferred shading pass. Returns
+// visibility of the lights, valid until the end of the frame.
+const u8 *
+CullLights(struct Game *game, u32 numLights)
+{
+    const struct Camera *camera = &game->camera;
+    const struct LightList *lights = &game->lights;
+    struct ClusterGrid *grid = &game->lightClusters;
+    struct UtilsArena *arena = &game->frameArena;
+    assert(numLights <= lights->numLights);
+    ClusterGrid_Begin(grid, game->framebufferSize.width,
+                      game->framebufferSize.height, camera->zNear,
+                      camera->zFar);
+    Vec4D *ndcRects = UtilsArenaAlloc(arena, sizeof *ndcRects * numLights);
+    Vec2D *depthRanges
+        = UtilsArenaAlloc(arena, sizeof *depthRanges * numLights);
+    u8 *visible = UtilsArenaAlloc(arena, numLights);
+    const u32 numVisible = MathProjectSpheres(
+        lights->x, lights->y, lights->z, lights->radius, &camera->view,
+        &camera->proj, camera->zNear, camera->zFar, ndcRects, depthRanges,
+        visible, numLights);
+    struct ClusterRange *ranges
+        = UtilsArenaAlloc(arena, sizeof *ranges * numVisible);
+    Vec4D *texels
+        = UtilsArenaAlloc(arena, sizeof *texels * LIGHT_TEXELS * numVisible);
+    u32 n = 0;
+    for (u32 i = 0; i < numLights; ++i) {
+        if (!visible[i]) {
+            continue;
+        }
+        ClusterGrid_GetRangeFromBounds(grid, ndcRects + i, depthRanges[i].X,
+                                       depthRanges[i].Y, ranges + n);
+        Vec4D *t = texels + n * LIGHT_TEXELS;
+        t[0] = MathVec4DFromXYZW(lights->x[i], lights->y[i], lights->z[i],
+                                 lights->radius[i]);
+        t[1] = MathVec4DFromXYZW(lights->red[i], lights->green[i],
+                                 lights->blue[i], 0.0f);
+        ++n;
+    }
+    assert(n == numVisible);
+    BufferTexture_Upload(&game->lightData, texels,
+                         sizeof *texels * LIGHT_TEXELS * n);
+    ClusterGrid_Build(grid, ranges, n);
+    game->numVisibleLights = n;
+    return visible;
+}
+
+// Draws the sphere of every visible light twice. The stencil pass counts
+// back faces behind the scene up and front faces behind it down, which
+// leaves pixels inside the volume nonzero. The light pass then shades
+// those, clearing the stencil for the next light. It draws back faces, so
+// volumes around the camera are shaded too.
+void
+DrawLightVolumes(struct Game *game, const u8 *lightVisibility, u32 numLights)
+{
+    const struct ModelProxy *lightSphere = game->models[2];
+    if (game->numVisibleLights == 0 || lightSphere->numMeshes == 0) {
+        ZERO_MEMORY(&game->lightVolumeStats);
+        return;
+    }
+    PushRenderPassAnnotation("Light Volumes");
+    const struct MeshProxy *mesh = lightSphere->meshes;
+    const struct LightList *lights = &game->lights;
+    struct UniformRing *ring = game->uniformRing;
+    const u32 stride
+        = UniformRing_GetStride(ring, sizeof(struct DrawConstants));
+    u32 offset = 0;
+    u8 *constants
+        = UniformRing_Map(ring, stride, game->numVisibleLights, &offset);
+    u32 n = 0;
+    for (u32 i = 0; i < numLights; ++i) {
+        if (!lightVisibility[i]) {
+            continue;
+        }
+        const Vec3D scale
+            = { lights->radius[i], lights->radius[i], lights->radius[i] };
+        const Vec3D position = { lights->x[i], lights->y[i], lights->z[i] };
+        const Mat4X4 scaleMat = MathMat4X4ScaleFromVec3D(&scale);
+        const Mat4X4 translateMat = MathMat4X4TranslateFromVec3D(&position);
+        const Mat4X4 world
+            = MathMat4X4MultMat4X4ByMat4X4(&scaleMat, &translateMat);
+        WriteDrawConstants((struct DrawConstants *)(constants + n * stride),
+                           mesh, &world, NULL);
+        ++n;
+    }
+    UniformRing_Unmap(ring);
+
+    const struct GameMaterial *stencil
+        = &game->materials[GM_LIGHT_VOLUME_STENCIL];
+    const struct GameMaterial *gm = &game->materials[GM_LIGHT_VOLUME];
+    struct Material *m = gm->material;
+    const i32 *u = gm->uniforms;
+    GLState_UseProgram(Material_GetHandle(m));
+    Material_SetTexture(m, u[GU_POSITION], &game->gbuffer.positionTex);
+    Material_SetTexture(m, u[GU_NORMAL], &game->gbuffer.normalTex);
+    Material_SetTexture(m, u[GU_ALBEDO], &game->gbuffer.albedoTex);
+    GLState_BindVertexArray(mesh->vao);
+    GLState_Enable(GL_STENCIL_TEST, 1);
+    GLState_DepthMask(0);
+    GLState_BlendFunc(GL_ONE, GL_ONE);
+    GpuSampleCounters_BeginFrame(&game->lightSamples);
+    UpdateLightVolumeStats(game);
+    n = 0;
+    for (u32 i = 0; i < numLights; ++i) {
+        if (!lightVisibility[i]) {
+            continue;
+        }
+        UniformRing_Bind(ring, UB_DRAW, offset + n * stride,
+                         sizeof(struct DrawConstants));
+
+        GLState_UseProgram(Material_GetHandle(stencil->material));
+        GLState_ColorMask(0);
+        GLState_Enable(GL_DEPTH_TEST, 1);
+        GLState_Enable(GL_CULL_FACE, 0);
+        GLState_Enable(GL_BLEND, 0);
+        glStencilFunc(GL_ALWAYS, 0, 0);
+        glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+        glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+        MeshProxy_DrawLod(mesh, 0);
+
+        GLState_UseProgram(Material_GetHandle(m));
+        GLState_ColorMask(1);
+        GLState_Enable(GL_DEPTH_TEST, 0);
+        GLState_Enable(GL_CULL_FACE, 1);
+        GLState_CullFace(GL_FRONT);
+        GLState_Enable(GL_BLEND, 1);
+        glStencilFunc(GL_NOTEQUAL, 0, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO);
+        const Vec4D light = { lights->x[i], lights->y[i], lights->z[i],
+                              lights->radius[i] };
+        const Vec3D color
+            = { lights->red[i], lights->green[i], lights->blue[i] };
+        Material_SetUniform(m, u[GU_LIGHT], &light);
+        Material_SetUniform(m, u[GU_LIGHT_COLOR], &color);
+        GpuSampleCounters_Begin(&game->lightSamples, n);
+        MeshProxy_DrawLod(mesh, 0);
+        GpuSampleCounters_End(&game->lightSamples);
+        ++n;
+    }
+    GpuSampleCounters_EndFrame(&game->lightSamples);
+    // Reset state
+    GLState_Enable(GL_STENCIL_TEST, 0);
+    GLState_Enable(GL_BLEND, 0);
+    GLState_CullFace(GL_BACK);
+    GLState_DepthMask(1);
+    PopRenderPassAnnotation();
+}
+
+// Clustered decals are applied while the deferred pass shades, but the
+// volumes shade straight from the GBuffer and would light the undecaled
+// surface, so that combination falls back to clustered lighting
+boolean
+UsesLightVolumes(const struct Game *game)
+{
+    return game->lightingMode == LM_LIGHT_VOLUMES
+           && game->decalMode != DM_CLUSTERED && game->gbufferDebugMode == 0;
+}
+
+// Sums the per light sample counts that were read this frame
+void
+UpdateLightVolumeStats(struct Game *game)
+{
+    const struct GpuSampleCounters *counters = &game->lightSamples;
+    struct LightVolumeStats *stats = &game->lightVolumeStats;
+    ZERO_MEMORY(stats);
+    stats->numLights = counters->numResults;
+    for (u32 i = 0; i < counters->numResults; ++i) {
+        const u32 samples = counters->samples[i];
+        stats->numSamples += samples;
+        stats->maxSamples
+            = samples > stats->maxSamples ? samples : stats->maxSamples;
+        stats->numEmpty += samples == 0;
+    }
+}
+
+// Bins boxes of visible decals into decalClusters and uploads their data
+// for the clustered deferred shading pass
+void
+BuildDecalClusters(struct Game *game, const Mat4X4 *decalWorlds,
+                   const Mat4X4 *decalInvWorlds,
+                   const struct DecalBinding *decals,
+                   const u8 *decalVisibility, u32 numDecals,
+                   u32 numVisibleDecals)
+{
+    const struct Camera *camera = &game->camera;
+    struct ClusterGrid *grid = &game->decalClusters;
+    ClusterGrid_Begin(grid, game->framebufferSize.width,
+                      game->framebufferSize.height, camera->zNear,
+                      camera->zFar);
+    struct ClusterRange *ranges = UtilsArenaAlloc(
+        &game->frameArena, sizeof *ranges * numVisibleDecals);
+    Vec4D *texels = UtilsArenaAlloc(
+        &game->frameArena, sizeof *texels * DECAL_TEXELS * numVisibleDecals);
+    // the projection volume of deferred_decal.glsl
+    const Vec3D localCorners[8]
+        = { { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f },
+            { -1.0f, 1.0f, -1.0f },  { 1.0f, 1.0f, -1.0f },
+            { -1.0f, -1.0f, 1.0f },  { 1.0f, -1.0f, 1.0f },
+            { -1.0f, 1.0f, 1.0f },   { 1.0f, 1.0f, 1.0f } };
+    u32 n = 0;
+    for (u32 i = 0; i < numDecals; ++i) {
+        if (!decalVisibility[i]) {
+            continue;
+        }
+        Vec3D corners[8];
+        MathMat4X4TransformPoints(localCorners, decalWorlds + i, corners, 8);
+        ClusterGrid_GetRange(grid, corners, 8, &camera->view, &camera->proj,
+                             ranges + n);
+        Vec4D *t = texels + n * DECAL_TEXELS;
+        const Mat4X4 *world = decalWorlds + i;
+        const Mat4X4 *invWorld = decalInvWorlds + i;
+        for (u32 row = 0; row < 4; ++row) {
+            const f32 *r = invWorld->A[row];
+            t[row] = MathVec4DFromXYZW(r[0], r[1], r[2], r[3]);
+        }
+        for (u32 row = 0; row < 3; ++row) {
+            t[4 + row] = MathVec4DFromXYZW(world->A[row][0], world->A[row][1],
+                                           world->A[row][2], 0.0f);
+        }
+        t[7] = MathVec4DFromXYZW((f32)decals[i].textureLayer, 0.0f, 0.0f,
+                                 0.0f);
+        ++n;
+    }
+    assert(n == numVisibleDecals);
+    BufferTexture_Upload(&game->decalData, texels,
+                         sizeof *texels * DECAL_TEXELS * n);
+    ClusterGrid_Build(grid, ranges, n);
+}
+
+// Draws the written decal instances as unit cubes with the program in use
+void
+DrawDecalInstances(struct Game *game, u32 numInstances)
+{
+    const struct ModelProxy *unitCube = game->models[1];
+    if (numInstances == 0 || unitCube->numMeshes == 0) {
+        return;
+    }
+    // instances replace world, the block still decodes positions
+    struct UniformRing *ring = game->uniformRing;
+    const u32 stride
+        = UniformRing_GetStride(ring, sizeof(struct DrawConstants));
+    u32 offset = 0;
+    u8 *constants = UniformRing_Map(ring, stride, unitCube->numMeshes,
+                                    &offset);
+    const Mat4X4 identity = MathMat4X4Identity();
+    for (u32 i = 0; i < unitCube->numMeshes; ++i) {
+        WriteDrawConstants((struct DrawConstants *)(constants + i * stride),
+                           unitCube->meshes + i, &identity, NULL);
+    }
+    UniformRing_Unmap(ring);
+    for (u32 i = 0; i < unitCube->numMeshes; ++i) {
+        UniformRing_Bind(ring, UB_DRAW, offset + i * stride,
+                         sizeof(struct DrawConstants));
+        MeshProxy_DrawLodInstanced(unitCube->meshes + i, 0, numInstances);
+    }
+}
+
+// Exponential moving average, keeps timings readable in the UI
+f64
+AverageMilliseconds(f64 average, f64 seconds)
+{
+    return average + 0.05 * (seconds * 1000.0 - average);
+}
+
+// Writes camera and light of the frame and binds them for all programs
+void
+UploadFrameConstants(struct Game *game, const Mat4X4 *viewProj,
+                     const Vec3D *cameraPos, const Vec3D *lightPos)
+{
+    struct UniformRing *ring = game->uniformRing;
+    const u32 stride
+        = UniformRing_GetStride(ring, sizeof(struct FrameConstants));
+    u32 offset = 0;
+    struct FrameConstants *frame = UniformRing_Map(ring, stride, 1, &offset);
+    const struct FrameConstants constants
+        = { .view = game->camera.view,
+            .proj = game->camera.proj,
+            .viewProj = *viewProj,
+            .invViewProj = MathMat4X4Inverse(viewProj),
+            .cameraPos = *cameraPos,
+            .lightPos = *lightPos,
+            .rtSize = { (f32)game->framebufferSize.width,
+                        (f32)game->framebufferSize.height,
+                        1.0f / game->framebufferSize.width,
+                        1.0f / game->framebufferSize.height } };
+    // mapped memory may be write combined, write it in one go
+    *frame = constants;
+    UniformRing_Unmap(ring);
+    UniformRing_Bind(ring, UB_FRAME, offset, sizeof(struct FrameConstants));
+}
+
+void
+WriteDrawConstants(struct DrawConstants *out, const struct MeshProxy *mesh,
+                   const Mat4X4 *world, const Mat4X4 *decalInvWorld)
+{
+    struct DrawConstants constants = { .world = *world,
+                                       .posScale = mesh->posScale,
+                                       .vertexFormat = mesh->vertexFormat,
+                                       .posBias = mesh->posBias };
+    if (decalInvWorld) {
+        constants.decalInvWorld = *decalInvWorld;
+    }
+    *out = constants;
+}
+
+void
+InitScenePacket(struct DrawPacket *packet, const struct Game *game,
+                enum RenderPass pass, enum GameMaterialId material,
+                const struct MeshProxy *mesh,
+                const struct Texture2D *textureSet, u32 userData)
+{
+    ZERO_MEMORY(packet);
+    // albedo handle stands for the whole texture set
+    const u32 textureSetId = textureSet ? textureSet->handle : 0;
+    packet->sortKey = RenderQueue_MakeSortKey(pass, material, textureSetId,
+                                              mesh->vao, 0.0f);
+    packet->material = game->materials[material].material;
+    packet->mesh = mesh;
+    packet->userData = userData;
+}
+
+void
+AddPacketTexture(struct DrawPacket *packet, i32 sampler,
+                 const struct Texture2D *texture)
+{
+    assert(packet->numTextures < DRAW_PACKET_MAX_TEXTURES);
+    packet->samplers[packet->numTextures] = sampler;
+    packet->textures[packet->numTextures++] = texture;
+}
+
+// Rebuilds scene packets when meshes were added, the room was reloaded or
+// the number of decals changed.
+// Meshes and decals are bound to their textures already.
+void
+UpdateScenePackets(struct Game *game, const struct DecalBinding *decals,
+                   u32 numDecals)
+{
+    const struct ModelProxy *room = game->models[0];
+    const struct ModelProxy *unitCube = game->models[1];
+    if (!game->isScenePacketsDirty
+        && room->numMeshes == game->numScenePacketRoomMeshes
+        && unitCube->numMeshes == game->numScenePacketCubeMeshes
+        && numDecals == game->numScenePacketDecals) {
+        return;
+    }
+    game->isScenePacketsDirty = 0;
+    game->numScenePacketRoomMeshes = room->numMeshes;
+    game->numScenePacketCubeMeshes = unitCube->numMeshes;
+    game->numScenePacketDecals = numDecals;
+
+    struct RenderQueue *q = &game->scenePackets;
+    // decals are drawn by the decal and the wireframe pass
+    RenderQueue_Reset(q,
+                      room->numMeshes + unitCube->numMeshes * numDecals * 2);
+    for (u32 i = 0; i < room->numMeshes; ++i) {
+        const struct MeshProxy *mesh = room->meshes + i;
+        const i32 *u = game->materials[mesh->material].uniforms;
+        struct DrawPacket *packet = RenderQueue_Push(q, 1);
+        InitScenePacket(packet, game, RP_GBUFFER, mesh->material, mesh,
+                        mesh->albedo, i);
+        AddPacketTexture(packet, u[GU_ALBEDO_TEX], mesh->albedo);
+        AddPacketTexture(packet, u[GU_NORMAL_TEX], mesh->normal);
+        AddPacketTexture(packet, u[GU_ROUGHNESS_TEX], mesh->specular);
+    }
+    const i32 *u = game->materials[GM_DECAL].uniforms;
+    for (u32 i = 0; i < unitCube->numMeshes; ++i) {
+        const struct MeshProxy *mesh = unitCube->meshes + i;
+        for (u32 n = 0; n < numDecals; ++n) {
+            struct DrawPacket *packet = RenderQueue_Push(q, 1);
+            InitScenePacket(packet, game, RP_DECAL, GM_DECAL, mesh,
+                            decals[n].albedo, n);
+            AddPacketTexture(packet, u[GU_ALBEDO], decals[n].albedo);
+            AddPacketTexture(packet, u[GU_NORMAL], decals[n].normal);
+            packet = RenderQueue_Push(q, 1);
+            InitScenePacket(packet, game, RP_WIREFRAME, GM_PHONG, mesh, NULL,
+                            n);
+        }
+    }
+}
+
+#define RECORD_CHUNK_SIZE 64
+
+struct RecordPacketsJob {
+    struct Game *game;
+    const u8 *meshVisibility;
+    const u8 *decalVisibility;
+    const Mat4X4 *decalWorlds;
+    const Mat4X4 *decalInvWorlds;
+    f32 pixelsPerUnit;
+    // mapped DrawConstants, one per frame packet in recording order
+    u8 *drawConstants;
+    u32 firstDrawOffset;
+    u32 drawStride;
+};
+
+i32
+IsScenePacketVisible(const struct RecordPacketsJob *job,
+                     const struct DrawPacket *packet)
+{
+    const u64 pass = packet->sortKey >> (64 - SORT_KEY_PASS_BITS);
+    return pass == RP_GBUFFER ? job->meshVisibility[packet->userData]
+                              : job->decalVisibility[packet->userData];
+}
+
+// Copies visible scene packets of one chunk to the frame queue and fills
+// their per frame data. Chunks run on pool threads.
+void
+RecordPacketsChunk(void *arg, u32 chunk, u32 threadIndex)
+{
+    (void)threadIndex;
+    const struct RecordPacketsJob *job = arg;
+    struct Game *game = job->game;
+    const struct RenderQueue *scene = &game->scenePackets;
+    const u32 begin = chunk * RECORD_CHUNK_SIZE;
+    const u32 end = begin + RECORD_CHUNK_SIZE < scene->numPackets
+                        ? begin + RECORD_CHUNK_SIZE
+                        : scene->numPackets;
+    u32 numVisible = 0;
+    for (u32 i = begin; i < end; ++i) {
+        numVisible += IsScenePacketVisible(job, scene->packets + i);
+    }
+    if (numVisible == 0) {
+        return;
+    }
+    struct DrawPacket *out = RenderQueue_Push(&game->framePackets, numVisible);
+    const Vec3D *eye = &game->camera.position;
+    for (u32 i = begin; i < end; ++i) {
+        const struct DrawPacket *packet = scene->packets + i;
+        if (!IsScenePacketVisible(job, packet)) {
+            continue;
+        }
+        *out = *packet;
+        const u32 slot = (u32)(out - game->framePackets.packets);
+        struct DrawConstants *constants
+            = (struct DrawConstants *)(job->drawConstants
+                                       + slot * job->drawStride);
+        out->drawOffset = job->firstDrawOffset + slot * job->drawStride;
+        Vec3D center;
+        if (packet->sortKey >> (64 - SORT_KEY_PASS_BITS) == RP_GBUFFER) {
+            Vec4D sphere;
+            Obb box;
+            MeshProxy_GetWorldBounds(packet->mesh, &sphere, &box);
+            center = MathVec3DFromXYZ(sphere.X, sphere.Y, sphere.Z);
+            out->lod = MeshProxy_SelectLod(packet->mesh, eye,
+                                           job->pixelsPerUnit,
+                                           game->lodPixelError);
+            WriteDrawConstants(constants, packet->mesh, &packet->mesh->world,
+                               NULL);
+        } else {
+            const Mat4X4 *world = job->decalWorlds + packet->userData;
+            center = MathVec3DFromXYZ(world->A30, world->A31, world->A32);
+            WriteDrawConstants(constants, packet->mesh, world,
+                               job->decalInvWorlds + packet->userData);
+        }
+        const Vec3D toCenter = MathVec3DSubtraction(&center, eye);
+        const f32 depth
+            = sqrtf(MathVec3DDot(&toCenter, &toCenter)) / game->camera.zFar;
+        out->sortKey |= RenderQueue_MakeSortKey(0, 0, 0, 0, depth);
+        ++out;
+    }
+}
+
+// Records visible scene packets with LOD, depth and DrawConstants into
+// framePackets. Large scenes are recorded on the thread pool.
+void
+RecordFramePackets(struct Game *game, const u8 *meshVisibility,
+                   const u8 *decalVisibility, const Mat4X4 *decalWorlds,
+                   const Mat4X4 *decalInvWorlds)
+{
+    const struct RenderQueue *scene = &game->scenePackets;
+    struct RecordPacketsJob job
+        = { .game = game,
+            .meshVisibility = meshVisibility,
+            .decalVisibility = decalVisibility,
+            .decalWorlds = decalWorlds,
+            .decalInvWorlds = decalInvWorlds,
+            .pixelsPerUnit = game->framebufferSize.height
+                             / (2.0f * tanf(game->camera.fov * 0.5f)) };
+    u32 numVisible = 0;
+    for (u32 i = 0; i < scene->numPackets; ++i) {
+        numVisible += IsScenePacketVisible(&job, scene->packets + i);
+    }
+    RenderQueue_Reset(&game->framePackets, numVisible);
+    if (numVisible == 0) {
+        return;
+    }
+    job.drawStride = UniformRing_GetStride(game->uniformRing,
+                                           sizeof(struct DrawConstants));
+    job.drawConstants = UniformRing_Map(game->uniformRing, job.drawStride,
+                                        numVisible, &job.firstDrawOffset);
+    const u32 numChunks
+        = (scene->numPackets + RECORD_CHUNK_SIZE - 1) / RECORD_CHUNK_SIZE;
+    UtilsParallelFor(numChunks > 1 ? game->threadPool : NULL, numChunks,
+                     RecordPacketsChunk, &job);
+    UniformRing_Unmap(game->uniformRing);
+}
+
+// Draws room meshes, LOD 0 goes through meshlet culling if enabled
+void
+DrawGeometryPacket(const struct DrawPacket *packet, void *userData)
+{
+    struct GeometryPassContext *context = userData;
+    struct Game *game = context->game;
+    if (packet->lod == 0 && game->isMeshletCullingEnabled) {
+        game->numSubmittedTriangles
+            += DrawMeshletsCulled(game, packet->mesh, context->frustum);
+    } else {
+        MeshProxy_DrawLod(packet->mesh, packet->lod);
+        game->numSubmittedTriangles
+            += packet->mesh->lods[packet->lod].numIndices / 3;
+    }
+}
+
+void
+BeginMeshletCulling(struct Game *game, const struct ModelProxy *model)
+{
+    ZERO_MEMORY(&game->meshletStats);
+    game->meshletEboOffset = 0;
+    if (!game->isMeshletCullingEnabled) {
+        return;
+    }
+    // room for all LOD 0 indices of model, meshes are aligned to u32
+    u64 size = 0;
+    u64 maxMeshSize = 0;
+    for (u32 i = 0; i < model->numMeshes; ++i) {
+        const struct MeshProxy *mesh = model->meshes + i;
+        const u64 meshSize
+            = (u64)MeshProxy_GetIndexSize(mesh) * mesh->lods[0].numIndices;
+        size += (meshSize + 3) & ~(u64)3;
+        maxMeshSize = meshSize > maxMeshSize ? meshSize : maxMeshSize;
+    }
+    if (maxMeshSize > game->meshletIndicesSize) {
+        free(game->meshletIndices);
+        game->meshletIndices = malloc(maxMeshSize);
+        game->meshletIndicesSize = maxMeshSize;
+    }
+    // orphan last frame's storage, GL_COPY_WRITE_BUFFER leaves element
+    // array binding of bound vertex array alone
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, game->meshletEbo));
+    GLCHECK(glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+}
+
+// Returns one visibility flag per mesh of model, valid until the next
+// frame. Meshes are tested by bounding sphere first, survivors by their box,
+// which is tighter for flat meshes like walls.
+const u8 *
+CullMeshes(struct Game *game, const struct ModelProxy *model,
+           const Frustum *frustum)
+{
+    struct UtilsArena *arena = &game->frameArena;
+    const u32 numMeshes = model->numMeshes;
+    u8 *visible = UtilsArenaAlloc(arena, numMeshes);
+    Vec4D *spheres = UtilsArenaAlloc(arena, sizeof(Vec4D) * numMeshes);
+    Obb *boxes = UtilsArenaAlloc(arena, sizeof(Obb) * numMeshes);
+    u32 *candidates = UtilsArenaAlloc(arena, sizeof(u32) * numMeshes);
+    for (u32 i = 0; i < numMeshes; ++i) {
+        MeshProxy_GetWorldBounds(model->meshes + i, spheres + i, boxes + i);
+    }
+    MathFrustumCullSpheres(frustum, spheres, visible, numMeshes);
+    u32 numCandidates = 0;
+    for (u32 i = 0; i < numMeshes; ++i) {
+        if (visible[i]) {
+            boxes[numCandidates] = boxes[i];
+            candidates[numCandidates++] = i;
+        }
+    }
+    u8 *boxVisible = UtilsArenaAlloc(arena, numCandidates);
+    game->cullStats.numMeshes = numMeshes;
+    game->cullStats.numVisibleMeshes
+        = MathFrustumCullObbs(frustum, boxes, boxVisible, numCandidates);
+    for (u32 i = 0; i < numCandidates; ++i) {
+        visible[candidates[i]] = boxVisible[i];
+    }
+    return visible;
+}
+
+// Tests boxes of unitCube placed by decalWorlds, returns number of visible
+// decals
+u32
+CullDecals(struct Game *game, const struct ModelProxy *unitCube,
+           const Mat4X4 *decalWorlds, u32 numDecals, const Frustum *frustum,
+           u8 *visible)
+{
+    u32 numVisible = 0;
+    if (unitCube->numMeshes > 0) {
+        const struct MeshProxy *cube = unitCube->meshes;
+        Obb *boxes
+            = UtilsArenaAlloc(&game->frameArena, sizeof(Obb) * numDecals);
+        for (u32 i = 0; i < numDecals; ++i) {
+            boxes[i] = MathObbFromAabb(&cube->boundsMin, &cube->boundsMax,
+                                       decalWorlds + i);
+        }
+        numVisible = MathFrustumCullObbs(frustum, boxes, visible, numDecals);
+    } else {
+        memset(visible, 0, numDecals);
+    }
+    game->cullStats.numDecals = numDecals;
+    game->cullStats.numVisibleDecals = numVisible;
+    return numVisible;
+}
+
+// Draws visible meshlets of LOD 0, vertex array of mesh must be bound.
+// Returns number of triangles drawn.
+u32
+DrawMeshletsCulled(struct Game *game, const struct MeshProxy *mesh,
+                   const Frustum *frustum)
+{
+    const u32 numIndices
+        = MeshProxy_CullMeshlets(mesh, frustum, &game->camera.position,
+                                 game->meshletIndices, &game->meshletStats);
+    if (numIndices == 0) {
+        return 0;
     }
-    UtilsFatalError("ERROR: Failed to find textures for mesh %s", meshName);
-    return -1;
+    const u64 size = (u64)MeshProxy_GetIndexSize(mesh) * numIndices;
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, game->meshletEbo));
+    GLCHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, game->meshletEboOffset,
+                            size, game->meshletIndices));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, game->meshletEbo));
+    GLCHECK(glDrawElementsBaseVertex(GL_TRIANGLES, numIndices,
+                                     mesh->indexType,
+                                     (void *)game->meshletEboOffset,
+                                     mesh->baseVertex));
+    // element array binding belongs to vertex array, restore it
+    GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->geometry->ebo));
+    game->meshletEboOffset += (size + 3) & ~(u64)3;
+    return numIndices / 3;
 }
@@ -0,0 +1,317 @@
+#include "meshcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESH_CACHE_MAGIC 0x434d4444 // "DDMC"
+#define MESH_CACHE_VERSION 5
+#define MESH_CACHE_ALIGNMENT 16
+
+// Layout of the file:
+// MeshCacheHeader
+// MeshCacheEntry[numMeshes]
+// per mesh: name, vertices, indices, meshlets; each section is aligned to
+// MESH_CACHE_ALIGNMENT and referenced by offsets from the file start
+struct MeshCacheHeader {
+    u32 magic;
+    u32 version;
+    u32 vertexSize;
+    u32 numMeshes;
+    u64 fileSize;
+    u64 sourceSize;
+    i64 sourceMtime;
+    u64 sourceHash;
+};
+
+struct MeshCacheEntry {
+    u64 nameOffset;
+    u64 verticesOffset;
+    u64 indicesOffset;
+    u64 meshletsOffset;
+    u32 numVertices;
+    u32 numIndices;
+    Vec3D boundsMin;
+    Vec3D boundsMax;
+    struct MeshLod lods[MESH_MAX_LODS];
+    u32 numLods;
+    u32 numMeshlets;
+};
+
+static u64
+AlignUp(u64 offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(u64)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static i32
+AreLodsValid(const struct MeshCacheEntry *e)
+{
+    if (e->numLods == 0 || e->numLods > MESH_MAX_LODS) {
+        return 0;
+    }
+    for (u32 i = 0; i < e->numLods; ++i) {
+        const struct MeshLod *lod = e->lods + i;
+        if ((u64)lod->firstIndex + lod->numIndices > e->numIndices) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Meshlets must lie within LOD 0
+static i32
+AreMeshletsValid(const struct MeshCacheEntry *e, const u8 *fileData)
+{
+    const struct Meshlet *meshlets
+        = (const struct Meshlet *)(fileData + e->meshletsOffset);
+    for (u32 i = 0; i < e->numMeshlets; ++i) {
+        if ((u64)meshlets[i].firstIndex + meshlets[i].numIndices
+            > e->lods[0].numIndices) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static i32
+StatSource(const i8 *sourcePath, u64 *size, i64 *mtime)
+{
+    struct stat sb;
+    if (stat(sourcePath, &sb) == -1) {
+        return 0;
+    }
+    *size = sb.st_size;
+    *mtime = sb.st_mtime;
+    return 1;
+}
+
+static i32
+HashSource(const i8 *sourcePath, u64 *hash)
+{
+    struct UtilsMappedFile file = { 0 };
+    if (!UtilsMapFile(sourcePath, &file)) {
+        return 0;
+    }
+    *hash = UtilsHash64(file.data, file.size);
+    UtilsUnmapFile(&file);
+    return 1;
+}
+
+static i32
+IsRangeValid(u64 offset, u64 size, u64 fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+// Source was touched without changing contents. Store new mtime, so that
+// next launch does not have to hash the source again.
+static void
+UpdateSourceMtime(const i8 *cachePath, i64 sourceMtime)
+{
+    FILE *f = fopen(cachePath, "r+b");
+    if (!f) {
+        return;
+    }
+    fseek(f, offsetof(struct MeshCacheHeader, sourceMtime), SEEK_SET);
+    fwrite(&sourceMtime, sizeof(sourceMtime), 1, f);
+    fclose(f);
+}
+
+static i32
+IsUpToDate(const struct MeshCacheHeader *header, const i8 *cachePath,
+           const i8 *sourcePath)
+{
+    u64 sourceSize = 0;
+    i64 sourceMtime = 0;
+    if (!StatSource(sourcePath, &sourceSize, &sourceMtime)) {
+        // only cache was shipped
+        return 1;
+    }
+    if (sourceSize != header->sourceSize) {
+        return 0;
+    }
+    if (sourceMtime == header->sourceMtime) {
+        return 1;
+    }
+    u64 sourceHash = 0;
+    if (!HashSource(sourcePath, &sourceHash)
+        || sourceHash != header->sourceHash) {
+        return 0;
+    }
+    UpdateSourceMtime(cachePath, sourceMtime);
+    return 1;
+}
+
+i32
+MeshCache_Load(const i8 *cachePath, const i8 *sourcePath,
+               struct ModelData *out)
+{
+    ZERO_MEMORY(out);
+    struct UtilsMappedFile file = { 0 };
+    if (!UtilsMapFile(cachePath, &file)) {
+        return 0;
+    }
+
+    const struct MeshCacheHeader *header = (const void *)file.data;
+    if (file.size < sizeof(*header) || header->magic != MESH_CACHE_MAGIC
+        || header->version != MESH_CACHE_VERSION
+        || header->vertexSize != sizeof(struct Vertex)
+        || header->fileSize != file.size
+        || !IsRangeValid(sizeof(*header),
+                         sizeof(struct MeshCacheEntry)
+                             * (u64)header->numMeshes,
+                         file.size)) {
+        UtilsDebugPrint("MeshCache: %s is invalid or outdated", cachePath);
+        UtilsUnmapFile(&file);
+        return 0;
+    }
+    if (!IsUpToDate(header, cachePath, sourcePath)) {
+        UtilsDebugPrint("MeshCache: %s is stale", cachePath);
+        UtilsUnmapFile(&file);
+        return 0;
+    }
+
+    const struct MeshCacheEntry *entries
+        = (const void *)(file.data + sizeof(*header));
+    out->numMeshes = header->numMeshes;
+    out->meshes = malloc(sizeof(struct MeshData) * out->numMeshes);
+    for (u32 i = 0; i < out->numMeshes; ++i) {
+        const struct MeshCacheEntry *e = entries + i;
+        if (!IsRangeValid(e->nameOffset, 1, file.size)
+            || !IsRangeValid(e->verticesOffset,
+                             sizeof(struct Vertex) * (u64)e->numVertices,
+                             file.size)
+            || !IsRangeValid(e->indicesOffset, sizeof(u32) * (u64)e->numIndices,
+                             file.size)
+            || !IsRangeValid(e->meshletsOffset,
+                             sizeof(struct Meshlet) * (u64)e->numMeshlets,
+                             file.size)
+            || memchr(file.data + e->nameOffset, 0,
+                      file.size - e->nameOffset)
+                   == NULL
+            || !AreLodsValid(e) || !AreMeshletsValid(e, file.data)) {
+            UtilsDebugPrint("MeshCache: %s is corrupted", cachePath);
+            free(out->meshes);
+            ZERO_MEMORY(out);
+            UtilsUnmapFile(&file);
+            return 0;
+        }
+        struct MeshData *mesh = out->meshes + i;
+        mesh->name = (i8 *)(file.data + e->nameOffset);
+        mesh->vertices = (struct Vertex *)(file.data + e->verticesOffset);
+        mesh->numVertices = e->numVertices;
+        mesh->indices = (u32 *)(file.data + e->indicesOffset);
+        mesh->numIndices = e->numIndices;
+        mesh->boundsMin = e->boundsMin;
+        mesh->boundsMax = e->boundsMax;
+        memcpy(mesh->lods, e->lods, sizeof(mesh->lods));
+        mesh->numLods = e->numLods;
+        mesh->meshlets = (struct Meshlet *)(file.data + e->meshletsOffset);
+        mesh->numMeshlets = e->numMeshlets;
+    }
+    out->cacheMapping = file;
+    return 1;
+}
+
+static void
+WriteAt(FILE *f, u64 *offset, u64 target, const void *data, u64 size)
+{
+    static const u8 zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+    assert(target >= *offset && target - *offset <= sizeof(zeros));
+    fwrite(zeros, 1, target - *offset, f);
+    fwrite(data, 1, size, f);
+    *offset = target + size;
+}
+
+i32
+MeshCache_Save(const i8 *cachePath, const i8 *sourcePath,
+               const struct ModelData *m)
+{
+    struct MeshCacheHeader header = { 0 };
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(struct Vertex);
+    header.numMeshes = m->numMeshes;
+    if (!StatSource(sourcePath, &header.sourceSize, &header.sourceMtime)
+        || !HashSource(sourcePath, &header.sourceHash)) {
+        return 0;
+    }
+
+    struct MeshCacheEntry *entries
+        = malloc(sizeof(struct MeshCacheEntry) * m->numMeshes);
+    ZERO_MEMORY_SZ(entries, sizeof(struct MeshCacheEntry) * m->numMeshes);
+    u64 offset
+        = sizeof(header) + sizeof(struct MeshCacheEntry) * m->numMeshes;
+    for (u32 i = 0; i < m->numMeshes; ++i) {
+        const struct MeshData *mesh = m->meshes + i;
+        struct MeshCacheEntry *e = entries + i;
+        e->nameOffset = AlignUp(offset);
+        offset = e->nameOffset + strlen(mesh->name) + 1;
+        e->verticesOffset = AlignUp(offset);
+        offset = e->verticesOffset
+                 + sizeof(struct Vertex) * (u64)mesh->numVertices;
+        e->indicesOffset = AlignUp(offset);
+        offset = e->indicesOffset + sizeof(u32) * (u64)mesh->numIndices;
+        e->meshletsOffset = AlignUp(offset);
+        offset = e->meshletsOffset
+                 + sizeof(struct Meshlet) * (u64)mesh->numMeshlets;
+        e->numVertices = mesh->numVertices;
+        e->numIndices = mesh->numIndices;
+        e->boundsMin = mesh->boundsMin;
+        e->boundsMax = mesh->boundsMax;
+        memcpy(e->lods, mesh->lods, sizeof(e->lods));
+        e->numLods = mesh->numLods;
+        e->numMeshlets = mesh->numMeshlets;
+    }
+    header.fileSize = offset;
+
+    // write to temporary file first, so that interrupted write never leaves
+    // truncated cache behind
+    i8 tmpPath[1024];
+    const i32 tmpLen
+        = snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", cachePath);
+    // cut path would name another file, which rename then replaces
+    if (tmpLen < 0 || (u32)tmpLen >= sizeof(tmpPath)) {
+        UtilsDebugPrint("MeshCache: Path too long %s", cachePath);
+        free(entries);
+        return 0;
+    }
+    FILE *f = fopen(tmpPath, "wb");
+    if (!f) {
+        UtilsDebugPrint("MeshCache: Failed to create %s", tmpPath);
+        free(entries);
+        return 0;
+    }
+    offset = 0;
+    WriteAt(f, &offset, 0, &header, sizeof(header));
+    WriteAt(f, &offset, offset, entries,
+            sizeof(struct MeshCacheEntry) * m->numMeshes);
+    for (u32 i = 0; i < m->numMeshes; ++i) {
+        const struct MeshData *mesh = m->meshes + i;
+        const struct MeshCacheEntry *e = entries + i;
+        WriteAt(f, &offset, e->nameOffset, mesh->name,
+                strlen(mesh->name) + 1);
+        WriteAt(f, &offset, e->verticesOffset, mesh->vertices,
+                sizeof(struct Vertex) * (u64)mesh->numVertices);
+        WriteAt(f, &offset, e->indicesOffset, mesh->indices,
+                sizeof(u32) * (u64)mesh->numIndices);
+        WriteAt(f, &offset, e->meshletsOffset, mesh->meshlets,
+                sizeof(struct Meshlet) * (u64)mesh->numMeshlets);
+    }
+    free(entries);
+    const i32 isWritten = !ferror(f);
+    fclose(f);
+
+    if (isWritten) {
+        remove(cachePath);
+        if (rename(tmpPath, cachePath) == 0) {
+            UtilsDebugPrint("MeshCache: Saved %s, %llu bytes", cachePath,
+                            (unsigned long long)header.fileSize);
+            return 1;
+        }
+    }
+    UtilsDebugPrint("MeshCache: Failed to write %s", cachePath);
+    remove(tmpPath);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "renderer.h"
+
+// Binary cache of ModelData that lives next to the source model. It stores
+// final interleaved vertex and index buffers of every mesh, so on a cache hit
+// model is uploaded without parsing *.obj or generating tangents.
+//
+// Cache is valid if it was built from a source file with the same size and
+// modification time, or with the same contents hash.
+
+// Returns 1 and fills out with meshes that point into the mapped cache file.
+// Mapping is released by ModelData_Destroy.
+i32 MeshCache_Load(const i8 *cachePath, const i8 *sourcePath,
+                   struct ModelData *out);
+
+// Returns 1 if cache was written
+i32 MeshCache_Save(const i8 *cachePath, const i8 *sourcePath,
+                   const struct ModelData *m);
@@ -0,0 +1,784 @@
+#include "meshopt.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESH_OPT_INVALID_INDEX UINT32_MAX
+
+// Tuning values from Forsyth's paper
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRI_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+struct MeshOptCacheStats
+MeshOpt_AnalyzeVertexCache(const u32 *indices, u32 numIndices,
+                           u32 numVertices, u32 cacheSize,
+                           struct UtilsArena *scratch)
+{
+    struct MeshOptCacheStats stats = { 0 };
+    if (numIndices == 0 || numVertices == 0) {
+        return stats;
+    }
+
+    // vertex is in cache if it was loaded less than cacheSize misses ago
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *loadTime = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    ZERO_MEMORY_SZ(loadTime, sizeof(u32) * numVertices);
+    u32 time = cacheSize + 1;
+    u32 numMisses = 0;
+    for (u32 i = 0; i < numIndices; ++i) {
+        const u32 v = indices[i];
+        assert(v < numVertices);
+        if (time - loadTime[v] > cacheSize) {
+            loadTime[v] = time++;
+            ++numMisses;
+        }
+    }
+    UtilsArenaPopToMarker(scratch, marker);
+
+    stats.acmr = (f32)numMisses / (numIndices / 3);
+    stats.atvr = (f32)numMisses / numVertices;
+    return stats;
+}
+
+static f32
+ForsythVertexScore(i32 cachePos, u32 numLiveTris)
+{
+    if (numLiveTris == 0) {
+        return -1.0f;
+    }
+
+    f32 score = 0.0f;
+    if (cachePos >= 0) {
+        if (cachePos < 3) {
+            // vertices of the last triangle are penalized, so that strips
+            // do not bounce back and forth
+            score = FORSYTH_LAST_TRI_SCORE;
+        } else {
+            const f32 scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePos - 3) * scaler,
+                         FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+    // boost vertices with few triangles left, so that they get finished
+    // instead of being reloaded later
+    score += FORSYTH_VALENCE_BOOST_SCALE
+             * powf((f32)numLiveTris, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+void
+MeshOpt_OptimizeVertexCache(u32 *indices, u32 numIndices, u32 numVertices,
+                            struct UtilsArena *scratch)
+{
+    const u32 numTris = numIndices / 3;
+    if (numTris == 0) {
+        return;
+    }
+
+    // vertex to triangle adjacency, first numLiveTris[v] entries of each
+    // vertex are triangles that were not emitted yet
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *numLiveTris = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    u32 *adjOffsets
+        = UtilsArenaAlloc(scratch, sizeof(u32) * (numVertices + 1));
+    u32 *adjTris = UtilsArenaAlloc(scratch, sizeof(u32) * numIndices);
+    ZERO_MEMORY_SZ(numLiveTris, sizeof(u32) * numVertices);
+    for (u32 i = 0; i < numIndices; ++i) {
+        ++numLiveTris[indices[i]];
+    }
+    adjOffsets[0] = 0;
+    for (u32 v = 0; v < numVertices; ++v) {
+        adjOffsets[v + 1] = adjOffsets[v] + numLiveTris[v];
+        numLiveTris[v] = 0;
+    }
+    for (u32 i = 0; i < numIndices; ++i) {
+        const u32 v = indices[i];
+        adjTris[adjOffsets[v] + numLiveTris[v]++] = i / 3;
+    }
+
+    i32 *cachePos = UtilsArenaAlloc(scratch, sizeof(i32) * numVertices);
+    f32 *vertexScores
+        = UtilsArenaAlloc(scratch, sizeof(f32) * numVertices);
+    for (u32 v = 0; v < numVertices; ++v) {
+        cachePos[v] = -1;
+        vertexScores[v] = ForsythVertexScore(-1, numLiveTris[v]);
+    }
+
+    f32 *triScores = UtilsArenaAlloc(scratch, sizeof(f32) * numTris);
+    u8 *isEmitted = UtilsArenaAlloc(scratch, numTris);
+    ZERO_MEMORY_SZ(isEmitted, numTris);
+    u32 bestTri = 0;
+    for (u32 t = 0; t < numTris; ++t) {
+        triScores[t] = vertexScores[indices[t * 3]]
+                       + vertexScores[indices[t * 3 + 1]]
+                       + vertexScores[indices[t * 3 + 2]];
+        if (triScores[t] > triScores[bestTri]) {
+            bestTri = t;
+        }
+    }
+
+    u32 *out = UtilsArenaAlloc(scratch, sizeof(u32) * numIndices);
+    u32 cache[FORSYTH_CACHE_SIZE + 3];
+    u32 numCached = 0;
+    u32 nextUnemitted = 0;
+    for (u32 emitted = 0; emitted < numTris; ++emitted) {
+        if (bestTri == MESH_OPT_INVALID_INDEX) {
+            // nothing in cache is connected to remaining triangles
+            while (isEmitted[nextUnemitted]) {
+                ++nextUnemitted;
+            }
+            bestTri = nextUnemitted;
+        }
+
+        const u32 *tri = indices + bestTri * 3;
+        memcpy(out + emitted * 3, tri, sizeof(u32) * 3);
+        isEmitted[bestTri] = 1;
+
+        u32 newCache[FORSYTH_CACHE_SIZE + 3];
+        u32 numNewCached = 0;
+        for (u32 k = 0; k < 3; ++k) {
+            const u32 v = tri[k];
+            u32 *adj = adjTris + adjOffsets[v];
+            for (u32 j = 0; j < numLiveTris[v]; ++j) {
+                if (adj[j] == bestTri) {
+                    adj[j] = adj[--numLiveTris[v]];
+                    break;
+                }
+            }
+            newCache[numNewCached++] = v;
+        }
+        for (u32 i = 0; i < numCached; ++i) {
+            const u32 v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                newCache[numNewCached++] = v;
+            }
+        }
+
+        // vertices pushed out of cache lose their position score
+        for (u32 i = FORSYTH_CACHE_SIZE; i < numNewCached; ++i) {
+            const u32 v = newCache[i];
+            cachePos[v] = -1;
+            vertexScores[v] = ForsythVertexScore(-1, numLiveTris[v]);
+        }
+        numCached = numNewCached < FORSYTH_CACHE_SIZE ? numNewCached
+                                                      : FORSYTH_CACHE_SIZE;
+        for (u32 i = 0; i < numCached; ++i) {
+            const u32 v = newCache[i];
+            cache[i] = v;
+            cachePos[v] = i;
+            vertexScores[v] = ForsythVertexScore(i, numLiveTris[v]);
+        }
+
+        // only triangles that touch cached vertices changed their score, so
+        // next triangle is picked among them
+        bestTri = MESH_OPT_INVALID_INDEX;
+        f32 bestScore = -1.0f;
+        for (u32 i = 0; i < numCached; ++i) {
+            const u32 v = cache[i];
+            const u32 *adj = adjTris + adjOffsets[v];
+            for (u32 j = 0; j < numLiveTris[v]; ++j) {
+                const u32 t = adj[j];
+                triScores[t] = vertexScores[indices[t * 3]]
+                               + vertexScores[indices[t * 3 + 1]]
+                               + vertexScores[indices[t * 3 + 2]];
+                if (triScores[t] > bestScore) {
+                    bestScore = triScores[t];
+                    bestTri = t;
+                }
+            }
+        }
+    }
+
+    memcpy(indices, out, sizeof(u32) * numTris * 3);
+    UtilsArenaPopToMarker(scratch, marker);
+}
+
+struct MeshOptCluster {
+    u32 firstTri;
+    u32 numTris;
+    f32 sortKey;
+};
+
+static i32
+CompareClusters(const void *lhs, const void *rhs)
+{
+    const struct MeshOptCluster *a = lhs;
+    const struct MeshOptCluster *b = rhs;
+    if (a->sortKey != b->sortKey) {
+        return a->sortKey > b->sortKey ? -1 : 1;
+    }
+    return a->firstTri < b->firstTri ? -1 : 1;
+}
+
+void
+MeshOpt_OptimizeOverdraw(u32 *indices, u32 numIndices,
+                         const struct Vertex *vertices, u32 numVertices,
+                         struct UtilsArena *scratch)
+{
+    const u32 numTris = numIndices / 3;
+    if (numTris == 0) {
+        return;
+    }
+
+    // new cluster starts where triangle misses cache on all three vertices,
+    // moving such clusters around costs nothing in vertex cache efficiency
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *loadTime = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    ZERO_MEMORY_SZ(loadTime, sizeof(u32) * numVertices);
+    struct MeshOptCluster *clusters = UtilsArenaAlloc(
+        scratch, sizeof(struct MeshOptCluster) * numTris);
+    u32 numClusters = 0;
+    u32 time = MESH_OPT_FIFO_CACHE_SIZE + 1;
+    for (u32 t = 0; t < numTris; ++t) {
+        u32 numMisses = 0;
+        for (u32 k = 0; k < 3; ++k) {
+            const u32 v = indices[t * 3 + k];
+            if (time - loadTime[v] > MESH_OPT_FIFO_CACHE_SIZE) {
+                loadTime[v] = time++;
+                ++numMisses;
+            }
+        }
+        if (t == 0 || numMisses == 3) {
+            clusters[numClusters].firstTri = t;
+            clusters[numClusters].numTris = 0;
+            ++numClusters;
+        }
+        ++clusters[numClusters - 1].numTris;
+    }
+    if (numClusters == 1) {
+        UtilsArenaPopToMarker(scratch, marker);
+        return;
+    }
+
+    // area weighted centroids and normals
+    Vec3D meshCenter = MathVec3DZero();
+    f32 meshArea = 0.0f;
+    Vec3D *clusterCenters
+        = UtilsArenaAlloc(scratch, sizeof(Vec3D) * numClusters);
+    Vec3D *clusterNormals
+        = UtilsArenaAlloc(scratch, sizeof(Vec3D) * numClusters);
+    for (u32 c = 0; c < numClusters; ++c) {
+        Vec3D center = MathVec3DZero();
+        Vec3D normal = MathVec3DZero();
+        f32 area = 0.0f;
+        const struct MeshOptCluster *cluster = clusters + c;
+        for (u32 t = cluster->firstTri;
+             t < cluster->firstTri + cluster->numTris; ++t) {
+            const Vec3D *p0 = &vertices[indices[t * 3]].position;
+            const Vec3D *p1 = &vertices[indices[t * 3 + 1]].position;
+            const Vec3D *p2 = &vertices[indices[t * 3 + 2]].position;
+            const Vec3D e1 = MathVec3DSubtraction(p1, p0);
+            const Vec3D e2 = MathVec3DSubtraction(p2, p0);
+            const Vec3D n = MathVec3DCross(&e1, &e2);
+            const f32 triArea = sqrtf(MathVec3DDot(&n, &n)) * 0.5f;
+            Vec3D triCenter = MathVec3DAddition(p0, p1);
+            triCenter = MathVec3DAddition(&triCenter, p2);
+            triCenter = MathVec3DModulateByScalar(&triCenter, triArea / 3.0f);
+            center = MathVec3DAddition(&center, &triCenter);
+            normal = MathVec3DAddition(&normal, &n);
+            area += triArea;
+        }
+        meshCenter = MathVec3DAddition(&meshCenter, &center);
+        meshArea += area;
+        clusterCenters[c] = area > 0.0f
+                                ? MathVec3DModulateByScalar(&center,
+                                                            1.0f / area)
+                                : vertices[indices[cluster->firstTri * 3]]
+                                      .position;
+        clusterNormals[c] = normal;
+    }
+    if (meshArea > 0.0f) {
+        meshCenter = MathVec3DModulateByScalar(&meshCenter, 1.0f / meshArea);
+    }
+
+    // clusters that point away from the center are likely to occlude the
+    // rest of the mesh, so they are drawn first
+    for (u32 c = 0; c < numClusters; ++c) {
+        const Vec3D toCluster
+            = MathVec3DSubtraction(clusterCenters + c, &meshCenter);
+        const f32 len = sqrtf(
+            MathVec3DDot(clusterNormals + c, clusterNormals + c));
+        clusters[c].sortKey
+            = len > 0.0f
+                  ? MathVec3DDot(&toCluster, clusterNormals + c) / len
+                  : 0.0f;
+    }
+    qsort(clusters, numClusters, sizeof(struct MeshOptCluster),
+          CompareClusters);
+
+    u32 *out = UtilsArenaAlloc(scratch, sizeof(u32) * numTris * 3);
+    u32 numOut = 0;
+    for (u32 c = 0; c < numClusters; ++c) {
+        const u32 count = clusters[c].numTris * 3;
+        memcpy(out + numOut, indices + clusters[c].firstTri * 3,
+               sizeof(u32) * count);
+        numOut += count;
+    }
+    memcpy(indices, out, sizeof(u32) * numOut);
+    UtilsArenaPopToMarker(scratch, marker);
+}
+
+u32
+MeshOpt_OptimizeVertexFetch(struct Vertex *vertices, u32 numVertices,
+                            u32 *indices, u32 numIndices,
+                            struct UtilsArena *scratch)
+{
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *remap = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    memset(remap, 0xff, sizeof(u32) * numVertices);
+    struct Vertex *reordered
+        = UtilsArenaAlloc(scratch, sizeof(struct Vertex) * numVertices);
+    u32 numUsed = 0;
+    for (u32 i = 0; i < numIndices; ++i) {
+        const u32 v = indices[i];
+        if (remap[v] == MESH_OPT_INVALID_INDEX) {
+            remap[v] = numUsed;
+            reordered[numUsed++] = vertices[v];
+        }
+        indices[i] = remap[v];
+    }
+    memcpy(vertices, reordered, sizeof(struct Vertex) * numUsed);
+    UtilsArenaPopToMarker(scratch, marker);
+    return numUsed;
+}
+
+// Symmetric 4x4 matrix of plane equations, error of p is p^T Q p. Kept in
+// doubles, plane offsets of large meshes cancel out badly in floats.
+struct MeshOptQuadric {
+    f64 a2, b2, c2, d2;
+    f64 ab, ac, ad;
+    f64 bc, bd;
+    f64 cd;
+    // sum of triangle areas, turns squared error into mean squared distance
+    f64 weight;
+};
+
+static void
+QuadricAddPlane(struct MeshOptQuadric *q, const Vec3D *n, f32 d, f32 weight)
+{
+    q->a2 += (f64)n->X * n->X * weight;
+    q->b2 += (f64)n->Y * n->Y * weight;
+    q->c2 += (f64)n->Z * n->Z * weight;
+    q->d2 += (f64)d * d * weight;
+    q->ab += (f64)n->X * n->Y * weight;
+    q->ac += (f64)n->X * n->Z * weight;
+    q->ad += (f64)n->X * d * weight;
+    q->bc += (f64)n->Y * n->Z * weight;
+    q->bd += (f64)n->Y * d * weight;
+    q->cd += (f64)n->Z * d * weight;
+    q->weight += weight;
+}
+
+static void
+QuadricAdd(struct MeshOptQuadric *q, const struct MeshOptQuadric *other)
+{
+    f64 *dst = &q->a2;
+    const f64 *src = &other->a2;
+    for (u32 i = 0; i < sizeof(*q) / sizeof(f64); ++i) {
+        dst[i] += src[i];
+    }
+}
+
+// Root mean squared distance of p to the planes
+static f32
+QuadricError(const struct MeshOptQuadric *q, const Vec3D *p)
+{
+    const f64 x = p->X;
+    const f64 y = p->Y;
+    const f64 z = p->Z;
+    const f64 e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z + q->d2
+                  + 2.0
+                        * (q->ab * x * y + q->ac * x * z + q->ad * x
+                           + q->bc * y * z + q->bd * y + q->cd * z);
+    return q->weight > 0.0 ? (f32)sqrt(fmax(e, 0.0) / q->weight) : 0.0f;
+}
+
+struct MeshOptCollapse {
+    u32 from;
+    u32 to;
+    f32 error;
+};
+
+static i32
+CompareCollapses(const void *lhs, const void *rhs)
+{
+    const struct MeshOptCollapse *a = lhs;
+    const struct MeshOptCollapse *b = rhs;
+    if (a->error != b->error) {
+        return a->error < b->error ? -1 : 1;
+    }
+    return a->from < b->from ? -1 : 1;
+}
+
+static Vec3D
+TriangleNormal(const Vec3D *p0, const Vec3D *p1, const Vec3D *p2)
+{
+    const Vec3D e1 = MathVec3DSubtraction(p1, p0);
+    const Vec3D e2 = MathVec3DSubtraction(p2, p0);
+    return MathVec3DCross(&e1, &e2);
+}
+
+// Maps every vertex to the first vertex with the same position. Vertices
+// that share position with another one are on an attribute seam.
+static void
+FindPositionIds(const struct Vertex *vertices, u32 numVertices,
+                u32 *positionIds, u8 *isSeam, struct UtilsArena *scratch)
+{
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 tableSize = 1;
+    while (tableSize < numVertices * 2) {
+        tableSize <<= 1;
+    }
+    u32 *table = UtilsArenaAlloc(scratch, sizeof(u32) * tableSize);
+    memset(table, 0xff, sizeof(u32) * tableSize);
+    for (u32 v = 0; v < numVertices; ++v) {
+        const Vec3D *p = &vertices[v].position;
+        u32 slot = UtilsHash64(p, sizeof(*p)) & (tableSize - 1);
+        while (table[slot] != MESH_OPT_INVALID_INDEX
+               && memcmp(&vertices[table[slot]].position, p, sizeof(*p))
+                      != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == MESH_OPT_INVALID_INDEX) {
+            table[slot] = v;
+            isSeam[v] = 0;
+        } else {
+            isSeam[table[slot]] = 1;
+            isSeam[v] = 1;
+        }
+        positionIds[v] = table[slot];
+    }
+    UtilsArenaPopToMarker(scratch, marker);
+}
+
+// Vertex can be collapsed only if it is not on a seam and not on an open
+// border, i.e. every outgoing edge has a matching incoming one
+static u8
+IsVertexMovable(u32 v, const u32 *indices, const u32 *adjOffsets,
+                const u32 *adjTris, const u32 *positionIds, const u8 *isSeam)
+{
+    if (isSeam[v] || adjOffsets[v] == adjOffsets[v + 1]) {
+        return 0;
+    }
+    for (u32 i = adjOffsets[v]; i < adjOffsets[v + 1]; ++i) {
+        const u32 *tri = indices + adjTris[i] * 3;
+        const u32 k = tri[0] == v ? 0 : tri[1] == v ? 1 : 2;
+        const u32 next = positionIds[tri[(k + 1) % 3]];
+        u32 numOut = 0;
+        u32 numIn = 0;
+        for (u32 j = adjOffsets[v]; j < adjOffsets[v + 1]; ++j) {
+            const u32 *other = indices + adjTris[j] * 3;
+            const u32 l = other[0] == v ? 0 : other[1] == v ? 1 : 2;
+            numOut += positionIds[other[(l + 1) % 3]] == next;
+            numIn += positionIds[other[(l + 2) % 3]] == next;
+        }
+        if (numOut != numIn) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+u32
+MeshOpt_Simplify(u32 *destination, const u32 *indices, u32 numIndices,
+                 const struct Vertex *vertices, u32 numVertices,
+                 u32 targetNumIndices, f32 maxError, f32 *outError,
+                 struct UtilsArena *scratch)
+{
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    memcpy(destination, indices, sizeof(u32) * numIndices);
+    *outError = 0.0f;
+
+    struct MeshOptQuadric *quadrics = UtilsArenaAlloc(
+        scratch, sizeof(struct MeshOptQuadric) * numVertices);
+    ZERO_MEMORY_SZ(quadrics, sizeof(struct MeshOptQuadric) * numVertices);
+    for (u32 t = 0; t < numIndices / 3; ++t) {
+        const u32 *tri = indices + t * 3;
+        const Vec3D *p0 = &vertices[tri[0]].position;
+        Vec3D n = TriangleNormal(p0, &vertices[tri[1]].position,
+                                 &vertices[tri[2]].position);
+        const f32 len = sqrtf(MathVec3DDot(&n, &n));
+        if (len == 0.0f) {
+            continue;
+        }
+        n = MathVec3DModulateByScalar(&n, 1.0f / len);
+        const f32 d = -MathVec3DDot(&n, p0);
+        for (u32 k = 0; k < 3; ++k) {
+            QuadricAddPlane(quadrics + tri[k], &n, d, len * 0.5f);
+        }
+    }
+
+    u32 *numAdj = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    u32 *adjOffsets
+        = UtilsArenaAlloc(scratch, sizeof(u32) * (numVertices + 1));
+    u32 *adjTris = UtilsArenaAlloc(scratch, sizeof(u32) * numIndices);
+    u32 *positionIds = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    u8 *isSeam = UtilsArenaAlloc(scratch, numVertices);
+    u8 *isTouched = UtilsArenaAlloc(scratch, numVertices);
+    u32 *remap = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    struct MeshOptCollapse *collapses = UtilsArenaAlloc(
+        scratch, sizeof(struct MeshOptCollapse) * numVertices);
+
+    FindPositionIds(vertices, numVertices, positionIds, isSeam, scratch);
+
+    // every pass collapses a set of independent edges of lowest error
+    u32 count = numIndices;
+    while (count > targetNumIndices) {
+        ZERO_MEMORY_SZ(numAdj, sizeof(u32) * numVertices);
+        for (u32 i = 0; i < count; ++i) {
+            ++numAdj[destination[i]];
+        }
+        adjOffsets[0] = 0;
+        for (u32 v = 0; v < numVertices; ++v) {
+            adjOffsets[v + 1] = adjOffsets[v] + numAdj[v];
+            numAdj[v] = 0;
+        }
+        for (u32 i = 0; i < count; ++i) {
+            const u32 v = destination[i];
+            adjTris[adjOffsets[v] + numAdj[v]++] = i / 3;
+        }
+        u32 numCollapses = 0;
+        for (u32 v = 0; v < numVertices; ++v) {
+            if (!IsVertexMovable(v, destination, adjOffsets, adjTris,
+                                 positionIds, isSeam)) {
+                continue;
+            }
+            struct MeshOptCollapse best = { v, v, FLT_MAX };
+            for (u32 i = adjOffsets[v]; i < adjOffsets[v + 1]; ++i) {
+                const u32 *tri = destination + adjTris[i] * 3;
+                for (u32 k = 0; k < 3; ++k) {
+                    if (tri[k] == v) {
+                        continue;
+                    }
+                    struct MeshOptQuadric q = quadrics[v];
+                    QuadricAdd(&q, quadrics + tri[k]);
+                    const f32 error
+                        = QuadricError(&q, &vertices[tri[k]].position);
+                    if (error < best.error) {
+                        best.to = tri[k];
+                        best.error = error;
+                    }
+                }
+            }
+            if (best.to != v && best.error <= maxError) {
+                collapses[numCollapses++] = best;
+            }
+        }
+        if (numCollapses == 0) {
+            break;
+        }
+        qsort(collapses, numCollapses, sizeof(struct MeshOptCollapse),
+              CompareCollapses);
+
+        for (u32 v = 0; v < numVertices; ++v) {
+            remap[v] = v;
+        }
+        ZERO_MEMORY_SZ(isTouched, numVertices);
+        u32 numRemovedIndices = 0;
+        u32 numApplied = 0;
+        for (u32 c = 0; c < numCollapses; ++c) {
+            if (count - numRemovedIndices <= targetNumIndices) {
+                break;
+            }
+            const struct MeshOptCollapse *collapse = collapses + c;
+            const u32 v = collapse->from;
+            const u32 w = collapse->to;
+            if (isTouched[v] || isTouched[w]) {
+                continue;
+            }
+
+            // reject collapses that flip a triangle or turn it by more
+            // than ~75 degrees, such triangles become folded slivers
+            i32 isFlipped = 0;
+            u32 numShared = 0;
+            for (u32 i = adjOffsets[v]; i < adjOffsets[v + 1]; ++i) {
+                const u32 *tri = destination + adjTris[i] * 3;
+                if (tri[0] == w || tri[1] == w || tri[2] == w) {
+                    ++numShared;
+                    continue;
+                }
+                Vec3D p[3];
+                for (u32 k = 0; k < 3; ++k) {
+                    p[k] = vertices[tri[k]].position;
+                }
+                const Vec3D before = TriangleNormal(p, p + 1, p + 2);
+                for (u32 k = 0; k < 3; ++k) {
+                    if (tri[k] == v) {
+                        p[k] = vertices[w].position;
+                    }
+                }
+                const Vec3D after = TriangleNormal(p, p + 1, p + 2);
+                const f32 limit
+                    = 0.25f
+                      * sqrtf(MathVec3DDot(&before, &before)
+                              * MathVec3DDot(&after, &after));
+                if (MathVec3DDot(&before, &after) <= limit) {
+                    isFlipped = 1;
+                    break;
+                }
+            }
+            if (isFlipped) {
+                continue;
+            }
+
+            // triangles around v must not change again in this pass
+            for (u32 i = adjOffsets[v]; i < adjOffsets[v + 1]; ++i) {
+                const u32 *tri = destination + adjTris[i] * 3;
+                isTouched[tri[0]] = 1;
+                isTouched[tri[1]] = 1;
+                isTouched[tri[2]] = 1;
+            }
+            remap[v] = w;
+            QuadricAdd(quadrics + w, quadrics + v);
+            *outError = fmaxf(*outError, collapse->error);
+            numRemovedIndices += numShared * 3;
+            ++numApplied;
+        }
+        if (numApplied == 0) {
+            break;
+        }
+
+        u32 newCount = 0;
+        for (u32 i = 0; i < count; i += 3) {
+            const u32 a = remap[destination[i]];
+            const u32 b = remap[destination[i + 1]];
+            const u32 c = remap[destination[i + 2]];
+            if (a != b && b != c && a != c) {
+                destination[newCount++] = a;
+                destination[newCount++] = b;
+                destination[newCount++] = c;
+            }
+        }
+        count = newCount;
+    }
+
+    UtilsArenaPopToMarker(scratch, marker);
+    return count;
+}
+
+// Bounding sphere around the AABB of the cluster and a cone that contains
+// the normals of all its triangles
+static void
+ComputeMeshletBounds(struct Meshlet *meshlet, const u32 *indices,
+                     const struct Vertex *vertices)
+{
+    const u32 *tris = indices + meshlet->firstIndex;
+    Vec3D boundsMin = vertices[tris[0]].position;
+    Vec3D boundsMax = boundsMin;
+    for (u32 i = 1; i < meshlet->numIndices; ++i) {
+        const Vec3D *p = &vertices[tris[i]].position;
+        boundsMin.X = fminf(boundsMin.X, p->X);
+        boundsMin.Y = fminf(boundsMin.Y, p->Y);
+        boundsMin.Z = fminf(boundsMin.Z, p->Z);
+        boundsMax.X = fmaxf(boundsMax.X, p->X);
+        boundsMax.Y = fmaxf(boundsMax.Y, p->Y);
+        boundsMax.Z = fmaxf(boundsMax.Z, p->Z);
+    }
+    Vec3D center = MathVec3DAddition(&boundsMin, &boundsMax);
+    center = MathVec3DModulateByScalar(&center, 0.5f);
+    f32 radiusSq = 0.0f;
+    for (u32 i = 0; i < meshlet->numIndices; ++i) {
+        const Vec3D d =
+            MathVec3DSubtraction(&vertices[tris[i]].position, &center);
+        radiusSq = fmaxf(radiusSq, MathVec3DDot(&d, &d));
+    }
+    meshlet->center = center;
+    meshlet->radius = sqrtf(radiusSq);
+
+    // Winding is taken from the geometric normal, which is flipped to agree
+    // with the shading normals, so it does not depend on front face setting.
+    // Degenerate triangles can't be seen and are skipped.
+    Vec3D normals[MESHLET_MAX_TRIANGLES];
+    u32 numNormals = 0;
+    Vec3D axis = MathVec3DZero();
+    for (u32 i = 0; i < meshlet->numIndices; i += 3) {
+        const struct Vertex *v0 = &vertices[tris[i + 0]];
+        const struct Vertex *v1 = &vertices[tris[i + 1]];
+        const struct Vertex *v2 = &vertices[tris[i + 2]];
+        Vec3D n = TriangleNormal(&v0->position, &v1->position, &v2->position);
+        const f32 length = sqrtf(MathVec3DDot(&n, &n));
+        if (length <= FLT_MIN) {
+            continue;
+        }
+        n = MathVec3DModulateByScalar(&n, 1.0f / length);
+        Vec3D shading = MathVec3DAddition(&v0->normal, &v1->normal);
+        shading = MathVec3DAddition(&shading, &v2->normal);
+        if (MathVec3DDot(&n, &shading) < 0.0f) {
+            MathVec3DNegate(&n);
+        }
+        normals[numNormals++] = n;
+        axis = MathVec3DAddition(&axis, &n);
+    }
+
+    // cutoff of 1 or more never culls
+    meshlet->coneAxis = MathVec3DZero();
+    meshlet->coneCutoff = 1.0f;
+    const f32 axisLength = sqrtf(MathVec3DDot(&axis, &axis));
+    if (numNormals == 0 || axisLength <= FLT_MIN) {
+        return;
+    }
+    axis = MathVec3DModulateByScalar(&axis, 1.0f / axisLength);
+    f32 minDot = 1.0f;
+    for (u32 i = 0; i < numNormals; ++i) {
+        minDot = fminf(minDot, MathVec3DDot(&axis, &normals[i]));
+    }
+    meshlet->coneAxis = axis;
+    if (minDot > 0.0f) {
+        meshlet->coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
+
+u32
+MeshOpt_BuildMeshlets(struct Meshlet *meshlets, const u32 *indices,
+                      u32 numIndices, const struct Vertex *vertices,
+                      u32 numVertices, struct UtilsArena *scratch)
+{
+    if (numIndices == 0) {
+        return 0;
+    }
+
+    // vertex is part of current meshlet if its stamp equals meshlet index
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *stamps = UtilsArenaAlloc(scratch, sizeof(u32) * numVertices);
+    memset(stamps, 0xff, sizeof(u32) * numVertices);
+
+    u32 numMeshlets = 0;
+    u32 numMeshletVertices = 0;
+    struct Meshlet *meshlet = &meshlets[0];
+    meshlet->firstIndex = 0;
+    meshlet->numIndices = 0;
+    for (u32 i = 0; i < numIndices; i += 3) {
+        const u32 a = indices[i + 0];
+        const u32 b = indices[i + 1];
+        const u32 c = indices[i + 2];
+        assert(a < numVertices && b < numVertices && c < numVertices);
+        const u32 numNew = (stamps[a] != numMeshlets) +
+                           (stamps[b] != numMeshlets && b != a) +
+                           (stamps[c] != numMeshlets && c != a && c != b);
+        if (numMeshletVertices + numNew > MESHLET_MAX_VERTICES ||
+            meshlet->numIndices == MESHLET_MAX_TRIANGLES * 3) {
+            ComputeMeshletBounds(meshlet, indices, vertices);
+            meshlet = &meshlets[++numMeshlets];
+            meshlet->firstIndex = i;
+            meshlet->numIndices = 0;
+            numMeshletVertices = 0;
+        }
+        for (u32 k = 0; k < 3; ++k) {
+            const u32 v = indices[i + k];
+            if (stamps[v] != numMeshlets) {
+                stamps[v] = numMeshlets;
+                ++numMeshletVertices;
+            }
+        }
+        meshlet->numIndices += 3;
+    }
+    ComputeMeshletBounds(meshlet, indices, vertices);
+
+    UtilsArenaPopToMarker(scratch, marker);
+    return numMeshlets + 1;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "renderer.h"
+
+// Size of the FIFO post-transform cache that is used to measure meshes
+#define MESH_OPT_FIFO_CACHE_SIZE 16
+
+struct MeshOptCacheStats {
+    // average number of vertex shader invocations per triangle
+    f32 acmr;
+    // average number of vertex shader invocations per vertex, 1.0 is ideal
+    f32 atvr;
+};
+
+// Temporary arrays of all functions below are allocated from scratch and
+// released before they return.
+
+// Simulates FIFO post-transform cache of cacheSize entries
+struct MeshOptCacheStats MeshOpt_AnalyzeVertexCache(
+    const u32 *indices, u32 numIndices, u32 numVertices, u32 cacheSize,
+    struct UtilsArena *scratch);
+
+// Reorders triangles to maximize post-transform cache hits (Tom Forsyth,
+// "Linear-Speed Vertex Cache Optimisation")
+void MeshOpt_OptimizeVertexCache(u32 *indices, u32 numIndices,
+                                 u32 numVertices, struct UtilsArena *scratch);
+
+// Splits cache optimized triangles into clusters and draws clusters that
+// face away from the mesh center first (Sander et al., "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw"). Triangle order
+// inside of a cluster is kept, so ACMR barely changes.
+void MeshOpt_OptimizeOverdraw(u32 *indices, u32 numIndices,
+                              const struct Vertex *vertices, u32 numVertices,
+                              struct UtilsArena *scratch);
+
+// Reorders vertices in order of first use by indices and remaps indices.
+// Returns number of referenced vertices, unused vertices are dropped.
+u32 MeshOpt_OptimizeVertexFetch(struct Vertex *vertices, u32 numVertices,
+                                u32 *indices, u32 numIndices,
+                                struct UtilsArena *scratch);
+
+// Quadric error edge collapse (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics"). Vertices collapse onto their neighbours, so
+// result references the same vertex buffer. Vertices on attribute seams and
+// open borders stay in place. Stops at targetNumIndices or when the cheapest
+// collapse would move the surface further than maxError. Writes up to
+// numIndices indices to destination and returns their count. outError is
+// the largest object space error of the collapses that were made.
+u32 MeshOpt_Simplify(u32 *destination, const u32 *indices, u32 numIndices,
+                     const struct Vertex *vertices, u32 numVertices,
+                     u32 targetNumIndices, f32 maxError, f32 *outError,
+                     struct UtilsArena *scratch);
+
+// Worst case number of meshlets MeshOpt_BuildMeshlets writes
+#define MESH_OPT_MAX_MESHLETS(numIndices)                                    \
+    ((numIndices) / 3 + 1)
+
+// Splits triangles into meshlets of at most MESHLET_MAX_VERTICES unique
+// vertices and MESHLET_MAX_TRIANGLES triangles without reordering them, so
+// a vertex cache optimized order gives spatially compact meshlets. Writes
+// bounds and normal cone of every meshlet. Returns number of meshlets.
+u32 MeshOpt_BuildMeshlets(struct Meshlet *meshlets, const u32 *indices,
+                          u32 numIndices, const struct Vertex *vertices,
+                          u32 numVertices, struct UtilsArena *scratch);
@@ -9,6 +9,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)            \
+    || defined(_M_IX86)
+#define MATH_X86 1
+#include <immintrin.h>
+#if _MSC_VER
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without extra flags
+#define MATH_TARGET_AVX2
+#else
+#define MATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#else
+#define MATH_X86 0
+#endif
 
 #define EPSILON 0.00001f
 
@@ -35,6 +51,98 @@ MathRandom(float min, float max)
     return ((float)rand() / (float)RAND_MAX) * (max - min) + min;
 }
 
+uint16_t
+MathFloatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t h;
+    if (x >= 0x47800000u) {
+        // too big for half, inf or nan
+        h = x > 0x7f800000u ? 0x7e00 : 0x7c00;
+    } else if (x < 0x38800000u) {
+        // denormal half, let FPU do the rounding by adding 0.5 that moves
+        // mantissa bits in place
+        float denorm;
+        const uint32_t magic = 0x3f000000u;
+        memcpy(&denorm, &x, sizeof(denorm));
+        float magicF;
+        memcpy(&magicF, &magic, sizeof(magicF));
+        denorm += magicF;
+        memcpy(&x, &denorm, sizeof(x));
+        h = (uint16_t)(x - magic);
+    } else {
+        // rebias exponent and round mantissa to nearest even
+        const uint32_t isMantissaOdd = (x >> 13) & 1;
+        x += ((uint32_t)(15 - 127) << 23) + 0xfff + isMantissaOdd;
+        h = (uint16_t)(x >> 13);
+    }
+    return h | (uint16_t)(sign >> 16);
+}
+
+float
+MathHalfToFloat(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0) {
+        const float f = ldexpf((float)mantissa, -24);
+        return sign ? -f : f;
+    }
+
+    uint32_t x;
+    if (exponent == 31) {
+        x = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static float
+SignNotZero(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+Vec2D
+MathOctEncode(const Vec3D *n)
+{
+    const float l1 = fabsf(n->X) + fabsf(n->Y) + fabsf(n->Z);
+    Vec2D e = { 0.0f, 0.0f };
+    if (l1 == 0.0f) {
+        return e;
+    }
+    e.X = n->X / l1;
+    e.Y = n->Y / l1;
+    if (n->Z < 0.0f) {
+        // fold lower hemisphere over diagonals
+        const float x = e.X;
+        e.X = (1.0f - fabsf(e.Y)) * SignNotZero(x);
+        e.Y = (1.0f - fabsf(x)) * SignNotZero(e.Y);
+    }
+    return e;
+}
+
+Vec3D
+MathOctDecode(const Vec2D *e)
+{
+    Vec3D n = { e->X, e->Y, 1.0f - fabsf(e->X) - fabsf(e->Y) };
+    if (n.Z < 0.0f) {
+        const float x = n.X;
+        n.X = (1.0f - fabsf(n.Y)) * SignNotZero(x);
+        n.Y = (1.0f - fabsf(x)) * SignNotZero(n.Y);
+    }
+    MathVec3DNormalize(&n);
+    return n;
+}
+
 Vec2D
 MathVec2DZero(void)
 {
@@ -190,8 +298,9 @@ MathMat4X4Addition(const Mat4X4 *mat1, const Mat4X4 *mat2)
     return res;
 }
 
-Vec4D
-MathMat4X4MultVec4DByMat4X4(const Vec4D *vec, const Mat4X4 *mat)
+// Scalar kernels are the reference the SIMD ones are tested against
+static Vec4D
+MultVec4DByMat4X4Scalar(const Vec4D *vec, const Mat4X4 *mat)
 {
     Vec4D res = { 0 };
     res.X = vec->X * mat->A00 + vec->Y * mat->A10 + vec->Z * mat->A20
@@ -205,8 +314,8 @@ MathMat4X4MultVec4DByMat4X4(const Vec4D *vec, const Mat4X4 *mat)
     return res;
 }
 
-Mat4X4
-MathMat4X4MultMat4X4ByMat4X4(const Mat4X4 *mat1, const Mat4X4 *mat2)
+static Mat4X4
+MultMat4X4ByMat4X4Scalar(const Mat4X4 *mat1, const Mat4X4 *mat2)
 {
     Mat4X4 res = { 0 };
     float x = mat1->A00;
@@ -451,6 +560,73 @@ MathMat4X4PerspectiveFov(float fovAngleY, float aspectRatio, float nearZ,
     return res;
 }
 
+Frustum
+MathFrustumFromViewProj(const Mat4X4 *viewProj)
+{
+    // row vectors, so clip = (p, 1) * viewProj and the planes are sums of
+    // columns (Gribb and Hartmann)
+    Vec4D columns[4];
+    for (uint32_t i = 0; i < 4; ++i) {
+        columns[i] = MathVec4DFromXYZW(viewProj->A[0][i], viewProj->A[1][i],
+                                       viewProj->A[2][i], viewProj->A[3][i]);
+    }
+    Frustum frustum;
+    frustum.planes[0] = MathVec4DAddition(&columns[3], &columns[0]);
+    MathVec4DSubtraction(&columns[3], &columns[0], &frustum.planes[1]);
+    frustum.planes[2] = MathVec4DAddition(&columns[3], &columns[1]);
+    MathVec4DSubtraction(&columns[3], &columns[1], &frustum.planes[3]);
+    // -w <= z like GL clips, which is more conservative than 0 <= z
+    frustum.planes[4] = MathVec4DAddition(&columns[3], &columns[2]);
+    MathVec4DSubtraction(&columns[3], &columns[2], &frustum.planes[5]);
+    for (uint32_t i = 0; i < 6; ++i) {
+        Vec4D *plane = frustum.planes + i;
+        const float len = sqrtf(plane->X * plane->X + plane->Y * plane->Y
+                                + plane->Z * plane->Z);
+        MathVec4DModulateByScalar(plane, 1.0f / len, plane);
+    }
+    return frustum;
+}
+
+int32_t
+MathFrustumIntersectsSphere(const Frustum *frustum, const Vec3D *center,
+                            float radius)
+{
+    for (uint32_t i = 0; i < 6; ++i) {
+        const Vec4D *plane = frustum->planes + i;
+        const float distance = plane->X * center->X + plane->Y * center->Y
+                               + plane->Z * center->Z + plane->W;
+        if (distance < -radius) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+Obb
+MathObbFromAabb(const Vec3D *boundsMin, const Vec3D *boundsMax,
+                const Mat4X4 *world)
+{
+    const float center[3] = { 0.5f * (boundsMin->X + boundsMax->X),
+                              0.5f * (boundsMin->Y + boundsMax->Y),
+                              0.5f * (boundsMin->Z + boundsMax->Z) };
+    const float extent[3] = { 0.5f * (boundsMax->X - boundsMin->X),
+                              0.5f * (boundsMax->Y - boundsMin->Y),
+                              0.5f * (boundsMax->Z - boundsMin->Z) };
+    Obb obb;
+    float c[3];
+    for (uint32_t j = 0; j < 3; ++j) {
+        c[j] = center[0] * world->A[0][j] + center[1] * world->A[1][j]
+               + center[2] * world->A[2][j] + world->A[3][j];
+    }
+    obb.center = MathVec3DFromXYZ(c[0], c[1], c[2]);
+    for (uint32_t i = 0; i < 3; ++i) {
+        obb.halfAxes[i] = MathVec3DFromXYZ(world->A[i][0] * extent[i],
+                                           world->A[i][1] * extent[i],
+                                           world->A[i][2] * extent[i]);
+    }
+    return obb;
+}
+
 float
 MathClamp(float min, float max, float v)
 {
@@ -765,14 +941,1045 @@ gluInvertMatrix(const float m[], float invOut[])
     return 1;
 }
 
-Mat4X4
-MathMat4X4Inverse(const Mat4X4 *mat)
+static Mat4X4
+InverseScalar(const Mat4X4 *mat)
 {
     Mat4X4 inv = { 0 };
     gluInvertMatrix(&mat->A00, &inv.A00);
     return inv;
 }
 
+Mat4X4
+MathMat4X4InverseTRS(const Vec3D *translation, const Mat4X4 *rotation,
+                     const Vec3D *scale)
+{
+    // upper 3x3 is (S R)^-1 = R^T S^-1
+    const float invScale[3] = { 1.0f / scale->X, 1.0f / scale->Y,
+                                1.0f / scale->Z };
+    Mat4X4 inv;
+    for (uint32_t i = 0; i < 3; ++i) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            inv.A[i][j] = rotation->A[j][i] * invScale[j];
+        }
+        inv.A[i][3] = 0.0f;
+    }
+    // translation row is -t (S R)^-1
+    for (uint32_t j = 0; j < 3; ++j) {
+        inv.A[3][j] = -(translation->X * inv.A[0][j]
+                        + translation->Y * inv.A[1][j]
+                        + translation->Z * inv.A[2][j]);
+    }
+    inv.A[3][3] = 1.0f;
+    return inv;
+}
+
+Mat4X4
+MathMat4X4ComposeTRS(const Vec3D *translation, const Mat4X4 *rotation,
+                     const Vec3D *scale)
+{
+    const float s[3] = { scale->X, scale->Y, scale->Z };
+    Mat4X4 out;
+    for (uint32_t i = 0; i < 3; ++i) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            out.A[i][j] = rotation->A[i][j] * s[i];
+        }
+        out.A[i][3] = 0.0f;
+    }
+    out.A30 = translation->X;
+    out.A31 = translation->Y;
+    out.A32 = translation->Z;
+    out.A33 = 1.0f;
+    return out;
+}
+
+Mat4X4
+MathMat4X4InverseRigid(const Mat4X4 *mat)
+{
+    Mat4X4 inv;
+    for (uint32_t i = 0; i < 3; ++i) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            inv.A[i][j] = mat->A[j][i];
+        }
+        inv.A[i][3] = 0.0f;
+    }
+    // translation row is -t R^T
+    for (uint32_t j = 0; j < 3; ++j) {
+        inv.A[3][j] = -(mat->A30 * mat->A[j][0] + mat->A31 * mat->A[j][1]
+                        + mat->A32 * mat->A[j][2]);
+    }
+    inv.A[3][3] = 1.0f;
+    return inv;
+}
+
+static void
+MultMat4X4ArrayByMat4X4Scalar(const Mat4X4 *mats, const Mat4X4 *mat,
+                              Mat4X4 *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        out[i] = MultMat4X4ByMat4X4Scalar(mats + i, mat);
+    }
+}
+
+static void
+MultVec4DArrayByMat4X4Scalar(const Vec4D *vecs, const Mat4X4 *mat,
+                             Vec4D *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        out[i] = MultVec4DByMat4X4Scalar(vecs + i, mat);
+    }
+}
+
+static void
+TransformPointsScalar(const Vec3D *points, const Mat4X4 *mat, Vec3D *out,
+                      uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        const Vec3D p = points[i];
+        out[i].X = p.X * mat->A00 + p.Y * mat->A10 + p.Z * mat->A20 + mat->A30;
+        out[i].Y = p.X * mat->A01 + p.Y * mat->A11 + p.Z * mat->A21 + mat->A31;
+        out[i].Z = p.X * mat->A02 + p.Y * mat->A12 + p.Z * mat->A22 + mat->A32;
+    }
+}
+
+static uint32_t
+FrustumCullSpheresScalar(const Frustum *frustum, const Vec4D *spheres,
+                         uint8_t *visible, uint32_t count)
+{
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Vec3D center = { spheres[i].X, spheres[i].Y, spheres[i].Z };
+        visible[i] = (uint8_t)MathFrustumIntersectsSphere(frustum, &center,
+                                                          spheres[i].W);
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+static uint32_t
+ProjectSpheresScalar(const float *x, const float *y, const float *z,
+                     const float *radius, const Mat4X4 *view,
+                     const Mat4X4 *proj, float zNear, float zFar,
+                     Vec4D *ndcRects, Vec2D *depthRanges, uint8_t *visible,
+                     uint32_t count)
+{
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const float vx = x[i] * view->A00 + y[i] * view->A10
+                         + z[i] * view->A20 + view->A30;
+        const float vy = x[i] * view->A01 + y[i] * view->A11
+                         + z[i] * view->A21 + view->A31;
+        const float vz = x[i] * view->A02 + y[i] * view->A12
+                         + z[i] * view->A22 + view->A32;
+        const float r = radius[i];
+        const float nearZ = fmaxf(vz - r, zNear);
+        const float farZ = fmaxf(vz + r, zNear);
+        // x / z over the view space box of the sphere is extreme at its
+        // corners
+        const float invNear = 1.0f / nearZ;
+        const float invFar = 1.0f / farZ;
+        const float minX
+            = fminf((vx - r) * invNear, (vx - r) * invFar) * proj->A00
+              + proj->A20;
+        const float maxX
+            = fmaxf((vx + r) * invNear, (vx + r) * invFar) * proj->A00
+              + proj->A20;
+        const float minY
+            = fminf((vy - r) * invNear, (vy - r) * invFar) * proj->A11
+              + proj->A21;
+        const float maxY
+            = fmaxf((vy + r) * invNear, (vy + r) * invFar) * proj->A11
+              + proj->A21;
+        ndcRects[i] = MathVec4DFromXYZW(minX, minY, maxX, maxY);
+        depthRanges[i].X = nearZ;
+        depthRanges[i].Y = farZ;
+        visible[i] = vz + r >= zNear && vz - r <= zFar && minX <= 1.0f
+                     && maxX >= -1.0f && minY <= 1.0f && maxY >= -1.0f;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+static uint32_t
+FrustumCullObbsScalar(const Frustum *frustum, const Obb *obbs,
+                      uint8_t *visible, uint32_t count)
+{
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Obb *obb = obbs + i;
+        visible[i] = 1;
+        for (uint32_t p = 0; p < 6; ++p) {
+            const Vec4D *plane = frustum->planes + p;
+            const Vec3D normal = { plane->X, plane->Y, plane->Z };
+            const float distance
+                = MathVec3DDot(&normal, &obb->center) + plane->W;
+            const float radius
+                = fabsf(MathVec3DDot(&normal, &obb->halfAxes[0]))
+                  + fabsf(MathVec3DDot(&normal, &obb->halfAxes[1]))
+                  + fabsf(MathVec3DDot(&normal, &obb->halfAxes[2]));
+            if (distance + radius < 0.0f) {
+                visible[i] = 0;
+                break;
+            }
+        }
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+static void
+QuatToMat4X4ArrayScalar(const Quat *quats, Mat4X4 *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        const Quat q = quats[i];
+        const float x2 = q.X + q.X;
+        const float y2 = q.Y + q.Y;
+        const float z2 = q.Z + q.Z;
+        const float xx = q.X * x2, yy = q.Y * y2, zz = q.Z * z2;
+        const float xy = q.X * y2, xz = q.X * z2, yz = q.Y * z2;
+        const float wx = q.W * x2, wy = q.W * y2, wz = q.W * z2;
+        Mat4X4 *m = out + i;
+        m->A00 = 1.0f - yy - zz;
+        m->A01 = xy + wz;
+        m->A02 = xz - wy;
+        m->A03 = 0.0f;
+        m->A10 = xy - wz;
+        m->A11 = 1.0f - xx - zz;
+        m->A12 = yz + wx;
+        m->A13 = 0.0f;
+        m->A20 = xz + wy;
+        m->A21 = yz - wx;
+        m->A22 = 1.0f - xx - yy;
+        m->A23 = 0.0f;
+        m->A30 = 0.0f;
+        m->A31 = 0.0f;
+        m->A32 = 0.0f;
+        m->A33 = 1.0f;
+    }
+}
+
+// *** SIMD kernels ***
+// Matrices are not required to be aligned, all loads are unaligned.
+// Rows of mat are broadcast and scaled by the components of the left hand
+// vector, which is how row vector times matrix maps to SIMD lanes.
+#if MATH_X86
+
+#define MATH_SHUFFLE(v, x, y, z, w)                                           \
+    _mm_shuffle_ps(v, v, _MM_SHUFFLE(w, z, y, x))
+
+static inline __m128
+MultRowByMat4X4SSE(__m128 row, __m128 m0, __m128 m1, __m128 m2, __m128 m3)
+{
+    __m128 res = _mm_mul_ps(MATH_SHUFFLE(row, 0, 0, 0, 0), m0);
+    res = _mm_add_ps(res, _mm_mul_ps(MATH_SHUFFLE(row, 1, 1, 1, 1), m1));
+    res = _mm_add_ps(res, _mm_mul_ps(MATH_SHUFFLE(row, 2, 2, 2, 2), m2));
+    return _mm_add_ps(res, _mm_mul_ps(MATH_SHUFFLE(row, 3, 3, 3, 3), m3));
+}
+
+static Vec4D
+MultVec4DByMat4X4SSE(const Vec4D *vec, const Mat4X4 *mat)
+{
+    Vec4D res;
+    _mm_storeu_ps(&res.X, MultRowByMat4X4SSE(
+                              _mm_loadu_ps(&vec->X), _mm_loadu_ps(mat->A[0]),
+                              _mm_loadu_ps(mat->A[1]), _mm_loadu_ps(mat->A[2]),
+                              _mm_loadu_ps(mat->A[3])));
+    return res;
+}
+
+// All rows are loaded before storing, so out may alias mat1
+static inline void
+MultMat4X4SSE(const Mat4X4 *mat1, __m128 m0, __m128 m1, __m128 m2,
+              __m128 m3, Mat4X4 *out)
+{
+    const __m128 r0 = _mm_loadu_ps(mat1->A[0]);
+    const __m128 r1 = _mm_loadu_ps(mat1->A[1]);
+    const __m128 r2 = _mm_loadu_ps(mat1->A[2]);
+    const __m128 r3 = _mm_loadu_ps(mat1->A[3]);
+    _mm_storeu_ps(out->A[0], MultRowByMat4X4SSE(r0, m0, m1, m2, m3));
+    _mm_storeu_ps(out->A[1], MultRowByMat4X4SSE(r1, m0, m1, m2, m3));
+    _mm_storeu_ps(out->A[2], MultRowByMat4X4SSE(r2, m0, m1, m2, m3));
+    _mm_storeu_ps(out->A[3], MultRowByMat4X4SSE(r3, m0, m1, m2, m3));
+}
+
+static Mat4X4
+MultMat4X4ByMat4X4SSE(const Mat4X4 *mat1, const Mat4X4 *mat2)
+{
+    Mat4X4 res;
+    MultMat4X4SSE(mat1, _mm_loadu_ps(mat2->A[0]), _mm_loadu_ps(mat2->A[1]),
+                  _mm_loadu_ps(mat2->A[2]), _mm_loadu_ps(mat2->A[3]), &res);
+    return res;
+}
+
+static void
+MultMat4X4ArrayByMat4X4SSE(const Mat4X4 *mats, const Mat4X4 *mat,
+                           Mat4X4 *out, uint32_t count)
+{
+    const __m128 m0 = _mm_loadu_ps(mat->A[0]);
+    const __m128 m1 = _mm_loadu_ps(mat->A[1]);
+    const __m128 m2 = _mm_loadu_ps(mat->A[2]);
+    const __m128 m3 = _mm_loadu_ps(mat->A[3]);
+    for (uint32_t i = 0; i < count; ++i) {
+        MultMat4X4SSE(mats + i, m0, m1, m2, m3, out + i);
+    }
+}
+
+static void
+MultVec4DArrayByMat4X4SSE(const Vec4D *vecs, const Mat4X4 *mat, Vec4D *out,
+                          uint32_t count)
+{
+    const __m128 m0 = _mm_loadu_ps(mat->A[0]);
+    const __m128 m1 = _mm_loadu_ps(mat->A[1]);
+    const __m128 m2 = _mm_loadu_ps(mat->A[2]);
+    const __m128 m3 = _mm_loadu_ps(mat->A[3]);
+    for (uint32_t i = 0; i < count; ++i) {
+        _mm_storeu_ps(&out[i].X,
+                      MultRowByMat4X4SSE(_mm_loadu_ps(&vecs[i].X), m0, m1,
+                                         m2, m3));
+    }
+}
+
+static void
+TransformPointsSSE(const Vec3D *points, const Mat4X4 *mat, Vec3D *out,
+                   uint32_t count)
+{
+    const __m128 m0 = _mm_loadu_ps(mat->A[0]);
+    const __m128 m1 = _mm_loadu_ps(mat->A[1]);
+    const __m128 m2 = _mm_loadu_ps(mat->A[2]);
+    const __m128 m3 = _mm_loadu_ps(mat->A[3]);
+    for (uint32_t i = 0; i < count; ++i) {
+        __m128 res = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(points[i].X), m0), m3);
+        res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(points[i].Y), m1));
+        res = _mm_add_ps(res, _mm_mul_ps(_mm_set1_ps(points[i].Z), m2));
+        float r[4];
+        _mm_storeu_ps(r, res);
+        out[i].X = r[0];
+        out[i].Y = r[1];
+        out[i].Z = r[2];
+    }
+}
+
+// Frustum planes in structure of arrays form, plane i is lane i % 4 of
+// group i / 4. Lanes past the sixth plane never cull.
+struct FrustumPlanesSSE {
+    __m128 x[2];
+    __m128 y[2];
+    __m128 z[2];
+    __m128 w[2];
+};
+
+static void
+LoadFrustumPlanesSSE(const Frustum *frustum, struct FrustumPlanesSSE *out)
+{
+    const Vec4D *p = frustum->planes;
+    out->x[0] = _mm_setr_ps(p[0].X, p[1].X, p[2].X, p[3].X);
+    out->y[0] = _mm_setr_ps(p[0].Y, p[1].Y, p[2].Y, p[3].Y);
+    out->z[0] = _mm_setr_ps(p[0].Z, p[1].Z, p[2].Z, p[3].Z);
+    out->w[0] = _mm_setr_ps(p[0].W, p[1].W, p[2].W, p[3].W);
+    out->x[1] = _mm_setr_ps(p[4].X, p[5].X, 0.0f, 0.0f);
+    out->y[1] = _mm_setr_ps(p[4].Y, p[5].Y, 0.0f, 0.0f);
+    out->z[1] = _mm_setr_ps(p[4].Z, p[5].Z, 0.0f, 0.0f);
+    out->w[1] = _mm_setr_ps(p[4].W, p[5].W, 1.0f, 1.0f);
+}
+
+// Tests four spheres at a time against one plane per step
+static uint32_t
+FrustumCullSpheresSSE(const Frustum *frustum, const Vec4D *spheres,
+                      uint8_t *visible, uint32_t count)
+{
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (uint32_t p = 0; p < 6; ++p) {
+        px[p] = _mm_set1_ps(frustum->planes[p].X);
+        py[p] = _mm_set1_ps(frustum->planes[p].Y);
+        pz[p] = _mm_set1_ps(frustum->planes[p].Z);
+        pw[p] = _mm_set1_ps(frustum->planes[p].W);
+    }
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    uint32_t numVisible = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&spheres[i].X);
+        __m128 y = _mm_loadu_ps(&spheres[i + 1].X);
+        __m128 z = _mm_loadu_ps(&spheres[i + 2].X);
+        __m128 r = _mm_loadu_ps(&spheres[i + 3].X);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        const __m128 negRadius = _mm_xor_ps(r, signMask);
+        __m128 outside = _mm_setzero_ps();
+        for (uint32_t p = 0; p < 6; ++p) {
+            __m128 d = _mm_mul_ps(px[p], x);
+            d = _mm_add_ps(d, _mm_mul_ps(py[p], y));
+            d = _mm_add_ps(d, _mm_mul_ps(pz[p], z));
+            d = _mm_add_ps(d, pw[p]);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negRadius));
+        }
+        const int mask = _mm_movemask_ps(outside);
+        for (uint32_t k = 0; k < 4; ++k) {
+            visible[i + k] = !(mask & (1 << k));
+            numVisible += visible[i + k];
+        }
+    }
+    return numVisible
+           + FrustumCullSpheresScalar(frustum, spheres + i, visible + i,
+                                      count - i);
+}
+
+// Projects four spheres at a time, lanes are spheres
+static uint32_t
+ProjectSpheresSSE(const float *x, const float *y, const float *z,
+                  const float *radius, const Mat4X4 *view, const Mat4X4 *proj,
+                  float zNear, float zFar, Vec4D *ndcRects, Vec2D *depthRanges,
+                  uint8_t *visible, uint32_t count)
+{
+    __m128 v[4][3];
+    for (uint32_t row = 0; row < 4; ++row) {
+        for (uint32_t col = 0; col < 3; ++col) {
+            v[row][col] = _mm_set1_ps(view->A[row][col]);
+        }
+    }
+    const __m128 p00 = _mm_set1_ps(proj->A00);
+    const __m128 p20 = _mm_set1_ps(proj->A20);
+    const __m128 p11 = _mm_set1_ps(proj->A11);
+    const __m128 p21 = _mm_set1_ps(proj->A21);
+    const __m128 nearPlane = _mm_set1_ps(zNear);
+    const __m128 farPlane = _mm_set1_ps(zFar);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    uint32_t numVisible = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        const __m128 r = _mm_loadu_ps(radius + i);
+        __m128 vc[3];
+        for (uint32_t col = 0; col < 3; ++col) {
+            __m128 c = _mm_add_ps(_mm_mul_ps(px, v[0][col]), v[3][col]);
+            c = _mm_add_ps(c, _mm_mul_ps(py, v[1][col]));
+            vc[col] = _mm_add_ps(c, _mm_mul_ps(pz, v[2][col]));
+        }
+        const __m128 backZ = _mm_sub_ps(vc[2], r);
+        const __m128 frontZ = _mm_add_ps(vc[2], r);
+        const __m128 nearZ = _mm_max_ps(backZ, nearPlane);
+        const __m128 farZ = _mm_max_ps(frontZ, nearPlane);
+        const __m128 invNear = _mm_div_ps(one, nearZ);
+        const __m128 invFar = _mm_div_ps(one, farZ);
+        const __m128 lowX = _mm_sub_ps(vc[0], r);
+        const __m128 highX = _mm_add_ps(vc[0], r);
+        const __m128 lowY = _mm_sub_ps(vc[1], r);
+        const __m128 highY = _mm_add_ps(vc[1], r);
+        __m128 minX = _mm_min_ps(_mm_mul_ps(lowX, invNear),
+                                 _mm_mul_ps(lowX, invFar));
+        __m128 maxX = _mm_max_ps(_mm_mul_ps(highX, invNear),
+                                 _mm_mul_ps(highX, invFar));
+        __m128 minY = _mm_min_ps(_mm_mul_ps(lowY, invNear),
+                                 _mm_mul_ps(lowY, invFar));
+        __m128 maxY = _mm_max_ps(_mm_mul_ps(highY, invNear),
+                                 _mm_mul_ps(highY, invFar));
+        minX = _mm_add_ps(_mm_mul_ps(minX, p00), p20);
+        maxX = _mm_add_ps(_mm_mul_ps(maxX, p00), p20);
+        minY = _mm_add_ps(_mm_mul_ps(minY, p11), p21);
+        maxY = _mm_add_ps(_mm_mul_ps(maxY, p11), p21);
+
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(frontZ, nearPlane),
+                                   _mm_cmple_ps(backZ, farPlane));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(minX, one));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(maxX, minusOne));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(minY, one));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(maxY, minusOne));
+        const int mask = _mm_movemask_ps(inside);
+        for (uint32_t k = 0; k < 4; ++k) {
+            visible[i + k] = (mask >> k) & 1;
+            numVisible += visible[i + k];
+        }
+
+        _MM_TRANSPOSE4_PS(minX, minY, maxX, maxY);
+        _mm_storeu_ps(&ndcRects[i].X, minX);
+        _mm_storeu_ps(&ndcRects[i + 1].X, minY);
+        _mm_storeu_ps(&ndcRects[i + 2].X, maxX);
+        _mm_storeu_ps(&ndcRects[i + 3].X, maxY);
+        // Vec2D pairs are contiguous, interleave near and far
+        _mm_storeu_ps(&depthRanges[i].X, _mm_unpacklo_ps(nearZ, farZ));
+        _mm_storeu_ps(&depthRanges[i + 2].X, _mm_unpackhi_ps(nearZ, farZ));
+    }
+    return numVisible
+           + ProjectSpheresScalar(x + i, y + i, z + i, radius + i, view, proj,
+                                  zNear, zFar, ndcRects + i, depthRanges + i,
+                                  visible + i, count - i);
+}
+
+// Tests one box at a time against four planes per step
+static uint32_t
+FrustumCullObbsSSE(const Frustum *frustum, const Obb *obbs, uint8_t *visible,
+                   uint32_t count)
+{
+    struct FrustumPlanesSSE planes;
+    LoadFrustumPlanesSSE(frustum, &planes);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const Obb *obb = obbs + i;
+        int outside = 0;
+        for (uint32_t g = 0; g < 2; ++g) {
+            // signed distance of the center
+            __m128 d = _mm_mul_ps(planes.x[g], _mm_set1_ps(obb->center.X));
+            d = _mm_add_ps(
+                d, _mm_mul_ps(planes.y[g], _mm_set1_ps(obb->center.Y)));
+            d = _mm_add_ps(
+                d, _mm_mul_ps(planes.z[g], _mm_set1_ps(obb->center.Z)));
+            d = _mm_add_ps(d, planes.w[g]);
+            // extent of the box along the plane normal
+            __m128 r = _mm_setzero_ps();
+            for (uint32_t a = 0; a < 3; ++a) {
+                const Vec3D *axis = obb->halfAxes + a;
+                __m128 e = _mm_mul_ps(planes.x[g], _mm_set1_ps(axis->X));
+                e = _mm_add_ps(e,
+                               _mm_mul_ps(planes.y[g], _mm_set1_ps(axis->Y)));
+                e = _mm_add_ps(e,
+                               _mm_mul_ps(planes.z[g], _mm_set1_ps(axis->Z)));
+                r = _mm_add_ps(r, _mm_and_ps(e, absMask));
+            }
+            outside |= _mm_movemask_ps(
+                _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        visible[i] = !outside;
+        numVisible += visible[i];
+    }
+    return numVisible;
+}
+
+// Converts four quaternions at a time in structure of arrays form
+static void
+QuatToMat4X4ArraySSE(const Quat *quats, Mat4X4 *out, uint32_t count)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lastRow = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(&quats[i].X);
+        __m128 y = _mm_loadu_ps(&quats[i + 1].X);
+        __m128 z = _mm_loadu_ps(&quats[i + 2].X);
+        __m128 w = _mm_loadu_ps(&quats[i + 3].X);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        const __m128 x2 = _mm_add_ps(x, x);
+        const __m128 y2 = _mm_add_ps(y, y);
+        const __m128 z2 = _mm_add_ps(z, z);
+        const __m128 xx = _mm_mul_ps(x, x2);
+        const __m128 yy = _mm_mul_ps(y, y2);
+        const __m128 zz = _mm_mul_ps(z, z2);
+        const __m128 xy = _mm_mul_ps(x, y2);
+        const __m128 xz = _mm_mul_ps(x, z2);
+        const __m128 yz = _mm_mul_ps(y, z2);
+        const __m128 wx = _mm_mul_ps(w, x2);
+        const __m128 wy = _mm_mul_ps(w, y2);
+        const __m128 wz = _mm_mul_ps(w, z2);
+        __m128 rows[3][4] = {
+            { _mm_sub_ps(_mm_sub_ps(one, yy), zz), _mm_add_ps(xy, wz),
+              _mm_sub_ps(xz, wy), zero },
+            { _mm_sub_ps(xy, wz), _mm_sub_ps(_mm_sub_ps(one, xx), zz),
+              _mm_add_ps(yz, wx), zero },
+            { _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx),
+              _mm_sub_ps(_mm_sub_ps(one, xx), yy), zero },
+        };
+        for (uint32_t r = 0; r < 3; ++r) {
+            _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+            for (uint32_t k = 0; k < 4; ++k) {
+                _mm_storeu_ps(out[i + k].A[r], rows[r][k]);
+            }
+        }
+        for (uint32_t k = 0; k < 4; ++k) {
+            _mm_storeu_ps(out[i + k].A[3], lastRow);
+        }
+    }
+    QuatToMat4X4ArrayScalar(quats + i, out + i, count - i);
+}
+
+// 2x2 matrices are stored as (m00, m01, m10, m11)
+static inline __m128
+Mat2Mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, MATH_SHUFFLE(b, 0, 3, 0, 3)),
+                      _mm_mul_ps(MATH_SHUFFLE(a, 1, 0, 3, 2),
+                                 MATH_SHUFFLE(b, 2, 1, 2, 1)));
+}
+
+// adj(a) * b
+static inline __m128
+Mat2AdjMul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(MATH_SHUFFLE(a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(MATH_SHUFFLE(a, 1, 1, 2, 2),
+                                 MATH_SHUFFLE(b, 2, 3, 0, 1)));
+}
+
+// a * adj(b)
+static inline __m128
+Mat2MulAdj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, MATH_SHUFFLE(b, 3, 0, 3, 0)),
+                      _mm_mul_ps(MATH_SHUFFLE(a, 1, 0, 3, 2),
+                                 MATH_SHUFFLE(b, 2, 1, 2, 1)));
+}
+
+// Block wise inverse of 2x2 sub-matrices A B / C D, see Eric Zhang, "Fast
+// 4x4 Matrix Inverse with SSE SIMD, Explained". Singular matrices give zero
+// matrix like gluInvertMatrix.
+static Mat4X4
+InverseSSE(const Mat4X4 *mat)
+{
+    const __m128 r0 = _mm_loadu_ps(mat->A[0]);
+    const __m128 r1 = _mm_loadu_ps(mat->A[1]);
+    const __m128 r2 = _mm_loadu_ps(mat->A[2]);
+    const __m128 r3 = _mm_loadu_ps(mat->A[3]);
+    const __m128 a = _mm_movelh_ps(r0, r1);
+    const __m128 b = _mm_movehl_ps(r1, r0);
+    const __m128 c = _mm_movelh_ps(r2, r3);
+    const __m128 d = _mm_movehl_ps(r3, r2);
+
+    // (|A|, |B|, |C|, |D|)
+    const __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)),
+                   _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)),
+                   _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+    const __m128 detA = MATH_SHUFFLE(detSub, 0, 0, 0, 0);
+    const __m128 detB = MATH_SHUFFLE(detSub, 1, 1, 1, 1);
+    const __m128 detC = MATH_SHUFFLE(detSub, 2, 2, 2, 2);
+    const __m128 detD = MATH_SHUFFLE(detSub, 3, 3, 3, 3);
+
+    const __m128 dc = Mat2AdjMul(d, c);
+    const __m128 ab = Mat2AdjMul(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Mat2Mul(b, dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Mat2Mul(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), Mat2MulAdj(d, ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), Mat2MulAdj(a, dc));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+    __m128 tr = _mm_mul_ps(ab, MATH_SHUFFLE(dc, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, MATH_SHUFFLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, MATH_SHUFFLE(tr, 1, 0, 3, 2));
+    const __m128 detM = _mm_sub_ps(
+        _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+    if (_mm_cvtss_f32(detM) == 0.0f) {
+        const Mat4X4 zero = { 0 };
+        return zero;
+    }
+
+    const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f),
+                                    detM);
+    x = _mm_mul_ps(x, rDetM);
+    y = _mm_mul_ps(y, rDetM);
+    z = _mm_mul_ps(z, rDetM);
+    w = _mm_mul_ps(w, rDetM);
+
+    Mat4X4 res;
+    _mm_storeu_ps(res.A[0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(res.A[1], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_storeu_ps(res.A[2], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(res.A[3], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return res;
+}
+
+// Two rows or two vectors are processed in the 128 bit halves of a 256 bit
+// register
+static inline MATH_TARGET_AVX2 __m256
+MultRowPairByMat4X4AVX2(__m256 rows, __m256 m0, __m256 m1, __m256 m2,
+                        __m256 m3)
+{
+    __m256 res = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), m0);
+    res = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0x55), m1, res);
+    res = _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xaa), m2, res);
+    return _mm256_fmadd_ps(_mm256_shuffle_ps(rows, rows, 0xff), m3, res);
+}
+
+static MATH_TARGET_AVX2 void
+MultMat4X4ArrayByMat4X4AVX2(const Mat4X4 *mats, const Mat4X4 *mat,
+                            Mat4X4 *out, uint32_t count)
+{
+    const __m256 m0 = _mm256_broadcast_ps((const __m128 *)mat->A[0]);
+    const __m256 m1 = _mm256_broadcast_ps((const __m128 *)mat->A[1]);
+    const __m256 m2 = _mm256_broadcast_ps((const __m128 *)mat->A[2]);
+    const __m256 m3 = _mm256_broadcast_ps((const __m128 *)mat->A[3]);
+    for (uint32_t i = 0; i < count; ++i) {
+        const __m256 r01 = _mm256_loadu_ps(mats[i].A[0]);
+        const __m256 r23 = _mm256_loadu_ps(mats[i].A[2]);
+        _mm256_storeu_ps(out[i].A[0],
+                         MultRowPairByMat4X4AVX2(r01, m0, m1, m2, m3));
+        _mm256_storeu_ps(out[i].A[2],
+                         MultRowPairByMat4X4AVX2(r23, m0, m1, m2, m3));
+    }
+}
+
+static MATH_TARGET_AVX2 Mat4X4
+MultMat4X4ByMat4X4AVX2(const Mat4X4 *mat1, const Mat4X4 *mat2)
+{
+    const __m256 m0 = _mm256_broadcast_ps((const __m128 *)mat2->A[0]);
+    const __m256 m1 = _mm256_broadcast_ps((const __m128 *)mat2->A[1]);
+    const __m256 m2 = _mm256_broadcast_ps((const __m128 *)mat2->A[2]);
+    const __m256 m3 = _mm256_broadcast_ps((const __m128 *)mat2->A[3]);
+    Mat4X4 res;
+    _mm256_storeu_ps(res.A[0],
+                     MultRowPairByMat4X4AVX2(_mm256_loadu_ps(mat1->A[0]), m0,
+                                             m1, m2, m3));
+    _mm256_storeu_ps(res.A[2],
+                     MultRowPairByMat4X4AVX2(_mm256_loadu_ps(mat1->A[2]), m0,
+                                             m1, m2, m3));
+    return res;
+}
+
+static MATH_TARGET_AVX2 void
+MultVec4DArrayByMat4X4AVX2(const Vec4D *vecs, const Mat4X4 *mat, Vec4D *out,
+                           uint32_t count)
+{
+    const __m256 m0 = _mm256_broadcast_ps((const __m128 *)mat->A[0]);
+    const __m256 m1 = _mm256_broadcast_ps((const __m128 *)mat->A[1]);
+    const __m256 m2 = _mm256_broadcast_ps((const __m128 *)mat->A[2]);
+    const __m256 m3 = _mm256_broadcast_ps((const __m128 *)mat->A[3]);
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm256_storeu_ps(&out[i].X,
+                         MultRowPairByMat4X4AVX2(_mm256_loadu_ps(&vecs[i].X),
+                                                 m0, m1, m2, m3));
+    }
+    if (i < count) {
+        MultVec4DArrayByMat4X4SSE(vecs + i, mat, out + i, count - i);
+    }
+}
+
+static MATH_TARGET_AVX2 void
+TransformPointsAVX2(const Vec3D *points, const Mat4X4 *mat, Vec3D *out,
+                    uint32_t count)
+{
+    const __m256 m0 = _mm256_broadcast_ps((const __m128 *)mat->A[0]);
+    const __m256 m1 = _mm256_broadcast_ps((const __m128 *)mat->A[1]);
+    const __m256 m2 = _mm256_broadcast_ps((const __m128 *)mat->A[2]);
+    const __m256 m3 = _mm256_broadcast_ps((const __m128 *)mat->A[3]);
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const Vec3D *p = points + i;
+        const __m256 x = _mm256_setr_m128(_mm_set1_ps(p[0].X),
+                                          _mm_set1_ps(p[1].X));
+        const __m256 y = _mm256_setr_m128(_mm_set1_ps(p[0].Y),
+                                          _mm_set1_ps(p[1].Y));
+        const __m256 z = _mm256_setr_m128(_mm_set1_ps(p[0].Z),
+                                          _mm_set1_ps(p[1].Z));
+        __m256 res = _mm256_fmadd_ps(x, m0, m3);
+        res = _mm256_fmadd_ps(y, m1, res);
+        res = _mm256_fmadd_ps(z, m2, res);
+        float r[8];
+        _mm256_storeu_ps(r, res);
+        out[i + 0] = (Vec3D){ r[0], r[1], r[2] };
+        out[i + 1] = (Vec3D){ r[4], r[5], r[6] };
+    }
+    if (i < count) {
+        TransformPointsSSE(points + i, mat, out + i, count - i);
+    }
+}
+
+#endif // MATH_X86
+
+struct MathKernels {
+    Vec4D (*multVec4DByMat4X4)(const Vec4D *vec, const Mat4X4 *mat);
+    Mat4X4 (*multMat4X4ByMat4X4)(const Mat4X4 *mat1, const Mat4X4 *mat2);
+    Mat4X4 (*inverse)(const Mat4X4 *mat);
+    void (*multMat4X4ArrayByMat4X4)(const Mat4X4 *mats, const Mat4X4 *mat,
+                                    Mat4X4 *out, uint32_t count);
+    void (*multVec4DArrayByMat4X4)(const Vec4D *vecs, const Mat4X4 *mat,
+                                   Vec4D *out, uint32_t count);
+    void (*transformPoints)(const Vec3D *points, const Mat4X4 *mat,
+                            Vec3D *out, uint32_t count);
+    void (*quatToMat4X4Array)(const Quat *quats, Mat4X4 *out, uint32_t count);
+    uint32_t (*frustumCullSpheres)(const Frustum *frustum,
+                                   const Vec4D *spheres, uint8_t *visible,
+                                   uint32_t count);
+    uint32_t (*frustumCullObbs)(const Frustum *frustum, const Obb *obbs,
+                                uint8_t *visible, uint32_t count);
+    uint32_t (*projectSpheres)(const float *x, const float *y, const float *z,
+                               const float *radius, const Mat4X4 *view,
+                               const Mat4X4 *proj, float zNear, float zFar,
+                               Vec4D *ndcRects, Vec2D *depthRanges,
+                               uint8_t *visible, uint32_t count);
+};
+
+static const struct MathKernels MATH_KERNELS[MATH_SIMD_COUNT] = {
+    [MATH_SIMD_SCALAR] = { MultVec4DByMat4X4Scalar, MultMat4X4ByMat4X4Scalar,
+                           InverseScalar, MultMat4X4ArrayByMat4X4Scalar,
+                           MultVec4DArrayByMat4X4Scalar,
+                           TransformPointsScalar, QuatToMat4X4ArrayScalar,
+                           FrustumCullSpheresScalar, FrustumCullObbsScalar,
+                           ProjectSpheresScalar },
+#if MATH_X86
+    [MATH_SIMD_SSE] = { MultVec4DByMat4X4SSE, MultMat4X4ByMat4X4SSE,
+                        InverseSSE, MultMat4X4ArrayByMat4X4SSE,
+                        MultVec4DArrayByMat4X4SSE, TransformPointsSSE,
+                        QuatToMat4X4ArraySSE, FrustumCullSpheresSSE,
+                        FrustumCullObbsSSE, ProjectSpheresSSE },
+    // single vectors gain nothing from 256 bit registers
+    [MATH_SIMD_AVX2] = { MultVec4DByMat4X4SSE, MultMat4X4ByMat4X4AVX2,
+                         InverseSSE, MultMat4X4ArrayByMat4X4AVX2,
+                         MultVec4DArrayByMat4X4AVX2, TransformPointsAVX2,
+                         QuatToMat4X4ArraySSE, FrustumCullSpheresSSE,
+                         FrustumCullObbsSSE, ProjectSpheresSSE },
+#endif
+};
+
+// NULL until first use, selection is idempotent so racing threads agree
+static const struct MathKernels *volatile g_mathKernels;
+static enum MathSimdLevel g_mathSimdLevel;
+
+enum MathSimdLevel
+MathGetSupportedSimdLevel(void)
+{
+#if MATH_X86
+#if _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        // OSXSAVE, AVX and FMA, then OS must save YMM state
+        const int hasAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28))
+                           && (info[2] & (1 << 12))
+                           && (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(info, 7, 0);
+        if (hasAvx && (info[1] & (1 << 5))) {
+            return MATH_SIMD_AVX2;
+        }
+    }
+#else
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return MATH_SIMD_AVX2;
+    }
+#endif
+    // SSE2 is part of x86-64 and required on 32 bit builds too
+    return MATH_SIMD_SSE;
+#else
+    return MATH_SIMD_SCALAR;
+#endif
+}
+
+enum MathSimdLevel
+MathSetSimdLevel(enum MathSimdLevel level)
+{
+    const enum MathSimdLevel supported = MathGetSupportedSimdLevel();
+    g_mathSimdLevel = level < supported ? level : supported;
+    g_mathKernels = &MATH_KERNELS[g_mathSimdLevel];
+    return g_mathSimdLevel;
+}
+
+enum MathSimdLevel
+MathGetSimdLevel(void)
+{
+    if (!g_mathKernels) {
+        MathSetSimdLevel(MATH_SIMD_COUNT);
+    }
+    return g_mathSimdLevel;
+}
+
+static const struct MathKernels *
+GetKernels(void)
+{
+    const struct MathKernels *kernels = g_mathKernels;
+    if (!kernels) {
+        MathSetSimdLevel(MATH_SIMD_COUNT);
+        kernels = g_mathKernels;
+    }
+    return kernels;
+}
+
+Vec4D
+MathMat4X4MultVec4DByMat4X4(const Vec4D *vec, const Mat4X4 *mat)
+{
+    return GetKernels()->multVec4DByMat4X4(vec, mat);
+}
+
+Mat4X4
+MathMat4X4MultMat4X4ByMat4X4(const Mat4X4 *mat1, const Mat4X4 *mat2)
+{
+    return GetKernels()->multMat4X4ByMat4X4(mat1, mat2);
+}
+
+Mat4X4
+MathMat4X4Inverse(const Mat4X4 *mat)
+{
+    return GetKernels()->inverse(mat);
+}
+
+void
+MathMat4X4MultMat4X4ArrayByMat4X4(const Mat4X4 *mats, const Mat4X4 *mat,
+                                  Mat4X4 *out, uint32_t count)
+{
+    GetKernels()->multMat4X4ArrayByMat4X4(mats, mat, out, count);
+}
+
+void
+MathMat4X4MultVec4DArrayByMat4X4(const Vec4D *vecs, const Mat4X4 *mat,
+                                 Vec4D *out, uint32_t count)
+{
+    GetKernels()->multVec4DArrayByMat4X4(vecs, mat, out, count);
+}
+
+void
+MathMat4X4TransformPoints(const Vec3D *points, const Mat4X4 *mat, Vec3D *out,
+                          uint32_t count)
+{
+    GetKernels()->transformPoints(points, mat, out, count);
+}
+
+Quat
+MathQuatIdentity(void)
+{
+    const Quat q = { 0.0f, 0.0f, 0.0f, 1.0f };
+    return q;
+}
+
+Quat
+MathQuatFromAxisAngle(const Vec3D *axis, float angle)
+{
+    const float s = sinf(angle * 0.5f);
+    const Quat q = { axis->X * s, axis->Y * s, axis->Z * s,
+                     cosf(angle * 0.5f) };
+    return q;
+}
+
+Quat
+MathQuatFromEuler(const Vec3D *angles)
+{
+    // roll, then pitch, then yaw like MathMat4X4RotateFromVec3D
+    const Vec3D xAxis = { 1.0f, 0.0f, 0.0f };
+    const Vec3D yAxis = { 0.0f, 1.0f, 0.0f };
+    const Vec3D zAxis = { 0.0f, 0.0f, 1.0f };
+    const Quat pitch = MathQuatFromAxisAngle(&xAxis, angles->X);
+    const Quat yaw = MathQuatFromAxisAngle(&yAxis, angles->Y);
+    const Quat roll = MathQuatFromAxisAngle(&zAxis, angles->Z);
+    const Quat q = MathQuatMultiply(&roll, &pitch);
+    return MathQuatMultiply(&q, &yaw);
+}
+
+Quat
+MathQuatMultiply(const Quat *q1, const Quat *q2)
+{
+    // Hamilton product q2 q1, so q1 is applied first
+    Quat out;
+    out.X = q2->W * q1->X + q2->X * q1->W + q2->Y * q1->Z - q2->Z * q1->Y;
+    out.Y = q2->W * q1->Y - q2->X * q1->Z + q2->Y * q1->W + q2->Z * q1->X;
+    out.Z = q2->W * q1->Z + q2->X * q1->Y - q2->Y * q1->X + q2->Z * q1->W;
+    out.W = q2->W * q1->W - q2->X * q1->X - q2->Y * q1->Y - q2->Z * q1->Z;
+    return out;
+}
+
+Quat
+MathQuatConjugate(const Quat *q)
+{
+    const Quat out = { -q->X, -q->Y, -q->Z, q->W };
+    return out;
+}
+
+void
+MathQuatNormalize(Quat *q)
+{
+    const float length
+        = sqrtf(q->X * q->X + q->Y * q->Y + q->Z * q->Z + q->W * q->W);
+    assert(!MathNearlyEqual(length, 0.0f));
+    q->X /= length;
+    q->Y /= length;
+    q->Z /= length;
+    q->W /= length;
+}
+
+Quat
+MathQuatSlerp(const Quat *q1, const Quat *q2, float t)
+{
+    float cosAngle
+        = q1->X * q2->X + q1->Y * q2->Y + q1->Z * q2->Z + q1->W * q2->W;
+    // q and -q are the same rotation, take the shorter arc
+    const float sign = cosAngle < 0.0f ? -1.0f : 1.0f;
+    cosAngle *= sign;
+    float w1 = 1.0f - t;
+    float w2 = t;
+    // sin of the angle vanishes for nearly equal rotations, lerp is exact
+    // enough there
+    if (cosAngle < 0.9995f) {
+        const float angle = acosf(cosAngle);
+        const float invSin = 1.0f / sinf(angle);
+        w1 = sinf((1.0f - t) * angle) * invSin;
+        w2 = sinf(t * angle) * invSin;
+    }
+    w2 *= sign;
+    Quat out = { w1 * q1->X + w2 * q2->X, w1 * q1->Y + w2 * q2->Y,
+                 w1 * q1->Z + w2 * q2->Z, w1 * q1->W + w2 * q2->W };
+    MathQuatNormalize(&out);
+    return out;
+}
+
+Vec3D
+MathQuatRotateVec3D(const Quat *q, const Vec3D *vec)
+{
+    // v + 2w (u x v) + 2 u x (u x v) with u the vector part
+    const Vec3D u = { q->X, q->Y, q->Z };
+    Vec3D t = MathVec3DCross(&u, vec);
+    t = MathVec3DModulateByScalar(&t, 2.0f);
+    const Vec3D ut = MathVec3DCross(&u, &t);
+    const Vec3D out = { vec->X + q->W * t.X + ut.X, vec->Y + q->W * t.Y + ut.Y,
+                        vec->Z + q->W * t.Z + ut.Z };
+    return out;
+}
+
+Mat4X4
+MathQuatToMat4X4(const Quat *q)
+{
+    Mat4X4 out;
+    QuatToMat4X4ArrayScalar(q, &out, 1);
+    return out;
+}
+
+void
+MathQuatToMat4X4Array(const Quat *quats, Mat4X4 *out, uint32_t count)
+{
+    GetKernels()->quatToMat4X4Array(quats, out, count);
+}
+
+void
+MathQuatRotateVec3DArray(const Quat *q, const Vec3D *vecs, Vec3D *out,
+                         uint32_t count)
+{
+    // one conversion, then the vectors go through the matrix kernels
+    const Mat4X4 rotation = MathQuatToMat4X4(q);
+    MathMat4X4TransformPoints(vecs, &rotation, out, count);
+}
+
+void
+MathQuatMultiplyArray(const Quat *quats, const Quat *q, Quat *out,
+                      uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        out[i] = MathQuatMultiply(quats + i, q);
+    }
+}
+
+uint32_t
+MathFrustumCullSpheres(const Frustum *frustum, const Vec4D *spheres,
+                       uint8_t *visible, uint32_t count)
+{
+    return GetKernels()->frustumCullSpheres(frustum, spheres, visible, count);
+}
+
+uint32_t
+MathFrustumCullObbs(const Frustum *frustum, const Obb *obbs, uint8_t *visible,
+                    uint32_t count)
+{
+    return GetKernels()->frustumCullObbs(frustum, obbs, visible, count);
+}
+
+uint32_t
+MathProjectSpheres(const float *x, const float *y, const float *z,
+                   const float *radius, const Mat4X4 *view, const Mat4X4 *proj,
+                   float zNear, float zFar, Vec4D *ndcRects,
+                   Vec2D *depthRanges, uint8_t *visible, uint32_t count)
+{
+    return GetKernels()->projectSpheres(x, y, z, radius, view, proj, zNear,
+                                        zFar, ndcRects, depthRanges, visible,
+                                        count);
+}
+
 #ifdef MATH_TEST
 void
 TestVec2D(void)
@@ -962,6 +2169,454 @@ TestMat4X4(void)
            && MathNearlyEqual(vec1.W, vec2.W));
 }
 
+void
+TestPacking(void)
+{
+    const float halves[] = { 0.0f, 1.0f, -2.5f, 0.5f, 65504.0f, 6.1035156e-5f,
+                             5.9604645e-8f };
+    for (uint32_t i = 0; i < sizeof(halves) / sizeof(halves[0]); ++i) {
+        assert(MathHalfToFloat(MathFloatToHalf(halves[i])) == halves[i]);
+    }
+    assert(MathFloatToHalf(1.0f) == 0x3c00);
+    assert(MathFloatToHalf(100000.0f) == 0x7c00);
+    // 1 + 2^-11 is halfway between two halves and rounds to even
+    assert(MathFloatToHalf(1.00048828125f) == 0x3c00);
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const float f = MathRandom(-1000.0f, 1000.0f);
+        const float h = MathHalfToFloat(MathFloatToHalf(f));
+        assert(fabsf(h - f) <= fabsf(f) / 2048.0f);
+    }
+
+    for (uint32_t i = 0; i < 1000; ++i) {
+        Vec3D n = { MathRandom(-1.0f, 1.0f), MathRandom(-1.0f, 1.0f),
+                    MathRandom(-1.0f, 1.0f) };
+        MathVec3DNormalize(&n);
+        const Vec2D e = MathOctEncode(&n);
+        assert(fabsf(e.X) <= 1.0f && fabsf(e.Y) <= 1.0f);
+        const Vec3D d = MathOctDecode(&e);
+        assert(MathVec3DDot(&n, &d) > 0.99999f);
+    }
+}
+
+void
+TestFrustum(void)
+{
+    const Vec3D eye = { 0.0f, 0.0f, -10.0f };
+    const Vec3D focus = { 0.0f, 0.0f, 0.0f };
+    const Vec3D up = { 0.0f, 1.0f, 0.0f };
+    const Mat4X4 view = MathMat4X4ViewAt(&eye, &focus, &up);
+    const Mat4X4 proj
+        = MathMat4X4PerspectiveFov(MathToRadians(90.0f), 1.0f, 0.1f, 100.0f);
+    const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+    const Frustum frustum = MathFrustumFromViewProj(&viewProj);
+
+    assert(MathFrustumIntersectsSphere(&frustum, &focus, 1.0f));
+    const Vec3D behind = { 0.0f, 0.0f, -20.0f };
+    assert(!MathFrustumIntersectsSphere(&frustum, &behind, 1.0f));
+    const Vec3D tooFar = { 0.0f, 0.0f, 200.0f };
+    assert(!MathFrustumIntersectsSphere(&frustum, &tooFar, 1.0f));
+    // 90 degrees fov, at distance 10 frustum spans -10..10
+    const Vec3D side = { 12.0f, 0.0f, 0.0f };
+    assert(!MathFrustumIntersectsSphere(&frustum, &side, 1.0f));
+    assert(MathFrustumIntersectsSphere(&frustum, &side, 2.0f));
+    const Vec3D top = { 0.0f, 9.0f, 0.0f };
+    assert(MathFrustumIntersectsSphere(&frustum, &top, 0.5f));
+    const Vec3D bottom = { 0.0f, -12.0f, 0.0f };
+    assert(!MathFrustumIntersectsSphere(&frustum, &bottom, 1.0f));
+
+    // cube just outside of the right plane, stretching it along x brings a
+    // corner inside
+    const Vec3D boundsMin = { -1.0f, -1.0f, -1.0f };
+    const Vec3D boundsMax = { 1.0f, 1.0f, 1.0f };
+    const Vec3D offset = { 12.2f, 0.0f, 0.0f };
+    Mat4X4 world = MathMat4X4TranslateFromVec3D(&offset);
+    Obb obbs[2];
+    obbs[0] = MathObbFromAabb(&boundsMin, &boundsMax, &world);
+    const Vec3D stretch = { 2.0f, 1.0f, 1.0f };
+    const Mat4X4 scale = MathMat4X4ScaleFromVec3D(&stretch);
+    world = MathMat4X4MultMat4X4ByMat4X4(&scale, &world);
+    obbs[1] = MathObbFromAabb(&boundsMin, &boundsMax, &world);
+    uint8_t visible[2];
+    assert(MathFrustumCullObbs(&frustum, obbs, visible, 2) == 1);
+    assert(!visible[0] && visible[1]);
+
+    // SIMD levels must agree with the scalar reference
+#define NUM_CULL_TESTS 255
+    Vec4D spheres[NUM_CULL_TESTS];
+    Obb boxes[NUM_CULL_TESTS];
+    uint8_t expectedSpheres[NUM_CULL_TESTS];
+    uint8_t expectedBoxes[NUM_CULL_TESTS];
+    for (uint32_t i = 0; i < NUM_CULL_TESTS; ++i) {
+        const Vec3D center = { MathRandom(-30.0f, 30.0f),
+                               MathRandom(-30.0f, 30.0f),
+                               MathRandom(-30.0f, 120.0f) };
+        spheres[i] = MathVec4DFromXYZW(center.X, center.Y, center.Z,
+                                       MathRandom(0.1f, 5.0f));
+        const Vec3D angles = { MathRandom(-3.14f, 3.14f),
+                               MathRandom(-3.14f, 3.14f),
+                               MathRandom(-3.14f, 3.14f) };
+        world = MathMat4X4RotateFromVec3D(&angles);
+        world.A30 = center.X;
+        world.A31 = center.Y;
+        world.A32 = center.Z;
+        boxes[i] = MathObbFromAabb(&boundsMin, &boundsMax, &world);
+        expectedSpheres[i] = (uint8_t)MathFrustumIntersectsSphere(
+            &frustum, &center, spheres[i].W);
+    }
+    MathSetSimdLevel(MATH_SIMD_SCALAR);
+    MathFrustumCullObbs(&frustum, boxes, expectedBoxes, NUM_CULL_TESTS);
+    const enum MathSimdLevel supported = MathGetSupportedSimdLevel();
+    for (uint32_t level = MATH_SIMD_SCALAR; level <= supported; ++level) {
+        MathSetSimdLevel(level);
+        uint8_t flags[NUM_CULL_TESTS];
+        uint32_t numVisible
+            = MathFrustumCullSpheres(&frustum, spheres, flags, NUM_CULL_TESTS);
+        uint32_t numExpected = 0;
+        for (uint32_t i = 0; i < NUM_CULL_TESTS; ++i) {
+            assert(flags[i] == expectedSpheres[i]);
+            numExpected += expectedSpheres[i];
+        }
+        assert(numVisible == numExpected);
+        numVisible = MathFrustumCullObbs(&frustum, boxes, flags,
+                                         NUM_CULL_TESTS);
+        numExpected = 0;
+        for (uint32_t i = 0; i < NUM_CULL_TESTS; ++i) {
+            assert(flags[i] == expectedBoxes[i]);
+            // box fits into its bounding sphere of radius sqrt(3)
+            const Vec3D center = { spheres[i].X, spheres[i].Y, spheres[i].Z };
+            assert(flags[i] <= MathFrustumIntersectsSphere(
+                                   &frustum, &center, sqrtf(3.0f) + 1e-4f));
+            numExpected += expectedBoxes[i];
+        }
+        assert(numVisible == numExpected);
+    }
+    MathSetSimdLevel(MATH_SIMD_COUNT);
+#undef NUM_CULL_TESTS
+}
+
+static int32_t
+IsNearlySame(const float *lhs, const float *rhs, uint32_t count)
+{
+    // FMA rounds once per multiply add, so results differ in the last bits
+    for (uint32_t i = 0; i < count; ++i) {
+        const float tolerance = 1e-4f * fmaxf(1.0f, fabsf(rhs[i]));
+        if (fabsf(lhs[i] - rhs[i]) > tolerance) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static Mat4X4
+RandomMat4X4(void)
+{
+    Mat4X4 mat;
+    for (uint32_t i = 0; i < 16; ++i) {
+        mat.A[i / 4][i % 4] = MathRandom(-10.0f, 10.0f);
+    }
+    return mat;
+}
+
+// Every SIMD level the CPU supports must match the scalar reference
+void
+TestSimdKernels(void)
+{
+#define NUM_SIMD_TESTS 64
+    Mat4X4 mats[NUM_SIMD_TESTS];
+    Vec4D vecs[NUM_SIMD_TESTS];
+    Vec3D points[NUM_SIMD_TESTS];
+    for (uint32_t i = 0; i < NUM_SIMD_TESTS; ++i) {
+        mats[i] = RandomMat4X4();
+        vecs[i] = MathVec4DFromXYZW(MathRandom(-10.0f, 10.0f),
+                                    MathRandom(-10.0f, 10.0f),
+                                    MathRandom(-10.0f, 10.0f),
+                                    MathRandom(-10.0f, 10.0f));
+        points[i] = MathVec3DFromXYZ(vecs[i].X, vecs[i].Y, vecs[i].Z);
+    }
+    const Mat4X4 mat = RandomMat4X4();
+    const Mat4X4 singular = { 0 };
+    float sphereX[NUM_SIMD_TESTS], sphereY[NUM_SIMD_TESTS],
+        sphereZ[NUM_SIMD_TESTS], sphereRadius[NUM_SIMD_TESTS];
+    for (uint32_t i = 0; i < NUM_SIMD_TESTS; ++i) {
+        sphereX[i] = MathRandom(-20.0f, 20.0f);
+        sphereY[i] = MathRandom(-20.0f, 20.0f);
+        sphereZ[i] = MathRandom(-10.0f, 60.0f);
+        sphereRadius[i] = MathRandom(0.1f, 5.0f);
+    }
+    const Mat4X4 view = MathMat4X4Identity();
+    const Mat4X4 proj
+        = MathMat4X4PerspectiveFov(MathToRadians(60.0f), 1.5f, 0.1f, 50.0f);
+    Vec4D refRects[NUM_SIMD_TESTS];
+    Vec2D refDepths[NUM_SIMD_TESTS];
+    uint8_t refVisible[NUM_SIMD_TESTS];
+    const uint32_t refNumVisible = ProjectSpheresScalar(
+        sphereX, sphereY, sphereZ, sphereRadius, &view, &proj, 0.1f, 50.0f,
+        refRects, refDepths, refVisible, NUM_SIMD_TESTS - 1);
+
+    const enum MathSimdLevel supported = MathGetSupportedSimdLevel();
+    for (uint32_t level = MATH_SIMD_SCALAR; level <= supported; ++level) {
+        assert(MathSetSimdLevel(level) == level);
+        Mat4X4 outMats[NUM_SIMD_TESTS];
+        Vec4D outVecs[NUM_SIMD_TESTS];
+        Vec3D outPoints[NUM_SIMD_TESTS];
+        // odd count covers tails of kernels that work on pairs
+        const uint32_t count = NUM_SIMD_TESTS - 1;
+        MathMat4X4MultMat4X4ArrayByMat4X4(mats, &mat, outMats, count);
+        MathMat4X4MultVec4DArrayByMat4X4(vecs, &mat, outVecs, count);
+        MathMat4X4TransformPoints(points, &mat, outPoints, count);
+        Vec4D rects[NUM_SIMD_TESTS];
+        Vec2D depths[NUM_SIMD_TESTS];
+        uint8_t visible[NUM_SIMD_TESTS];
+        assert(MathProjectSpheres(sphereX, sphereY, sphereZ, sphereRadius,
+                                  &view, &proj, 0.1f, 50.0f, rects, depths,
+                                  visible, count)
+               == refNumVisible);
+        for (uint32_t i = 0; i < count; ++i) {
+            assert(visible[i] == refVisible[i]);
+            assert(IsNearlySame(&rects[i].X, &refRects[i].X, 4));
+            assert(IsNearlySame(&depths[i].X, &refDepths[i].X, 2));
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            const Mat4X4 product = MultMat4X4ByMat4X4Scalar(mats + i, &mat);
+            const Mat4X4 single = MathMat4X4MultMat4X4ByMat4X4(mats + i, &mat);
+            assert(IsNearlySame(&single.A00, &product.A00, 16));
+            assert(IsNearlySame(&outMats[i].A00, &product.A00, 16));
+
+            const Vec4D vec = MultVec4DByMat4X4Scalar(vecs + i, &mat);
+            const Vec4D singleVec
+                = MathMat4X4MultVec4DByMat4X4(vecs + i, &mat);
+            assert(IsNearlySame(&singleVec.X, &vec.X, 4));
+            assert(IsNearlySame(&outVecs[i].X, &vec.X, 4));
+
+            Vec3D point;
+            TransformPointsScalar(points + i, &mat, &point, 1);
+            assert(IsNearlySame(&outPoints[i].X, &point.X, 3));
+
+            // inverse amplifies rounding, compare M * inv(M) with identity
+            const Mat4X4 inv = MathMat4X4Inverse(mats + i);
+            const Mat4X4 identity = MathMat4X4Identity();
+            const Mat4X4 check = MultMat4X4ByMat4X4Scalar(mats + i, &inv);
+            for (uint32_t k = 0; k < 16; ++k) {
+                assert(fabsf(check.A[k / 4][k % 4] - identity.A[k / 4][k % 4])
+                       < 1e-3f);
+            }
+        }
+        const Mat4X4 singularInv = MathMat4X4Inverse(&singular);
+        assert(IsNearlySame(&singularInv.A00, &singular.A00, 16));
+
+        // in place batches
+        Mat4X4 inPlace[2] = { mats[0], mats[1] };
+        MathMat4X4MultMat4X4ArrayByMat4X4(inPlace, &mat, inPlace, 2);
+        assert(IsNearlySame(&inPlace[1].A00, &outMats[1].A00, 16));
+    }
+    MathSetSimdLevel(MATH_SIMD_COUNT);
+#undef NUM_SIMD_TESTS
+}
+
+static float
+MaxDifference(const Mat4X4 *lhs, const Mat4X4 *rhs)
+{
+    float diff = 0.0f;
+    for (uint32_t i = 0; i < 16; ++i) {
+        diff = fmaxf(diff, fabsf(lhs->A[i / 4][i % 4] - rhs->A[i / 4][i % 4]));
+    }
+    return diff;
+}
+
+static Mat4X4
+RandomRotation(void)
+{
+    const Vec3D angles = { MathRandom(-3.14f, 3.14f),
+                           MathRandom(-3.14f, 3.14f),
+                           MathRandom(-3.14f, 3.14f) };
+    return MathMat4X4RotateFromVec3D(&angles);
+}
+
+void
+TestInverseTRS(void)
+{
+    const Mat4X4 identity = MathMat4X4Identity();
+    for (uint32_t i = 0; i < 256; ++i) {
+        const Vec3D translation = { MathRandom(-100.0f, 100.0f),
+                                    MathRandom(-100.0f, 100.0f),
+                                    MathRandom(-100.0f, 100.0f) };
+        const Vec3D scale = { MathRandom(0.1f, 10.0f),
+                              MathRandom(0.1f, 10.0f),
+                              MathRandom(0.1f, 10.0f) };
+        const Mat4X4 rotation = RandomRotation();
+        const Mat4X4 s = MathMat4X4ScaleFromVec3D(&scale);
+        const Mat4X4 t = MathMat4X4TranslateFromVec3D(&translation);
+        Mat4X4 world = MathMat4X4MultMat4X4ByMat4X4(&s, &rotation);
+        world = MathMat4X4MultMat4X4ByMat4X4(&world, &t);
+
+        const Mat4X4 inv = MathMat4X4InverseTRS(&translation, &rotation,
+                                                &scale);
+        const Mat4X4 check = MathMat4X4MultMat4X4ByMat4X4(&world, &inv);
+        assert(MaxDifference(&check, &identity) < 1e-4f);
+        const Mat4X4 general = MathMat4X4Inverse(&world);
+        assert(MaxDifference(&inv, &general) < 1e-3f);
+
+        Mat4X4 rigid = MathMat4X4MultMat4X4ByMat4X4(&rotation, &t);
+        const Mat4X4 rigidInv = MathMat4X4InverseRigid(&rigid);
+        rigid = MathMat4X4MultMat4X4ByMat4X4(&rigid, &rigidInv);
+        assert(MaxDifference(&rigid, &identity) < 1e-4f);
+    }
+
+    const Vec3D eye = { 4.6f, 9.6f, 6.9f };
+    const Vec3D focus = { 0.0f, 0.0f, 0.0f };
+    const Vec3D up = { 0.0f, 1.0f, 0.0f };
+    const Mat4X4 view = MathMat4X4ViewAt(&eye, &focus, &up);
+    const Mat4X4 invView = MathMat4X4InverseRigid(&view);
+    const Mat4X4 general = MathMat4X4Inverse(&view);
+    assert(MaxDifference(&invView, &general) < 1e-5f);
+    // camera sits at the origin of its inverse view
+    assert(fabsf(invView.A30 - eye.X) < 1e-4f
+           && fabsf(invView.A31 - eye.Y) < 1e-4f
+           && fabsf(invView.A32 - eye.Z) < 1e-4f);
+}
+
+static Quat
+RandomQuat(void)
+{
+    const Vec3D angles = { MathRandom(-3.14f, 3.14f),
+                           MathRandom(-3.14f, 3.14f),
+                           MathRandom(-3.14f, 3.14f) };
+    return MathQuatFromEuler(&angles);
+}
+
+void
+TestQuat(void)
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        const Vec3D angles = { MathRandom(-3.14f, 3.14f),
+                               MathRandom(-3.14f, 3.14f),
+                               MathRandom(-3.14f, 3.14f) };
+        const Quat q = MathQuatFromEuler(&angles);
+        const Mat4X4 rotation = MathQuatToMat4X4(&q);
+        const Mat4X4 euler = MathMat4X4RotateFromVec3D(&angles);
+        assert(MaxDifference(&rotation, &euler) < 1e-5f);
+
+        const Vec3D v = { MathRandom(-10.0f, 10.0f), MathRandom(-10.0f, 10.0f),
+                          MathRandom(-10.0f, 10.0f) };
+        const Vec3D rotated = MathQuatRotateVec3D(&q, &v);
+        const Vec4D v4 = { v.X, v.Y, v.Z, 0.0f };
+        const Vec4D expected = MathMat4X4MultVec4DByMat4X4(&v4, &euler);
+        assert(IsNearlySame(&rotated.X, &expected.X, 3));
+
+        // composition order matches matrices
+        const Quat q2 = RandomQuat();
+        const Quat composed = MathQuatMultiply(&q, &q2);
+        const Mat4X4 rotation2 = MathQuatToMat4X4(&q2);
+        const Mat4X4 product
+            = MathMat4X4MultMat4X4ByMat4X4(&rotation, &rotation2);
+        const Mat4X4 composedMat = MathQuatToMat4X4(&composed);
+        assert(MaxDifference(&composedMat, &product) < 1e-5f);
+
+        const Quat inv = MathQuatConjugate(&q);
+        const Quat identity = MathQuatMultiply(&q, &inv);
+        assert(fabsf(fabsf(identity.W) - 1.0f) < 1e-5f);
+
+        const Quat start = MathQuatSlerp(&q, &q2, 0.0f);
+        const Quat end = MathQuatSlerp(&q, &q2, 1.0f);
+        const float startDot = start.X * q.X + start.Y * q.Y + start.Z * q.Z
+                               + start.W * q.W;
+        const float endDot = end.X * q2.X + end.Y * q2.Y + end.Z * q2.Z
+                             + end.W * q2.W;
+        assert(fabsf(startDot) > 0.9999f && fabsf(endDot) > 0.9999f);
+    }
+
+    // halfway between identity and 90 degrees about y is 45 degrees
+    const Vec3D yAxis = { 0.0f, 1.0f, 0.0f };
+    const Quat identity = MathQuatIdentity();
+    const Quat quarter = MathQuatFromAxisAngle(&yAxis, MathToRadians(90.0f));
+    const Quat half = MathQuatSlerp(&identity, &quarter, 0.5f);
+    const Quat expected = MathQuatFromAxisAngle(&yAxis, MathToRadians(45.0f));
+    assert(IsNearlySame(&half.X, &expected.X, 4));
+
+#define NUM_QUAT_TESTS 31
+    Quat quats[NUM_QUAT_TESTS];
+    Vec3D vecs[NUM_QUAT_TESTS];
+    for (uint32_t i = 0; i < NUM_QUAT_TESTS; ++i) {
+        quats[i] = RandomQuat();
+        vecs[i] = MathVec3DFromXYZ(MathRandom(-10.0f, 10.0f),
+                                   MathRandom(-10.0f, 10.0f),
+                                   MathRandom(-10.0f, 10.0f));
+    }
+    const enum MathSimdLevel supported = MathGetSupportedSimdLevel();
+    for (uint32_t level = MATH_SIMD_SCALAR; level <= supported; ++level) {
+        MathSetSimdLevel(level);
+        Mat4X4 mats[NUM_QUAT_TESTS];
+        Vec3D rotated[NUM_QUAT_TESTS];
+        Quat composed[NUM_QUAT_TESTS];
+        MathQuatToMat4X4Array(quats, mats, NUM_QUAT_TESTS);
+        MathQuatRotateVec3DArray(quats, vecs, rotated, NUM_QUAT_TESTS);
+        MathQuatMultiplyArray(quats, quats + 1, composed, NUM_QUAT_TESTS);
+        for (uint32_t i = 0; i < NUM_QUAT_TESTS; ++i) {
+            const Mat4X4 mat = MathQuatToMat4X4(quats + i);
+            assert(IsNearlySame(&mats[i].A00, &mat.A00, 16));
+            const Vec3D v = MathQuatRotateVec3D(quats, vecs + i);
+            assert(IsNearlySame(&rotated[i].X, &v.X, 3));
+            const Quat q = MathQuatMultiply(quats + i, quats + 1);
+            assert(IsNearlySame(&composed[i].X, &q.X, 4));
+        }
+    }
+    MathSetSimdLevel(MATH_SIMD_COUNT);
+#undef NUM_QUAT_TESTS
+}
+
+// Inverts 1M decal like matrices with the general and specialized paths
+void
+BenchmarkInverse(void)
+{
+#define NUM_BENCHMARK_MATRICES (1024 * 1024)
+    Mat4X4 *worlds = malloc(sizeof(Mat4X4) * NUM_BENCHMARK_MATRICES);
+    Mat4X4 *rotations = malloc(sizeof(Mat4X4) * NUM_BENCHMARK_MATRICES);
+    Vec3D *translations = malloc(sizeof(Vec3D) * NUM_BENCHMARK_MATRICES);
+    Vec3D *scales = malloc(sizeof(Vec3D) * NUM_BENCHMARK_MATRICES);
+    Mat4X4 *out = malloc(sizeof(Mat4X4) * NUM_BENCHMARK_MATRICES);
+    for (uint32_t i = 0; i < NUM_BENCHMARK_MATRICES; ++i) {
+        rotations[i] = RandomRotation();
+        translations[i] = MathVec3DFromXYZ(MathRandom(-10.0f, 10.0f),
+                                           MathRandom(-10.0f, 10.0f),
+                                           MathRandom(-10.0f, 10.0f));
+        scales[i] = MathVec3DFromXYZ(MathRandom(0.5f, 2.0f),
+                                     MathRandom(0.5f, 2.0f),
+                                     MathRandom(0.5f, 2.0f));
+        const Mat4X4 s = MathMat4X4ScaleFromVec3D(scales + i);
+        const Mat4X4 t = MathMat4X4TranslateFromVec3D(translations + i);
+        worlds[i] = MathMat4X4MultMat4X4ByMat4X4(&s, rotations + i);
+        worlds[i] = MathMat4X4MultMat4X4ByMat4X4(worlds + i, &t);
+    }
+
+    clock_t start = clock();
+    for (uint32_t i = 0; i < NUM_BENCHMARK_MATRICES; ++i) {
+        out[i] = MathMat4X4Inverse(worlds + i);
+    }
+    const double general = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (uint32_t i = 0; i < NUM_BENCHMARK_MATRICES; ++i) {
+        out[i] = MathMat4X4InverseTRS(translations + i, rotations + i,
+                                      scales + i);
+    }
+    const double trs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (uint32_t i = 0; i < NUM_BENCHMARK_MATRICES; ++i) {
+        out[i] = MathMat4X4InverseRigid(rotations + i);
+    }
+    const double rigid = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("Inverse of %u matrices: general %.2f ms, TRS %.2f ms, rigid "
+           "%.2f ms (%f)\n",
+           NUM_BENCHMARK_MATRICES, general * 1000.0, trs * 1000.0,
+           rigid * 1000.0, out[NUM_BENCHMARK_MATRICES / 2].A00);
+
+    free(worlds);
+    free(rotations);
+    free(translations);
+    free(scales);
+    free(out);
+#undef NUM_BENCHMARK_MATRICES
+}
+
 void
 MathTest(void)
 {
@@ -969,5 +2624,11 @@ MathTest(void)
     TestVec3D();
     TestMat3X3();
     TestMat4X4();
+    TestPacking();
+    TestFrustum();
+    TestSimdKernels();
+    TestInverseTRS();
+    TestQuat();
+    BenchmarkInverse();
 }
 #endif
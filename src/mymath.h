@@ -44,6 +44,26 @@ typedef struct Mat4X4 {
     };
 } Mat4X4;
 
+// Rotation quaternion, W is the scalar part
+typedef struct Quat {
+    float X;
+    float Y;
+    float Z;
+    float W;
+} Quat;
+
+typedef struct Frustum {
+    // normalized planes with normals pointing inside, order is left, right,
+    // bottom, top, near, far
+    Vec4D planes[6];
+} Frustum;
+
+// Oriented box, center plus half extent vectors along its axes
+typedef struct Obb {
+    Vec3D center;
+    Vec3D halfAxes[3];
+} Obb;
+
 // *** 2D vector math ***
 Vec2D MathVec2DZero(void);
 
@@ -167,8 +187,126 @@ Mat4X4 MathMat4X4RotateY(float angle);
 Mat4X4 MathMat4X4PerspectiveFov(float fovAngleY, float aspectRatio,
                                 float nearZ, float farZ);
 
+// Singular matrix gives zero matrix
 Mat4X4 MathMat4X4Inverse(const Mat4X4 *mat);
 
+// Inverse of scale * rotation * translation built from its components, i.e.
+// inverse translation * transposed rotation * reciprocal scale. rotation
+// must be orthonormal and scale must not have zero components.
+Mat4X4 MathMat4X4InverseTRS(const Vec3D *translation, const Mat4X4 *rotation,
+                            const Vec3D *scale);
+
+// scale * rotation * translation without the matrix products
+Mat4X4 MathMat4X4ComposeTRS(const Vec3D *translation, const Mat4X4 *rotation,
+                            const Vec3D *scale);
+
+// Inverse of rotation * translation, e.g. a view matrix. Upper 3x3 must be
+// orthonormal.
+Mat4X4 MathMat4X4InverseRigid(const Mat4X4 *mat);
+
+// *** batched transforms ***
+// out[i] = mats[i] * mat, out may be mats
+void MathMat4X4MultMat4X4ArrayByMat4X4(const Mat4X4 *mats, const Mat4X4 *mat,
+                                       Mat4X4 *out, uint32_t count);
+
+// out[i] = vecs[i] * mat, out may be vecs
+void MathMat4X4MultVec4DArrayByMat4X4(const Vec4D *vecs, const Mat4X4 *mat,
+                                      Vec4D *out, uint32_t count);
+
+// Transforms points with w = 1 and drops w, meant for affine matrices
+void MathMat4X4TransformPoints(const Vec3D *points, const Mat4X4 *mat,
+                               Vec3D *out, uint32_t count);
+
+// out[i] = rotation matrix of quats[i]
+void MathQuatToMat4X4Array(const Quat *quats, Mat4X4 *out, uint32_t count);
+
+// out[i] = vecs[i] rotated by q, out may be vecs
+void MathQuatRotateVec3DArray(const Quat *q, const Vec3D *vecs, Vec3D *out,
+                              uint32_t count);
+
+// out[i] = quats[i] followed by q, out may be quats
+void MathQuatMultiplyArray(const Quat *quats, const Quat *q, Quat *out,
+                           uint32_t count);
+
+// *** SIMD dispatch ***
+// Matrix functions above run SSE or AVX2 kernels when CPU supports them,
+// chosen by CPUID on first use. Lower level can be forced, e.g. to compare
+// against the scalar reference.
+enum MathSimdLevel {
+    MATH_SIMD_SCALAR,
+    MATH_SIMD_SSE,
+    MATH_SIMD_AVX2,
+    MATH_SIMD_COUNT,
+};
+
+enum MathSimdLevel MathGetSupportedSimdLevel(void);
+
+// Clamps level to the supported one and returns the level that is used
+enum MathSimdLevel MathSetSimdLevel(enum MathSimdLevel level);
+
+enum MathSimdLevel MathGetSimdLevel(void);
+
+// *** quaternion math ***
+// Quaternions rotate like the matrices they convert to, i.e. v * M with M of
+// MathQuatToMat4X4. Angles are in radians.
+Quat MathQuatIdentity(void);
+
+// axis must be unit length
+Quat MathQuatFromAxisAngle(const Vec3D *axis, float angle);
+
+// Same rotation as MathMat4X4RotateFromVec3D
+Quat MathQuatFromEuler(const Vec3D *angles);
+
+// Rotation by q1 followed by q2, like MathMat4X4MultMat4X4ByMat4X4
+Quat MathQuatMultiply(const Quat *q1, const Quat *q2);
+
+// Inverse rotation of a unit quaternion
+Quat MathQuatConjugate(const Quat *q);
+
+void MathQuatNormalize(Quat *q);
+
+// Interpolates along the shorter arc, t in [0, 1]
+Quat MathQuatSlerp(const Quat *q1, const Quat *q2, float t);
+
+Vec3D MathQuatRotateVec3D(const Quat *q, const Vec3D *vec);
+
+Mat4X4 MathQuatToMat4X4(const Quat *q);
+
+// *** culling ***
+// Extracts planes of clip space volume of view * proj in world space
+Frustum MathFrustumFromViewProj(const Mat4X4 *viewProj);
+
+// Returns 0 if sphere is entirely outside of frustum
+int32_t MathFrustumIntersectsSphere(const Frustum *frustum,
+                                    const Vec3D *center, float radius);
+
+// Box boundsMin..boundsMax transformed by world
+Obb MathObbFromAabb(const Vec3D *boundsMin, const Vec3D *boundsMax,
+                    const Mat4X4 *world);
+
+// Sets visible[i] to 0 if sphere i (xyz center, w radius) is entirely
+// outside of frustum and to 1 otherwise. Returns number of visible spheres.
+// Spheres are tested four at a time when SIMD is available.
+uint32_t MathFrustumCullSpheres(const Frustum *frustum, const Vec4D *spheres,
+                                uint8_t *visible, uint32_t count);
+
+// Same for oriented boxes, every box is tested against four planes at once
+uint32_t MathFrustumCullObbs(const Frustum *frustum, const Obb *obbs,
+                             uint8_t *visible, uint32_t count);
+
+// Conservative screen and depth bounds of spheres for a perspective
+// projection without skew like MathMat4X4PerspectiveFov. ndcRects[i] is
+// (minX, minY, maxX, maxY) in normalized device coordinates and
+// depthRanges[i] the (min, max) view z clamped to zNear. Spheres outside of
+// zNear..zFar or of the -1..1 rectangle get visible[i] = 0. Centers and
+// radii are separate arrays so four spheres are projected at a time when
+// SIMD is available. Returns number of visible spheres.
+uint32_t MathProjectSpheres(const float *x, const float *y, const float *z,
+                            const float *radius, const Mat4X4 *view,
+                            const Mat4X4 *proj, float zNear, float zFar,
+                            Vec4D *ndcRects, Vec2D *depthRanges,
+                            uint8_t *visible, uint32_t count);
+
 // *** misc math helpers ***
 float MathClamp(float min, float max, float v);
 
@@ -182,6 +320,16 @@ int32_t MathIsNaN(float n);
 
 float MathRandom(float min, float max);
 
+// IEEE 754 binary16 conversion, rounds to nearest even
+uint16_t MathFloatToHalf(float f);
+
+float MathHalfToFloat(uint16_t h);
+
+// Octahedral mapping of unit vector to [-1, 1] square
+Vec2D MathOctEncode(const Vec3D *n);
+
+Vec3D MathOctDecode(const Vec2D *e);
+
 #ifdef MATH_TEST
 void MathTest(void);
 #endif
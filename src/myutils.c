@@ -10,6 +10,13 @@
 
 #if _WIN32
 #include <Windows.h>
+#include <psapi.h>
+#else
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #endif
 
 void
@@ -111,6 +118,889 @@ UtilsReadData(const char *filepath, unsigned int *bufferSize)
     return bytes;
 }
 
+int
+UtilsMapFile(const char *filepath, struct UtilsMappedFile *file)
+{
+    ZERO_MEMORY(file);
+#if _WIN32
+    HANDLE f = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (f == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER fileSize = { 0 };
+    if (!GetFileSizeEx(f, &fileSize)) {
+        CloseHandle(f);
+        return 0;
+    }
+    file->fileHandle = f;
+    file->size = fileSize.QuadPart;
+    if (file->size == 0) {
+        return 1;
+    }
+    HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        UtilsUnmapFile(file);
+        return 0;
+    }
+    file->mappingHandle = mapping;
+    file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!file->data) {
+        UtilsUnmapFile(file);
+        return 0;
+    }
+    return 1;
+#else
+    FILE *f = fopen(filepath, "rb");
+    if (!f) {
+        return 0;
+    }
+    struct stat sb;
+    if (fstat(fileno(f), &sb) == -1) {
+        fclose(f);
+        return 0;
+    }
+    file->size = sb.st_size;
+    if (file->size == 0) {
+        fclose(f);
+        return 1;
+    }
+    void *data
+        = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    // the mapping keeps its own reference to the file
+    fclose(f);
+    if (data == MAP_FAILED) {
+        file->size = 0;
+        return 0;
+    }
+    madvise(data, file->size, MADV_SEQUENTIAL);
+    file->data = data;
+    return 1;
+#endif
+}
+
+void
+UtilsUnmapFile(struct UtilsMappedFile *file)
+{
+#if _WIN32
+    if (file->data) {
+        UnmapViewOfFile(file->data);
+    }
+    if (file->mappingHandle) {
+        CloseHandle(file->mappingHandle);
+    }
+    if (file->fileHandle) {
+        CloseHandle(file->fileHandle);
+    }
+#else
+    if (file->data) {
+        munmap((void *)file->data, file->size);
+    }
+#endif
+    ZERO_MEMORY(file);
+}
+
+uint64_t
+UtilsHash64(const void *data, uint64_t size)
+{
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const unsigned char *bytes = data;
+    uint64_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash;
+}
+
+void
+UtilsRadixSort64(uint64_t *keys, uint32_t *values, uint32_t count,
+                 uint64_t *tmpKeys, uint32_t *tmpValues)
+{
+    uint32_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t digit = 0; digit < 8; ++digit) {
+            ++histograms[digit][(keys[i] >> (digit * 8)) & 0xff];
+        }
+    }
+    uint64_t *srcKeys = keys;
+    uint32_t *srcValues = values;
+    uint64_t *dstKeys = tmpKeys;
+    uint32_t *dstValues = tmpValues;
+    for (uint32_t digit = 0; digit < 8; ++digit) {
+        uint32_t *histogram = histograms[digit];
+        const uint32_t shift = digit * 8;
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < 256; ++bucket) {
+            const uint32_t bucketSize = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketSize;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t slot = histogram[(srcKeys[i] >> shift) & 0xff]++;
+            dstKeys[slot] = srcKeys[i];
+            dstValues[slot] = srcValues[i];
+        }
+        uint64_t *swapKeys = srcKeys;
+        srcKeys = dstKeys;
+        dstKeys = swapKeys;
+        uint32_t *swapValues = srcValues;
+        srcValues = dstValues;
+        dstValues = swapValues;
+    }
+    if (srcKeys != keys) {
+        memcpy(keys, srcKeys, sizeof(uint64_t) * count);
+        memcpy(values, srcValues, sizeof(uint32_t) * count);
+    }
+}
+
+double
+UtilsGetTimeInSeconds(void)
+{
+#if _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (!frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter = { 0 };
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+double
+UtilsGetThreadCpuTimeInSeconds(void)
+{
+#if _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime,
+                   &userTime);
+    const uint64_t kernel = ((uint64_t)kernelTime.dwHighDateTime << 32)
+                            | kernelTime.dwLowDateTime;
+    const uint64_t user
+        = ((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime;
+    // FILETIME is in 100 ns units
+    return (double)(kernel + user) * 1e-7;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+struct UtilsThread {
+#if _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    UtilsThreadFunc func;
+    void *arg;
+};
+
+#if _WIN32
+static DWORD WINAPI
+UtilsThreadEntry(LPVOID param)
+{
+    struct UtilsThread *thread = param;
+    thread->func(thread->arg);
+    return 0;
+}
+#else
+static void *
+UtilsThreadEntry(void *param)
+{
+    struct UtilsThread *thread = param;
+    thread->func(thread->arg);
+    return NULL;
+}
+#endif
+
+struct UtilsThread *
+UtilsThreadCreate(UtilsThreadFunc func, void *arg)
+{
+    struct UtilsThread *thread = malloc(sizeof *thread);
+    thread->func = func;
+    thread->arg = arg;
+#if _WIN32
+    thread->handle = CreateThread(NULL, 0, UtilsThreadEntry, thread, 0, NULL);
+    if (!thread->handle) {
+        UTILS_FATAL_ERROR("Failed to create thread. Error: %lu",
+                          GetLastError());
+    }
+#else
+    const int err
+        = pthread_create(&thread->handle, NULL, UtilsThreadEntry, thread);
+    if (err) {
+        UTILS_FATAL_ERROR("Failed to create thread. Error: %d", err);
+    }
+#endif
+    return thread;
+}
+
+void
+UtilsThreadJoin(struct UtilsThread *thread)
+{
+#if _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+uint32_t
+UtilsGetNumCpus(void)
+{
+#if _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (uint32_t)n : 1;
+#endif
+}
+
+uint32_t
+UtilsAtomicAdd32(volatile uint32_t *v, uint32_t add)
+{
+#if _WIN32
+    return (uint32_t)InterlockedExchangeAdd((volatile LONG *)v, (LONG)add);
+#else
+    return __atomic_fetch_add(v, add, __ATOMIC_SEQ_CST);
+#endif
+}
+
+uint32_t
+UtilsAtomicLoad32(const volatile uint32_t *v)
+{
+#if _WIN32
+    return (uint32_t)InterlockedCompareExchange((volatile LONG *)v, 0, 0);
+#else
+    return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void
+UtilsAtomicStore32(volatile uint32_t *v, uint32_t value)
+{
+#if _WIN32
+    InterlockedExchange((volatile LONG *)v, (LONG)value);
+#else
+    __atomic_store_n(v, value, __ATOMIC_RELEASE);
+#endif
+}
+
+void
+UtilsSleepMs(uint32_t ms)
+{
+#if _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void
+UtilsSpscQueueInit(struct UtilsSpscQueue *queue, uint32_t capacity)
+{
+    assert(capacity && (capacity & (capacity - 1)) == 0);
+    queue->items = malloc(sizeof(void *) * capacity);
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+void
+UtilsSpscQueueDeinit(struct UtilsSpscQueue *queue)
+{
+    free(queue->items);
+    memset(queue, 0, sizeof *queue);
+}
+
+int
+UtilsSpscQueuePush(struct UtilsSpscQueue *queue, void *item)
+{
+    // head and tail grow forever, unsigned overflow keeps difference valid
+    const uint32_t tail = queue->tail;
+    if (tail - UtilsAtomicLoad32(&queue->head) == queue->capacity) {
+        return 0;
+    }
+    queue->items[tail & (queue->capacity - 1)] = item;
+    UtilsAtomicStore32(&queue->tail, tail + 1);
+    return 1;
+}
+
+void *
+UtilsSpscQueuePop(struct UtilsSpscQueue *queue)
+{
+    const uint32_t head = queue->head;
+    if (head == UtilsAtomicLoad32(&queue->tail)) {
+        return NULL;
+    }
+    void *item = queue->items[head & (queue->capacity - 1)];
+    UtilsAtomicStore32(&queue->head, head + 1);
+    return item;
+}
+
+struct UtilsThreadPoolWorker {
+    struct UtilsThreadPool *pool;
+    struct UtilsThread *thread;
+    uint32_t threadIndex;
+};
+
+struct UtilsThreadPool {
+    struct UtilsThreadPoolWorker *workers;
+    uint32_t numWorkers;
+#if _WIN32
+    SRWLOCK lock;
+    CONDITION_VARIABLE wakeCond;
+    CONDITION_VARIABLE doneCond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t wakeCond;
+    pthread_cond_t doneCond;
+#endif
+    // bumped for every UtilsParallelFor, so that workers can tell new work
+    // from spurious wake ups
+    uint64_t generation;
+    int isShuttingDown;
+    uint32_t numBusyWorkers;
+
+    UtilsParallelForFunc func;
+    void *arg;
+    uint32_t count;
+    volatile uint32_t nextIndex;
+};
+
+static void
+UtilsThreadPoolLock(struct UtilsThreadPool *pool)
+{
+#if _WIN32
+    AcquireSRWLockExclusive(&pool->lock);
+#else
+    pthread_mutex_lock(&pool->lock);
+#endif
+}
+
+static void
+UtilsThreadPoolUnlock(struct UtilsThreadPool *pool)
+{
+#if _WIN32
+    ReleaseSRWLockExclusive(&pool->lock);
+#else
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+#if _WIN32
+#define UTILS_COND_WAIT(cond, pool)                                           \
+    SleepConditionVariableSRW(cond, &(pool)->lock, INFINITE, 0)
+#define UTILS_COND_BROADCAST(cond) WakeAllConditionVariable(cond)
+#else
+#define UTILS_COND_WAIT(cond, pool) pthread_cond_wait(cond, &(pool)->lock)
+#define UTILS_COND_BROADCAST(cond) pthread_cond_broadcast(cond)
+#endif
+
+static void
+UtilsThreadPoolRunItems(struct UtilsThreadPool *pool, uint32_t threadIndex)
+{
+    uint32_t i;
+    while ((i = UtilsAtomicAdd32(&pool->nextIndex, 1)) < pool->count) {
+        pool->func(pool->arg, i, threadIndex);
+    }
+}
+
+static void
+UtilsThreadPoolWorkerMain(void *arg)
+{
+    const struct UtilsThreadPoolWorker *worker = arg;
+    struct UtilsThreadPool *pool = worker->pool;
+    // worker may start after the first UtilsParallelFor was issued, so it
+    // must not sample generation here
+    uint64_t seenGeneration = 0;
+    UtilsThreadPoolLock(pool);
+    for (;;) {
+        while (pool->generation == seenGeneration && !pool->isShuttingDown) {
+            UTILS_COND_WAIT(&pool->wakeCond, pool);
+        }
+        if (pool->isShuttingDown) {
+            break;
+        }
+        seenGeneration = pool->generation;
+        UtilsThreadPoolUnlock(pool);
+
+        UtilsThreadPoolRunItems(pool, worker->threadIndex);
+
+        UtilsThreadPoolLock(pool);
+        if (--pool->numBusyWorkers == 0) {
+            UTILS_COND_BROADCAST(&pool->doneCond);
+        }
+    }
+    UtilsThreadPoolUnlock(pool);
+}
+
+struct UtilsThreadPool *
+UtilsThreadPoolCreate(uint32_t numThreads)
+{
+    if (numThreads == 0) {
+        numThreads = UtilsGetNumCpus();
+    }
+    struct UtilsThreadPool *pool = malloc(sizeof *pool);
+    memset(pool, 0, sizeof *pool);
+#if _WIN32
+    InitializeSRWLock(&pool->lock);
+    InitializeConditionVariable(&pool->wakeCond);
+    InitializeConditionVariable(&pool->doneCond);
+#else
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+#endif
+    pool->numWorkers = numThreads - 1;
+    pool->workers = malloc(sizeof(struct UtilsThreadPoolWorker) * numThreads);
+    for (uint32_t i = 0; i < pool->numWorkers; ++i) {
+        struct UtilsThreadPoolWorker *worker = pool->workers + i;
+        worker->pool = pool;
+        worker->threadIndex = i + 1;
+        worker->thread = UtilsThreadCreate(UtilsThreadPoolWorkerMain, worker);
+    }
+    return pool;
+}
+
+void
+UtilsThreadPoolDestroy(struct UtilsThreadPool *pool)
+{
+    if (!pool) {
+        return;
+    }
+    UtilsThreadPoolLock(pool);
+    pool->isShuttingDown = 1;
+    UTILS_COND_BROADCAST(&pool->wakeCond);
+    UtilsThreadPoolUnlock(pool);
+    for (uint32_t i = 0; i < pool->numWorkers; ++i) {
+        UtilsThreadJoin(pool->workers[i].thread);
+    }
+#if !_WIN32
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_cond_destroy(&pool->wakeCond);
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool->workers);
+    free(pool);
+}
+
+uint32_t
+UtilsThreadPoolGetNumThreads(const struct UtilsThreadPool *pool)
+{
+    return pool ? pool->numWorkers + 1 : 1;
+}
+
+void
+UtilsParallelFor(struct UtilsThreadPool *pool, uint32_t count,
+                 UtilsParallelForFunc func, void *arg)
+{
+    if (!pool || pool->numWorkers == 0 || count <= 1) {
+        for (uint32_t i = 0; i < count; ++i) {
+            func(arg, i, 0);
+        }
+        return;
+    }
+
+    UtilsThreadPoolLock(pool);
+    pool->func = func;
+    pool->arg = arg;
+    pool->count = count;
+    pool->nextIndex = 0;
+    pool->numBusyWorkers = pool->numWorkers;
+    ++pool->generation;
+    UTILS_COND_BROADCAST(&pool->wakeCond);
+    UtilsThreadPoolUnlock(pool);
+
+    UtilsThreadPoolRunItems(pool, 0);
+
+    UtilsThreadPoolLock(pool);
+    while (pool->numBusyWorkers > 0) {
+        UTILS_COND_WAIT(&pool->doneCond, pool);
+    }
+    UtilsThreadPoolUnlock(pool);
+}
+
+#define UTILS_ARENA_ALIGNMENT 16
+
+struct UtilsArenaBlock {
+    struct UtilsArenaBlock *prev;
+    uint64_t size;
+    uint64_t used;
+    // keeps data that follows the header aligned
+    uint64_t padding;
+};
+
+void
+UtilsArenaInit(struct UtilsArena *arena, uint64_t blockSize)
+{
+    memset(arena, 0, sizeof *arena);
+    arena->blockSize = blockSize;
+}
+
+void
+UtilsArenaDeinit(struct UtilsArena *arena)
+{
+    while (arena->current) {
+        struct UtilsArenaBlock *block = arena->current;
+        arena->current = block->prev;
+        free(block);
+    }
+    memset(arena, 0, sizeof *arena);
+}
+
+void *
+UtilsArenaAlloc(struct UtilsArena *arena, uint64_t size)
+{
+    size = (size + UTILS_ARENA_ALIGNMENT - 1)
+           & ~(uint64_t)(UTILS_ARENA_ALIGNMENT - 1);
+    struct UtilsArenaBlock *block = arena->current;
+    if (!block || block->size - block->used < size) {
+        const uint64_t blockSize
+            = size > arena->blockSize ? size : arena->blockSize;
+        block = malloc(sizeof(struct UtilsArenaBlock) + blockSize);
+        if (!block) {
+            UTILS_FATAL_ERROR("Failed to allocate arena block of %llu bytes",
+                              (unsigned long long)blockSize);
+        }
+        block->prev = arena->current;
+        block->size = blockSize;
+        block->used = 0;
+        arena->current = block;
+        ++arena->numBlocks;
+    }
+    void *ptr = (unsigned char *)(block + 1) + block->used;
+    block->used += size;
+    ++arena->numAllocations;
+    arena->bytesAllocated += size;
+    if (arena->bytesAllocated > arena->peakBytesAllocated) {
+        arena->peakBytesAllocated = arena->bytesAllocated;
+    }
+    return ptr;
+}
+
+char *
+UtilsArenaStrDup(struct UtilsArena *arena, const char *str)
+{
+    const size_t len = strlen(str) + 1;
+    char *copy = UtilsArenaAlloc(arena, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+struct UtilsArenaMarker
+UtilsArenaGetMarker(const struct UtilsArena *arena)
+{
+    struct UtilsArenaMarker marker;
+    marker.block = arena->current;
+    marker.used = arena->current ? arena->current->used : 0;
+    marker.bytesAllocated = arena->bytesAllocated;
+    return marker;
+}
+
+void
+UtilsArenaPopToMarker(struct UtilsArena *arena,
+                      struct UtilsArenaMarker marker)
+{
+    while (arena->current != marker.block) {
+        struct UtilsArenaBlock *block = arena->current;
+        if (!block->prev) {
+            // first block is kept, so that scratch arena that is popped
+            // after every use does not go back to malloc
+            block->used = 0;
+            break;
+        }
+        arena->current = block->prev;
+        free(block);
+    }
+    if (arena->current == marker.block && marker.block) {
+        arena->current->used = marker.used;
+    }
+    arena->bytesAllocated = marker.bytesAllocated;
+}
+
+void
+UtilsStringTableInit(struct UtilsStringTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    UtilsArenaInit(&table->arena, 16 * 1024);
+}
+
+void
+UtilsStringTableDeinit(struct UtilsStringTable *table)
+{
+    UtilsArenaDeinit(&table->arena);
+    free(table->strings);
+    free(table->hashes);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Returns slot that holds str or the empty slot where it belongs
+static uint32_t
+FindStringSlot(const struct UtilsStringTable *table, const char *str,
+               uint64_t hash)
+{
+    const uint32_t mask = table->numSlots - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while (table->slots[slot]) {
+        const uint32_t id = table->slots[slot] - 1;
+        if (table->hashes[id] == hash
+            && strcmp(table->strings[id], str) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+uint32_t
+UtilsStringTableIntern(struct UtilsStringTable *table, const char *str)
+{
+    // keep load factor at most one half
+    if (2 * (table->numStrings + 1) > table->numSlots) {
+        free(table->slots);
+        table->numSlots = table->numSlots ? 2 * table->numSlots : 64;
+        table->slots = calloc(table->numSlots, sizeof(uint32_t));
+        const uint32_t mask = table->numSlots - 1;
+        for (uint32_t id = 0; id < table->numStrings; ++id) {
+            uint32_t slot = (uint32_t)table->hashes[id] & mask;
+            while (table->slots[slot]) {
+                slot = (slot + 1) & mask;
+            }
+            table->slots[slot] = id + 1;
+        }
+    }
+    const uint64_t hash = UtilsHash64(str, strlen(str));
+    const uint32_t slot = FindStringSlot(table, str, hash);
+    if (table->slots[slot]) {
+        return table->slots[slot] - 1;
+    }
+    if (table->numStrings == table->capacity) {
+        table->capacity = table->capacity ? 2 * table->capacity : 32;
+        table->strings = realloc(table->strings,
+                                 sizeof(const char *) * table->capacity);
+        table->hashes
+            = realloc(table->hashes, sizeof(uint64_t) * table->capacity);
+    }
+    const uint32_t id = table->numStrings++;
+    table->strings[id] = UtilsArenaStrDup(&table->arena, str);
+    table->hashes[id] = hash;
+    table->slots[slot] = id + 1;
+    return id;
+}
+
+uint32_t
+UtilsStringTableFind(const struct UtilsStringTable *table, const char *str)
+{
+    if (table->numStrings == 0) {
+        return UTILS_INVALID_STRING;
+    }
+    const uint32_t slot
+        = FindStringSlot(table, str, UtilsHash64(str, strlen(str)));
+    return table->slots[slot] ? table->slots[slot] - 1 : UTILS_INVALID_STRING;
+}
+
+const char *
+UtilsStringTableGet(const struct UtilsStringTable *table, uint32_t id)
+{
+    return id < table->numStrings ? table->strings[id] : NULL;
+}
+
+static uint64_t
+RoundUpToGranularity(uint64_t size, uint64_t granularity)
+{
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+void
+UtilsRangeAllocatorInit(struct UtilsRangeAllocator *allocator,
+                        uint64_t capacity, uint64_t granularity)
+{
+    assert(granularity > 0 && capacity % granularity == 0);
+    memset(allocator, 0, sizeof(*allocator));
+    allocator->granularity = granularity;
+    UtilsRangeAllocatorGrow(allocator, capacity);
+}
+
+void
+UtilsRangeAllocatorDeinit(struct UtilsRangeAllocator *allocator)
+{
+    free(allocator->freeRanges);
+    memset(allocator, 0, sizeof(*allocator));
+}
+
+// Inserts range before index, caller makes sure it does not touch its
+// neighbours
+static void
+InsertFreeRange(struct UtilsRangeAllocator *allocator, uint32_t index,
+                uint64_t offset, uint64_t size)
+{
+    if (allocator->numFreeRanges == allocator->freeRangesCapacity) {
+        const uint32_t capacity = allocator->freeRangesCapacity
+                                      ? allocator->freeRangesCapacity * 2
+                                      : 16;
+        allocator->freeRanges = realloc(allocator->freeRanges,
+                                        sizeof(struct UtilsRange) * capacity);
+        allocator->freeRangesCapacity = capacity;
+    }
+    memmove(allocator->freeRanges + index + 1, allocator->freeRanges + index,
+            sizeof(struct UtilsRange) * (allocator->numFreeRanges - index));
+    allocator->freeRanges[index].offset = offset;
+    allocator->freeRanges[index].size = size;
+    ++allocator->numFreeRanges;
+}
+
+static void
+RemoveFreeRange(struct UtilsRangeAllocator *allocator, uint32_t index)
+{
+    --allocator->numFreeRanges;
+    memmove(allocator->freeRanges + index, allocator->freeRanges + index + 1,
+            sizeof(struct UtilsRange) * (allocator->numFreeRanges - index));
+}
+
+uint64_t
+UtilsRangeAllocatorAlloc(struct UtilsRangeAllocator *allocator, uint64_t size)
+{
+    size = RoundUpToGranularity(size, allocator->granularity);
+    for (uint32_t i = 0; i < allocator->numFreeRanges; ++i) {
+        struct UtilsRange *range = allocator->freeRanges + i;
+        if (range->size < size) {
+            continue;
+        }
+        const uint64_t offset = range->offset;
+        range->offset += size;
+        range->size -= size;
+        if (range->size == 0) {
+            RemoveFreeRange(allocator, i);
+        }
+        allocator->usedSize += size;
+        ++allocator->numAllocations;
+        return offset;
+    }
+    return UTILS_INVALID_RANGE;
+}
+
+void
+UtilsRangeAllocatorFree(struct UtilsRangeAllocator *allocator,
+                        uint64_t offset, uint64_t size)
+{
+    size = RoundUpToGranularity(size, allocator->granularity);
+    assert(offset + size <= allocator->capacity);
+    assert(allocator->numAllocations > 0 && allocator->usedSize >= size);
+    allocator->usedSize -= size;
+    --allocator->numAllocations;
+
+    // first free range after the freed one
+    uint32_t next = 0;
+    while (next < allocator->numFreeRanges
+           && allocator->freeRanges[next].offset < offset) {
+        ++next;
+    }
+    struct UtilsRange *prevRange
+        = next > 0 ? allocator->freeRanges + next - 1 : NULL;
+    struct UtilsRange *nextRange = next < allocator->numFreeRanges
+                                       ? allocator->freeRanges + next
+                                       : NULL;
+    assert(!prevRange || prevRange->offset + prevRange->size <= offset);
+    assert(!nextRange || offset + size <= nextRange->offset);
+    const int touchesPrev
+        = prevRange && prevRange->offset + prevRange->size == offset;
+    const int touchesNext = nextRange && offset + size == nextRange->offset;
+    if (touchesPrev && touchesNext) {
+        prevRange->size += size + nextRange->size;
+        RemoveFreeRange(allocator, next);
+    } else if (touchesPrev) {
+        prevRange->size += size;
+    } else if (touchesNext) {
+        nextRange->offset = offset;
+        nextRange->size += size;
+    } else {
+        InsertFreeRange(allocator, next, offset, size);
+    }
+}
+
+void
+UtilsRangeAllocatorGrow(struct UtilsRangeAllocator *allocator,
+                        uint64_t newCapacity)
+{
+    assert(newCapacity >= allocator->capacity
+           && newCapacity % allocator->granularity == 0);
+    if (newCapacity == allocator->capacity) {
+        return;
+    }
+    const uint64_t offset = allocator->capacity;
+    const uint64_t size = newCapacity - allocator->capacity;
+    allocator->capacity = newCapacity;
+    struct UtilsRange *last
+        = allocator->numFreeRanges
+              ? allocator->freeRanges + allocator->numFreeRanges - 1
+              : NULL;
+    if (last && last->offset + last->size == offset) {
+        last->size += size;
+    } else {
+        InsertFreeRange(allocator, allocator->numFreeRanges, offset, size);
+    }
+}
+
+uint64_t
+UtilsRangeAllocatorGetLargestFreeRange(const struct UtilsRangeAllocator *a)
+{
+    uint64_t largest = 0;
+    for (uint32_t i = 0; i < a->numFreeRanges; ++i) {
+        largest = a->freeRanges[i].size > largest ? a->freeRanges[i].size
+                                                  : largest;
+    }
+    return largest;
+}
+
+uint64_t
+UtilsGetPeakRSS(void)
+{
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                              sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    // kilobytes on Linux
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
 #define DIRECTORY_NAME_MAX_LENGTH 255
 #define DIRECTORY_STACK_MIN_CAPACITY 8
 struct DirectoryStack {
@@ -29,6 +29,221 @@ const char *UtilsGetStrAfterChar(const char *str, const char ch);
 
 unsigned char *UtilsReadData(const char *filepath, unsigned int *bufferSize);
 
+// Read-only view of a whole file mapped into the address space
+struct UtilsMappedFile {
+    const unsigned char *data;
+    uint64_t size;
+#if _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+};
+
+int UtilsMapFile(const char *filepath, struct UtilsMappedFile *file);
+
+void UtilsUnmapFile(struct UtilsMappedFile *file);
+
+// 64-bit FNV-1a over 8 byte words, tail is hashed byte by byte
+uint64_t UtilsHash64(const void *data, uint64_t size);
+
+// Stable LSD radix sort of keys by 8 bit digits, values move with their
+// keys. tmpKeys and tmpValues need room for count elements. Digits that are
+// equal in all keys are skipped.
+void UtilsRadixSort64(uint64_t *keys, uint32_t *values, uint32_t count,
+                      uint64_t *tmpKeys, uint32_t *tmpValues);
+
+// Monotonic wall clock time in seconds
+double UtilsGetTimeInSeconds(void);
+
+// CPU time consumed by calling thread, unlike wall clock it does not grow
+// while thread is preempted
+double UtilsGetThreadCpuTimeInSeconds(void);
+
+/* Threads */
+
+typedef void (*UtilsThreadFunc)(void *arg);
+
+struct UtilsThread;
+
+struct UtilsThread *UtilsThreadCreate(UtilsThreadFunc func, void *arg);
+
+// Waits for thread to finish and releases it
+void UtilsThreadJoin(struct UtilsThread *thread);
+
+uint32_t UtilsGetNumCpus(void);
+
+// Returns value before the addition
+uint32_t UtilsAtomicAdd32(volatile uint32_t *v, uint32_t add);
+
+// Load with acquire and store with release semantics
+uint32_t UtilsAtomicLoad32(const volatile uint32_t *v);
+
+void UtilsAtomicStore32(volatile uint32_t *v, uint32_t value);
+
+void UtilsSleepMs(uint32_t ms);
+
+// Bounded lock-free queue of pointers for exactly one producer thread and
+// one consumer thread
+struct UtilsSpscQueue {
+    void **items;
+    // power of two
+    uint32_t capacity;
+    // written by consumer only
+    volatile uint32_t head;
+    // written by producer only
+    volatile uint32_t tail;
+};
+
+void UtilsSpscQueueInit(struct UtilsSpscQueue *queue, uint32_t capacity);
+
+void UtilsSpscQueueDeinit(struct UtilsSpscQueue *queue);
+
+// Returns 0 if queue is full
+int UtilsSpscQueuePush(struct UtilsSpscQueue *queue, void *item);
+
+// Returns NULL if queue is empty
+void *UtilsSpscQueuePop(struct UtilsSpscQueue *queue);
+
+/* Thread pool */
+
+// threadIndex is in [0, number of pool threads), calling thread is 0
+typedef void (*UtilsParallelForFunc)(void *arg, uint32_t index,
+                                     uint32_t threadIndex);
+
+struct UtilsThreadPool;
+
+// Pool runs work on numThreads - 1 workers and calling thread,
+// 0 uses all cores
+struct UtilsThreadPool *UtilsThreadPoolCreate(uint32_t numThreads);
+
+void UtilsThreadPoolDestroy(struct UtilsThreadPool *pool);
+
+// Counts calling thread as well
+uint32_t UtilsThreadPoolGetNumThreads(const struct UtilsThreadPool *pool);
+
+// Calls func(arg, i) for every i in [0, count) and returns when all calls are
+// done. Runs serially if pool is NULL. Must not be called from func.
+void UtilsParallelFor(struct UtilsThreadPool *pool, uint32_t count,
+                      UtilsParallelForFunc func, void *arg);
+
+/* Arena */
+
+struct UtilsArenaBlock;
+
+// Linear allocator. Allocations are bumped out of large blocks and released
+// all at once.
+struct UtilsArena {
+    struct UtilsArenaBlock *current;
+    uint64_t blockSize;
+    uint64_t numAllocations;
+    // every block is a single malloc
+    uint64_t numBlocks;
+    uint64_t bytesAllocated;
+    uint64_t peakBytesAllocated;
+};
+
+struct UtilsArenaMarker {
+    struct UtilsArenaBlock *block;
+    uint64_t used;
+    uint64_t bytesAllocated;
+};
+
+void UtilsArenaInit(struct UtilsArena *arena, uint64_t blockSize);
+
+void UtilsArenaDeinit(struct UtilsArena *arena);
+
+// Returns 16 byte aligned memory
+void *UtilsArenaAlloc(struct UtilsArena *arena, uint64_t size);
+
+char *UtilsArenaStrDup(struct UtilsArena *arena, const char *str);
+
+struct UtilsArenaMarker UtilsArenaGetMarker(const struct UtilsArena *arena);
+
+// Releases everything that was allocated after marker was taken. First
+// block stays allocated until UtilsArenaDeinit.
+void UtilsArenaPopToMarker(struct UtilsArena *arena,
+                           struct UtilsArenaMarker marker);
+
+/* String table */
+
+#define UTILS_INVALID_STRING UINT32_MAX
+
+// Interned strings, equal strings share one id. Ids are dense, start at 0
+// and stay valid until the table is deinitialized.
+struct UtilsStringTable {
+    // copies of the strings
+    struct UtilsArena arena;
+    const char **strings;
+    uint64_t *hashes;
+    uint32_t numStrings;
+    uint32_t capacity;
+    // open addressing by hash, slots hold id + 1 and 0 when empty. Size is
+    // a power of two.
+    uint32_t *slots;
+    uint32_t numSlots;
+};
+
+void UtilsStringTableInit(struct UtilsStringTable *table);
+
+void UtilsStringTableDeinit(struct UtilsStringTable *table);
+
+// Returns id of str, adds a copy of it if it is new
+uint32_t UtilsStringTableIntern(struct UtilsStringTable *table,
+                                const char *str);
+
+// Returns UTILS_INVALID_STRING if str was never interned
+uint32_t UtilsStringTableFind(const struct UtilsStringTable *table,
+                              const char *str);
+
+const char *UtilsStringTableGet(const struct UtilsStringTable *table,
+                                uint32_t id);
+
+/* Range allocator */
+
+#define UTILS_INVALID_RANGE UINT64_MAX
+
+struct UtilsRange {
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Hands out ranges of a resource it does not own, e.g. a GPU buffer. Free
+// ranges are kept sorted by offset and merged with their neighbours, so
+// freeing everything always gives back one range. Sizes are rounded up to
+// granularity, so offsets stay multiples of it.
+struct UtilsRangeAllocator {
+    struct UtilsRange *freeRanges;
+    uint32_t numFreeRanges;
+    uint32_t freeRangesCapacity;
+    uint64_t capacity;
+    uint64_t granularity;
+    uint64_t usedSize;
+    uint32_t numAllocations;
+};
+
+void UtilsRangeAllocatorInit(struct UtilsRangeAllocator *allocator,
+                             uint64_t capacity, uint64_t granularity);
+
+void UtilsRangeAllocatorDeinit(struct UtilsRangeAllocator *allocator);
+
+// First fit, returns UTILS_INVALID_RANGE when no free range is big enough
+uint64_t UtilsRangeAllocatorAlloc(struct UtilsRangeAllocator *allocator,
+                                  uint64_t size);
+
+// size must be the one the range was allocated with
+void UtilsRangeAllocatorFree(struct UtilsRangeAllocator *allocator,
+                             uint64_t offset, uint64_t size);
+
+// Appends [capacity, newCapacity) to the free ranges
+void UtilsRangeAllocatorGrow(struct UtilsRangeAllocator *allocator,
+                             uint64_t newCapacity);
+
+uint64_t
+UtilsRangeAllocatorGetLargestFreeRange(const struct UtilsRangeAllocator *a);
+
+// Peak resident set size of the process in bytes
+uint64_t UtilsGetPeakRSS(void);
+
 struct UtilsFile {
     char name[256];
     uint32_t size;
@@ -94,8 +309,7 @@ struct UtilsFileArray *UtilsFileUtilsWalkDirectory(const char *directory);
     }                                                                         \
                                                                               \
     void Array##ClassSuffix##FreeCustom(                                      \
-        struct Array##ClassSuffix *arr,                                       \
-        void (*CustomFree)(struct Array##ClassSuffix * arr))                  \
+        struct Array##ClassSuffix *arr, void (*CustomFree)(DataType * v))     \
     {                                                                         \
         for (uint32_t i = 0; i < arr->Count; ++i)                             \
             CustomFree(&arr->Data[i]);                                        \
@@ -119,8 +333,7 @@ struct UtilsFileArray *UtilsFileUtilsWalkDirectory(const char *directory);
     void Array##ClassSuffix##Free(struct Array##ClassSuffix *arr);            \
                                                                               \
     void Array##ClassSuffix##FreeCustom(                                      \
-        struct Array##ClassSuffix *arr,                                       \
-        void (*CustomFree)(struct Array##ClassSuffix * arr))
+        struct Array##ClassSuffix *arr, void (*CustomFree)(DataType * v))
 
 #define COM_FREE(This) (This->lpVtbl->Release(This))
 
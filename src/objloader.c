@@ -1,20 +1,23 @@
 #include <assert.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "objloader.h"
+#include "myutils.h"
 
 void
 OLLogInfo(const char *fmt, ...)
 {
 #if OBJLOADER_VERBOSE
-    static char out[512];
+    // chunks are parsed on pool threads, so no static buffer
+    char out[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(out, fmt, args);
+    vsnprintf(out, sizeof(out), fmt, args);
     va_end(args);
     fprintf(stdout, "%s\n", out);
 #endif
@@ -23,174 +26,687 @@ OLLogInfo(const char *fmt, ...)
 void
 OLLogError(const char *fmt, ...)
 {
-    static char out[512];
+    // chunks are parsed on pool threads, so no static buffer
+    char out[512];
     va_list args;
     va_start(args, fmt);
-    vsprintf(out, fmt, args);
+    vsnprintf(out, sizeof(out), fmt, args);
     va_end(args);
     fprintf(stderr, "ERROR: %s\n", out);
 }
 
-uint32_t
-OLReadLine(FILE *f, char *out, uint32_t sz)
+// Longer lines are cut in error messages
+#define OL_MAX_LOGGED_LINE 120
+
+DECLARE_ARRAY_TYPE(struct Position, Position);
+DEFINE_ARRAY_TYPE(struct Position, Position);
+DECLARE_ARRAY_TYPE(struct TexCoord, TexCoord);
+DEFINE_ARRAY_TYPE(struct TexCoord, TexCoord);
+DECLARE_ARRAY_TYPE(struct Normal, Normal);
+DEFINE_ARRAY_TYPE(struct Normal, Normal);
+DECLARE_ARRAY_TYPE(struct Face, Face);
+DEFINE_ARRAY_TYPE(struct Face, Face);
+DECLARE_ARRAY_TYPE(struct Mesh, Mesh);
+DEFINE_ARRAY_TYPE(struct Mesh, Mesh);
+
+// Chunks smaller than that are not worth a thread
+#define OL_MIN_CHUNK_SIZE (1024 * 1024)
+
+// Face corner that used a negative (relative) index. Chunk does not know how
+// many elements precede it, so such corners are patched once it is known.
+struct OLFixup {
+    uint32_t face;
+    uint32_t component;
+    int32_t idx;
+};
+
+DECLARE_ARRAY_TYPE(struct OLFixup, Fixup);
+DEFINE_ARRAY_TYPE(struct OLFixup, Fixup);
+
+// Consecutive lines of one mesh inside a chunk. Only the first run of a chunk
+// may have no name, in that case it continues the mesh of previous chunk.
+struct OLMeshRun {
+    char *name;
+    struct ArrayPosition positions;
+    struct ArrayTexCoord texCoords;
+    struct ArrayNormal normals;
+    struct ArrayFace faces;
+    struct ArrayFixup fixups;
+    // number of elements parsed in this chunk before the run started
+    uint32_t firstPosition;
+    uint32_t firstTexCoord;
+    uint32_t firstNormal;
+    // filled when chunks are stitched together
+    uint32_t meshIdx;
+    uint32_t positionsOffset;
+    uint32_t texCoordsOffset;
+    uint32_t normalsOffset;
+    uint32_t facesOffset;
+};
+
+DECLARE_ARRAY_TYPE(struct OLMeshRun, MeshRun);
+DEFINE_ARRAY_TYPE(struct OLMeshRun, MeshRun);
+
+// Line aligned part of file that is parsed independently of other chunks.
+// Face indices are stored as global 0-based indices and are made relative to
+// the owning mesh when chunks are stitched.
+struct OLChunk {
+    const char *begin;
+    const char *end;
+    struct ArrayMeshRun runs;
+    uint32_t numPositions;
+    uint32_t numTexCoords;
+    uint32_t numNormals;
+    // global index of the first element of the chunk
+    uint32_t basePositions;
+    uint32_t baseTexCoords;
+    uint32_t baseNormals;
+};
+
+// Global index of the first element of the mesh. Prefix sum over chunks.
+struct OLMeshBase {
+    uint32_t positions;
+    uint32_t texCoords;
+    uint32_t normals;
+    uint32_t numRuns;
+};
+
+struct OLStitchData {
+    struct OLChunk *chunk;
+    struct Mesh *meshes;
+    const struct OLMeshBase *bases;
+};
+
+static const double OL_POW10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static int
+OLIsSpace(char ch)
 {
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+static int
+OLIsDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static const char *
+OLSkipSpaces(const char *p, const char *end)
+{
+    while (p < end && OLIsSpace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+static const char *
+OLSkipLine(const char *p, const char *end)
+{
+    const char *nl = memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+}
+
+// Slow path for numbers the fast path can not convert exactly
+// (more than 19 significant digits, huge exponents, nan, inf)
+static const char *
+OLParseFloatSlow(const char *p, const char *end, float *out)
+{
+    char buf[64];
     uint32_t len = 0;
-    char ch = 0;
-    while (sz--) {
-        if ((ch = fgetc(f)) != EOF) {
-            if (ch == '\n') {
-                break;
+    while (p + len < end && len < sizeof(buf) - 1 && !OLIsSpace(p[len])
+           && p[len] != '\n' && p[len] != '/') {
+        buf[len] = p[len];
+        ++len;
+    }
+    buf[len] = 0;
+    char *numEnd = NULL;
+    *out = strtof(buf, &numEnd);
+    return numEnd == buf ? NULL : p + (numEnd - buf);
+}
+
+// Parses [+-]digits[.digits][(e|E)[+-]digits]. The significand is
+// accumulated as an integer and scaled by an exact power of ten, so for up to
+// 19 significant digits and |exponent| <= 22 the only rounding happens in the
+// final multiplication/division.
+static const char *
+OLParseFloat(const char *p, const char *end, float *out)
+{
+    const char *start = p;
+    int32_t negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t significand = 0;
+    int32_t numDigits = 0;
+    int32_t exponent = 0;
+    int32_t seenDigit = 0;
+    while (p < end && *p == '0') {
+        seenDigit = 1;
+        ++p;
+    }
+    while (p < end && OLIsDigit(*p)) {
+        if (numDigits < 19) {
+            significand = significand * 10 + (*p - '0');
+            ++numDigits;
+        } else {
+            ++exponent;
+        }
+        seenDigit = 1;
+        ++p;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        if (numDigits == 0) {
+            while (p < end && *p == '0') {
+                --exponent;
+                seenDigit = 1;
+                ++p;
+            }
+        }
+        while (p < end && OLIsDigit(*p)) {
+            if (numDigits < 19) {
+                significand = significand * 10 + (*p - '0');
+                ++numDigits;
+                --exponent;
             }
-            out[len++] = ch;
+            seenDigit = 1;
+            ++p;
+        }
+    }
+    if (!seenDigit) {
+        return OLParseFloatSlow(start, end, out);
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        int32_t expNegative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            expNegative = *q == '-';
+            ++q;
+        }
+        if (q < end && OLIsDigit(*q)) {
+            int32_t e = 0;
+            while (q < end && OLIsDigit(*q)) {
+                if (e < 10000) {
+                    e = e * 10 + (*q - '0');
+                }
+                ++q;
+            }
+            exponent += expNegative ? -e : e;
+            p = q;
+        }
+    }
+
+    if (numDigits >= 19 || exponent > 22 || exponent < -22
+        || significand > (1ull << 53)) {
+        return OLParseFloatSlow(start, end, out);
+    }
+
+    double value = (double)significand;
+    if (exponent < 0) {
+        value /= OL_POW10[-exponent];
+    } else {
+        value *= OL_POW10[exponent];
+    }
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+static const char *
+OLParseInt(const char *p, const char *end, int32_t *out)
+{
+    int32_t negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p >= end || !OLIsDigit(*p)) {
+        return NULL;
+    }
+    int64_t value = 0;
+    while (p < end && OLIsDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        if (value > INT32_MAX) {
+            return NULL;
         }
+        ++p;
     }
-    out[len] = 0;
-    return len;
+    *out = (int32_t)(negative ? -value : value);
+    return p;
 }
 
-struct MeshInfo {
-    uint32_t NumPositions;
-    uint32_t NumNormals;
-    uint32_t NumTexCoords;
-    uint32_t NumFaces;
+static const char *
+OLParseFloats(const char *p, const char *end, float *out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        p = OLParseFloat(OLSkipSpaces(p, end), end, out + i);
+        if (!p) {
+            return NULL;
+        }
+    }
+    return p;
+}
+
+static struct OLMeshRun *
+OLCurrentRun(struct OLChunk *chunk)
+{
+    if (chunk->runs.Count == 0) {
+        struct OLMeshRun run = { 0 };
+        ArrayMeshRunPushBack(&chunk->runs, run);
+    }
+    return chunk->runs.Data + chunk->runs.Count - 1;
+}
+
+// Face corner as it was read from file
+struct OLCorner {
+    struct Face face;
+    int32_t relative[3];
+    uint32_t relativeMask;
 };
 
+// Converts 1-based OBJ index to 0-based global index. Negative (relative)
+// indices are resolved against the start of the chunk and patched during
+// stitching.
 static uint32_t
-OLGetNumMeshes(FILE *objfile)
+OLResolveIndex(int32_t idx, uint32_t count, uint32_t component,
+               struct OLCorner *corner)
 {
-    uint32_t numMeshes = 0;
-    char line[128];
-    while (OLReadLine(objfile, line, 128)) {
-        if (line[0] == 'o') {
-            ++numMeshes;
-        }
+    if (idx > 0) {
+        return (uint32_t)idx - 1;
     }
-    rewind(objfile);
-    return numMeshes;
+    if (idx < 0) {
+        corner->relative[component] = (int32_t)count + idx;
+        corner->relativeMask |= 1u << component;
+    }
+    return OL_INVALID_INDEX;
 }
 
-static uint32_t
-OLNumFacesInLine(const char *line)
+// Parses one face vertex in form of v, v/vt, v//vn or v/vt/vn
+static const char *
+OLParseFaceVertex(const char *p, const char *end, const struct OLChunk *chunk,
+                  struct OLCorner *corner)
 {
-    uint32_t numSlashes = 0;
-    while (*line++) {
-        if (*line == '/') {
-            ++numSlashes;
+    int32_t idx = 0;
+    struct Face *face = &corner->face;
+    corner->relativeMask = 0;
+    face->texIdx = OL_INVALID_INDEX;
+    face->normIdx = OL_INVALID_INDEX;
+    if (!(p = OLParseInt(p, end, &idx))) {
+        return NULL;
+    }
+    face->posIdx = OLResolveIndex(idx, chunk->numPositions, 0, corner);
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') {
+            if (!(p = OLParseInt(p, end, &idx))) {
+                return NULL;
+            }
+            face->texIdx
+                = OLResolveIndex(idx, chunk->numTexCoords, 1, corner);
+        }
+        if (p < end && *p == '/') {
+            ++p;
+            if (!(p = OLParseInt(p, end, &idx))) {
+                return NULL;
+            }
+            face->normIdx = OLResolveIndex(idx, chunk->numNormals, 2, corner);
         }
     }
-    assert(numSlashes % 2 == 0 && "Mesh is not triangulated");
-    return numSlashes / 2;
+    return p;
 }
 
 static void
-OLGetMeshInfos(struct MeshInfo *infos, uint32_t numMeshes, FILE *objfile)
-{
-    char line[128];
-    int32_t meshIdx = -1;
-    while (OLReadLine(objfile, line, 128)) {
-        if (strstr(line, "o ")) {
-            ++meshIdx;
-        } else if (strstr(line, "v ")) {
-            infos[meshIdx].NumPositions++;
-        } else if (strstr(line, "vt")) {
-            infos[meshIdx].NumTexCoords++;
-        } else if (strstr(line, "vn")) {
-            infos[meshIdx].NumNormals++;
-        } else if (strstr(line, "f ")) {
-            infos[meshIdx].NumFaces
-                += OLNumFacesInLine(line); // we expect 3 faces in row
+OLPushCorner(struct OLMeshRun *run, const struct OLCorner *corner)
+{
+    for (uint32_t i = 0; corner->relativeMask && i < 3; ++i) {
+        if (corner->relativeMask & (1u << i)) {
+            const struct OLFixup fixup
+                = { (uint32_t)run->faces.Count, i, corner->relative[i] };
+            ArrayFixupPushBack(&run->fixups, fixup);
         }
     }
-    assert(meshIdx + 1 == numMeshes);
-    rewind(objfile);
+    ArrayFacePushBack(&run->faces, corner->face);
+}
+
+static char *
+OLCopyName(const char *p, const char *end)
+{
+    p = OLSkipSpaces(p, end);
+    const char *nameEnd = p;
+    while (nameEnd < end && *nameEnd != '\n') {
+        ++nameEnd;
+    }
+    while (nameEnd > p && OLIsSpace(nameEnd[-1])) {
+        --nameEnd;
+    }
+    const size_t len = nameEnd - p;
+    char *name = malloc(len + 1);
+    memcpy(name, p, len);
+    name[len] = 0;
+    return name;
 }
 
 static void
-OLParseMeshes(struct Mesh *meshes, uint32_t numMeshes, struct MeshInfo *infos,
-              FILE *objfile)
+OLBeginRun(struct OLChunk *chunk, char *name)
+{
+    struct OLMeshRun run = { 0 };
+    run.name = name;
+    run.firstPosition = chunk->numPositions;
+    run.firstTexCoord = chunk->numTexCoords;
+    run.firstNormal = chunk->numNormals;
+    ArrayMeshRunPushBack(&chunk->runs, run);
+}
+
+static int32_t
+OLParseFace(const char *p, const char *end, struct OLChunk *chunk)
+{
+    struct OLMeshRun *run = OLCurrentRun(chunk);
+    struct OLCorner first = { 0 };
+    struct OLCorner prev = { 0 };
+    struct OLCorner corner = { 0 };
+    uint32_t numVertices = 0;
+    while (1) {
+        p = OLSkipSpaces(p, end);
+        if (p >= end || *p == '\n' || *p == '#') {
+            break;
+        }
+        if (!(p = OLParseFaceVertex(p, end, chunk, &corner))) {
+            return 0;
+        }
+        // triangulate polygons as a fan around the first vertex
+        if (numVertices >= 2) {
+            OLPushCorner(run, &first);
+            OLPushCorner(run, &prev);
+            OLPushCorner(run, &corner);
+        } else if (numVertices == 0) {
+            first = corner;
+        }
+        prev = corner;
+        ++numVertices;
+    }
+    return numVertices >= 3;
+}
+
+// Parses a single line starting at p. Returns pointer past the end of line.
+static const char *
+OLParseLine(const char *p, const char *end, struct OLChunk *chunk)
 {
-    char line[128];
-    char prefix[4];
+    const char *lineBegin = p;
+    const char *lineEnd = OLSkipLine(p, end);
     float vec[3];
-    uint32_t idx[9];
-    int32_t result = 0;
-    int32_t meshIdx = -1;
-    struct Mesh *mesh = NULL;
-    struct MeshInfo *info = NULL;
-    struct Face face = { 0 };
-
-    while (OLReadLine(objfile, line, 128)) {
-        memset(prefix, 0, sizeof(prefix));
-        strncpy(prefix, line, 2);
-        if (strcmp(prefix, "o ") == 0) {
-            ++meshIdx;
-            mesh = meshes + meshIdx;
-            info = infos + meshIdx;
-            mesh->Name = strdup(line + 2);
-        } else if (strcmp(prefix, "v ") == 0) {
-            result = sscanf(line, "%s%f%f%f", prefix, vec, vec + 1, vec + 2);
-            assert(result == 4);
-            mesh->Positions[mesh->NumPositions].x = vec[0];
-            mesh->Positions[mesh->NumPositions].y = vec[1];
-            mesh->Positions[mesh->NumPositions].z = vec[2];
-            ++mesh->NumPositions;
-            assert(mesh->NumPositions <= info->NumPositions);
+    int32_t ok = 1;
+    p = OLSkipSpaces(p, lineEnd);
+    if (p + 1 >= lineEnd) {
+        return lineEnd;
+    }
+
+    if (p[0] == 'v' && OLIsSpace(p[1])) {
+        if ((ok = OLParseFloats(p + 2, lineEnd, vec, 3) != NULL)) {
+            const struct Position pos = { vec[0], vec[1], vec[2] };
+            ArrayPositionPushBack(&OLCurrentRun(chunk)->positions, pos);
+            ++chunk->numPositions;
             OLLogInfo("Position { %f %f %f }", vec[0], vec[1], vec[2]);
-        } else if (strcmp(prefix, "vt") == 0) {
-            result = sscanf(line, "%s%f%f", prefix, vec, vec + 1);
-            assert(result == 3);
-            mesh->TexCoords[mesh->NumTexCoords].u = vec[0];
-            mesh->TexCoords[mesh->NumTexCoords].v = vec[1];
-            ++mesh->NumTexCoords;
-            assert(mesh->NumTexCoords <= info->NumTexCoords);
-            OLLogInfo("TexCoord { pref: %s %f %f }", prefix, vec[0], vec[1]);
-        } else if (strcmp(prefix, "vn") == 0) {
-            result = sscanf(line, "%s%f%f%f", prefix, vec, vec + 1, vec + 2);
-            assert(result == 4);
-            mesh->Normals[mesh->NumNormals].x = vec[0];
-            mesh->Normals[mesh->NumNormals].y = vec[1];
-            mesh->Normals[mesh->NumNormals].z = vec[2];
-            ++mesh->NumNormals;
-            assert(mesh->NumNormals <= info->NumNormals);
+        }
+    } else if (p[0] == 'v' && p[1] == 't' && p + 2 < lineEnd
+               && OLIsSpace(p[2])) {
+        if ((ok = OLParseFloats(p + 3, lineEnd, vec, 2) != NULL)) {
+            const struct TexCoord tc = { vec[0], vec[1] };
+            ArrayTexCoordPushBack(&OLCurrentRun(chunk)->texCoords, tc);
+            ++chunk->numTexCoords;
+            OLLogInfo("TexCoord { %f %f }", vec[0], vec[1]);
+        }
+    } else if (p[0] == 'v' && p[1] == 'n' && p + 2 < lineEnd
+               && OLIsSpace(p[2])) {
+        if ((ok = OLParseFloats(p + 3, lineEnd, vec, 3) != NULL)) {
+            const struct Normal n = { vec[0], vec[1], vec[2] };
+            ArrayNormalPushBack(&OLCurrentRun(chunk)->normals, n);
+            ++chunk->numNormals;
             OLLogInfo("Normal { %f %f %f }", vec[0], vec[1], vec[2]);
-        } else if (strcmp(prefix, "f ") == 0) {
-            result = sscanf(line, "%s%d/%d/%d%d/%d/%d%d/%d/%d", prefix, idx,
-                            idx + 1, idx + 2, idx + 3, idx + 4, idx + 5,
-                            idx + 6, idx + 7, idx + 8);
-            assert(result == 10);
-            OLLogInfo("Face { %d/%d/%d %d/%d/%d %d/%d/%d }", idx[0], idx[1],
-                      idx[2], idx[3], idx[4], idx[5], idx[6], idx[7], idx[8]);
-            for (uint32_t i = 0; i < 9; i += 3) {
-                face.posIdx = idx[i] - 1;
-                face.texIdx = idx[i + 1] - 1;
-                face.normIdx = idx[i + 2] - 1;
-                mesh->Faces[mesh->NumFaces++] = face;
-                assert(mesh->NumFaces <= info->NumFaces);
+        }
+    } else if (p[0] == 'f' && OLIsSpace(p[1])) {
+        ok = OLParseFace(p + 2, lineEnd, chunk);
+    } else if (p[0] == 'o' && OLIsSpace(p[1])) {
+        OLBeginRun(chunk, OLCopyName(p + 2, lineEnd));
+    } else {
+        OLLogInfo("Skip line, because of unknown prefix: %c%c", p[0], p[1]);
+    }
+
+    if (!ok) {
+        const ptrdiff_t length = lineEnd - lineBegin;
+        OLLogError("Failed to parse line: %.*s%s",
+                   (int)(length > OL_MAX_LOGGED_LINE ? OL_MAX_LOGGED_LINE
+                                                     : length),
+                   lineBegin, length > OL_MAX_LOGGED_LINE ? "..." : "");
+    }
+    return lineEnd;
+}
+
+static void
+OLParseChunk(void *arg)
+{
+    struct OLChunk *chunk = arg;
+    const char *p = chunk->begin;
+    while (p < chunk->end) {
+        p = OLParseLine(p, chunk->end, chunk);
+    }
+}
+
+// Runs func for every chunk. Calling thread takes the first chunk.
+static void
+OLForEachChunk(UtilsThreadFunc func, void *args, size_t argSize,
+               uint32_t numChunks)
+{
+    struct UtilsThread *threads[OL_MAX_THREADS];
+    for (uint32_t i = 1; i < numChunks; ++i) {
+        threads[i] = UtilsThreadCreate(func, (char *)args + argSize * i);
+    }
+    func(args);
+    for (uint32_t i = 1; i < numChunks; ++i) {
+        UtilsThreadJoin(threads[i]);
+    }
+}
+
+// Computes where every run goes: owning mesh, offsets of its elements inside
+// of mesh arrays, global index of the first element of each mesh
+static void
+OLAssignRuns(struct OLChunk *chunks, uint32_t numChunks,
+             struct ArrayMesh *meshes, struct OLMeshBase **outBases)
+{
+    uint32_t numPositions = 0;
+    uint32_t numTexCoords = 0;
+    uint32_t numNormals = 0;
+    size_t basesCapacity = 0;
+    struct OLMeshBase *bases = NULL;
+    for (uint32_t c = 0; c < numChunks; ++c) {
+        struct OLChunk *chunk = chunks + c;
+        chunk->basePositions = numPositions;
+        chunk->baseTexCoords = numTexCoords;
+        chunk->baseNormals = numNormals;
+        numPositions += chunk->numPositions;
+        numTexCoords += chunk->numTexCoords;
+        numNormals += chunk->numNormals;
+
+        for (size_t r = 0; r < chunk->runs.Count; ++r) {
+            struct OLMeshRun *run = chunk->runs.Data + r;
+            if (run->name || meshes->Count == 0) {
+                struct Mesh mesh = { 0 };
+                // geometry before the first "o" line goes to unnamed mesh
+                mesh.Name = run->name ? run->name : strdup("default");
+                run->name = NULL;
+                ArrayMeshPushBack(meshes, mesh);
+                if (meshes->Count > basesCapacity) {
+                    basesCapacity = meshes->Capacity;
+                    bases = realloc(bases, sizeof(*bases) * basesCapacity);
+                }
+                struct OLMeshBase *base = bases + meshes->Count - 1;
+                base->positions = chunk->basePositions + run->firstPosition;
+                base->texCoords = chunk->baseTexCoords + run->firstTexCoord;
+                base->normals = chunk->baseNormals + run->firstNormal;
+                base->numRuns = 0;
             }
-        } else {
-            OLLogInfo("Skip %s, because unknown prefix: %s\n", line, prefix);
+            run->meshIdx = (uint32_t)meshes->Count - 1;
+            struct Mesh *mesh = meshes->Data + run->meshIdx;
+            run->positionsOffset = mesh->NumPositions;
+            run->texCoordsOffset = mesh->NumTexCoords;
+            run->normalsOffset = mesh->NumNormals;
+            run->facesOffset = mesh->NumFaces;
+            mesh->NumPositions += (uint32_t)run->positions.Count;
+            mesh->NumTexCoords += (uint32_t)run->texCoords.Count;
+            mesh->NumNormals += (uint32_t)run->normals.Count;
+            mesh->NumFaces += (uint32_t)run->faces.Count;
+            bases[run->meshIdx].numRuns++;
         }
     }
+    *outBases = bases;
 }
 
+// Indices outside of the count elements of the mesh become invalid
 static uint32_t
-OLValidateMeshes(const struct Mesh *meshes, const struct MeshInfo *infos,
-                 uint32_t numMeshes)
+OLMakeLocal(uint32_t idx, uint32_t base, uint32_t count)
+{
+    return idx != OL_INVALID_INDEX && idx >= base && idx - base < count
+               ? idx - base
+               : OL_INVALID_INDEX;
+}
+
+// Streamed mesh adopts arrays of its run
+static void
+OLAdoptRun(struct OLMeshRun *run, struct Mesh *mesh)
+{
+    // shrink to fit, so that MeshDeinit can free arrays
+    if (run->positions.Count) {
+        ArrayPositionResize(&run->positions, run->positions.Count);
+    }
+    if (run->texCoords.Count) {
+        ArrayTexCoordResize(&run->texCoords, run->texCoords.Count);
+    }
+    if (run->normals.Count) {
+        ArrayNormalResize(&run->normals, run->normals.Count);
+    }
+    if (run->faces.Count) {
+        ArrayFaceResize(&run->faces, run->faces.Count);
+    }
+    mesh->Positions = run->positions.Data;
+    mesh->TexCoords = run->texCoords.Data;
+    mesh->Normals = run->normals.Data;
+    mesh->Faces = run->faces.Data;
+}
+
+// Patches relative indices of the run and makes all of its indices local to
+// mesh, whose element counts must be final
+static void
+OLResolveRunFaces(struct OLMeshRun *run, struct Face *faces, size_t numFaces,
+                  const struct OLChunk *chunk, const struct OLMeshBase *base,
+                  const struct Mesh *mesh)
+{
+    for (size_t i = 0; i < run->fixups.Count; ++i) {
+        const struct OLFixup *fixup = run->fixups.Data + i;
+        const uint32_t chunkBase[3] = { chunk->basePositions,
+                                        chunk->baseTexCoords,
+                                        chunk->baseNormals };
+        const int64_t global
+            = (int64_t)chunkBase[fixup->component] + fixup->idx;
+        (&faces[fixup->face].posIdx)[fixup->component]
+            = global >= 0 ? (uint32_t)global : OL_INVALID_INDEX;
+    }
+    ArrayFixupFree(&run->fixups);
+
+    for (size_t i = 0; i < numFaces; ++i) {
+        struct Face *face = faces + i;
+        face->posIdx
+            = OLMakeLocal(face->posIdx, base->positions, mesh->NumPositions);
+        face->texIdx
+            = OLMakeLocal(face->texIdx, base->texCoords, mesh->NumTexCoords);
+        face->normIdx
+            = OLMakeLocal(face->normIdx, base->normals, mesh->NumNormals);
+    }
+}
+
+// Copies run data to mesh arrays preallocated in model arena
+static void
+OLStitchChunk(void *arg)
 {
-    uint32_t areMeshesValid = 1;
-    for (uint32_t i = 0; i < numMeshes; ++i) {
-        const struct Mesh *m = meshes + i;
-        const struct MeshInfo *mi = infos + i;
-        areMeshesValid = areMeshesValid && m->NumFaces == mi->NumFaces;
-        assert(m->NumFaces == mi->NumFaces);
-        areMeshesValid = areMeshesValid && m->NumNormals == mi->NumNormals;
-        assert(m->NumNormals == mi->NumNormals);
-        areMeshesValid = areMeshesValid && m->NumTexCoords == mi->NumTexCoords;
-        assert(m->NumTexCoords == mi->NumTexCoords);
-        areMeshesValid = areMeshesValid && m->NumPositions == mi->NumPositions;
-        assert(m->NumPositions == mi->NumPositions);
+    struct OLStitchData *data = arg;
+    struct OLChunk *chunk = data->chunk;
+    for (size_t r = 0; r < chunk->runs.Count; ++r) {
+        struct OLMeshRun *run = chunk->runs.Data + r;
+        struct Mesh *mesh = data->meshes + run->meshIdx;
+        const struct OLMeshBase *base = data->bases + run->meshIdx;
+        memcpy(mesh->Positions + run->positionsOffset, run->positions.Data,
+               sizeof(struct Position) * run->positions.Count);
+        memcpy(mesh->TexCoords + run->texCoordsOffset, run->texCoords.Data,
+               sizeof(struct TexCoord) * run->texCoords.Count);
+        memcpy(mesh->Normals + run->normalsOffset, run->normals.Data,
+               sizeof(struct Normal) * run->normals.Count);
+        struct Face *faces = mesh->Faces + run->facesOffset;
+        memcpy(faces, run->faces.Data, sizeof(struct Face) * run->faces.Count);
+        OLResolveRunFaces(run, faces, run->faces.Count, chunk, base, mesh);
+        ArrayPositionFree(&run->positions);
+        ArrayTexCoordFree(&run->texCoords);
+        ArrayNormalFree(&run->normals);
+        ArrayFaceFree(&run->faces);
     }
-    return areMeshesValid;
+    ArrayMeshRunFree(&chunk->runs);
+}
+
+// Places meshes, names and arrays of the whole model in a single arena block
+static struct Mesh *
+OLAllocateMeshes(struct UtilsArena *arena, const struct ArrayMesh *meshes)
+{
+    // every allocation may lose up to 16 bytes to alignment
+    uint64_t bytes = sizeof(struct Mesh) * meshes->Count + 16;
+    for (size_t i = 0; i < meshes->Count; ++i) {
+        const struct Mesh *mesh = meshes->Data + i;
+        bytes += strlen(mesh->Name) + 1 + 16;
+        bytes += sizeof(struct Position) * (uint64_t)mesh->NumPositions + 16;
+        bytes += sizeof(struct TexCoord) * (uint64_t)mesh->NumTexCoords + 16;
+        bytes += sizeof(struct Normal) * (uint64_t)mesh->NumNormals + 16;
+        bytes += sizeof(struct Face) * (uint64_t)mesh->NumFaces + 16;
+    }
+    UtilsArenaInit(arena, bytes);
+
+    struct Mesh *result
+        = UtilsArenaAlloc(arena, sizeof(struct Mesh) * meshes->Count);
+    for (size_t i = 0; i < meshes->Count; ++i) {
+        struct Mesh *mesh = result + i;
+        *mesh = meshes->Data[i];
+        mesh->Name = UtilsArenaStrDup(arena, meshes->Data[i].Name);
+        free(meshes->Data[i].Name);
+        mesh->Positions = UtilsArenaAlloc(
+            arena, sizeof(struct Position) * mesh->NumPositions);
+        mesh->TexCoords = UtilsArenaAlloc(
+            arena, sizeof(struct TexCoord) * mesh->NumTexCoords);
+        mesh->Normals
+            = UtilsArenaAlloc(arena, sizeof(struct Normal) * mesh->NumNormals);
+        mesh->Faces
+            = UtilsArenaAlloc(arena, sizeof(struct Face) * mesh->NumFaces);
+    }
+    return result;
+}
+
+// Turns finished run of a chunk that spans the whole file into a mesh
+static void
+OLEmitRun(struct OLChunk *chunk, struct OLMeshRun *run,
+          OLMeshCallback callback, void *userData)
+{
+    struct Mesh mesh = { 0 };
+    mesh.Name = run->name ? run->name : strdup("default");
+    run->name = NULL;
+    mesh.NumPositions = (uint32_t)run->positions.Count;
+    mesh.NumTexCoords = (uint32_t)run->texCoords.Count;
+    mesh.NumNormals = (uint32_t)run->normals.Count;
+    mesh.NumFaces = (uint32_t)run->faces.Count;
+    OLAdoptRun(run, &mesh);
+    const struct OLMeshBase base
+        = { run->firstPosition, run->firstTexCoord, run->firstNormal, 1 };
+    OLResolveRunFaces(run, mesh.Faces, mesh.NumFaces, chunk, &base, &mesh);
+    ZERO_MEMORY(run);
+    callback(&mesh, userData);
 }
 
 static char *
@@ -258,52 +774,140 @@ OLDumpModelToFile(const struct Model *model, const char *filename)
 struct Model *
 OLLoad(const char *filename)
 {
-    FILE *f = fopen(filename, "r");
-    if (!f) {
+    return OLLoadParallel(filename, 1);
+}
+
+struct Model *
+OLLoadParallel(const char *filename, uint32_t numThreads)
+{
+    const double startTime = UtilsGetTimeInSeconds();
+    struct UtilsMappedFile file = { 0 };
+    if (!UtilsMapFile(filename, &file)) {
         OLLogError("Failed to open %s", filename);
         return NULL;
     }
 
-    const uint32_t numMeshes = OLGetNumMeshes(f);
+    if (numThreads == 0) {
+        numThreads = UtilsGetNumCpus();
+    }
+    uint64_t numChunks = file.size / OL_MIN_CHUNK_SIZE;
+    numChunks = numChunks < numThreads ? numChunks : numThreads;
+    numChunks = numChunks < OL_MAX_THREADS ? numChunks : OL_MAX_THREADS;
+    numChunks = numChunks > 0 ? numChunks : 1;
+
+    // split at line boundaries
+    struct OLChunk chunks[OL_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char *begin = (const char *)file.data;
+    const char *end = begin + file.size;
+    const char *p = begin;
+    uint32_t n = 0;
+    for (; n < numChunks && p < end; ++n) {
+        const char *chunkEnd
+            = n + 1 == numChunks ? end : begin + file.size * (n + 1) / numChunks;
+        chunkEnd = chunkEnd > p ? OLSkipLine(chunkEnd - 1, end) : p;
+        chunks[n].begin = p;
+        chunks[n].end = chunkEnd;
+        p = chunkEnd;
+    }
+    numChunks = n;
+
+    OLForEachChunk(OLParseChunk, chunks, sizeof(*chunks), (uint32_t)numChunks);
+
+    struct ArrayMesh meshes = { 0 };
+    struct OLMeshBase *bases = NULL;
+    OLAssignRuns(chunks, (uint32_t)numChunks, &meshes, &bases);
+    struct UtilsArena *arena = malloc(sizeof(struct UtilsArena));
+    struct Mesh *modelMeshes = OLAllocateMeshes(arena, &meshes);
+    const uint32_t numMeshes = (uint32_t)meshes.Count;
+    ArrayMeshFree(&meshes);
+
+    struct OLStitchData stitchData[OL_MAX_THREADS];
+    for (uint32_t i = 0; i < numChunks; ++i) {
+        stitchData[i].chunk = chunks + i;
+        stitchData[i].meshes = modelMeshes;
+        stitchData[i].bases = bases;
+    }
+    OLForEachChunk(OLStitchChunk, stitchData, sizeof(*stitchData),
+                   (uint32_t)numChunks);
+    free(bases);
+
+    const uint64_t fileSize = file.size;
+    UtilsUnmapFile(&file);
+
     if (numMeshes == 0) {
         OLLogError("No meshes found in %s", filename);
+        UtilsArenaDeinit(arena);
+        free(arena);
         return NULL;
     }
 
-    size_t bytes = sizeof(struct Mesh) * numMeshes;
-    struct Mesh *meshes = malloc(bytes);
-    memset(meshes, 0, bytes);
-
-    bytes = sizeof(struct MeshInfo) * numMeshes;
-    struct MeshInfo *infos = malloc(bytes);
-    memset(infos, 0, bytes);
-
-    OLGetMeshInfos(infos, numMeshes, f);
-    // assert(numMeshes == 1);
-    for (uint32_t i = 0; i < numMeshes; ++i) {
-        meshes[i].Faces = malloc(sizeof(struct Face) * infos[i].NumFaces);
-        meshes[i].Normals
-            = malloc(sizeof(struct Normal) * infos[i].NumNormals);
-        meshes[i].Positions
-            = malloc(sizeof(struct Position) * infos[i].NumPositions);
-        meshes[i].TexCoords
-            = malloc(sizeof(struct TexCoord) * infos[i].NumTexCoords);
-    }
-    OLParseMeshes(meshes, numMeshes, infos, f);
-    fclose(f);
-
-    assert(OLValidateMeshes(meshes, infos, numMeshes));
-    free(infos);
-
     struct Model *model = malloc(sizeof(struct Model));
-    model->Meshes = meshes;
+    model->Meshes = modelMeshes;
     model->NumMeshes = numMeshes;
     model->Directory = OLGetCwd(filename);
+    model->Arena = arena;
     // OLDumpModelToFile(model, "model.txt");
 
+    const double elapsed = UtilsGetTimeInSeconds() - startTime;
+    const double megabytes = (double)fileSize / (1024.0 * 1024.0);
+    UtilsDebugPrint("OLLoad: %s, %.2f MB in %.2f ms (%.1f MB/s, %u threads), "
+                    "%llu arena allocations in %llu blocks (%.2f MB)",
+                    filename, megabytes, elapsed * 1000.0,
+                    elapsed > 0.0 ? megabytes / elapsed : 0.0,
+                    (uint32_t)numChunks,
+                    (unsigned long long)arena->numAllocations,
+                    (unsigned long long)arena->numBlocks,
+                    (double)arena->bytesAllocated / (1024.0 * 1024.0));
+
     return model;
 }
 
+uint32_t
+OLLoadStreaming(const char *filename, OLMeshCallback callback, void *userData)
+{
+    const double startTime = UtilsGetTimeInSeconds();
+    struct UtilsMappedFile file = { 0 };
+    if (!UtilsMapFile(filename, &file)) {
+        OLLogError("Failed to open %s", filename);
+        return 0;
+    }
+
+    struct OLChunk chunk = { 0 };
+    chunk.begin = (const char *)file.data;
+    chunk.end = chunk.begin + file.size;
+    const char *p = chunk.begin;
+    uint32_t numMeshes = 0;
+    while (p < chunk.end) {
+        const size_t numRuns = chunk.runs.Count;
+        p = OLParseLine(p, chunk.end, &chunk);
+        // "o" line started a new run, so the previous one is complete
+        if (chunk.runs.Count > numRuns && numRuns > 0) {
+            OLEmitRun(&chunk, chunk.runs.Data + numRuns - 1, callback,
+                      userData);
+            ++numMeshes;
+        }
+    }
+    if (chunk.runs.Count > 0) {
+        OLEmitRun(&chunk, chunk.runs.Data + chunk.runs.Count - 1, callback,
+                  userData);
+        ++numMeshes;
+    }
+    ArrayMeshRunFree(&chunk.runs);
+
+    const uint64_t fileSize = file.size;
+    UtilsUnmapFile(&file);
+    if (numMeshes == 0) {
+        OLLogError("No meshes found in %s", filename);
+    }
+
+    const double elapsed = UtilsGetTimeInSeconds() - startTime;
+    UtilsDebugPrint("OLLoadStreaming: %s, %.2f MB, %u meshes in %.2f ms",
+                    filename, (double)fileSize / (1024.0 * 1024.0),
+                    numMeshes, elapsed * 1000.0);
+    return numMeshes;
+}
+
 struct Mesh *
 MeshNew(void)
 {
@@ -350,6 +954,11 @@ void
 ModelDeinit(struct Model *model)
 {
     free(model->Directory);
+    if (model->Arena) {
+        UtilsArenaDeinit(model->Arena);
+        free(model->Arena);
+        return;
+    }
     for (uint32_t i = 0; i < model->NumMeshes; ++i) {
         MeshDeinit(model->Meshes + i);
     }
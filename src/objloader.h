@@ -19,6 +19,12 @@ struct Normal {
     float z;
 };
 
+#define OL_INVALID_INDEX UINT32_MAX
+
+// One corner of a triangle. Indices are 0-based and relative to the arrays
+// of the mesh the face belongs to. OL_INVALID_INDEX marks missing texture
+// coordinate or normal (e.g. "f 1//1 2//2 3//3") and references to elements
+// of other meshes or past the end of the arrays, positions included.
 struct Face {
     uint32_t posIdx;
     uint32_t texIdx;
@@ -37,13 +43,38 @@ struct Mesh {
     uint32_t NumFaces;
 };
 
+struct UtilsArena;
+
 struct Model {
     struct Mesh *Meshes;
     uint32_t NumMeshes;
     char *Directory;
+    // Owns meshes, their names and arrays when model comes from OLLoad.
+    // NULL when they were allocated one by one.
+    struct UtilsArena *Arena;
 };
 
+#define OL_MAX_THREADS 64
+
+// Maps the file and parses it in a single pass. Polygons are triangulated
+// as fans, so NumFaces is always a multiple of 3. All mesh data is placed in
+// one arena, which ModelFree releases at once.
 struct Model *OLLoad(const char *filename);
+
+// Same as OLLoad, but file is split at line boundaries and chunks are parsed
+// concurrently. Output is identical to OLLoad. numThreads == 0 uses all cores.
+struct Model *OLLoadParallel(const char *filename, uint32_t numThreads);
+
+// mesh is a temporary, callback takes ownership of its name and arrays and
+// releases them with MeshDeinit
+typedef void (*OLMeshCallback)(struct Mesh *mesh, void *userData);
+
+// Parses file on calling thread and hands every mesh to callback as soon as
+// it is complete, i.e. when next "o" line or end of file is reached. Meshes
+// are identical to the ones of OLLoad. Returns number of meshes.
+uint32_t OLLoadStreaming(const char *filename, OLMeshCallback callback,
+                         void *userData);
+
 void OLDumpModelToFile(const struct Model *model, const char *filename);
 
 struct Mesh *MeshNew(void);
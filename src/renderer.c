@@ -1,6 +1,9 @@
 #include "renderer.h"
+#include "meshcache.h"
+#include "meshopt.h"
 #include "objloader.h"
 
+#include <float.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,10 +19,32 @@ struct File {
     uint64_t size;
 };
 
+// Active uniform of a program, found by reflection when material is created
+struct MaterialUniform {
+    i8 *name;
+    i32 location;
+    // GL type, e.g. GL_FLOAT_MAT4
+    u32 type;
+    // number of array elements, 1 for non-arrays
+    i32 count;
+    // fixed texture unit of samplers, -1 for other uniforms
+    i32 textureUnit;
+    // last value set with Material_SetUniform, valueSize is 0 for samplers
+    u8 *value;
+    u32 valueSize;
+    boolean hasValue;
+};
+
 struct Material {
     u32 programHandle;
     const i8 *name;
     struct MaterialCreateInfo createInfo;
+    struct MaterialUniform *uniforms;
+    u32 numUniforms;
+    // open addressing by name hash, slots hold uniform index + 1 and 0 when
+    // empty. Size is a power of two.
+    u32 *uniformTable;
+    u32 uniformTableSize;
 };
 
 void
@@ -32,43 +57,6 @@ DebugBreak(void)
 #endif
 }
 
-static u32
-GetUniformLocation(u32 programHandle, const i8 *name)
-{
-    GLCHECK(u32 loc = glGetUniformLocation(programHandle, name));
-    return loc;
-}
-
-static void
-SetUniform(u32 programHandle, const i8 *name, u32 size, const void *data,
-           enum UniformType type)
-{
-    const u32 loc = GetUniformLocation(programHandle, name);
-    switch (type) {
-    case UT_MAT4:
-        GLCHECK(glUniformMatrix4fv(loc, 1, GL_FALSE, data));
-        break;
-    case UT_VEC4F:
-        GLCHECK(glUniform4fv(loc, 1, data));
-        break;
-    case UT_VEC3F:
-        GLCHECK(glUniform3fv(loc, 1, data));
-        break;
-    case UT_VEC2F:
-        break;
-    case UT_FLOAT:
-        break;
-    case UT_INT:
-        GLCHECK(glUniform1i(loc, *(const i32 *)data));
-        break;
-    case UT_UINT:
-        GLCHECK(glUniform1ui(loc, *(const u32 *)data));
-        break;
-    default:
-        UtilsFatalError("FATAL ERROR: Failed to locate %s uniform");
-    }
-}
-
 static struct File
 LoadShader(const i8 *shaderName)
 {
@@ -96,12 +84,21 @@ LoadShader(const i8 *shaderName)
     return out;
 }
 
+// defines go after the first line, GLSL requires #version to come first
 static i32
-CompileShader(const struct File *shader, i32 shaderType, u32 *pHandle)
+CompileShader(const struct File *shader, const i8 *defines, i32 shaderType,
+              u32 *pHandle)
 {
+    const i8 *versionEnd = memchr(shader->contents, '\n', shader->size);
+    const GLint versionLength
+        = versionEnd ? (GLint)(versionEnd - shader->contents + 1) : 0;
+    const GLchar *sources[3] = { shader->contents, defines ? defines : "",
+                                 shader->contents + versionLength };
+    // -1 for the null terminated defines
+    const GLint lengths[3]
+        = { versionLength, -1, (GLint)shader->size - versionLength };
     GLCHECK(*pHandle = glCreateShader(shaderType));
-    GLCHECK(glShaderSource(*pHandle, 1, (const GLchar **)&shader->contents,
-                           (const GLint *)&shader->size));
+    GLCHECK(glShaderSource(*pHandle, 3, sources, lengths));
     GLCHECK(glCompileShader(*pHandle));
     i32 compileStatus = 0;
     GLCHECK(glGetShaderiv(*pHandle, GL_COMPILE_STATUS, &compileStatus));
@@ -140,18 +137,20 @@ LinkProgram(const u32 vs, const u32 fs, u32 *pHandle)
 }
 
 static u32
-CreateProgram(const i8 *fs, const i8 *vs, const i8 *programName)
+CreateProgram(const i8 *fs, const i8 *vs, const i8 *programName,
+              const i8 *defines)
 {
     u32 programHandle = 0;
     struct File fragSource = LoadShader(fs);
     struct File vertSource = LoadShader(vs);
 
     u32 fragHandle = 0;
-    if (!CompileShader(&fragSource, GL_FRAGMENT_SHADER, &fragHandle)) {
+    if (!CompileShader(&fragSource, defines, GL_FRAGMENT_SHADER,
+                       &fragHandle)) {
         return 0;
     }
     u32 vertHandle = 0;
-    if (!CompileShader(&vertSource, GL_VERTEX_SHADER, &vertHandle)) {
+    if (!CompileShader(&vertSource, defines, GL_VERTEX_SHADER, &vertHandle)) {
         return 0;
     }
     if (!LinkProgram(vertHandle, fragHandle, &programHandle)) {
@@ -168,360 +167,2033 @@ CreateProgram(const i8 *fs, const i8 *vs, const i8 *programName)
     return programHandle;
 }
 
-static void
-CopyMaterialCreateInfo(struct MaterialCreateInfo *dest,
-                       const struct MaterialCreateInfo *src)
+#define GLSTATE_MAX_TEXTURE_UNITS MAX_SAMPLERS
+#define GLSTATE_MAX_UNIFORM_BUFFERS 8
+
+struct GLStateTexture {
+    u32 target;
+    u32 texture;
+};
+
+struct GLStateUniformBuffer {
+    u32 buffer;
+    u32 offset;
+    u32 size;
+};
+
+struct GLState {
+    u32 program;
+    u32 vertexArray;
+    u32 activeTexture;
+    struct GLStateTexture textures[GLSTATE_MAX_TEXTURE_UNITS];
+    u32 drawFramebuffer;
+    u32 readFramebuffer;
+    struct GLStateUniformBuffer uniformBuffers[GLSTATE_MAX_UNIFORM_BUFFERS];
+    // GL_TRUE or GL_FALSE
+    u32 depthTest;
+    u32 cullFace;
+    u32 blend;
+    u32 scissorTest;
+    u32 stencilTest;
+    u32 depthFunc;
+    u32 depthMask;
+    u32 colorMask;
+    u32 cullFaceMode;
+    u32 blendSrc;
+    u32 blendDst;
+    struct GLStateStats frameStats;
+    struct GLStateStats lastFrameStats;
+};
+
+// GL context is global, so is its shadow
+static struct GLState g_glState;
+
+// Returns 1 and counts an issued call if *shadow differs from value, counts
+// a filtered call otherwise
+static i32
+ChangeGLState(u32 *shadow, u32 value, enum GLStateCall call)
 {
-    dest->fsPath = src->fsPath;
-    dest->vsPath = src->vsPath;
-    dest->name = src->name;
-    dest->numSamplers = src->numSamplers;
-    for (u32 i = 0; i < dest->numSamplers; ++i) {
-        dest->samplers[i] = src->samplers[i];
+    if (*shadow == value) {
+        ++g_glState.frameStats.numFiltered[call];
+        return 0;
     }
+    *shadow = value;
+    ++g_glState.frameStats.numIssued[call];
+    return 1;
 }
 
-struct Material *
-Material_Create(const struct MaterialCreateInfo *info)
+void
+GLState_Invalidate(void)
 {
-    struct Material *m = malloc(sizeof *m);
-    m->programHandle = CreateProgram(info->fsPath, info->vsPath, info->name);
-    m->name = info->name;
-    CopyMaterialCreateInfo(&m->createInfo, info);
-    return m;
+    // every shadowed value becomes UINT32_MAX, which is no GL name or enum.
+    // Uniform values belong to programs and stay valid.
+    struct GLStateStats frameStats = g_glState.frameStats;
+    struct GLStateStats lastFrameStats = g_glState.lastFrameStats;
+    memset(&g_glState, 0xff, sizeof(g_glState));
+    g_glState.frameStats = frameStats;
+    g_glState.lastFrameStats = lastFrameStats;
 }
 
 void
-Material_Destroy(struct Material *m)
+GLState_BeginFrame(void)
 {
-    GLCHECK(glDeleteProgram(m->programHandle));
-    free(m);
-    m = NULL;
+    GLState_Invalidate();
+    g_glState.lastFrameStats = g_glState.frameStats;
+    ZERO_MEMORY(&g_glState.frameStats);
 }
 
 void
-Material_SetUniform(struct Material *m, const i8 *name, u32 size,
-                    const void *data, enum UniformType type)
+GLState_GetStats(struct GLStateStats *stats)
 {
-    SetUniform(m->programHandle, name, size, data, type);
+    *stats = g_glState.lastFrameStats;
 }
 
-u32
-Material_GetHandle(const struct Material *m)
+// No GLCHECK in setters, they are called for every draw and errors reach
+// the debug message callback anyway
+
+void
+GLState_UseProgram(u32 program)
 {
-    return m->programHandle;
+    if (ChangeGLState(&g_glState.program, program, GSC_PROGRAM)) {
+        glUseProgram(program);
+    }
 }
 
-const i8 *
-Material_GetName(const struct Material *m)
+void
+GLState_BindVertexArray(u32 vao)
 {
-    return m->name;
+    if (ChangeGLState(&g_glState.vertexArray, vao, GSC_VERTEX_ARRAY)) {
+        glBindVertexArray(vao);
+    }
 }
 
 void
-Material_SetTexture(struct Material *m, const i8 *name,
-                    const struct Texture2D *t)
+GLState_BindTexture(u32 unit, u32 target, u32 texture)
 {
-    for (u32 i = 0; i < m->createInfo.numSamplers; ++i) {
-        if (strcmp(m->createInfo.samplers[i], name) == 0) {
-            const i32 loc = (i32)i;
-            Material_SetUniform(m, name, sizeof(i32), &loc, UT_INT);
-            GLCHECK(glActiveTexture(GL_TEXTURE0 + loc));
-            GLCHECK(glBindTexture(GL_TEXTURE_2D, t->handle));
-            break;
-        }
+    assert(unit < GLSTATE_MAX_TEXTURE_UNITS);
+    struct GLStateTexture *shadow = g_glState.textures + unit;
+    if (shadow->target == target && shadow->texture == texture) {
+        ++g_glState.frameStats.numFiltered[GSC_TEXTURE];
+        return;
+    }
+    if (ChangeGLState(&g_glState.activeTexture, unit, GSC_TEXTURE)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
     }
+    shadow->target = target;
+    shadow->texture = texture;
+    ++g_glState.frameStats.numIssued[GSC_TEXTURE];
+    glBindTexture(target, texture);
 }
 
 void
-SetObjectName(enum ObjectIdentifier objectIdentifier, u32 name,
-              const i8 *label)
+GLState_BindFramebuffer(u32 target, u32 framebuffer)
 {
-    const i8 *prefix = NULL;
-    i32 identifier = 0;
-    switch (objectIdentifier) {
-    case OI_BUFFER:
-        prefix = "BUFFER";
-        identifier = GL_BUFFER;
-        break;
-    case OI_INDEX_BUFFER:
-        prefix = "EBO";
-        identifier = GL_BUFFER;
-        break;
-    case OI_VERTEX_BUFFER:
-        prefix = "VBO";
-        identifier = GL_BUFFER;
-        break;
-    case OI_SHADER:
-        prefix = "SHADER";
-        identifier = GL_SHADER;
-        break;
-    case OI_VERTEX_SHADER:
-        prefix = "VS";
-        identifier = GL_SHADER;
-        break;
-    case OI_FRAGMENT_SHADER:
-        prefix = "FS";
-        identifier = GL_SHADER;
-        break;
-    case OI_PROGRAM:
-        prefix = "PROGRAM";
-        identifier = GL_PROGRAM;
-        break;
-    case OI_VERTEX_ARRAY:
-        prefix = "VAO";
-        identifier = GL_VERTEX_ARRAY;
+    switch (target) {
+    case GL_FRAMEBUFFER:
+        if (g_glState.drawFramebuffer == framebuffer
+            && g_glState.readFramebuffer == framebuffer) {
+            ++g_glState.frameStats.numFiltered[GSC_FRAMEBUFFER];
+            return;
+        }
+        g_glState.drawFramebuffer = framebuffer;
+        g_glState.readFramebuffer = framebuffer;
+        ++g_glState.frameStats.numIssued[GSC_FRAMEBUFFER];
         break;
-    case OI_QUERY:
-        prefix = "QUERY";
-        identifier = GL_QUERY;
+    case GL_DRAW_FRAMEBUFFER:
+        if (!ChangeGLState(&g_glState.drawFramebuffer, framebuffer,
+                            GSC_FRAMEBUFFER)) {
+            return;
+        }
         break;
-    case OI_PROGRAM_PIPELINE:
-        prefix = "PROGRAM_PIPELINE";
-        identifier = GL_PROGRAM_PIPELINE;
+    case GL_READ_FRAMEBUFFER:
+        if (!ChangeGLState(&g_glState.readFramebuffer, framebuffer,
+                            GSC_FRAMEBUFFER)) {
+            return;
+        }
         break;
-    case OI_TRANSFORM_FEEDBACK:
-        prefix = "TRANSFORM_FEEDBACK";
-        identifier = GL_TRANSFORM_FEEDBACK;
+    default:
+        assert(0);
+    }
+    glBindFramebuffer(target, framebuffer);
+}
+
+void
+GLState_BindUniformBuffer(u32 index, u32 buffer, u32 offset, u32 size)
+{
+    assert(index < GLSTATE_MAX_UNIFORM_BUFFERS);
+    struct GLStateUniformBuffer *shadow = g_glState.uniformBuffers + index;
+    if (shadow->buffer == buffer && shadow->offset == offset
+        && shadow->size == size) {
+        ++g_glState.frameStats.numFiltered[GSC_UNIFORM_BUFFER];
+        return;
+    }
+    shadow->buffer = buffer;
+    shadow->offset = offset;
+    shadow->size = size;
+    ++g_glState.frameStats.numIssued[GSC_UNIFORM_BUFFER];
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+}
+
+void
+GLState_Enable(u32 cap, boolean enable)
+{
+    u32 *shadow = NULL;
+    switch (cap) {
+    case GL_DEPTH_TEST:
+        shadow = &g_glState.depthTest;
         break;
-    case OI_SAMPLER:
-        prefix = "SAMPLER";
-        identifier = GL_SAMPLER;
+    case GL_CULL_FACE:
+        shadow = &g_glState.cullFace;
         break;
-    case OI_TEXTURE:
-        prefix = "TEXTURE";
-        identifier = GL_TEXTURE;
+    case GL_BLEND:
+        shadow = &g_glState.blend;
         break;
-    case OI_RENDERBUFFER:
-        prefix = "RENDERBUFFER";
-        identifier = GL_RENDERBUFFER;
+    case GL_SCISSOR_TEST:
+        shadow = &g_glState.scissorTest;
         break;
-    case OI_FRAMEBUFFER:
-        prefix = "FRAMEBUFFER";
-        identifier = GL_FRAMEBUFFER;
+    case GL_STENCIL_TEST:
+        shadow = &g_glState.stencilTest;
         break;
+    default:
+        UtilsFatalError("FATAL ERROR: GL state 0x%x is not tracked", cap);
+    }
+    if (!ChangeGLState(shadow, enable ? GL_TRUE : GL_FALSE, GSC_RASTER)) {
+        return;
+    }
+    if (enable) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
     }
-
-    const i8 *fullLabel = UtilsFormatStr("%s_%s", label, prefix);
-    GLCHECK(glObjectLabel(identifier, name, strlen(fullLabel), fullLabel));
 }
 
-struct Texture2D *
-Texture2D_Create(const struct Texture2DCreateInfo *info)
+void
+GLState_DepthFunc(u32 func)
 {
-    struct Texture2D *t = malloc(sizeof *t);
-    Texture2D_Init(t, info);
-    return t;
+    if (ChangeGLState(&g_glState.depthFunc, func, GSC_RASTER)) {
+        glDepthFunc(func);
+    }
 }
 
 void
-Texture2D_Init(struct Texture2D *t, const struct Texture2DCreateInfo *info)
+GLState_DepthMask(boolean mask)
 {
-    u32 handle = 0;
-    GLCHECK(glGenTextures(1, &handle));
-    GLCHECK(glBindTexture(GL_TEXTURE_2D, handle));
-    GLCHECK(glTexImage2D(GL_TEXTURE_2D, 0, info->internalFormat, info->width,
-                         info->height, 0, info->format, info->type, NULL));
-    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    if (info->genFB) {
-        GLCHECK(glFramebufferTexture2D(GL_FRAMEBUFFER,
-                                       info->framebufferAttachment,
-                                       GL_TEXTURE_2D, handle, 0));
+    const u32 value = mask ? GL_TRUE : GL_FALSE;
+    if (ChangeGLState(&g_glState.depthMask, value, GSC_RASTER)) {
+        glDepthMask(value);
     }
-    SetObjectName(OI_TEXTURE, handle, info->name);
-    t->handle = handle;
-    t->width = info->width;
-    t->height = info->height;
-    t->name = strdup(info->name);
 }
 
 void
-Texture2D_Destroy(struct Texture2D *t)
+GLState_ColorMask(boolean mask)
 {
-    free(t->name);
-    free(t);
-    t = NULL;
+    const u32 value = mask ? GL_TRUE : GL_FALSE;
+    if (ChangeGLState(&g_glState.colorMask, value, GSC_RASTER)) {
+        glColorMask(value, value, value, value);
+    }
 }
 
-static struct ModelProxy *CreateModelProxy(const struct Model *m);
-static struct ModelProxy *
-LoadModel(const i8 *filename)
+void
+GLState_CullFace(u32 mode)
 {
-    const i8 *absPath = UtilsFormatStr("%s/%s", RES_HOME, filename);
-    struct Model *model = OLLoad(absPath);
-    struct ModelProxy *proxy = NULL;
-    if (model) {
-        for (u32 i = 0; i < model->NumMeshes; ++i) {
-            const struct Mesh *mesh = model->Meshes + i;
-            UtilsDebugPrint("Mesh %s, faces: %u, normals: %u, positions: %u, "
-                            "texCoords: %u",
-                            mesh->Name, mesh->NumFaces, mesh->NumNormals,
-                            mesh->NumPositions, mesh->NumTexCoords);
-        }
-
-        proxy = CreateModelProxy(model);
-        ModelFree(model);
+    if (ChangeGLState(&g_glState.cullFaceMode, mode, GSC_RASTER)) {
+        glCullFace(mode);
     }
-    return proxy;
 }
 
-static void
-ValidateModelProxy(const struct ModelProxy *m)
+void
+GLState_BlendFunc(u32 src, u32 dst)
 {
-    UtilsDebugPrint("Validating ModelProxy. Num meshes: %d", m->numMeshes);
-    for (u32 i = 0; i < m->numMeshes; ++i) {
-        UtilsDebugPrint("Mesh %d, Num indices: %d", i,
-                        m->meshes[i].numIndices);
+    if (g_glState.blendSrc == src && g_glState.blendDst == dst) {
+        ++g_glState.frameStats.numFiltered[GSC_RASTER];
+        return;
     }
+    g_glState.blendSrc = src;
+    g_glState.blendDst = dst;
+    ++g_glState.frameStats.numIssued[GSC_RASTER];
+    glBlendFunc(src, dst);
 }
 
-struct CalculateTangetData {
-    struct Vertex *vertices;
-    u32 numVertices;
-    const u32 *indices;
-    u32 numIndices;
-};
-
-static void
-GetNormal(const SMikkTSpaceContext *pContext, f32 fvNormOut[], const i32 iFace,
-          const i32 iVert)
+void
+GpuTimer_Init(struct GpuTimer *t, const i8 *name)
 {
-    struct CalculateTangetData *data = pContext->m_pUserData;
-    fvNormOut[0] = data->vertices[iFace * 3 + iVert].normal.X;
-    fvNormOut[1] = data->vertices[iFace * 3 + iVert].normal.Y;
-    fvNormOut[2] = data->vertices[iFace * 3 + iVert].normal.Z;
+    ZERO_MEMORY(t);
+    GLCHECK(glGenQueries(GPU_TIMER_FRAMES, t->queries));
+    for (u32 i = 0; i < GPU_TIMER_FRAMES; ++i) {
+        // a query object is created by its first use
+        GLCHECK(glBeginQuery(GL_TIME_ELAPSED, t->queries[i]));
+        GLCHECK(glEndQuery(GL_TIME_ELAPSED));
+        SetObjectName(OI_QUERY, t->queries[i], name);
+    }
 }
 
-static void
-GetPosition(const SMikkTSpaceContext *pContext, f32 fvPosOut[],
-            const i32 iFace, const i32 iVert)
+void
+GpuTimer_Deinit(struct GpuTimer *t)
 {
-    struct CalculateTangetData *data = pContext->m_pUserData;
-    fvPosOut[0] = data->vertices[iFace * 3 + iVert].position.X;
-    fvPosOut[1] = data->vertices[iFace * 3 + iVert].position.Y;
-    fvPosOut[2] = data->vertices[iFace * 3 + iVert].position.Z;
+    GLCHECK(glDeleteQueries(GPU_TIMER_FRAMES, t->queries));
 }
 
-static void
-GetTexCoords(const SMikkTSpaceContext *pContext, f32 fvTexcOut[],
-             const i32 iFace, const i32 iVert)
+void
+GpuTimer_Begin(struct GpuTimer *t)
 {
-    struct CalculateTangetData *data = pContext->m_pUserData;
-    fvTexcOut[0] = data->vertices[iFace * 3 + iVert].texCoords.X;
-    fvTexcOut[1] = data->vertices[iFace * 3 + iVert].texCoords.Y;
+    const u32 query = t->queries[t->next];
+    if (t->isPending[t->next]) {
+        GLuint64 nanoseconds = 0;
+        GLCHECK(glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds));
+        t->milliseconds = nanoseconds / 1.0e6;
+    }
+    GLCHECK(glBeginQuery(GL_TIME_ELAPSED, query));
 }
 
-static i32
-GetNumVerticesOfFace(const SMikkTSpaceContext *pContext, const i32 iFace)
+void
+GpuTimer_End(struct GpuTimer *t)
 {
-    return 3;
+    GLCHECK(glEndQuery(GL_TIME_ELAPSED));
+    t->isPending[t->next] = 1;
+    t->next = (t->next + 1) % GPU_TIMER_FRAMES;
 }
 
-static void
-SetTSpaceBasic(const SMikkTSpaceContext *pContext, const f32 fvTangent[],
-               const f32 fSign, const i32 iFace, const i32 iVert)
+void
+GpuSampleCounters_Init(struct GpuSampleCounters *c, u32 numCounters)
 {
-    struct CalculateTangetData *data = pContext->m_pUserData;
-    data->vertices[iFace * 3 + iVert].tangent.X = fvTangent[0];
-    data->vertices[iFace * 3 + iVert].tangent.Y = fvTangent[1];
-    data->vertices[iFace * 3 + iVert].tangent.Z = fvTangent[2];
-    data->vertices[iFace * 3 + iVert].tangent.W = fSign;
+    ZERO_MEMORY(c);
+    c->numCounters = numCounters;
+    c->queries = malloc(sizeof(u32) * GPU_TIMER_FRAMES * numCounters);
+    c->samples = malloc(sizeof(u32) * numCounters);
+    GLCHECK(glGenQueries(GPU_TIMER_FRAMES * numCounters, c->queries));
 }
 
-static i32
-GetNumFaces(const SMikkTSpaceContext *pContext)
+void
+GpuSampleCounters_Deinit(struct GpuSampleCounters *c)
 {
-    struct CalculateTangetData *data = pContext->m_pUserData;
-    return data->numIndices / 3;
+    GLCHECK(glDeleteQueries(GPU_TIMER_FRAMES * c->numCounters, c->queries));
+    free(c->queries);
+    free(c->samples);
 }
 
-static void
-CalculateTangentArray(struct CalculateTangetData *data)
+void
+GpuSampleCounters_BeginFrame(struct GpuSampleCounters *c)
 {
-    SMikkTSpaceInterface interface = { 0 };
-    interface.m_setTSpaceBasic = SetTSpaceBasic;
-    interface.m_getNumFaces = GetNumFaces;
-    interface.m_getNumVerticesOfFace = GetNumVerticesOfFace;
-    interface.m_getPosition = GetPosition;
-    interface.m_getNormal = GetNormal;
-    interface.m_getTexCoord = GetTexCoords;
-
-    SMikkTSpaceContext context
-        = { .m_pInterface = &interface, .m_pUserData = data };
-    genTangSpaceDefault(&context);
+    const u32 *queries = c->queries + c->next * c->numCounters;
+    const u32 numUsed = c->numUsed[c->next];
+    if (numUsed == 0) {
+        c->numResults = 0;
+        return;
+    }
+    for (u32 i = 0; i < numUsed; ++i) {
+        GLCHECK(glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT,
+                                    c->samples + i));
+    }
+    c->numResults = numUsed;
+    c->numUsed[c->next] = 0;
 }
 
-static struct ModelProxy *
-CreateModelProxy(const struct Model *m)
+void
+GpuSampleCounters_Begin(struct GpuSampleCounters *c, u32 counter)
 {
-    if (!m || m->NumMeshes == 0) {
-        return NULL;
+    assert(counter < c->numCounters);
+    GLCHECK(glBeginQuery(GL_SAMPLES_PASSED,
+                         c->queries[c->next * c->numCounters + counter]));
+    if (counter >= c->numUsed[c->next]) {
+        c->numUsed[c->next] = counter + 1;
     }
+}
 
-    const Mat4X4 world = MathMat4X4Identity();
+void
+GpuSampleCounters_End(struct GpuSampleCounters *c)
+{
+    (void)c;
+    GLCHECK(glEndQuery(GL_SAMPLES_PASSED));
+}
 
-    struct ModelProxy *ret = malloc(sizeof *ret);
-    ret->meshes = malloc(sizeof(struct MeshProxy) * m->NumMeshes);
-    ret->numMeshes = m->NumMeshes;
-    // indices in *.obj are increased from 1 to N
-    // and they do not reset to 0 when next mesh starts
-    // say we have two cubes and first cube's last indices are
-    // 4 0 1
-    // then follows next cube and it's indices start from 8 and not from 1
-    // 12 10 8
-    // thus we add indexOffset and subtract it from index from *.obj
-    u32 posIdxOffset = 0;
-    u32 normIdxOffset = 0;
-    u32 texIdxOffset = 0;
+void
+GpuSampleCounters_EndFrame(struct GpuSampleCounters *c)
+{
+    c->next = (c->next + 1) % GPU_TIMER_FRAMES;
+}
+
+void
+ClusterGrid_Init(struct ClusterGrid *g, const i8 *name)
+{
+    ZERO_MEMORY(g);
+    BufferTexture_Init(&g->clusterTexture, GL_RG32UI,
+                       UtilsFormatStr("%sClusters", name));
+    BufferTexture_Init(&g->indexTexture, GL_R32UI,
+                       UtilsFormatStr("%sIndices", name));
+}
+
+void
+ClusterGrid_Deinit(struct ClusterGrid *g)
+{
+    BufferTexture_Deinit(&g->clusterTexture);
+    BufferTexture_Deinit(&g->indexTexture);
+    free(g->clusters);
+    free(g->indices);
+}
+
+void
+ClusterGrid_Begin(struct ClusterGrid *g, u32 width, u32 height, f32 zNear,
+                  f32 zFar)
+{
+    g->width = width;
+    g->height = height;
+    g->numTilesX = (width + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+    g->numTilesY = (height + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+    g->numClusters = g->numTilesX * g->numTilesY * CLUSTER_DEPTH_SLICES;
+    g->zNear = zNear;
+    g->zFar = zFar;
+    g->sliceScale = CLUSTER_DEPTH_SLICES / logf(zFar / zNear);
+    g->sliceBias = -logf(zNear) * g->sliceScale;
+    if (g->numClusters > g->clusterCapacity) {
+        g->clusterCapacity = g->numClusters;
+        g->clusters = realloc(g->clusters,
+                              sizeof(u32) * 2 * g->clusterCapacity);
+    }
+}
+
+static u16
+ClampClusterCoord(f32 v, u32 count)
+{
+    return v <= 0.0f ? 0 : v >= (f32)(count - 1) ? (u16)(count - 1) : (u16)v;
+}
+
+void
+ClusterGrid_GetRange(const struct ClusterGrid *g, const Vec3D *points,
+                     u32 numPoints, const Mat4X4 *view, const Mat4X4 *proj,
+                     struct ClusterRange *out)
+{
+    f32 minZ = FLT_MAX;
+    f32 maxZ = 0.0f;
+    // normalized device coordinates
+    f32 minX = 1.0f;
+    f32 maxX = -1.0f;
+    f32 minY = 1.0f;
+    f32 maxY = -1.0f;
+    boolean isCrossingNear = 0;
+    for (u32 i = 0; i < numPoints; ++i) {
+        const Vec4D world
+            = { points[i].X, points[i].Y, points[i].Z, 1.0f };
+        const Vec4D v = MathMat4X4MultVec4DByMat4X4(&world, view);
+        minZ = v.Z < minZ ? v.Z : minZ;
+        maxZ = v.Z > maxZ ? v.Z : maxZ;
+        if (v.Z < g->zNear) {
+            // projection of points behind the camera flips, such hulls may
+            // cover any pixel
+            isCrossingNear = 1;
+            continue;
+        }
+        const Vec4D clip = MathMat4X4MultVec4DByMat4X4(&v, proj);
+        const f32 x = clip.X / clip.W;
+        const f32 y = clip.Y / clip.W;
+        minX = x < minX ? x : minX;
+        maxX = x > maxX ? x : maxX;
+        minY = y < minY ? y : minY;
+        maxY = y > maxY ? y : maxY;
+    }
+    if (isCrossingNear) {
+        minX = minY = -1.0f;
+        maxX = maxY = 1.0f;
+    }
+    minZ = minZ < g->zNear ? g->zNear : minZ;
+    maxZ = maxZ < g->zNear ? g->zNear : maxZ;
+    const Vec4D ndcRect = { minX, minY, maxX, maxY };
+    ClusterGrid_GetRangeFromBounds(g, &ndcRect, minZ, maxZ, out);
+}
+
+void
+ClusterGrid_GetRangeFromBounds(const struct ClusterGrid *g,
+                               const Vec4D *ndcRect, f32 minZ, f32 maxZ,
+                               struct ClusterRange *out)
+{
+    const f32 tilesPerNdcX = 0.5f * g->width / CLUSTER_TILE_SIZE;
+    const f32 tilesPerNdcY = 0.5f * g->height / CLUSTER_TILE_SIZE;
+    out->minX = ClampClusterCoord((ndcRect->X + 1.0f) * tilesPerNdcX,
+                                  g->numTilesX);
+    out->maxX = ClampClusterCoord((ndcRect->Z + 1.0f) * tilesPerNdcX,
+                                  g->numTilesX);
+    out->minY = ClampClusterCoord((ndcRect->Y + 1.0f) * tilesPerNdcY,
+                                  g->numTilesY);
+    out->maxY = ClampClusterCoord((ndcRect->W + 1.0f) * tilesPerNdcY,
+                                  g->numTilesY);
+    out->minZ = ClampClusterCoord(logf(minZ) * g->sliceScale + g->sliceBias,
+                                  CLUSTER_DEPTH_SLICES);
+    out->maxZ = ClampClusterCoord(logf(maxZ) * g->sliceScale + g->sliceBias,
+                                  CLUSTER_DEPTH_SLICES);
+}
+
+void
+ClusterGrid_Build(struct ClusterGrid *g, const struct ClusterRange *ranges,
+                  u32 numItems)
+{
+    // counts, then first indices by prefix sum, then the lists
+    u32 *clusters = g->clusters;
+    memset(clusters, 0, sizeof(u32) * 2 * g->numClusters);
+    const u32 sliceSize = g->numTilesX * g->numTilesY;
+    for (u32 i = 0; i < numItems; ++i) {
+        const struct ClusterRange *r = ranges + i;
+        for (u32 z = r->minZ; z <= r->maxZ; ++z) {
+            for (u32 y = r->minY; y <= r->maxY; ++y) {
+                const u32 row = z * sliceSize + y * g->numTilesX;
+                for (u32 x = r->minX; x <= r->maxX; ++x) {
+                    ++clusters[2 * (row + x) + 1];
+                }
+            }
+        }
+    }
+    u32 numIndices = 0;
+    for (u32 c = 0; c < g->numClusters; ++c) {
+        clusters[2 * c] = numIndices;
+        numIndices += clusters[2 * c + 1];
+        clusters[2 * c + 1] = 0;
+    }
+    if (numIndices > g->indexCapacity) {
+        g->indexCapacity = numIndices;
+        g->indices = realloc(g->indices, sizeof(u32) * g->indexCapacity);
+    }
+    g->numIndices = numIndices;
+    for (u32 i = 0; i < numItems; ++i) {
+        const struct ClusterRange *r = ranges + i;
+        for (u32 z = r->minZ; z <= r->maxZ; ++z) {
+            for (u32 y = r->minY; y <= r->maxY; ++y) {
+                const u32 row = z * sliceSize + y * g->numTilesX;
+                for (u32 x = r->minX; x <= r->maxX; ++x) {
+                    u32 *cluster = clusters + 2 * (row + x);
+                    g->indices[cluster[0] + cluster[1]++] = i;
+                }
+            }
+        }
+    }
+    BufferTexture_Upload(&g->clusterTexture, clusters,
+                         sizeof(u32) * 2 * g->numClusters);
+    BufferTexture_Upload(&g->indexTexture, g->indices,
+                         sizeof(u32) * numIndices);
+}
+
+Vec4D
+ClusterGrid_GetShaderParams(const struct ClusterGrid *g)
+{
+    const Vec4D params = { (f32)g->numTilesX, (f32)g->numTilesY,
+                           g->sliceScale, g->sliceBias };
+    return params;
+}
+
+static i32
+IsSamplerType(u32 type)
+{
+    switch (type) {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_1D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_BUFFER:
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_INT_SAMPLER_2D:
+    case GL_INT_SAMPLER_2D_ARRAY:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Bytes of one element of uniform types Material_SetUniform supports, 0 for
+// others
+static u32
+GetUniformTypeSize(u32 type)
+{
+    switch (type) {
+    case GL_FLOAT_MAT4:
+        return sizeof(Mat4X4);
+    case GL_FLOAT_VEC4:
+        return sizeof(Vec4D);
+    case GL_FLOAT_VEC3:
+        return sizeof(Vec3D);
+    case GL_FLOAT_VEC2:
+        return sizeof(Vec2D);
+    case GL_FLOAT:
+    case GL_INT:
+    case GL_BOOL:
+    case GL_UNSIGNED_INT:
+        return sizeof(u32);
+    default:
+        return 0;
+    }
+}
+
+static u32
+HashUniformName(const i8 *name)
+{
+    return (u32)UtilsHash64(name, strlen(name));
+}
+
+// Queries all active uniforms once, assigns texture units to samplers in
+// order and points the samplers at them
+static void
+ReflectUniforms(struct Material *m)
+{
+    i32 numActive = 0;
+    i32 maxNameLength = 0;
+    GLCHECK(glGetProgramiv(m->programHandle, GL_ACTIVE_UNIFORMS, &numActive));
+    GLCHECK(glGetProgramiv(m->programHandle, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+                           &maxNameLength));
+    m->uniforms = malloc(sizeof(struct MaterialUniform) * (numActive + 1));
+    m->numUniforms = 0;
+    i8 *name = malloc(maxNameLength + 1);
+    i32 currentProgram = 0;
+    GLCHECK(glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram));
+    GLCHECK(glUseProgram(m->programHandle));
+    i32 numTextureUnits = 0;
+    for (i32 i = 0; i < numActive; ++i) {
+        i32 length = 0;
+        i32 count = 0;
+        u32 type = 0;
+        GLCHECK(glGetActiveUniform(m->programHandle, i, maxNameLength + 1,
+                                   &length, &count, &type, name));
+        GLCHECK(const i32 location
+                = glGetUniformLocation(m->programHandle, name));
+        // members of uniform blocks have no location
+        if (location < 0) {
+            continue;
+        }
+        // arrays are reported as name[0], look them up by plain name
+        if (length > 3 && strcmp(name + length - 3, "[0]") == 0) {
+            name[length - 3] = '\0';
+        }
+        struct MaterialUniform *u = m->uniforms + m->numUniforms++;
+        u->name = strdup(name);
+        u->location = location;
+        u->type = type;
+        u->count = count;
+        u->textureUnit = -1;
+        u->valueSize = GetUniformTypeSize(type) * count;
+        u->value = u->valueSize ? malloc(u->valueSize) : NULL;
+        u->hasValue = 0;
+        if (IsSamplerType(type)) {
+            if (numTextureUnits + count > MAX_SAMPLERS) {
+                UtilsFatalError("FATAL ERROR: %s uses more than %d samplers",
+                                m->name, MAX_SAMPLERS);
+            }
+            u->textureUnit = numTextureUnits;
+            for (i32 k = 0; k < count; ++k) {
+                GLCHECK(glUniform1i(location + k, numTextureUnits++));
+            }
+        }
+    }
+    GLCHECK(glUseProgram(currentProgram));
+    free(name);
+
+    m->uniformTableSize = 1;
+    while (m->uniformTableSize < 2 * m->numUniforms) {
+        m->uniformTableSize *= 2;
+    }
+    m->uniformTable = calloc(m->uniformTableSize, sizeof(u32));
+    const u32 mask = m->uniformTableSize - 1;
+    for (u32 i = 0; i < m->numUniforms; ++i) {
+        u32 slot = HashUniformName(m->uniforms[i].name) & mask;
+        while (m->uniformTable[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        m->uniformTable[slot] = i + 1;
+    }
+    UtilsDebugPrint("%s: %u uniforms, %d samplers", m->name, m->numUniforms,
+                    numTextureUnits);
+}
+
+static const i8 *const UNIFORM_BLOCK_NAMES[UB_COUNT]
+    = { "FrameConstants", "DrawConstants" };
+
+static const u32 UNIFORM_BLOCK_SIZES[UB_COUNT]
+    = { sizeof(struct FrameConstants), sizeof(struct DrawConstants) };
+
+// Points active uniform blocks at their fixed binding points and checks
+// that std140 size matches the C struct
+static void
+BindUniformBlocks(struct Material *m)
+{
+    i32 numBlocks = 0;
+    GLCHECK(glGetProgramiv(m->programHandle, GL_ACTIVE_UNIFORM_BLOCKS,
+                           &numBlocks));
+    for (i32 i = 0; i < numBlocks; ++i) {
+        i8 name[64];
+        GLCHECK(glGetActiveUniformBlockName(m->programHandle, i,
+                                            sizeof(name), NULL, name));
+        u32 block = 0;
+        while (block < UB_COUNT
+               && strcmp(UNIFORM_BLOCK_NAMES[block], name) != 0) {
+            ++block;
+        }
+        if (block == UB_COUNT) {
+            UtilsFatalError("FATAL ERROR: %s uses unknown uniform block %s",
+                            m->name, name);
+        }
+        i32 size = 0;
+        GLCHECK(glGetActiveUniformBlockiv(m->programHandle, i,
+                                          GL_UNIFORM_BLOCK_DATA_SIZE, &size));
+        if ((u32)size != UNIFORM_BLOCK_SIZES[block]) {
+            UtilsFatalError("FATAL ERROR: Block %s of %s is %d bytes, "
+                            "expected %u",
+                            name, m->name, size, UNIFORM_BLOCK_SIZES[block]);
+        }
+        GLCHECK(glUniformBlockBinding(m->programHandle, i, block));
+    }
+}
+
+struct Material *
+Material_Create(const struct MaterialCreateInfo *info)
+{
+    struct Material *m = malloc(sizeof *m);
+    m->programHandle = CreateProgram(info->fsPath, info->vsPath, info->name,
+                                     info->defines);
+    m->name = info->name;
+    m->createInfo = *info;
+    ReflectUniforms(m);
+    BindUniformBlocks(m);
+    return m;
+}
+
+void
+Material_Destroy(struct Material *m)
+{
+    GLCHECK(glDeleteProgram(m->programHandle));
+    for (u32 i = 0; i < m->numUniforms; ++i) {
+        free(m->uniforms[i].name);
+        free(m->uniforms[i].value);
+    }
+    free(m->uniforms);
+    free(m->uniformTable);
+    free(m);
+    m = NULL;
+}
+
+u32
+Material_GetHandle(const struct Material *m)
+{
+    return m->programHandle;
+}
+
+const i8 *
+Material_GetName(const struct Material *m)
+{
+    return m->name;
+}
+
+i32
+Material_GetUniformHandle(const struct Material *m, const i8 *name)
+{
+    const u32 mask = m->uniformTableSize - 1;
+    for (u32 slot = HashUniformName(name) & mask; m->uniformTable[slot];
+         slot = (slot + 1) & mask) {
+        const u32 index = m->uniformTable[slot] - 1;
+        if (strcmp(m->uniforms[index].name, name) == 0) {
+            return (i32)index;
+        }
+    }
+    return MATERIAL_INVALID_UNIFORM;
+}
+
+void
+Material_SetUniform(struct Material *m, i32 uniform, const void *data)
+{
+    if (uniform == MATERIAL_INVALID_UNIFORM) {
+        return;
+    }
+    assert((u32)uniform < m->numUniforms);
+    struct MaterialUniform *u = m->uniforms + uniform;
+    if (u->hasValue && memcmp(u->value, data, u->valueSize) == 0) {
+        ++g_glState.frameStats.numFiltered[GSC_UNIFORM];
+        return;
+    }
+    ++g_glState.frameStats.numIssued[GSC_UNIFORM];
+    // no GLCHECK, glGetError would stall every upload and errors reach the
+    // debug message callback anyway
+    switch (u->type) {
+    case GL_FLOAT_MAT4:
+        glUniformMatrix4fv(u->location, u->count, GL_FALSE, data);
+        break;
+    case GL_FLOAT_VEC4:
+        glUniform4fv(u->location, u->count, data);
+        break;
+    case GL_FLOAT_VEC3:
+        glUniform3fv(u->location, u->count, data);
+        break;
+    case GL_FLOAT_VEC2:
+        glUniform2fv(u->location, u->count, data);
+        break;
+    case GL_FLOAT:
+        glUniform1fv(u->location, u->count, data);
+        break;
+    case GL_INT:
+    case GL_BOOL:
+        glUniform1iv(u->location, u->count, data);
+        break;
+    case GL_UNSIGNED_INT:
+        glUniform1uiv(u->location, u->count, data);
+        break;
+    default:
+        UtilsFatalError("FATAL ERROR: Uniform %s of %s has unsupported type "
+                        "0x%x",
+                        u->name, m->name, u->type);
+    }
+    memcpy(u->value, data, u->valueSize);
+    u->hasValue = 1;
+}
+
+void
+Material_SetTexture(struct Material *m, i32 uniform,
+                    const struct Texture2D *t)
+{
+    if (uniform == MATERIAL_INVALID_UNIFORM) {
+        return;
+    }
+    assert((u32)uniform < m->numUniforms);
+    const struct MaterialUniform *u = m->uniforms + uniform;
+    assert(u->textureUnit >= 0);
+    GLState_BindTexture(u->textureUnit, GL_TEXTURE_2D, t->handle);
+}
+
+void
+Material_SetTextureArray(struct Material *m, i32 uniform,
+                         const struct Texture2DArray *t)
+{
+    if (uniform == MATERIAL_INVALID_UNIFORM) {
+        return;
+    }
+    assert((u32)uniform < m->numUniforms);
+    const struct MaterialUniform *u = m->uniforms + uniform;
+    assert(u->textureUnit >= 0);
+    GLState_BindTexture(u->textureUnit, GL_TEXTURE_2D_ARRAY, t->handle);
+}
+
+void
+Material_SetBufferTexture(struct Material *m, i32 uniform,
+                          const struct BufferTexture *t)
+{
+    if (uniform == MATERIAL_INVALID_UNIFORM) {
+        return;
+    }
+    assert((u32)uniform < m->numUniforms);
+    const struct MaterialUniform *u = m->uniforms + uniform;
+    assert(u->textureUnit >= 0);
+    GLState_BindTexture(u->textureUnit, GL_TEXTURE_BUFFER, t->texture);
+}
+
+struct UniformRing *
+UniformRing_Create(u32 frameSize)
+{
+    struct UniformRing *r = malloc(sizeof *r);
+    ZERO_MEMORY(r);
+    i32 alignment = 0;
+    GLCHECK(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+    r->alignment = alignment > 0 ? (u32)alignment : 256;
+    r->frameSize = UniformRing_GetStride(r, frameSize);
+    GLCHECK(glGenBuffers(1, &r->buffer));
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, r->buffer));
+    GLCHECK(glBufferData(GL_UNIFORM_BUFFER,
+                         (u64)r->frameSize * UNIFORM_RING_FRAMES, NULL,
+                         GL_STREAM_DRAW));
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    SetObjectName(OI_BUFFER, r->buffer, "Uniform Ring");
+    return r;
+}
+
+void
+UniformRing_Destroy(struct UniformRing *r)
+{
+    for (u32 i = 0; i < UNIFORM_RING_FRAMES; ++i) {
+        if (r->fences[i]) {
+            GLCHECK(glDeleteSync(r->fences[i]));
+        }
+    }
+    GLCHECK(glDeleteBuffers(1, &r->buffer));
+    free(r);
+}
+
+void
+UniformRing_BeginFrame(struct UniformRing *r)
+{
+    r->frameIndex = (r->frameIndex + 1) % UNIFORM_RING_FRAMES;
+    r->head = 0;
+    GLsync fence = r->fences[r->frameIndex];
+    if (!fence) {
+        return;
+    }
+    // usually signaled already, the part was written UNIFORM_RING_FRAMES
+    // frames ago
+    GLCHECK(GLenum result = glClientWaitSync(fence, 0, 0));
+    while (result == GL_TIMEOUT_EXPIRED) {
+        GLCHECK(result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                          1000 * 1000));
+    }
+    GLCHECK(glDeleteSync(fence));
+    r->fences[r->frameIndex] = 0;
+}
+
+void
+UniformRing_EndFrame(struct UniformRing *r)
+{
+    assert(!r->isMapped);
+    assert(!r->fences[r->frameIndex]);
+    GLCHECK(r->fences[r->frameIndex]
+            = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
+
+u32
+UniformRing_GetStride(const struct UniformRing *r, u32 blockSize)
+{
+    return (blockSize + r->alignment - 1) / r->alignment * r->alignment;
+}
+
+void *
+UniformRing_Map(struct UniformRing *r, u32 stride, u32 count, u32 *outOffset)
+{
+    assert(!r->isMapped);
+    assert(count > 0 && stride % r->alignment == 0);
+    const u64 size = (u64)stride * count;
+    if (size > r->frameSize) {
+        UtilsFatalError("FATAL ERROR: %llu bytes do not fit uniform ring "
+                        "frame of %u bytes",
+                        (unsigned long long)size, r->frameSize);
+    }
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, r->buffer));
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+                        | GL_MAP_INVALIDATE_RANGE_BIT;
+    if (r->head + size > r->frameSize) {
+        // frame is out of space, orphan the buffer. Draws that were issued
+        // keep the old storage, so the fences of all parts are moot.
+        UtilsDebugPrint("WARNING: Uniform ring frame of %u bytes is full",
+                        r->frameSize);
+        GLCHECK(glBufferData(GL_UNIFORM_BUFFER,
+                             (u64)r->frameSize * UNIFORM_RING_FRAMES, NULL,
+                             GL_STREAM_DRAW));
+        for (u32 i = 0; i < UNIFORM_RING_FRAMES; ++i) {
+            if (r->fences[i]) {
+                GLCHECK(glDeleteSync(r->fences[i]));
+                r->fences[i] = 0;
+            }
+        }
+        r->head = 0;
+    }
+    *outOffset = r->frameIndex * r->frameSize + r->head;
+    GLCHECK(void *data = glMapBufferRange(GL_UNIFORM_BUFFER, *outOffset,
+                                          size, access));
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    r->head += size;
+    r->isMapped = 1;
+    return data;
+}
+
+void
+UniformRing_Unmap(struct UniformRing *r)
+{
+    assert(r->isMapped);
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, r->buffer));
+    GLCHECK(glUnmapBuffer(GL_UNIFORM_BUFFER));
+    GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    r->isMapped = 0;
+}
+
+void
+UniformRing_Bind(const struct UniformRing *r, enum UniformBlock block,
+                 u32 offset, u32 size)
+{
+    GLState_BindUniformBuffer(block, r->buffer, offset, size);
+}
+
+void
+RenderQueue_Init(struct RenderQueue *q)
+{
+    ZERO_MEMORY(q);
+}
+
+void
+RenderQueue_Deinit(struct RenderQueue *q)
+{
+    free(q->packets);
+    free(q->order);
+    free(q->keys);
+    free(q->tmpKeys);
+    free(q->tmpOrder);
+    ZERO_MEMORY(q);
+}
+
+void
+RenderQueue_Reset(struct RenderQueue *q, u32 capacity)
+{
+    q->numPackets = 0;
+    if (capacity <= q->capacity) {
+        return;
+    }
+    q->capacity = capacity;
+    q->packets = realloc(q->packets, sizeof(struct DrawPacket) * capacity);
+    q->order = realloc(q->order, sizeof(u32) * capacity);
+    q->keys = realloc(q->keys, sizeof(uint64_t) * capacity);
+    q->tmpKeys = realloc(q->tmpKeys, sizeof(uint64_t) * capacity);
+    q->tmpOrder = realloc(q->tmpOrder, sizeof(u32) * capacity);
+}
+
+struct DrawPacket *
+RenderQueue_Push(struct RenderQueue *q, u32 count)
+{
+    const u32 first = UtilsAtomicAdd32(&q->numPackets, count);
+    if (first + count > q->capacity) {
+        UtilsFatalError("FATAL ERROR: Render queue of %u packets is full",
+                        q->capacity);
+    }
+    return q->packets + first;
+}
+
+u64
+RenderQueue_MakeSortKey(u32 pass, u32 program, u32 textureSet,
+                        u32 vertexArray, f32 depth)
+{
+    const u32 maxDepth = (1u << SORT_KEY_DEPTH_BITS) - 1;
+    depth = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+    u64 key = pass & ((1u << SORT_KEY_PASS_BITS) - 1);
+    key = (key << SORT_KEY_PROGRAM_BITS)
+          | (program & ((1u << SORT_KEY_PROGRAM_BITS) - 1));
+    key = (key << SORT_KEY_TEXTURE_SET_BITS)
+          | (textureSet & ((1u << SORT_KEY_TEXTURE_SET_BITS) - 1));
+    key = (key << SORT_KEY_VERTEX_ARRAY_BITS)
+          | (vertexArray & ((1u << SORT_KEY_VERTEX_ARRAY_BITS) - 1));
+    key = (key << SORT_KEY_DEPTH_BITS) | (u32)(depth * maxDepth);
+    return key;
+}
+
+void
+RenderQueue_Sort(struct RenderQueue *q)
+{
+    for (u32 i = 0; i < q->numPackets; ++i) {
+        q->keys[i] = q->packets[i].sortKey;
+        q->order[i] = i;
+    }
+    UtilsRadixSort64(q->keys, q->order, q->numPackets, q->tmpKeys,
+                     q->tmpOrder);
+}
+
+void
+RenderQueue_Execute(const struct RenderQueue *q, u32 pass,
+                    const struct UniformRing *ring, DrawPacketFunc draw,
+                    void *userData)
+{
+    const u32 passShift = 64 - SORT_KEY_PASS_BITS;
+    u32 i = 0;
+    while (i < q->numPackets && q->keys[i] >> passShift < pass) {
+        ++i;
+    }
+    for (; i < q->numPackets && q->keys[i] >> passShift == pass; ++i) {
+        const struct DrawPacket *p = q->packets + q->order[i];
+        GLState_UseProgram(Material_GetHandle(p->material));
+        for (u32 t = 0; t < p->numTextures; ++t) {
+            Material_SetTexture(p->material, p->samplers[t], p->textures[t]);
+        }
+        GLState_BindVertexArray(p->mesh->vao);
+        UniformRing_Bind(ring, UB_DRAW, p->drawOffset,
+                         sizeof(struct DrawConstants));
+        if (draw) {
+            draw(p, userData);
+        } else {
+            MeshProxy_DrawLod(p->mesh, p->lod);
+        }
+    }
+}
+
+void
+SetObjectName(enum ObjectIdentifier objectIdentifier, u32 name,
+              const i8 *label)
+{
+    const i8 *prefix = NULL;
+    i32 identifier = 0;
+    switch (objectIdentifier) {
+    case OI_BUFFER:
+        prefix = "BUFFER";
+        identifier = GL_BUFFER;
+        break;
+    case OI_INDEX_BUFFER:
+        prefix = "EBO";
+        identifier = GL_BUFFER;
+        break;
+    case OI_VERTEX_BUFFER:
+        prefix = "VBO";
+        identifier = GL_BUFFER;
+        break;
+    case OI_SHADER:
+        prefix = "SHADER";
+        identifier = GL_SHADER;
+        break;
+    case OI_VERTEX_SHADER:
+        prefix = "VS";
+        identifier = GL_SHADER;
+        break;
+    case OI_FRAGMENT_SHADER:
+        prefix = "FS";
+        identifier = GL_SHADER;
+        break;
+    case OI_PROGRAM:
+        prefix = "PROGRAM";
+        identifier = GL_PROGRAM;
+        break;
+    case OI_VERTEX_ARRAY:
+        prefix = "VAO";
+        identifier = GL_VERTEX_ARRAY;
+        break;
+    case OI_QUERY:
+        prefix = "QUERY";
+        identifier = GL_QUERY;
+        break;
+    case OI_PROGRAM_PIPELINE:
+        prefix = "PROGRAM_PIPELINE";
+        identifier = GL_PROGRAM_PIPELINE;
+        break;
+    case OI_TRANSFORM_FEEDBACK:
+        prefix = "TRANSFORM_FEEDBACK";
+        identifier = GL_TRANSFORM_FEEDBACK;
+        break;
+    case OI_SAMPLER:
+        prefix = "SAMPLER";
+        identifier = GL_SAMPLER;
+        break;
+    case OI_TEXTURE:
+        prefix = "TEXTURE";
+        identifier = GL_TEXTURE;
+        break;
+    case OI_RENDERBUFFER:
+        prefix = "RENDERBUFFER";
+        identifier = GL_RENDERBUFFER;
+        break;
+    case OI_FRAMEBUFFER:
+        prefix = "FRAMEBUFFER";
+        identifier = GL_FRAMEBUFFER;
+        break;
+    }
+
+    const i8 *fullLabel = UtilsFormatStr("%s_%s", label, prefix);
+    GLCHECK(glObjectLabel(identifier, name, strlen(fullLabel), fullLabel));
+}
+
+struct Texture2D *
+Texture2D_Create(const struct Texture2DCreateInfo *info)
+{
+    struct Texture2D *t = malloc(sizeof *t);
+    Texture2D_Init(t, info);
+    return t;
+}
+
+void
+Texture2D_Init(struct Texture2D *t, const struct Texture2DCreateInfo *info)
+{
+    u32 handle = 0;
+    GLCHECK(glGenTextures(1, &handle));
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, handle));
+    GLCHECK(glTexImage2D(GL_TEXTURE_2D, 0, info->internalFormat, info->width,
+                         info->height, 0, info->format, info->type, NULL));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    if (info->genFB) {
+        GLCHECK(glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                       info->framebufferAttachment,
+                                       GL_TEXTURE_2D, handle, 0));
+    }
+    SetObjectName(OI_TEXTURE, handle, info->name);
+    t->handle = handle;
+    t->width = info->width;
+    t->height = info->height;
+    t->name = strdup(info->name);
+}
+
+void
+Texture2D_Destroy(struct Texture2D *t)
+{
+    free(t->name);
+    free(t);
+    t = NULL;
+}
+
+void
+Texture2DArray_Init(struct Texture2DArray *t, const struct Texture2D *layers,
+                    u32 numLayers, const i8 *name)
+{
+    assert(numLayers > 0);
+    t->width = layers[0].width;
+    t->height = layers[0].height;
+    t->numLayers = numLayers;
+    t->name = strdup(name);
+    GLCHECK(glGenTextures(1, &t->handle));
+    GLState_BindTexture(0, GL_TEXTURE_2D_ARRAY, t->handle);
+    GLCHECK(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, t->width,
+                         t->height, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         NULL));
+    // blits copy on the GPU and scale layers of a different size
+    u32 framebuffers[2] = { 0 };
+    GLCHECK(glGenFramebuffers(2, framebuffers));
+    GLState_BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+    GLState_BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+    for (u32 i = 0; i < numLayers; ++i) {
+        GLCHECK(glFramebufferTexture2D(GL_READ_FRAMEBUFFER,
+                                       GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                       layers[i].handle, 0));
+        GLCHECK(glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER,
+                                          GL_COLOR_ATTACHMENT0, t->handle, 0,
+                                          i));
+        GLCHECK(glBlitFramebuffer(0, 0, layers[i].width, layers[i].height, 0,
+                                  0, t->width, t->height,
+                                  GL_COLOR_BUFFER_BIT, GL_LINEAR));
+    }
+    GLState_BindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLCHECK(glDeleteFramebuffers(2, framebuffers));
+    GLCHECK(glGenerateMipmap(GL_TEXTURE_2D_ARRAY));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+                            GL_REPEAT));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+                            GL_REPEAT));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                            GL_LINEAR_MIPMAP_LINEAR));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER,
+                            GL_LINEAR));
+    SetObjectName(OI_TEXTURE, t->handle, name);
+}
+
+void
+Texture2DArray_Deinit(struct Texture2DArray *t)
+{
+    GLCHECK(glDeleteTextures(1, &t->handle));
+    free(t->name);
+}
+
+static u32
+GetBufferTexelSize(u32 internalFormat)
+{
+    switch (internalFormat) {
+    case GL_R32F:
+    case GL_R32UI:
+        return 4;
+    case GL_RG32F:
+    case GL_RG32UI:
+        return 8;
+    case GL_RGBA32F:
+    case GL_RGBA32UI:
+        return 16;
+    default:
+        UtilsFatalError("FATAL ERROR: Unsupported buffer texture format 0x%x",
+                        internalFormat);
+        return 0;
+    }
+}
+
+void
+BufferTexture_Init(struct BufferTexture *t, u32 internalFormat,
+                   const i8 *name)
+{
+    ZERO_MEMORY(t);
+    t->internalFormat = internalFormat;
+    t->texelSize = GetBufferTexelSize(internalFormat);
+    i32 maxTexels = 0;
+    GLCHECK(glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels));
+    t->maxTexels = (u32)maxTexels;
+    GLCHECK(glGenBuffers(1, &t->buffer));
+    GLCHECK(glBindBuffer(GL_TEXTURE_BUFFER, t->buffer));
+    GLCHECK(glBufferData(GL_TEXTURE_BUFFER, t->texelSize, NULL,
+                         GL_STREAM_DRAW));
+    GLCHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+    GLCHECK(glGenTextures(1, &t->texture));
+    GLState_BindTexture(0, GL_TEXTURE_BUFFER, t->texture);
+    GLCHECK(glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, t->buffer));
+    SetObjectName(OI_BUFFER, t->buffer, name);
+    SetObjectName(OI_TEXTURE, t->texture, name);
+}
+
+void
+BufferTexture_Deinit(struct BufferTexture *t)
+{
+    GLCHECK(glDeleteTextures(1, &t->texture));
+    GLCHECK(glDeleteBuffers(1, &t->buffer));
+}
+
+void
+BufferTexture_Upload(struct BufferTexture *t, const void *data, u64 size)
+{
+    const u64 maxSize = (u64)t->maxTexels * t->texelSize;
+    if (size > maxSize) {
+        UtilsDebugPrint("WARNING: %llu texels exceed buffer texture limit of "
+                        "%u",
+                        (unsigned long long)(size / t->texelSize),
+                        t->maxTexels);
+        size = maxSize;
+    }
+    // texture refers to the buffer by name, new storage needs no setup.
+    // Empty buffers keep one texel, texelFetch past the end returns 0.
+    GLCHECK(glBindBuffer(GL_TEXTURE_BUFFER, t->buffer));
+    GLCHECK(glBufferData(GL_TEXTURE_BUFFER, size ? size : t->texelSize,
+                         size ? data : NULL, GL_STREAM_DRAW));
+    GLCHECK(glBindBuffer(GL_TEXTURE_BUFFER, 0));
+}
+
+static void BuildModelData(const struct Model *m, struct ModelData *out,
+                           struct UtilsThreadPool *threadPool);
+static struct ModelProxy *
+CreateModelProxy(const struct ModelData *m, enum VertexFormat vertexFormat,
+                 struct GeometryBuffer *geometry, const Mat4X4 *world);
+static struct ModelProxy *
+LoadModel(const struct ModelProxyCreateInfo *info)
+{
+    const f64 startTime = UtilsGetTimeInSeconds();
+    i8 absPath[512];
+    // never truncated, a cut path would name another file
+    i8 cachePath[sizeof(absPath) + sizeof(".meshcache")];
+    snprintf(absPath, sizeof(absPath), "%s/%s", RES_HOME, info->path);
+    snprintf(cachePath, sizeof(cachePath), "%s.meshcache", absPath);
+
+    struct ModelData data = { 0 };
+    f64 parseSeconds = 0.0;
+    f64 buildSeconds = 0.0;
+    const i32 isCacheHit = MeshCache_Load(cachePath, absPath, &data);
+    if (!isCacheHit) {
+        struct Model *model = OLLoadParallel(absPath, 0);
+        if (!model) {
+            return NULL;
+        }
+        for (u32 i = 0; i < model->NumMeshes; ++i) {
+            const struct Mesh *mesh = model->Meshes + i;
+            UtilsDebugPrint("Mesh %s, faces: %u, normals: %u, positions: %u, "
+                            "texCoords: %u",
+                            mesh->Name, mesh->NumFaces, mesh->NumNormals,
+                            mesh->NumPositions, mesh->NumTexCoords);
+        }
+        const f64 buildStartTime = UtilsGetTimeInSeconds();
+        parseSeconds = buildStartTime - startTime;
+        BuildModelData(model, &data, info->threadPool);
+        ModelFree(model);
+        MeshCache_Save(cachePath, absPath, &data);
+        buildSeconds = UtilsGetTimeInSeconds() - buildStartTime;
+    }
+
+    const f64 uploadStartTime = UtilsGetTimeInSeconds();
+    struct ModelProxy *proxy
+        = CreateModelProxy(&data, info->vertexFormat, info->geometry,
+                           info->world);
+    ModelData_Destroy(&data);
+    const f64 endTime = UtilsGetTimeInSeconds();
+    UtilsDebugPrint("LoadModel: %s, %s start in %.2f ms (parse %.2f ms, "
+                    "build %.2f ms, upload %.2f ms), peak RSS %.1f MB",
+                    info->path, isCacheHit ? "warm" : "cold",
+                    (endTime - startTime) * 1000.0, parseSeconds * 1000.0,
+                    buildSeconds * 1000.0,
+                    (endTime - uploadStartTime) * 1000.0,
+                    UtilsGetPeakRSS() / (1024.0 * 1024.0));
+    return proxy;
+}
+
+void
+ModelData_Destroy(struct ModelData *m)
+{
+    if (m->cacheMapping.data) {
+        UtilsUnmapFile(&m->cacheMapping);
+    }
+    for (u32 i = 0; i < m->numArenas; ++i) {
+        UtilsArenaDeinit(m->arenas + i);
+    }
+    free(m->arenas);
+    free(m->meshes);
+    ZERO_MEMORY(m);
+}
+
+static void
+ValidateModelProxy(const struct ModelProxy *m)
+{
+    UtilsDebugPrint("Validating ModelProxy. Num meshes: %d", m->numMeshes);
+    for (u32 i = 0; i < m->numMeshes; ++i) {
+        UtilsDebugPrint("Mesh %d, Num indices: %d", i,
+                        m->meshes[i].numIndices);
+    }
+}
+
+struct CalculateTangetData {
+    struct Vertex *vertices;
+    u32 numVertices;
+    const u32 *indices;
+    u32 numIndices;
+};
+
+static void
+GetNormal(const SMikkTSpaceContext *pContext, f32 fvNormOut[], const i32 iFace,
+          const i32 iVert)
+{
+    struct CalculateTangetData *data = pContext->m_pUserData;
+    fvNormOut[0] = data->vertices[iFace * 3 + iVert].normal.X;
+    fvNormOut[1] = data->vertices[iFace * 3 + iVert].normal.Y;
+    fvNormOut[2] = data->vertices[iFace * 3 + iVert].normal.Z;
+}
+
+static void
+GetPosition(const SMikkTSpaceContext *pContext, f32 fvPosOut[],
+            const i32 iFace, const i32 iVert)
+{
+    struct CalculateTangetData *data = pContext->m_pUserData;
+    fvPosOut[0] = data->vertices[iFace * 3 + iVert].position.X;
+    fvPosOut[1] = data->vertices[iFace * 3 + iVert].position.Y;
+    fvPosOut[2] = data->vertices[iFace * 3 + iVert].position.Z;
+}
+
+static void
+GetTexCoords(const SMikkTSpaceContext *pContext, f32 fvTexcOut[],
+             const i32 iFace, const i32 iVert)
+{
+    struct CalculateTangetData *data = pContext->m_pUserData;
+    fvTexcOut[0] = data->vertices[iFace * 3 + iVert].texCoords.X;
+    fvTexcOut[1] = data->vertices[iFace * 3 + iVert].texCoords.Y;
+}
+
+static i32
+GetNumVerticesOfFace(const SMikkTSpaceContext *pContext, const i32 iFace)
+{
+    return 3;
+}
+
+static void
+SetTSpaceBasic(const SMikkTSpaceContext *pContext, const f32 fvTangent[],
+               const f32 fSign, const i32 iFace, const i32 iVert)
+{
+    struct CalculateTangetData *data = pContext->m_pUserData;
+    data->vertices[iFace * 3 + iVert].tangent.X = fvTangent[0];
+    data->vertices[iFace * 3 + iVert].tangent.Y = fvTangent[1];
+    data->vertices[iFace * 3 + iVert].tangent.Z = fvTangent[2];
+    data->vertices[iFace * 3 + iVert].tangent.W = fSign;
+}
+
+static i32
+GetNumFaces(const SMikkTSpaceContext *pContext)
+{
+    struct CalculateTangetData *data = pContext->m_pUserData;
+    return data->numIndices / 3;
+}
+
+static void
+CalculateTangentArray(struct CalculateTangetData *data)
+{
+    SMikkTSpaceInterface interface = { 0 };
+    interface.m_setTSpaceBasic = SetTSpaceBasic;
+    interface.m_getNumFaces = GetNumFaces;
+    interface.m_getNumVerticesOfFace = GetNumVerticesOfFace;
+    interface.m_getPosition = GetPosition;
+    interface.m_getNormal = GetNormal;
+    interface.m_getTexCoord = GetTexCoords;
+
+    SMikkTSpaceContext context
+        = { .m_pInterface = &interface, .m_pUserData = data };
+    genTangSpaceDefault(&context);
+}
+
+// Identifies a unique vertex. Corners that reference same attributes can
+// still get different tangents from MikkTSpace, so those stay split.
+struct WeldKey {
+    u32 posIdx;
+    u32 texIdx;
+    u32 normIdx;
+    Vec4D tangent;
+};
+
+#define WELD_EMPTY_SLOT UINT32_MAX
+
+// Replaces one vertex per corner with unique vertices and indices that
+// reference them. corners are consumed, out->vertices and out->indices must
+// hold a slot per corner.
+static void
+WeldVertices(const struct Face *faces, const struct Vertex *corners,
+             u32 numCorners, struct MeshData *out, struct UtilsArena *scratch)
+{
+    u32 tableSize = 1;
+    while (tableSize < numCorners * 2) {
+        tableSize <<= 1;
+    }
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    u32 *table = UtilsArenaAlloc(scratch, sizeof(u32) * tableSize);
+    memset(table, 0xff, sizeof(u32) * tableSize);
+    struct WeldKey *keys
+        = UtilsArenaAlloc(scratch, sizeof(struct WeldKey) * numCorners);
+
+    out->numVertices = 0;
+    for (u32 i = 0; i < numCorners; ++i) {
+        struct WeldKey key;
+        ZERO_MEMORY(&key);
+        key.posIdx = faces[i].posIdx;
+        key.texIdx = faces[i].texIdx;
+        key.normIdx = faces[i].normIdx;
+        key.tangent = corners[i].tangent;
+
+        u32 slot = UtilsHash64(&key, sizeof(key)) & (tableSize - 1);
+        while (table[slot] != WELD_EMPTY_SLOT
+               && memcmp(keys + table[slot], &key, sizeof(key)) != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if (table[slot] == WELD_EMPTY_SLOT) {
+            table[slot] = out->numVertices;
+            keys[out->numVertices] = key;
+            out->vertices[out->numVertices++] = corners[i];
+        }
+        out->indices[i] = table[slot];
+    }
+    UtilsArenaPopToMarker(scratch, marker);
+}
+
+// Each LOD targets half the triangles of the previous one
+#define MESH_LOD_REDUCTION 0.5f
+// Chain stops when simplifier removes less than that fraction of triangles
+#define MESH_LOD_MIN_REDUCTION 0.25f
+#define MESH_LOD_MIN_TRIANGLES 32
+// LODs never deviate more than that fraction of mesh bounds diagonal
+#define MESH_LOD_MAX_ERROR 0.05f
+
+// Appends simplified LODs after LOD 0 in out->indices. Every LOD is made
+// from the previous one, so its error is the sum of errors along the chain.
+static void
+BuildMeshLods(struct MeshData *out, struct UtilsArena *scratch)
+{
+    const Vec3D extent
+        = MathVec3DSubtraction(&out->boundsMax, &out->boundsMin);
+    const f32 maxError
+        = sqrtf(MathVec3DDot(&extent, &extent)) * MESH_LOD_MAX_ERROR;
+    out->lods[0].firstIndex = 0;
+    out->lods[0].numIndices = out->numIndices;
+    out->lods[0].error = 0.0f;
+    out->numLods = 1;
+    while (out->numLods < MESH_MAX_LODS) {
+        const struct MeshLod *prev = out->lods + out->numLods - 1;
+        const u32 target
+            = (u32)(prev->numIndices / 3 * MESH_LOD_REDUCTION) * 3;
+        if (target < MESH_LOD_MIN_TRIANGLES * 3) {
+            break;
+        }
+        u32 *lodIndices = out->indices + out->numIndices;
+        f32 error = 0.0f;
+        const u32 numIndices = MeshOpt_Simplify(
+            lodIndices, out->indices + prev->firstIndex, prev->numIndices,
+            out->vertices, out->numVertices, target, maxError - prev->error,
+            &error, scratch);
+        if (numIndices
+            > prev->numIndices * (1.0f - MESH_LOD_MIN_REDUCTION)) {
+            break;
+        }
+        MeshOpt_OptimizeVertexCache(lodIndices, numIndices, out->numVertices,
+                                    scratch);
+        struct MeshLod *lod = out->lods + out->numLods++;
+        lod->firstIndex = out->numIndices;
+        lod->numIndices = numIndices;
+        lod->error = prev->error + error;
+        out->numIndices += numIndices;
+    }
+}
+
+// Result is allocated from arena, temporaries from scratch
+static void
+BuildMeshData(const struct Mesh *mesh, struct MeshData *out,
+              struct UtilsArena *arena, struct UtilsArena *scratch)
+{
+    const struct UtilsArenaMarker marker = UtilsArenaGetMarker(scratch);
+    struct Vertex *corners
+        = UtilsArenaAlloc(scratch, sizeof(struct Vertex) * mesh->NumFaces);
+    // A kept LOD has at most 1 - MESH_LOD_MIN_REDUCTION of the previous
+    // one's indices, and a rejected attempt still copies the previous LOD
+    // into the tail, so the whole chain stays under LOD 0 divided by
+    // MESH_LOD_MIN_REDUCTION
+    const u64 maxIndices
+        = (u64)ceil((f64)mesh->NumFaces / MESH_LOD_MIN_REDUCTION);
+    u32 *cornerIndices
+        = UtilsArenaAlloc(scratch, sizeof(u32) * maxIndices);
+    // weld keys of the kept corners
+    struct Face *faces
+        = UtilsArenaAlloc(scratch, sizeof(struct Face) * mesh->NumFaces);
+    u32 numCorners = 0;
+    u32 numSkipped = 0;
+    for (u32 t = 0; t + 3 <= mesh->NumFaces; t += 3) {
+        const struct Face *face = mesh->Faces + t;
+        if (face[0].posIdx >= mesh->NumPositions
+            || face[1].posIdx >= mesh->NumPositions
+            || face[2].posIdx >= mesh->NumPositions) {
+            ++numSkipped;
+            continue;
+        }
+        Vec3D p[3];
+        for (u32 k = 0; k < 3; ++k) {
+            p[k] = *(Vec3D *)&mesh->Positions[face[k].posIdx];
+        }
+        // corners without normal get the normal of their triangle
+        const Vec3D e1 = MathVec3DSubtraction(&p[1], &p[0]);
+        const Vec3D e2 = MathVec3DSubtraction(&p[2], &p[0]);
+        Vec3D faceNormal = MathVec3DCross(&e1, &e2);
+        if (MathVec3DDot(&faceNormal, &faceNormal) > 0.0f) {
+            MathVec3DNormalize(&faceNormal);
+        } else {
+            faceNormal = MathVec3DFromXYZ(0.0f, 1.0f, 0.0f);
+        }
+        for (u32 k = 0; k < 3; ++k) {
+            const u32 j = numCorners++;
+            faces[j] = face[k];
+            corners[j].position = p[k];
+            if (face[k].normIdx < mesh->NumNormals) {
+                corners[j].normal = *(Vec3D *)&mesh->Normals[face[k].normIdx];
+            } else {
+                corners[j].normal = faceNormal;
+                // past the real normals, so only corners of this triangle
+                // weld with each other
+                faces[j].normIdx = mesh->NumNormals + t / 3;
+            }
+            if (face[k].texIdx < mesh->NumTexCoords) {
+                corners[j].texCoords
+                    = *(Vec2D *)&mesh->TexCoords[face[k].texIdx];
+            } else {
+                corners[j].texCoords = MathVec2DZero();
+                faces[j].texIdx = OL_INVALID_INDEX;
+            }
+            corners[j].tangent = MathVec4DZero();
+            cornerIndices[j] = j;
+        }
+    }
+    if (numSkipped > 0) {
+        UtilsDebugPrint("WARNING: Skipped %u triangles of mesh %s with "
+                        "invalid positions",
+                        numSkipped, mesh->Name);
+    }
+
+    // MikkTSpace expects unindexed triangles
+    struct CalculateTangetData data
+        = { corners, numCorners, cornerIndices, numCorners };
+    CalculateTangentArray(&data);
+
+    out->numIndices = numCorners;
+    out->indices = cornerIndices;
+    // welded vertices stay in scratch until their final count is known
+    out->vertices
+        = UtilsArenaAlloc(scratch, sizeof(struct Vertex) * numCorners);
+    WeldVertices(faces, corners, numCorners, out, scratch);
+
+    out->boundsMin = MathVec3DFromXYZ(FLT_MAX, FLT_MAX, FLT_MAX);
+    out->boundsMax = MathVec3DFromXYZ(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (u32 j = 0; j < out->numVertices; ++j) {
+        const Vec3D *p = &out->vertices[j].position;
+        out->boundsMin = MathVec3DFromXYZ(fminf(out->boundsMin.X, p->X),
+                                          fminf(out->boundsMin.Y, p->Y),
+                                          fminf(out->boundsMin.Z, p->Z));
+        out->boundsMax = MathVec3DFromXYZ(fmaxf(out->boundsMax.X, p->X),
+                                          fmaxf(out->boundsMax.Y, p->Y),
+                                          fmaxf(out->boundsMax.Z, p->Z));
+    }
+
+    const struct MeshOptCacheStats before = MeshOpt_AnalyzeVertexCache(
+        out->indices, out->numIndices, out->numVertices,
+        MESH_OPT_FIFO_CACHE_SIZE, scratch);
+    MeshOpt_OptimizeVertexCache(out->indices, out->numIndices,
+                                out->numVertices, scratch);
+    MeshOpt_OptimizeOverdraw(out->indices, out->numIndices, out->vertices,
+                             out->numVertices, scratch);
+    BuildMeshLods(out, scratch);
+    // LOD 0 comes first, so vertices are ordered for full detail
+    out->numVertices
+        = MeshOpt_OptimizeVertexFetch(out->vertices, out->numVertices,
+                                      out->indices, out->numIndices, scratch);
+    const struct MeshOptCacheStats after = MeshOpt_AnalyzeVertexCache(
+        out->indices, out->lods[0].numIndices, out->numVertices,
+        MESH_OPT_FIFO_CACHE_SIZE, scratch);
+    // meshlets split LOD 0 only, coarser LODs are drawn as a whole
+    struct Meshlet *meshlets = UtilsArenaAlloc(
+        scratch, sizeof(struct Meshlet)
+                     * MESH_OPT_MAX_MESHLETS(out->lods[0].numIndices));
+    out->numMeshlets = MeshOpt_BuildMeshlets(
+        meshlets, out->indices, out->lods[0].numIndices, out->vertices,
+        out->numVertices, scratch);
+    out->meshlets
+        = UtilsArenaAlloc(arena, sizeof(struct Meshlet) * out->numMeshlets);
+    memcpy(out->meshlets, meshlets,
+           sizeof(struct Meshlet) * out->numMeshlets);
+    struct Vertex *vertices
+        = UtilsArenaAlloc(arena, sizeof(struct Vertex) * out->numVertices);
+    memcpy(vertices, out->vertices, sizeof(struct Vertex) * out->numVertices);
+    out->vertices = vertices;
+    u32 *indices = UtilsArenaAlloc(arena, sizeof(u32) * out->numIndices);
+    memcpy(indices, out->indices, sizeof(u32) * out->numIndices);
+    out->indices = indices;
+    UtilsArenaPopToMarker(scratch, marker);
+    out->name = UtilsArenaStrDup(arena, mesh->Name);
+
+    UtilsDebugPrint("Mesh %s, welded %u corners into %u vertices (%.2fx)",
+                    out->name, numCorners, out->numVertices,
+                    out->numVertices ? (f64)numCorners / out->numVertices
+                                     : 0.0);
+    UtilsDebugPrint("Mesh %s, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f "
+                    "(FIFO %u)",
+                    out->name, before.acmr, after.acmr, before.atvr,
+                    after.atvr, MESH_OPT_FIFO_CACHE_SIZE);
+    for (u32 i = 1; i < out->numLods; ++i) {
+        const struct MeshLod *lod = out->lods + i;
+        UtilsDebugPrint("Mesh %s, LOD %u: %u -> %u triangles (%.1f%%), "
+                        "error %.4f",
+                        out->name, i, numCorners / 3, lod->numIndices / 3,
+                        100.0 * lod->numIndices / numCorners, lod->error);
+    }
+    UtilsDebugPrint("Mesh %s, %u meshlets, %.1f triangles per meshlet",
+                    out->name, out->numMeshlets,
+                    out->numMeshlets ? (f64)out->lods[0].numIndices / 3
+                                           / out->numMeshlets
+                                     : 0.0);
+}
+
+// Mesh data of a model is allocated in blocks of that size
+#define MODEL_ARENA_BLOCK_SIZE (4 * 1024 * 1024)
+// Scratch block fits temporaries of a mesh with ~100k corners
+#define MODEL_SCRATCH_BLOCK_SIZE (16 * 1024 * 1024)
+
+struct BuildModelJob {
+    const struct Model *model;
+    struct ModelData *out;
+    // one per pool thread, so that threads never share an arena
+    struct UtilsArena *scratchArenas;
+    // CPU time spent in each mesh, sum is what serial build would cost
+    f64 *meshSeconds;
+};
+
+static void
+BuildMeshJob(void *arg, u32 index, u32 threadIndex)
+{
+    struct BuildModelJob *job = arg;
+    const f64 startTime = UtilsGetThreadCpuTimeInSeconds();
+    BuildMeshData(job->model->Meshes + index, job->out->meshes + index,
+                  job->out->arenas + threadIndex,
+                  job->scratchArenas + threadIndex);
+    job->meshSeconds[index] = UtilsGetThreadCpuTimeInSeconds() - startTime;
+}
+
+static void
+BuildModelData(const struct Model *m, struct ModelData *out,
+               struct UtilsThreadPool *threadPool)
+{
+    const f64 startTime = UtilsGetTimeInSeconds();
+    ZERO_MEMORY(out);
+    out->meshes = malloc(sizeof(struct MeshData) * m->NumMeshes);
+    out->numMeshes = m->NumMeshes;
+    out->numArenas = UtilsThreadPoolGetNumThreads(threadPool);
+    out->arenas = malloc(sizeof(struct UtilsArena) * out->numArenas);
+    struct BuildModelJob job = {
+        m, out, malloc(sizeof(struct UtilsArena) * out->numArenas),
+        malloc(sizeof(f64) * m->NumMeshes)
+    };
+    for (u32 i = 0; i < out->numArenas; ++i) {
+        UtilsArenaInit(out->arenas + i, MODEL_ARENA_BLOCK_SIZE);
+        UtilsArenaInit(job.scratchArenas + i, MODEL_SCRATCH_BLOCK_SIZE);
+    }
+    UtilsParallelFor(threadPool, m->NumMeshes, BuildMeshJob, &job);
+    const f64 buildSeconds = UtilsGetTimeInSeconds() - startTime;
+
+    u64 numCorners = 0;
+    u64 numIndices = 0;
+    u64 numVertices = 0;
+    f64 meshSeconds = 0.0;
     for (u32 i = 0; i < m->NumMeshes; ++i) {
-        GLCHECK(glGenVertexArrays(1, &ret->meshes[i].vao));
-        GLCHECK(glGenBuffers(1, &ret->meshes[i].vbo));
-        GLCHECK(glGenBuffers(1, &ret->meshes[i].ebo));
-
-        u32 *indices = malloc(sizeof *indices * m->Meshes[i].NumFaces);
-        struct Vertex *vertices
-            = malloc(sizeof *vertices * m->Meshes[i].NumFaces);
-        for (u32 j = 0; j < m->Meshes[i].NumFaces; ++j) {
-            const u32 posIdx = m->Meshes[i].Faces[j].posIdx - posIdxOffset;
-            const u32 normIdx = m->Meshes[i].Faces[j].normIdx - normIdxOffset;
-            const u32 texIdx = m->Meshes[i].Faces[j].texIdx - texIdxOffset;
-            assert(posIdx < m->Meshes[i].NumPositions);
-            assert(normIdx < m->Meshes[i].NumNormals);
-            assert(texIdx < m->Meshes[i].NumTexCoords);
-            vertices[j].position = *(Vec3D *)&m->Meshes[i].Positions[posIdx];
-            vertices[j].normal = *(Vec3D *)&m->Meshes[i].Normals[normIdx];
-            vertices[j].texCoords = *(Vec2D *)&m->Meshes[i].TexCoords[texIdx];
-            vertices[j].tangent = MathVec4DZero();
-            indices[j] = j;
-        }
-        posIdxOffset += m->Meshes[i].NumPositions;
-        normIdxOffset += m->Meshes[i].NumNormals;
-        texIdxOffset += m->Meshes[i].NumTexCoords;
-
-        struct CalculateTangetData data = { vertices, m->Meshes[i].NumFaces,
-                                            indices, m->Meshes[i].NumFaces };
-        CalculateTangentArray(&data);
-
-        GLCHECK(glBindVertexArray(ret->meshes[i].vao));
-        SetObjectName(OI_VERTEX_ARRAY, ret->meshes[i].vao, m->Meshes[i].Name);
-        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, ret->meshes[i].vbo));
-        GLCHECK(glBufferData(GL_ARRAY_BUFFER,
-                             sizeof(struct Vertex) * m->Meshes[i].NumFaces,
-                             vertices, GL_STATIC_DRAW));
-        free(vertices);
-
-        GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ret->meshes[i].ebo));
-        GLCHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                             sizeof(u32) * m->Meshes[i].NumFaces, indices,
-                             GL_STATIC_DRAW));
-
-        GLCHECK(glEnableVertexAttribArray(0));
-        GLCHECK(glEnableVertexAttribArray(1));
-        GLCHECK(glEnableVertexAttribArray(2));
-        GLCHECK(glEnableVertexAttribArray(3));
+        numCorners += out->meshes[i].lods[0].numIndices;
+        numIndices += out->meshes[i].numIndices;
+        numVertices += out->meshes[i].numVertices;
+        meshSeconds += job.meshSeconds[i];
+    }
+    free(job.meshSeconds);
+
+    u64 numAllocations = 0;
+    u64 numBlocks = 0;
+    u64 arenaBytes = 0;
+    u64 numScratchAllocations = 0;
+    u64 numScratchBlocks = 0;
+    u64 scratchPeakBytes = 0;
+    for (u32 i = 0; i < out->numArenas; ++i) {
+        const struct UtilsArena *scratch = job.scratchArenas + i;
+        numAllocations += out->arenas[i].numAllocations;
+        numBlocks += out->arenas[i].numBlocks;
+        arenaBytes += out->arenas[i].bytesAllocated;
+        numScratchAllocations += scratch->numAllocations;
+        numScratchBlocks += scratch->numBlocks;
+        scratchPeakBytes += scratch->peakBytesAllocated;
+        UtilsArenaDeinit(job.scratchArenas + i);
+    }
+    free(job.scratchArenas);
+
+    // every mesh is drawn once in the geometry pass and the index buffer
+    // has a slot per corner either way, so the difference in unique vertex
+    // data is what each geometry pass saves in vertex fetch
+    const u64 cornerBytes = numCorners * sizeof(struct Vertex);
+    const u64 vertexBytes = numVertices * sizeof(struct Vertex);
+    UtilsDebugPrint("BuildModelData: %llu corners -> %llu vertices (%.2fx), "
+                    "VB %.1f KB -> %.1f KB, IB %.1f KB (%.1f KB with LODs), "
+                    "geometry pass saves %.1f KB of vertex data per frame",
+                    (unsigned long long)numCorners,
+                    (unsigned long long)numVertices,
+                    numVertices ? (f64)numCorners / numVertices : 0.0,
+                    cornerBytes / 1024.0, vertexBytes / 1024.0,
+                    numCorners * sizeof(u32) / 1024.0,
+                    numIndices * sizeof(u32) / 1024.0,
+                    (cornerBytes - vertexBytes) / 1024.0);
+    UtilsDebugPrint("BuildModelData: %u meshes in %.2f ms, %.2f ms of mesh "
+                    "work (%.1fx on %u threads)",
+                    m->NumMeshes, buildSeconds * 1000.0, meshSeconds * 1000.0,
+                    buildSeconds > 0.0 ? meshSeconds / buildSeconds : 0.0,
+                    UtilsThreadPoolGetNumThreads(threadPool));
+    // every arena block is one malloc, everything else is a pointer bump
+    UtilsDebugPrint("BuildModelData: %llu allocations in %llu blocks "
+                    "(%.2f MB), %llu scratch allocations in %llu blocks "
+                    "(peak %.2f MB)",
+                    (unsigned long long)numAllocations,
+                    (unsigned long long)numBlocks,
+                    arenaBytes / (1024.0 * 1024.0),
+                    (unsigned long long)numScratchAllocations,
+                    (unsigned long long)numScratchBlocks,
+                    scratchPeakBytes / (1024.0 * 1024.0));
+}
+
+static i16
+PackSnorm16(f32 v)
+{
+    return (i16)roundf(MathClamp(-1.0f, 1.0f, v) * 32767.0f);
+}
+
+static f32
+UnpackSnorm16(i16 v)
+{
+    return fmaxf(v / 32767.0f, -1.0f);
+}
+
+static Vec3D
+UnpackOct(const i16 e[2])
+{
+    const Vec2D v = { UnpackSnorm16(e[0]), UnpackSnorm16(e[1]) };
+    return MathOctDecode(&v);
+}
+
+static f32
+AngleBetween(const Vec3D *a, const Vec3D *b)
+{
+    Vec3D na = *a;
+    MathVec3DNormalize(&na);
+    return MathToDegrees(acosf(MathClamp(-1.0f, 1.0f, MathVec3DDot(&na, b))));
+}
+
+// Quantizes vertices to VF_PACKED and reports round trip error, so that
+// quality loss of packed meshes stays measurable
+static struct PackedVertex *
+PackVertices(const struct MeshData *mesh, Vec3D *posScale, Vec3D *posBias)
+{
+    const Vec3D extent
+        = MathVec3DSubtraction(&mesh->boundsMax, &mesh->boundsMin);
+    *posBias = mesh->boundsMin;
+    *posScale = MathVec3DModulateByScalar(&extent, 1.0f / 65535.0f);
+    const Vec3D invScale = MathVec3DFromXYZ(
+        extent.X > 0.0f ? 65535.0f / extent.X : 0.0f,
+        extent.Y > 0.0f ? 65535.0f / extent.Y : 0.0f,
+        extent.Z > 0.0f ? 65535.0f / extent.Z : 0.0f);
+
+    f32 maxPosError = 0.0f;
+    f32 maxNormalError = 0.0f;
+    f32 maxTangentError = 0.0f;
+    f32 maxTexCoordError = 0.0f;
+    struct PackedVertex *packed
+        = malloc(sizeof(struct PackedVertex) * mesh->numVertices);
+    for (u32 i = 0; i < mesh->numVertices; ++i) {
+        const struct Vertex *v = mesh->vertices + i;
+        struct PackedVertex *p = packed + i;
+        const f32 *pos = &v->position.X;
+        const f32 *bias = &posBias->X;
+        const f32 *scale = &posScale->X;
+        for (u32 k = 0; k < 3; ++k) {
+            p->position[k] = (u16)roundf(MathClamp(
+                0.0f, 65535.0f, (pos[k] - bias[k]) * (&invScale.X)[k]));
+            const f32 decoded = p->position[k] * scale[k] + bias[k];
+            maxPosError = fmaxf(maxPosError, fabsf(decoded - pos[k]));
+        }
+        p->position[3] = v->tangent.W < 0.0f;
+
+        const Vec2D normal = MathOctEncode(&v->normal);
+        p->normal[0] = PackSnorm16(normal.X);
+        p->normal[1] = PackSnorm16(normal.Y);
+        const Vec3D decodedNormal = UnpackOct(p->normal);
+        maxNormalError = fmaxf(maxNormalError,
+                               AngleBetween(&v->normal, &decodedNormal));
+
+        const Vec3D tangent
+            = MathVec3DFromXYZ(v->tangent.X, v->tangent.Y, v->tangent.Z);
+        const Vec2D octTangent = MathOctEncode(&tangent);
+        p->tangent[0] = PackSnorm16(octTangent.X);
+        p->tangent[1] = PackSnorm16(octTangent.Y);
+        const Vec3D decodedTangent = UnpackOct(p->tangent);
+        maxTangentError = fmaxf(maxTangentError,
+                                AngleBetween(&tangent, &decodedTangent));
+
+        p->texCoords[0] = MathFloatToHalf(v->texCoords.X);
+        p->texCoords[1] = MathFloatToHalf(v->texCoords.Y);
+        maxTexCoordError = fmaxf(
+            maxTexCoordError,
+            fmaxf(fabsf(MathHalfToFloat(p->texCoords[0]) - v->texCoords.X),
+                  fabsf(MathHalfToFloat(p->texCoords[1]) - v->texCoords.Y)));
+    }
+
+    UtilsDebugPrint("Mesh %s, packed round trip error: position %.2e, "
+                    "normal %.4f deg, tangent %.4f deg, texCoords %.2e",
+                    mesh->name, maxPosError, maxNormalError, maxTangentError,
+                    maxTexCoordError);
+    return packed;
+}
+
+// Initial sizes, buffers double when they run out of space
+#define GEOMETRY_VERTEX_POOL_SIZE (16 * 1024 * 1024)
+#define GEOMETRY_INDEX_BUFFER_SIZE (8 * 1024 * 1024)
+#define GEOMETRY_INSTANCE_BUFFER_SIZE (64 * 1024)
+// u16 and u32 indices share the index buffer
+#define GEOMETRY_INDEX_ALIGNMENT 4
+
+static const i8 *const VERTEX_FORMAT_NAMES[VF_COUNT] = { "float", "packed" };
+
+struct GeometryBuffer *
+GeometryBuffer_Create(void)
+{
+    struct GeometryBuffer *g = malloc(sizeof *g);
+    ZERO_MEMORY(g);
+    GLCHECK(glGenBuffers(1, &g->ebo));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, g->ebo));
+    GLCHECK(glBufferData(GL_COPY_WRITE_BUFFER, GEOMETRY_INDEX_BUFFER_SIZE,
+                         NULL, GL_STATIC_DRAW));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    SetObjectName(OI_INDEX_BUFFER, g->ebo, "Geometry");
+    UtilsRangeAllocatorInit(&g->indexAllocator, GEOMETRY_INDEX_BUFFER_SIZE,
+                            GEOMETRY_INDEX_ALIGNMENT);
+    g->instanceVboSize = GEOMETRY_INSTANCE_BUFFER_SIZE;
+    GLCHECK(glGenBuffers(1, &g->instanceVbo));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, g->instanceVbo));
+    GLCHECK(glBufferData(GL_COPY_WRITE_BUFFER, g->instanceVboSize, NULL,
+                         GL_STREAM_DRAW));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    SetObjectName(OI_VERTEX_BUFFER, g->instanceVbo, "Instances");
+    return g;
+}
+
+void
+GeometryBuffer_Destroy(struct GeometryBuffer *g)
+{
+    for (u32 i = 0; i < VF_COUNT; ++i) {
+        struct GeometryVertexPool *pool = g->pools + i;
+        if (pool->vao) {
+            assert(pool->allocator.numAllocations == 0);
+            GLCHECK(glDeleteVertexArrays(1, &pool->vao));
+            GLCHECK(glDeleteVertexArrays(1, &pool->instancedVao));
+            GLCHECK(glDeleteBuffers(1, &pool->vbo));
+            UtilsRangeAllocatorDeinit(&pool->allocator);
+        }
+    }
+    assert(g->indexAllocator.numAllocations == 0);
+    GLCHECK(glDeleteBuffers(1, &g->ebo));
+    GLCHECK(glDeleteBuffers(1, &g->instanceVbo));
+    UtilsRangeAllocatorDeinit(&g->indexAllocator);
+    free(g);
+}
+
+static f32
+GetFragmentation(const struct UtilsRangeAllocator *allocator)
+{
+    const u64 freeBytes = allocator->capacity - allocator->usedSize;
+    if (freeBytes == 0) {
+        return 0.0f;
+    }
+    return 1.0f
+           - (f32)UtilsRangeAllocatorGetLargestFreeRange(allocator)
+                 / freeBytes;
+}
+
+void
+GeometryBuffer_GetStats(const struct GeometryBuffer *g,
+                        struct GeometryBufferStats *stats)
+{
+    ZERO_MEMORY(stats);
+    for (u32 i = 0; i < VF_COUNT; ++i) {
+        const struct UtilsRangeAllocator *allocator = &g->pools[i].allocator;
+        stats->vertexBytes += allocator->usedSize;
+        stats->vertexCapacity += allocator->capacity;
+        stats->numAllocations += allocator->numAllocations;
+        stats->numFreeRanges += allocator->numFreeRanges;
+        stats->vertexFragmentation
+            = fmaxf(stats->vertexFragmentation, GetFragmentation(allocator));
+    }
+    stats->indexBytes = g->indexAllocator.usedSize;
+    stats->indexCapacity = g->indexAllocator.capacity;
+    stats->numAllocations += g->indexAllocator.numAllocations;
+    stats->numFreeRanges += g->indexAllocator.numFreeRanges;
+    stats->indexFragmentation = GetFragmentation(&g->indexAllocator);
+}
+
+struct DrawInstance *
+GeometryBuffer_MapInstances(struct GeometryBuffer *g, u32 count)
+{
+    assert(!g->isInstanceVboMapped);
+    assert(count > 0);
+    const u64 size = (u64)count * sizeof(struct DrawInstance);
+    while (g->instanceVboSize < size) {
+        g->instanceVboSize *= 2;
+    }
+    // vertex arrays refer to the buffer by name, new storage needs no setup
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, g->instanceVbo));
+    GLCHECK(glBufferData(GL_ARRAY_BUFFER, g->instanceVboSize, NULL,
+                         GL_STREAM_DRAW));
+    GLCHECK(void *data = glMapBufferRange(
+                GL_ARRAY_BUFFER, 0, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+                    | GL_MAP_UNSYNCHRONIZED_BIT));
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    g->isInstanceVboMapped = 1;
+    return data;
+}
+
+void
+GeometryBuffer_UnmapInstances(struct GeometryBuffer *g)
+{
+    assert(g->isInstanceVboMapped);
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, g->instanceVbo));
+    GLCHECK(glUnmapBuffer(GL_ARRAY_BUFFER));
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    g->isInstanceVboMapped = 0;
+}
+
+// Buffers are sourced at offset 0, meshes are reached through base vertex
+// and index offsets
+static void
+SetupVertexAttributes(const struct GeometryBuffer *g, enum VertexFormat format,
+                      u32 vao)
+{
+    const struct GeometryVertexPool *pool = g->pools + format;
+    GLCHECK(glBindVertexArray(vao));
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, pool->vbo));
+    GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g->ebo));
+    GLCHECK(glEnableVertexAttribArray(0));
+    GLCHECK(glEnableVertexAttribArray(1));
+    GLCHECK(glEnableVertexAttribArray(2));
+    GLCHECK(glEnableVertexAttribArray(3));
+    if (format == VF_PACKED) {
+        // integers are not normalized by GL, because snorm conversion rules
+        // differ between GL versions, vert.glsl does it instead
+        GLCHECK(glVertexAttribPointer(
+            0, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(struct PackedVertex),
+            (void *)offsetof(struct PackedVertex, position)));
+        GLCHECK(glVertexAttribPointer(
+            1, 2, GL_SHORT, GL_FALSE, sizeof(struct PackedVertex),
+            (void *)offsetof(struct PackedVertex, normal)));
+        GLCHECK(glVertexAttribPointer(
+            2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(struct PackedVertex),
+            (void *)offsetof(struct PackedVertex, texCoords)));
+        GLCHECK(glVertexAttribPointer(
+            3, 2, GL_SHORT, GL_FALSE, sizeof(struct PackedVertex),
+            (void *)offsetof(struct PackedVertex, tangent)));
+    } else {
         GLCHECK(glVertexAttribPointer(
             0, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex),
             (void *)offsetof(struct Vertex, position)));
@@ -534,19 +2206,295 @@ CreateModelProxy(const struct Model *m)
         GLCHECK(glVertexAttribPointer(
             3, 4, GL_FLOAT, GL_FALSE, sizeof(struct Vertex),
             (void *)offsetof(struct Vertex, tangent)));
+    }
+    GLCHECK(glBindVertexArray(0));
+}
+
+// One vec4 attribute per matrix row, rows are what std140 and GLSL call
+// columns of the matrices in vert.glsl
+static void
+SetupInstanceAttributes(const struct GeometryBuffer *g, u32 vao)
+{
+    GLCHECK(glBindVertexArray(vao));
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, g->instanceVbo));
+    const u32 numVec4s = sizeof(struct DrawInstance) / sizeof(Vec4D);
+    for (u32 i = 0; i < numVec4s; ++i) {
+        const u32 location = DRAW_INSTANCE_FIRST_LOCATION + i;
+        GLCHECK(glEnableVertexAttribArray(location));
+        GLCHECK(glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE,
+                                      sizeof(struct DrawInstance),
+                                      (void *)(i * sizeof(Vec4D))));
+        GLCHECK(glVertexAttribDivisor(location, 1));
+    }
+    GLCHECK(glBindVertexArray(0));
+}
+
+// Must be called again after a buffer was replaced
+static void
+SetupVertexArray(const struct GeometryBuffer *g, enum VertexFormat format)
+{
+    const struct GeometryVertexPool *pool = g->pools + format;
+    SetupVertexAttributes(g, format, pool->vao);
+    SetupVertexAttributes(g, format, pool->instancedVao);
+    SetupInstanceAttributes(g, pool->instancedVao);
+}
+
+// Creates vertex buffer and vertex array of a format on first use
+static struct GeometryVertexPool *
+GetVertexPool(struct GeometryBuffer *g, enum VertexFormat format)
+{
+    struct GeometryVertexPool *pool = g->pools + format;
+    if (pool->vao) {
+        return pool;
+    }
+    pool->vertexSize = format == VF_PACKED ? sizeof(struct PackedVertex)
+                                           : sizeof(struct Vertex);
+    const u64 size
+        = GEOMETRY_VERTEX_POOL_SIZE / pool->vertexSize * pool->vertexSize;
+    UtilsRangeAllocatorInit(&pool->allocator, size, pool->vertexSize);
+    GLCHECK(glGenVertexArrays(1, &pool->vao));
+    GLCHECK(glGenVertexArrays(1, &pool->instancedVao));
+    GLCHECK(glGenBuffers(1, &pool->vbo));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, pool->vbo));
+    GLCHECK(glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    SetupVertexArray(g, format);
+    SetObjectName(OI_VERTEX_ARRAY, pool->vao, VERTEX_FORMAT_NAMES[format]);
+    SetObjectName(OI_VERTEX_ARRAY, pool->instancedVao,
+                  UtilsFormatStr("%sInstanced", VERTEX_FORMAT_NAMES[format]));
+    SetObjectName(OI_VERTEX_BUFFER, pool->vbo, VERTEX_FORMAT_NAMES[format]);
+    return pool;
+}
+
+// Replaces buffer with a bigger one that starts with its contents
+static u32
+ResizeBuffer(u32 buffer, u64 size, u64 newSize)
+{
+    u32 newBuffer = 0;
+    GLCHECK(glGenBuffers(1, &newBuffer));
+    GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, buffer));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer));
+    GLCHECK(glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL,
+                         GL_STATIC_DRAW));
+    GLCHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                                0, size));
+    GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    GLCHECK(glDeleteBuffers(1, &buffer));
+    return newBuffer;
+}
+
+// Allocates from one of the buffers of g, buffer grows when it has no free
+// range that is big enough
+static u64
+AllocGeometryRange(struct GeometryBuffer *g,
+                   struct UtilsRangeAllocator *allocator, u32 *buffer,
+                   u64 size)
+{
+    u64 offset = UtilsRangeAllocatorAlloc(allocator, size);
+    if (offset != UTILS_INVALID_RANGE) {
+        return offset;
+    }
+    const u64 capacity = allocator->capacity;
+    u64 newCapacity = capacity * 2;
+    while (newCapacity - capacity < size) {
+        newCapacity *= 2;
+    }
+    *buffer = ResizeBuffer(*buffer, capacity, newCapacity);
+    UtilsRangeAllocatorGrow(allocator, newCapacity);
+    for (u32 i = 0; i < VF_COUNT; ++i) {
+        if (g->pools[i].vao) {
+            SetupVertexArray(g, i);
+        }
+    }
+    UtilsDebugPrint("GeometryBuffer: grew buffer %u from %.2f MB to %.2f MB",
+                    *buffer, capacity / (1024.0 * 1024.0),
+                    newCapacity / (1024.0 * 1024.0));
+    offset = UtilsRangeAllocatorAlloc(allocator, size);
+    assert(offset != UTILS_INVALID_RANGE);
+    return offset;
+}
+
+// Geometry ranges of the mesh are allocated up front and filled by
+// ContinueMeshUpload, possibly over several frames
+struct MeshUpload {
+    const u8 *vertices;
+    u64 vertexBytes;
+    u64 vertexOffset;
+    const u8 *indices;
+    u64 indexBytes;
+    u64 indexOffset;
+    // buffers can be replaced when geometry grows, so they are looked up
+    // for every part
+    struct GeometryBuffer *geometry;
+    enum VertexFormat vertexFormat;
+    u64 vertexDestOffset;
+    u64 indexDestOffset;
+    // converted copies of mesh data, released once upload is done
+    struct PackedVertex *packedVertices;
+    u16 *shortIndices;
+};
+
+// Converts mesh to the requested format on CPU, does not touch GL, so it can
+// run on any thread
+static void
+PrepareMeshUpload(struct MeshProxy *proxy, const struct MeshData *mesh,
+                  enum VertexFormat vertexFormat,
+                  struct GeometryBuffer *geometry, const Mat4X4 *world,
+                  struct MeshUpload *upload)
+{
+    ZERO_MEMORY(upload);
+    upload->geometry = geometry;
+    upload->vertexFormat = vertexFormat;
+    proxy->geometry = geometry;
+    proxy->vertexFormat = vertexFormat;
+    proxy->posScale = MathVec3DFromXYZ(1.0f, 1.0f, 1.0f);
+    proxy->posBias = MathVec3DZero();
+    u32 vertexSize = sizeof(struct Vertex);
+    upload->vertices = (const u8 *)mesh->vertices;
+    if (vertexFormat == VF_PACKED) {
+        upload->packedVertices
+            = PackVertices(mesh, &proxy->posScale, &proxy->posBias);
+        vertexSize = sizeof(struct PackedVertex);
+        upload->vertices = (const u8 *)upload->packedVertices;
+    }
+    upload->vertexBytes = (u64)vertexSize * mesh->numVertices;
+
+    // indices are u16 whenever they fit
+    u32 indexSize = sizeof(u32);
+    upload->indices = (const u8 *)mesh->indices;
+    proxy->indexType = GL_UNSIGNED_INT;
+    if (mesh->numVertices <= UINT16_MAX + 1) {
+        upload->shortIndices = malloc(sizeof(u16) * mesh->numIndices);
+        for (u32 i = 0; i < mesh->numIndices; ++i) {
+            upload->shortIndices[i] = (u16)mesh->indices[i];
+        }
+        indexSize = sizeof(u16);
+        upload->indices = (const u8 *)upload->shortIndices;
+        proxy->indexType = GL_UNSIGNED_SHORT;
+    }
+    upload->indexBytes = (u64)indexSize * mesh->numIndices;
+
+    UtilsDebugPrint("Mesh %s, %s: VB %u -> %u bytes, IB %u -> %u bytes",
+                    mesh->name, vertexFormat == VF_PACKED ? "packed" : "float",
+                    (u32)sizeof(struct Vertex) * mesh->numVertices,
+                    (u32)upload->vertexBytes,
+                    (u32)sizeof(u32) * mesh->numIndices,
+                    (u32)upload->indexBytes);
+
+    proxy->vertexBytes = upload->vertexBytes;
+    proxy->indexBytes = upload->indexBytes;
+    proxy->numIndices = mesh->numIndices;
+    memcpy(proxy->lods, mesh->lods, sizeof(proxy->lods));
+    proxy->numLods = mesh->numLods;
+    proxy->numMeshlets = mesh->numMeshlets;
+    proxy->meshlets = malloc(sizeof(struct Meshlet) * mesh->numMeshlets);
+    memcpy(proxy->meshlets, mesh->meshlets,
+           sizeof(struct Meshlet) * mesh->numMeshlets);
+    // culled index lists are gathered from LOD 0, which comes first
+    const u64 lodBytes = (u64)indexSize * mesh->lods[0].numIndices;
+    proxy->indices = malloc(lodBytes);
+    memcpy(proxy->indices, upload->indices, lodBytes);
+    proxy->boundsMin = mesh->boundsMin;
+    proxy->boundsMax = mesh->boundsMax;
+    const Vec3D center = MathVec3DAddition(&mesh->boundsMin, &mesh->boundsMax);
+    proxy->boundsCenter = MathVec3DModulateByScalar(&center, 0.5f);
+    const Vec3D extent
+        = MathVec3DSubtraction(&mesh->boundsMax, &mesh->boundsMin);
+    proxy->boundsRadius = 0.5f * sqrtf(MathVec3DDot(&extent, &extent));
+    proxy->world = world ? *world : MathMat4X4Identity();
+    proxy->name = strdup(mesh->name);
+}
+
+// Allocates ranges of prepared mesh in geometry buffer, they are left
+// unfilled
+static void
+BeginMeshUpload(struct MeshProxy *proxy, struct MeshUpload *upload)
+{
+    struct GeometryBuffer *g = upload->geometry;
+    struct GeometryVertexPool *pool = GetVertexPool(g, proxy->vertexFormat);
+    upload->vertexDestOffset = AllocGeometryRange(
+        g, &pool->allocator, &pool->vbo, upload->vertexBytes);
+    upload->indexDestOffset = AllocGeometryRange(
+        g, &g->indexAllocator, &g->ebo, upload->indexBytes);
+    proxy->vao = pool->vao;
+    proxy->baseVertex = (u32)(upload->vertexDestOffset / pool->vertexSize);
+    proxy->indexOffset = upload->indexDestOffset;
+}
+
+static u64
+UploadBufferPart(u32 buffer, u64 destOffset, const u8 *data, u64 size,
+                 u64 *offset, u64 byteBudget)
+{
+    const u64 bytes
+        = size - *offset < byteBudget ? size - *offset : byteBudget;
+    if (bytes == 0) {
+        return 0;
+    }
+    // copy write target does not disturb bindings of the current VAO
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, buffer));
+    GLCHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, destOffset + *offset,
+                            bytes, data + *offset));
+    GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    *offset += bytes;
+    return bytes;
+}
+
+static i32
+IsMeshUploadDone(const struct MeshUpload *upload)
+{
+    return upload->vertexOffset == upload->vertexBytes
+           && upload->indexOffset == upload->indexBytes;
+}
+
+// Returns number of uploaded bytes
+static u64
+ContinueMeshUpload(struct MeshUpload *upload, u64 byteBudget)
+{
+    const struct GeometryBuffer *g = upload->geometry;
+    u64 uploaded = UploadBufferPart(
+        g->pools[upload->vertexFormat].vbo, upload->vertexDestOffset,
+        upload->vertices, upload->vertexBytes, &upload->vertexOffset,
+        byteBudget);
+    uploaded += UploadBufferPart(g->ebo, upload->indexDestOffset,
+                                 upload->indices, upload->indexBytes,
+                                 &upload->indexOffset, byteBudget - uploaded);
+    if (IsMeshUploadDone(upload)) {
+        free(upload->packedVertices);
+        free(upload->shortIndices);
+        upload->packedVertices = NULL;
+        upload->shortIndices = NULL;
+    }
+    return uploaded;
+}
 
-        ret->meshes[i].numIndices = m->Meshes[i].NumFaces;
-        ret->meshes[i].world = world;
-        const u32 nameLen = strlen(m->Meshes[i].Name);
-        ret->meshes[i].name = malloc(nameLen + 1);
-        ZERO_MEMORY_SZ(ret->meshes[i].name, nameLen + 1);
-        memcpy(ret->meshes[i].name, m->Meshes[i].Name, nameLen);
+static void
+UploadMeshProxy(struct MeshProxy *proxy, const struct MeshData *mesh,
+                enum VertexFormat vertexFormat,
+                struct GeometryBuffer *geometry, const Mat4X4 *world)
+{
+    struct MeshUpload upload;
+    PrepareMeshUpload(proxy, mesh, vertexFormat, geometry, world, &upload);
+    BeginMeshUpload(proxy, &upload);
+    ContinueMeshUpload(&upload, UINT64_MAX);
+}
 
-        free(indices);
+static struct ModelProxy *
+CreateModelProxy(const struct ModelData *m, enum VertexFormat vertexFormat,
+                 struct GeometryBuffer *geometry, const Mat4X4 *world)
+{
+    if (!m || m->numMeshes == 0) {
+        return NULL;
+    }
 
-        SetObjectName(OI_VERTEX_ARRAY, ret->meshes[i].vao, m->Meshes[i].Name);
-        SetObjectName(OI_VERTEX_BUFFER, ret->meshes[i].vbo, m->Meshes[i].Name);
-        SetObjectName(OI_INDEX_BUFFER, ret->meshes[i].ebo, m->Meshes[i].Name);
+    struct ModelProxy *ret = malloc(sizeof *ret);
+    ZERO_MEMORY(ret);
+    ret->meshes = malloc(sizeof(struct MeshProxy) * m->numMeshes);
+    ZERO_MEMORY_SZ(ret->meshes, sizeof(struct MeshProxy) * m->numMeshes);
+    ret->numMeshes = m->numMeshes;
+    for (u32 i = 0; i < m->numMeshes; ++i) {
+        UploadMeshProxy(ret->meshes + i, m->meshes + i, vertexFormat,
+                        geometry, world);
     }
 
     //	ValidateModelProxy(ret);
@@ -555,9 +2503,417 @@ CreateModelProxy(const struct Model *m)
 }
 
 struct ModelProxy *
-ModelProxy_Create(const i8 *path)
+ModelProxy_Create(const struct ModelProxyCreateInfo *info)
+{
+    return LoadModel(info);
+}
+
+#define MODEL_STREAM_QUEUE_SIZE 64
+
+// Mesh converted on worker thread that waits for upload
+struct StreamedMesh {
+    struct MeshProxy proxy;
+    struct MeshUpload upload;
+};
+
+#define MODEL_STREAM_MAX_PATH 512
+
+struct ModelStream {
+    struct UtilsThread *thread;
+    // meshes that are ready to be uploaded, worker thread to GL thread
+    struct UtilsSpscQueue queue;
+    // set by worker thread after it pushed the last mesh
+    volatile u32 isParsed;
+    // set by GL thread when model is destroyed while it is loading, worker
+    // thread drops remaining meshes
+    volatile u32 isCancelled;
+    i8 *path;
+    i8 absPath[MODEL_STREAM_MAX_PATH];
+    // never truncated, a cut path would name another file
+    i8 cachePath[MODEL_STREAM_MAX_PATH + sizeof(".meshcache")];
+    enum VertexFormat vertexFormat;
+    struct GeometryBuffer *geometry;
+    Mat4X4 world;
+
+    // owned by worker thread until isParsed is set
+    i32 isCacheHit;
+    struct ModelData cache;
+    // built meshes and their data, never moves while GL thread reads it
+    struct UtilsArena arena;
+    struct UtilsArena scratch;
+    struct MeshData **builtMeshes;
+    u32 numBuiltMeshes;
+    u32 builtMeshesCapacity;
+
+    // owned by GL thread
+    struct StreamedMesh *uploadingMesh;
+    u32 meshesCapacity;
+    u64 uploadedBytes;
+    f64 startTime;
+    f64 firstMeshTime;
+};
+
+// Frees CPU side of a mesh and its geometry ranges if it has any
+static void
+ReleaseMeshProxy(struct MeshProxy *mesh)
+{
+    if (mesh->vao) {
+        struct GeometryBuffer *g = mesh->geometry;
+        struct GeometryVertexPool *pool = g->pools + mesh->vertexFormat;
+        UtilsRangeAllocatorFree(&pool->allocator,
+                                (u64)mesh->baseVertex * pool->vertexSize,
+                                mesh->vertexBytes);
+        UtilsRangeAllocatorFree(&g->indexAllocator, mesh->indexOffset,
+                                mesh->indexBytes);
+    }
+    free(mesh->meshlets);
+    free(mesh->indices);
+    free(mesh->name);
+}
+
+static void
+ReleaseStreamedMesh(struct StreamedMesh *streamed)
+{
+    free(streamed->upload.packedVertices);
+    free(streamed->upload.shortIndices);
+    ReleaseMeshProxy(&streamed->proxy);
+    free(streamed);
+}
+
+static void
+PushStreamedMesh(struct ModelStream *stream, const struct MeshData *mesh)
+{
+    struct StreamedMesh *streamed = malloc(sizeof *streamed);
+    ZERO_MEMORY(&streamed->proxy);
+    PrepareMeshUpload(&streamed->proxy, mesh, stream->vertexFormat,
+                      stream->geometry, &stream->world, &streamed->upload);
+    // GL thread is behind, let it catch up
+    while (!UtilsSpscQueuePush(&stream->queue, streamed)) {
+        if (UtilsAtomicLoad32(&stream->isCancelled)) {
+            ReleaseStreamedMesh(streamed);
+            return;
+        }
+        UtilsSleepMs(1);
+    }
+}
+
+static void
+OnMeshParsed(struct Mesh *mesh, void *userData)
+{
+    struct ModelStream *stream = userData;
+    if (UtilsAtomicLoad32(&stream->isCancelled)) {
+        MeshDeinit(mesh);
+        return;
+    }
+    struct MeshData *data = UtilsArenaAlloc(&stream->arena, sizeof *data);
+    BuildMeshData(mesh, data, &stream->arena, &stream->scratch);
+    MeshDeinit(mesh);
+
+    if (stream->numBuiltMeshes == stream->builtMeshesCapacity) {
+        stream->builtMeshesCapacity = stream->builtMeshesCapacity
+                                          ? stream->builtMeshesCapacity * 2
+                                          : 16;
+        stream->builtMeshes
+            = realloc(stream->builtMeshes, sizeof(struct MeshData *)
+                                               * stream->builtMeshesCapacity);
+    }
+    stream->builtMeshes[stream->numBuiltMeshes++] = data;
+    PushStreamedMesh(stream, data);
+}
+
+static void
+StreamModel(void *arg)
+{
+    struct ModelStream *stream = arg;
+    stream->isCacheHit
+        = MeshCache_Load(stream->cachePath, stream->absPath, &stream->cache);
+    if (stream->isCacheHit) {
+        for (u32 i = 0; i < stream->cache.numMeshes; ++i) {
+            PushStreamedMesh(stream, stream->cache.meshes + i);
+        }
+    } else if (OLLoadStreaming(stream->absPath, OnMeshParsed, stream)
+               && !UtilsAtomicLoad32(&stream->isCancelled)) {
+        // cache wants meshes in one array, copies share the buffers
+        struct ModelData data = { 0 };
+        data.numMeshes = stream->numBuiltMeshes;
+        data.meshes = malloc(sizeof(struct MeshData) * data.numMeshes);
+        for (u32 i = 0; i < data.numMeshes; ++i) {
+            data.meshes[i] = *stream->builtMeshes[i];
+        }
+        MeshCache_Save(stream->cachePath, stream->absPath, &data);
+        free(data.meshes);
+    }
+    UtilsArenaDeinit(&stream->scratch);
+    UtilsAtomicStore32(&stream->isParsed, 1);
+}
+
+struct ModelProxy *
+ModelProxy_CreateAsync(const struct ModelProxyCreateInfo *info)
+{
+    struct ModelStream *stream = malloc(sizeof *stream);
+    ZERO_MEMORY(stream);
+    stream->startTime = UtilsGetTimeInSeconds();
+    stream->path = strdup(info->path);
+    snprintf(stream->absPath, sizeof(stream->absPath), "%s/%s", RES_HOME,
+             info->path);
+    snprintf(stream->cachePath, sizeof(stream->cachePath), "%s.meshcache",
+             stream->absPath);
+    stream->vertexFormat = info->vertexFormat;
+    stream->geometry = info->geometry;
+    stream->world = info->world ? *info->world : MathMat4X4Identity();
+    UtilsSpscQueueInit(&stream->queue, MODEL_STREAM_QUEUE_SIZE);
+    UtilsArenaInit(&stream->arena, MODEL_ARENA_BLOCK_SIZE);
+    UtilsArenaInit(&stream->scratch, MODEL_SCRATCH_BLOCK_SIZE);
+
+    struct ModelProxy *proxy = malloc(sizeof *proxy);
+    ZERO_MEMORY(proxy);
+    proxy->stream = stream;
+    stream->thread = UtilsThreadCreate(StreamModel, stream);
+    return proxy;
+}
+
+static void
+FinishModelStream(struct ModelProxy *m)
+{
+    struct ModelStream *stream = m->stream;
+    UtilsThreadJoin(stream->thread);
+    // leftovers of a cancelled stream
+    if (stream->uploadingMesh) {
+        ReleaseStreamedMesh(stream->uploadingMesh);
+    }
+    struct StreamedMesh *streamed = NULL;
+    while ((streamed = UtilsSpscQueuePop(&stream->queue))) {
+        ReleaseStreamedMesh(streamed);
+    }
+    if (stream->isCacheHit) {
+        ModelData_Destroy(&stream->cache);
+    }
+    UtilsArenaDeinit(&stream->arena);
+    free(stream->builtMeshes);
+    UtilsSpscQueueDeinit(&stream->queue);
+
+    UtilsDebugPrint("ModelProxy: %s streamed %u meshes, %.2f MB in %.2f ms "
+                    "(%s, first mesh after %.2f ms)",
+                    stream->path, m->numMeshes,
+                    stream->uploadedBytes / (1024.0 * 1024.0),
+                    (UtilsGetTimeInSeconds() - stream->startTime) * 1000.0,
+                    stream->isCacheHit ? "warm" : "cold",
+                    stream->firstMeshTime * 1000.0);
+    free(stream->path);
+    free(stream);
+    m->stream = NULL;
+}
+
+void
+ModelProxy_Destroy(struct ModelProxy *m)
+{
+    if (!m) {
+        return;
+    }
+    if (m->stream) {
+        UtilsAtomicStore32(&m->stream->isCancelled, 1);
+        FinishModelStream(m);
+    }
+    for (u32 i = 0; i < m->numMeshes; ++i) {
+        ReleaseMeshProxy(m->meshes + i);
+    }
+    free(m->meshes);
+    free(m);
+}
+
+i32
+ModelProxy_Update(struct ModelProxy *m, u64 byteBudget)
+{
+    struct ModelStream *stream = m->stream;
+    if (!stream) {
+        return 0;
+    }
+
+    // read before the queue, so that empty queue after that means that
+    // every mesh was received
+    const u32 isParsed = UtilsAtomicLoad32(&stream->isParsed);
+    i32 isQueueEmpty = 0;
+    u64 uploaded = 0;
+    while (uploaded < byteBudget) {
+        struct StreamedMesh *streamed = stream->uploadingMesh;
+        if (!streamed) {
+            streamed = UtilsSpscQueuePop(&stream->queue);
+            if (!streamed) {
+                isQueueEmpty = 1;
+                break;
+            }
+            BeginMeshUpload(&streamed->proxy, &streamed->upload);
+            stream->uploadingMesh = streamed;
+        }
+        uploaded
+            += ContinueMeshUpload(&streamed->upload, byteBudget - uploaded);
+        if (!IsMeshUploadDone(&streamed->upload)) {
+            break;
+        }
+
+        // mesh becomes visible only when all of its data is on GPU
+        if (m->numMeshes == stream->meshesCapacity) {
+            stream->meshesCapacity
+                = stream->meshesCapacity ? stream->meshesCapacity * 2 : 16;
+            m->meshes = realloc(m->meshes, sizeof(struct MeshProxy)
+                                               * stream->meshesCapacity);
+        }
+        m->meshes[m->numMeshes++] = streamed->proxy;
+        free(streamed);
+        stream->uploadingMesh = NULL;
+        if (m->numMeshes == 1) {
+            stream->firstMeshTime
+                = UtilsGetTimeInSeconds() - stream->startTime;
+        }
+    }
+    stream->uploadedBytes += uploaded;
+
+    if (isParsed && isQueueEmpty) {
+        FinishModelStream(m);
+        return 0;
+    }
+    return 1;
+}
+
+// Length of the longest axis of world matrix, scales bounding spheres
+static f32
+GetMaxWorldScale(const Mat4X4 *world)
+{
+    f32 scale = 0.0f;
+    for (u32 i = 0; i < 3; ++i) {
+        const Vec3D axis = { world->A[i][0], world->A[i][1], world->A[i][2] };
+        scale = fmaxf(scale, MathVec3DDot(&axis, &axis));
+    }
+    return sqrtf(scale);
+}
+
+static Vec3D
+TransformPoint(const Vec3D *p, const Mat4X4 *m)
+{
+    const Vec4D v = { p->X, p->Y, p->Z, 1.0f };
+    const Vec4D r = MathMat4X4MultVec4DByMat4X4(&v, m);
+    return MathVec3DFromXYZ(r.X, r.Y, r.Z);
+}
+
+u32
+MeshProxy_SelectLod(const struct MeshProxy *mesh, const Vec3D *cameraPos,
+                    f32 pixelsPerUnit, f32 maxPixelError)
+{
+    // bounding sphere of the mesh in world space
+    const Vec3D worldCenter
+        = TransformPoint(&mesh->boundsCenter, &mesh->world);
+    const f32 scale = GetMaxWorldScale(&mesh->world);
+    const f32 radius = mesh->boundsRadius * scale;
+    const Vec3D toCamera = MathVec3DSubtraction(&worldCenter, cameraPos);
+    // distance to the closest point of the sphere, camera inside of it
+    // always gets full detail
+    const f32 distance
+        = sqrtf(MathVec3DDot(&toCamera, &toCamera)) - radius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+
+    u32 lod = 0;
+    for (u32 i = 1; i < mesh->numLods; ++i) {
+        const f32 pixels = mesh->lods[i].error * scale / distance
+                           * pixelsPerUnit;
+        if (pixels > maxPixelError) {
+            break;
+        }
+        lod = i;
+    }
+    return lod;
+}
+
+void
+MeshProxy_GetWorldBounds(const struct MeshProxy *mesh, Vec4D *outSphere,
+                         Obb *outBox)
+{
+    const Vec3D center = TransformPoint(&mesh->boundsCenter, &mesh->world);
+    *outSphere = MathVec4DFromXYZW(
+        center.X, center.Y, center.Z,
+        mesh->boundsRadius * GetMaxWorldScale(&mesh->world));
+    *outBox = MathObbFromAabb(&mesh->boundsMin, &mesh->boundsMax,
+                              &mesh->world);
+}
+
+u32
+MeshProxy_GetIndexSize(const struct MeshProxy *mesh)
 {
-    return LoadModel(path);
+    return mesh->indexType == GL_UNSIGNED_SHORT ? sizeof(u16) : sizeof(u32);
+}
+
+void
+MeshProxy_DrawLod(const struct MeshProxy *mesh, u32 lod)
+{
+    const struct MeshLod *range = mesh->lods + lod;
+    const u64 indexSize = MeshProxy_GetIndexSize(mesh);
+    GLCHECK(glDrawElementsBaseVertex(
+        GL_TRIANGLES, range->numIndices, mesh->indexType,
+        (void *)(mesh->indexOffset + range->firstIndex * indexSize),
+        mesh->baseVertex));
+}
+
+void
+MeshProxy_DrawLodInstanced(const struct MeshProxy *mesh, u32 lod,
+                           u32 numInstances)
+{
+    const struct GeometryBuffer *g = mesh->geometry;
+    assert(!g->isInstanceVboMapped);
+    GLState_BindVertexArray(g->pools[mesh->vertexFormat].instancedVao);
+    const struct MeshLod *range = mesh->lods + lod;
+    const u64 indexSize = MeshProxy_GetIndexSize(mesh);
+    GLCHECK(glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, range->numIndices, mesh->indexType,
+        (void *)(mesh->indexOffset + range->firstIndex * indexSize),
+        numInstances, mesh->baseVertex));
+}
+
+u32
+MeshProxy_CullMeshlets(const struct MeshProxy *mesh, const Frustum *frustum,
+                       const Vec3D *cameraPos, void *outIndices,
+                       struct MeshletCullStats *stats)
+{
+    const f32 scale = GetMaxWorldScale(&mesh->world);
+    // normals transform by inverse transpose, cones stay exact for rotation
+    // and uniform scale only, which is all meshes use
+    Mat4X4 normalMatrix = MathMat4X4Inverse(&mesh->world);
+    MathMat4X4Transpose(&normalMatrix);
+    const u64 indexSize = MeshProxy_GetIndexSize(mesh);
+
+    u32 numIndices = 0;
+    for (u32 i = 0; i < mesh->numMeshlets; ++i) {
+        const struct Meshlet *meshlet = mesh->meshlets + i;
+        const Vec3D center = TransformPoint(&meshlet->center, &mesh->world);
+        const f32 radius = meshlet->radius * scale;
+        if (!MathFrustumIntersectsSphere(frustum, &center, radius)) {
+            ++stats->numFrustumCulled;
+            stats->numCulledTriangles += meshlet->numIndices / 3;
+            continue;
+        }
+        if (meshlet->coneCutoff < 1.0f) {
+            const Vec4D a = { meshlet->coneAxis.X, meshlet->coneAxis.Y,
+                              meshlet->coneAxis.Z, 0.0f };
+            const Vec4D r = MathMat4X4MultVec4DByMat4X4(&a, &normalMatrix);
+            Vec3D axis = MathVec3DFromXYZ(r.X, r.Y, r.Z);
+            MathVec3DNormalize(&axis);
+            const Vec3D fromCamera = MathVec3DSubtraction(&center, cameraPos);
+            const f32 distance = sqrtf(MathVec3DDot(&fromCamera, &fromCamera));
+            if (MathVec3DDot(&fromCamera, &axis)
+                > meshlet->coneCutoff * distance + radius) {
+                ++stats->numBackfaceCulled;
+                stats->numCulledTriangles += meshlet->numIndices / 3;
+                continue;
+            }
+        }
+        memcpy((u8 *)outIndices + numIndices * indexSize,
+               (const u8 *)mesh->indices + meshlet->firstIndex * indexSize,
+               meshlet->numIndices * indexSize);
+        numIndices += meshlet->numIndices;
+    }
+    stats->numMeshlets += mesh->numMeshlets;
+    stats->numTriangles += mesh->lods[0].numIndices / 3;
+    return numIndices;
 }
 
 void
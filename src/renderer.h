@@ -15,35 +15,258 @@ struct Vertex {
     Vec4D tangent;
 };
 
-struct MeshProxy {
+// Must match VF_* defines in vert.glsl
+enum VertexFormat {
+    // struct Vertex
+    VF_FLOAT,
+    // struct PackedVertex
+    VF_PACKED,
+    VF_COUNT,
+};
+
+struct PackedVertex {
+    // xyz are quantized to mesh bounds, w is 1 if tangent sign is negative
+    u16 position[4];
+    // octahedral snorm16
+    i16 normal[2];
+    // octahedral snorm16
+    i16 tangent[2];
+    // half floats
+    u16 texCoords[2];
+};
+
+#define MESH_MAX_LODS 4
+
+// Range of the index buffer with one level of detail, LOD 0 is full detail.
+// All LODs share the vertex buffer.
+struct MeshLod {
+    u32 firstIndex;
+    u32 numIndices;
+    // object space distance by which LOD may deviate from full detail
+    f32 error;
+};
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Cluster of consecutive LOD 0 triangles that is culled as a whole
+struct Meshlet {
+    u32 firstIndex;
+    u32 numIndices;
+    // object space bounding sphere
+    Vec3D center;
+    f32 radius;
+    // normals of all triangles are within coneCutoff = sin(angle) of the
+    // axis, cluster faces away from camera when
+    // dot(center - camera, coneAxis) > coneCutoff * |center - camera| + radius
+    Vec3D coneAxis;
+    f32 coneCutoff;
+};
+
+// CPU side mesh ready to be uploaded to GPU
+struct MeshData {
+    i8 *name;
+    struct Vertex *vertices;
+    u32 numVertices;
+    // indices of all LODs
+    u32 *indices;
+    u32 numIndices;
+    struct MeshLod lods[MESH_MAX_LODS];
+    u32 numLods;
+    struct Meshlet *meshlets;
+    u32 numMeshlets;
+    Vec3D boundsMin;
+    Vec3D boundsMax;
+};
+
+struct ModelData {
+    struct MeshData *meshes;
+    u32 numMeshes;
+    // set if mesh data points into a mapped mesh cache file
+    struct UtilsMappedFile cacheMapping;
+    // own names, vertices and indices of meshes that were built from a model
+    struct UtilsArena *arenas;
+    u32 numArenas;
+};
+
+void ModelData_Destroy(struct ModelData *m);
+
+// Vertices of one format in a single buffer with a vertex array that every
+// mesh of that format is drawn with
+struct GeometryVertexPool {
     u32 vao;
+    // attributes of vao plus struct DrawInstance from the instance buffer
+    u32 instancedVao;
     u32 vbo;
+    u32 vertexSize;
+    // in bytes, granularity is vertexSize
+    struct UtilsRangeAllocator allocator;
+};
+
+// Vertex and index data of all meshes. Meshes are sub-allocated from a few
+// large buffers and drawn with base vertex, so the vertex array does not
+// change between meshes of the same format. Buffers grow on demand, freed
+// ranges are merged and reused.
+struct GeometryBuffer {
+    struct GeometryVertexPool pools[VF_COUNT];
+    // indices of all formats, bound to every pool's vertex array
     u32 ebo;
+    struct UtilsRangeAllocator indexAllocator;
+    // DrawInstances of the frame, orphaned by GeometryBuffer_MapInstances
+    u32 instanceVbo;
+    u64 instanceVboSize;
+    boolean isInstanceVboMapped;
+};
+
+// Per instance attributes of instanced draws, must match vert.glsl.
+// Matrices take four locations each.
+struct DrawInstance {
+    Mat4X4 world;
+    Mat4X4 invWorld;
+    // free for the shaders, e.g. a texture array layer in x
+    Vec4D params;
+};
+
+#define DRAW_INSTANCE_FIRST_LOCATION 4
+
+struct GeometryBufferStats {
+    u64 vertexBytes;
+    u64 vertexCapacity;
+    u64 indexBytes;
+    u64 indexCapacity;
+    u32 numAllocations;
+    u32 numFreeRanges;
+    // 1 - largest free range / free bytes, 0 when free space is contiguous
+    f32 vertexFragmentation;
+    f32 indexFragmentation;
+};
+
+struct GeometryBuffer *GeometryBuffer_Create(void);
+
+// All models that live in the buffer must be destroyed first
+void GeometryBuffer_Destroy(struct GeometryBuffer *g);
+
+void GeometryBuffer_GetStats(const struct GeometryBuffer *g,
+                             struct GeometryBufferStats *stats);
+
+// Maps count > 0 instances for writing. Instanced draws read from the start
+// of the buffer, so there is one batch of instances at a time and mapping
+// again orphans the previous one.
+struct DrawInstance *GeometryBuffer_MapInstances(struct GeometryBuffer *g,
+                                                 u32 count);
+void GeometryBuffer_UnmapInstances(struct GeometryBuffer *g);
+
+struct MeshProxy {
+    // vertex array of vertexFormat pool, shared with other meshes
+    u32 vao;
+    struct GeometryBuffer *geometry;
+    // first vertex in the pool, vertices of the mesh take vertexBytes
+    u32 baseVertex;
+    u64 vertexBytes;
+    // byte offset of the first index in geometry index buffer
+    u64 indexOffset;
+    u64 indexBytes;
+    // indices of all LODs
     u32 numIndices;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    u32 indexType;
+    struct MeshLod lods[MESH_MAX_LODS];
+    u32 numLods;
+    struct Meshlet *meshlets;
+    u32 numMeshlets;
+    // CPU copy of LOD 0 indices in indexType, source of culled index lists
+    void *indices;
+    enum VertexFormat vertexFormat;
+    // decodes VF_PACKED position, pos = position * posScale + posBias
+    Vec3D posScale;
+    Vec3D posBias;
+    // object space box and the sphere around it
+    Vec3D boundsMin;
+    Vec3D boundsMax;
+    Vec3D boundsCenter;
+    f32 boundsRadius;
     Mat4X4 world;
+    // bound by the application once the mesh arrived, material is its own
+    // material index
+    u32 material;
     struct Texture2D *albedo;
     struct Texture2D *normal;
     struct Texture2D *specular;
     i8 *name;
 };
 
+struct ModelStream;
+
 struct ModelProxy {
     struct MeshProxy *meshes;
     u32 numMeshes;
+    // set while meshes of ModelProxy_CreateAsync are still arriving
+    struct ModelStream *stream;
 };
 
-struct ModelProxy *ModelProxy_Create(const i8 *path);
+struct ModelProxyCreateInfo {
+    const i8 *path;
+    enum VertexFormat vertexFormat;
+    struct GeometryBuffer *geometry;
+    // optional, meshes are built on the calling thread if NULL
+    struct UtilsThreadPool *threadPool;
+    // optional, initial world of every mesh, identity if NULL
+    const Mat4X4 *world;
+};
+
+struct ModelProxy *ModelProxy_Create(const struct ModelProxyCreateInfo *info);
+
+// Returns model without meshes right away. Model is loaded on a background
+// thread and meshes are added by ModelProxy_Update as they arrive. Meshes are
+// built serially on that thread, threadPool is not used.
+struct ModelProxy *
+ModelProxy_CreateAsync(const struct ModelProxyCreateInfo *info);
+
+// Releases meshes and their geometry ranges, cancels streaming if model is
+// still loading. Must be called on GL thread.
+void ModelProxy_Destroy(struct ModelProxy *m);
+
+// Uploads streamed meshes spending about byteBudget bytes per call. Must be
+// called on GL thread, e.g. once per frame. Returns 1 while model is loading.
+i32 ModelProxy_Update(struct ModelProxy *m, u64 byteBudget);
+
+// Picks the coarsest LOD whose error projects to at most maxPixelError
+// pixels. pixelsPerUnit is the projected size of one world unit at distance
+// one, i.e. viewport height / (2 * tan(fovY / 2)).
+u32 MeshProxy_SelectLod(const struct MeshProxy *mesh, const Vec3D *cameraPos,
+                        f32 pixelsPerUnit, f32 maxPixelError);
+
+// Bounds of a mesh placed by its world matrix. outSphere is xyz center and
+// w radius.
+void MeshProxy_GetWorldBounds(const struct MeshProxy *mesh, Vec4D *outSphere,
+                              Obb *outBox);
 
-enum UniformType {
-    UT_MAT4,
-    UT_VEC4F,
-    UT_VEC3F,
-    UT_VEC2F,
-    UT_FLOAT,
-    UT_INT,
-    UT_UINT,
+// Size of one index in bytes
+u32 MeshProxy_GetIndexSize(const struct MeshProxy *mesh);
+
+// Draws one LOD of a mesh, vertex array must be bound
+void MeshProxy_DrawLod(const struct MeshProxy *mesh, u32 lod);
+
+// Draws the first numInstances mapped instances of the mesh's geometry
+// buffer, binds the instanced vertex array itself
+void MeshProxy_DrawLodInstanced(const struct MeshProxy *mesh, u32 lod,
+                                u32 numInstances);
+
+struct MeshletCullStats {
+    u32 numMeshlets;
+    u32 numFrustumCulled;
+    u32 numBackfaceCulled;
+    u64 numTriangles;
+    u64 numCulledTriangles;
 };
 
+// Copies LOD 0 indices of meshlets that may be visible to outIndices, which
+// must have room for all LOD 0 indices of indexType. frustum and cameraPos
+// are in world space. Returns number of indices written and adds to stats.
+u32 MeshProxy_CullMeshlets(const struct MeshProxy *mesh,
+                           const Frustum *frustum, const Vec3D *cameraPos,
+                           void *outIndices, struct MeshletCullStats *stats);
+
 enum ObjectIdentifier {
     OI_BUFFER,
     OI_INDEX_BUFFER,
@@ -89,26 +312,387 @@ void Texture2D_Load(struct Texture2D *t, const i8 *texPath, i32 internalFormat,
                     i32 format, i32 type);
 void Texture2D_Destroy(struct Texture2D *t);
 
+/// Texture2DArray
+struct Texture2DArray {
+    i32 width;
+    i32 height;
+    u32 numLayers;
+    i8 *name;
+    u32 handle;
+};
+
+// Copies textures into the layers of a new array. Layers take the size of
+// the first texture, others are scaled to it.
+void Texture2DArray_Init(struct Texture2DArray *t,
+                         const struct Texture2D *layers, u32 numLayers,
+                         const i8 *name);
+void Texture2DArray_Deinit(struct Texture2DArray *t);
+
+/// BufferTexture
+// Buffer that shaders read with texelFetch from a samplerBuffer
+struct BufferTexture {
+    u32 buffer;
+    u32 texture;
+    // sized format of the texels, e.g. GL_RGBA32F
+    u32 internalFormat;
+    u32 texelSize;
+    // GL_MAX_TEXTURE_BUFFER_SIZE, may be as low as 65536
+    u32 maxTexels;
+};
+
+void BufferTexture_Init(struct BufferTexture *t, u32 internalFormat,
+                        const i8 *name);
+void BufferTexture_Deinit(struct BufferTexture *t);
+
+// Replaces the contents with size bytes of data, orphans the old storage.
+// Texels past GL_MAX_TEXTURE_BUFFER_SIZE are dropped with a warning.
+void BufferTexture_Upload(struct BufferTexture *t, const void *data,
+                          u64 size);
+
 /// Material
+// Texture units available to samplers of one material
 #define MAX_SAMPLERS 16
+#define MATERIAL_INVALID_UNIFORM -1
+
 struct MaterialCreateInfo {
     const i8 *vsPath;
     const i8 *fsPath;
     const i8 *name;
-    const i8 *samplers[MAX_SAMPLERS];
-    u32 numSamplers;
+    // optional, inserted after the #version line of both stages, e.g.
+    // "#define INSTANCED\n"
+    const i8 *defines;
 };
 
 struct Material;
 
+// Active uniforms of the linked program are reflected into a hash table and
+// every sampler gets a fixed texture unit
 struct Material *Material_Create(const struct MaterialCreateInfo *info);
 void Material_Destroy(struct Material *m);
-void Material_SetUniform(struct Material *m, const i8 *name, u32 size,
-                         const void *data, enum UniformType type);
 u32 Material_GetHandle(const struct Material *m);
 const i8 *Material_GetName(const struct Material *m);
-void Material_SetTexture(struct Material *m, const i8 *name,
+
+// Returns handle of active uniform or sampler name, MATERIAL_INVALID_UNIFORM
+// if the program does not use it. Handles stay valid as long as material,
+// resolve them once instead of every frame.
+i32 Material_GetUniformHandle(const struct Material *m, const i8 *name);
+
+// data must match GLSL type of the uniform, e.g. Mat4X4 for mat4 and i32 for
+// int and bool. Program of m must be in use. Invalid handles are ignored.
+void Material_SetUniform(struct Material *m, i32 uniform, const void *data);
+
+// Binds t to the texture unit of sampler uniform
+void Material_SetTexture(struct Material *m, i32 uniform,
                          const struct Texture2D *t);
+void Material_SetTextureArray(struct Material *m, i32 uniform,
+                              const struct Texture2DArray *t);
+void Material_SetBufferTexture(struct Material *m, i32 uniform,
+                               const struct BufferTexture *t);
+
+/// Uniform blocks
+// Binding points of std140 blocks shared by all programs. Material_Create
+// binds blocks of these names, their layout must match the structs below.
+enum UniformBlock {
+    // FrameConstants, written once per frame
+    UB_FRAME,
+    // DrawConstants, one range of the uniform ring per draw
+    UB_DRAW,
+    UB_COUNT,
+};
+
+struct FrameConstants {
+    Mat4X4 view;
+    Mat4X4 proj;
+    Mat4X4 viewProj;
+    Mat4X4 invViewProj;
+    // vec3 members are padded to 16 bytes
+    Vec3D cameraPos;
+    f32 pad0;
+    Vec3D lightPos;
+    f32 pad1;
+    // width, height, 1 / width, 1 / height
+    Vec4D rtSize;
+};
+
+struct DrawConstants {
+    Mat4X4 world;
+    // inverse world of decal volumes, unused by other draws
+    Mat4X4 decalInvWorld;
+    // decodes VF_PACKED position, see MeshProxy
+    Vec3D posScale;
+    // enum VertexFormat
+    i32 vertexFormat;
+    Vec3D posBias;
+    f32 pad0;
+};
+
+#define UNIFORM_RING_FRAMES 3
+
+// Streams uniform block data through one buffer. Each of the last
+// UNIFORM_RING_FRAMES frames writes its own part of the buffer, which is
+// reused once the GPU has passed the fence of the frame that wrote it.
+struct UniformRing {
+    u32 buffer;
+    // bytes of one frame's part
+    u32 frameSize;
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    u32 alignment;
+    u32 frameIndex;
+    // next free byte in the part of the current frame
+    u32 head;
+    GLsync fences[UNIFORM_RING_FRAMES];
+    boolean isMapped;
+};
+
+struct UniformRing *UniformRing_Create(u32 frameSize);
+void UniformRing_Destroy(struct UniformRing *r);
+
+// Waits until the GPU is done with the part the new frame writes to
+void UniformRing_BeginFrame(struct UniformRing *r);
+void UniformRing_EndFrame(struct UniformRing *r);
+
+// Distance between consecutive blocks of blockSize bytes
+u32 UniformRing_GetStride(const struct UniformRing *r, u32 blockSize);
+
+// Maps count > 0 blocks that are stride bytes apart for writing, outOffset
+// is the buffer offset of the first block. Must be unmapped before drawing.
+void *UniformRing_Map(struct UniformRing *r, u32 stride, u32 count,
+                      u32 *outOffset);
+void UniformRing_Unmap(struct UniformRing *r);
+
+// Binds size bytes at offset to the binding point of block
+void UniformRing_Bind(const struct UniformRing *r, enum UniformBlock block,
+                      u32 offset, u32 size);
+
+/// RenderQueue
+#define DRAW_PACKET_MAX_TEXTURES 4
+
+// Sort key fields from most significant bits down. Ids are truncated to
+// their field, collisions only cost order, not correctness.
+#define SORT_KEY_PASS_BITS 4
+#define SORT_KEY_PROGRAM_BITS 8
+#define SORT_KEY_TEXTURE_SET_BITS 16
+#define SORT_KEY_VERTEX_ARRAY_BITS 12
+#define SORT_KEY_DEPTH_BITS 24
+
+// Everything needed to issue one draw
+struct DrawPacket {
+    u64 sortKey;
+    struct Material *material;
+    const struct MeshProxy *mesh;
+    u32 lod;
+    // sampler uniform handles of material and their textures
+    i32 samplers[DRAW_PACKET_MAX_TEXTURES];
+    const struct Texture2D *textures[DRAW_PACKET_MAX_TEXTURES];
+    u32 numTextures;
+    // DrawConstants range in the uniform ring
+    u32 drawOffset;
+    // not used by the queue, e.g. index of the drawn object
+    u32 userData;
+};
+
+// Packets of one or more passes. Recording may happen on any thread,
+// everything else on the GL thread.
+struct RenderQueue {
+    struct DrawPacket *packets;
+    u32 numPackets;
+    u32 capacity;
+    // packet indices in execution order after RenderQueue_Sort
+    u32 *order;
+    // sorted keys and UtilsRadixSort64 scratch
+    uint64_t *keys;
+    uint64_t *tmpKeys;
+    u32 *tmpOrder;
+};
+
+// Issues the draw of a packet whose state is set, NULL draws packet->lod
+typedef void (*DrawPacketFunc)(const struct DrawPacket *packet,
+                               void *userData);
+
+void RenderQueue_Init(struct RenderQueue *q);
+void RenderQueue_Deinit(struct RenderQueue *q);
+
+// Drops all packets and makes room for capacity packets, not thread safe
+void RenderQueue_Reset(struct RenderQueue *q, u32 capacity);
+
+// Returns count uninitialized packets, safe to call from several threads
+// between resets. Recording more than capacity packets is a fatal error.
+struct DrawPacket *RenderQueue_Push(struct RenderQueue *q, u32 count);
+
+// depth is in [0, 1], nearer packets sort first within equal state
+u64 RenderQueue_MakeSortKey(u32 pass, u32 program, u32 textureSet,
+                            u32 vertexArray, f32 depth);
+
+// Radix sorts packets by sortKey, equal keys keep recording order
+void RenderQueue_Sort(struct RenderQueue *q);
+
+// Executes sorted packets of pass. Program, textures, vertex array and
+// DrawConstants of ring are set through GLState, so state shared by
+// consecutive packets is not set again.
+void RenderQueue_Execute(const struct RenderQueue *q, u32 pass,
+                         const struct UniformRing *ring, DrawPacketFunc draw,
+                         void *userData);
+
+/// GLState
+// Shadow of the GL state that the frame loop changes. Setters skip calls
+// that would not change anything. Code that changes this state directly
+// must call GLState_Invalidate afterwards.
+enum GLStateCall {
+    GSC_PROGRAM,
+    GSC_VERTEX_ARRAY,
+    // active texture unit and texture bindings
+    GSC_TEXTURE,
+    GSC_FRAMEBUFFER,
+    // depth, cull, blend, stencil test and color mask state
+    GSC_RASTER,
+    GSC_UNIFORM_BUFFER,
+    // Material_SetUniform
+    GSC_UNIFORM,
+    GSC_COUNT,
+};
+
+struct GLStateStats {
+    // calls that reached GL
+    u32 numIssued[GSC_COUNT];
+    // redundant calls that were skipped
+    u32 numFiltered[GSC_COUNT];
+};
+
+// Forgets all shadowed state, starts counting a new frame and keeps
+// counters of the last one for GLState_GetStats
+void GLState_BeginFrame(void);
+void GLState_Invalidate(void);
+void GLState_GetStats(struct GLStateStats *stats);
+
+void GLState_UseProgram(u32 program);
+void GLState_BindVertexArray(u32 vao);
+// Also makes unit the active texture unit
+void GLState_BindTexture(u32 unit, u32 target, u32 texture);
+// GL_FRAMEBUFFER binds both draw and read framebuffer
+void GLState_BindFramebuffer(u32 target, u32 framebuffer);
+void GLState_BindUniformBuffer(u32 index, u32 buffer, u32 offset, u32 size);
+// cap is GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST or
+// GL_STENCIL_TEST. Stencil functions and operations are not shadowed.
+void GLState_Enable(u32 cap, boolean enable);
+void GLState_DepthFunc(u32 func);
+void GLState_DepthMask(boolean mask);
+// all four channels
+void GLState_ColorMask(boolean mask);
+void GLState_CullFace(u32 mode);
+void GLState_BlendFunc(u32 src, u32 dst);
+
+/// GpuTimer
+#define GPU_TIMER_FRAMES 3
+
+// GPU time between Begin and End from GL_TIME_ELAPSED queries. A query is
+// read when it is reused GPU_TIMER_FRAMES measurements later, by then it has
+// finished and reading it does not stall. Timers must not overlap.
+struct GpuTimer {
+    u32 queries[GPU_TIMER_FRAMES];
+    boolean isPending[GPU_TIMER_FRAMES];
+    u32 next;
+    // latest result that was read
+    f64 milliseconds;
+};
+
+void GpuTimer_Init(struct GpuTimer *t, const i8 *name);
+void GpuTimer_Deinit(struct GpuTimer *t);
+void GpuTimer_Begin(struct GpuTimer *t);
+void GpuTimer_End(struct GpuTimer *t);
+
+/// GpuSampleCounters
+// GL_SAMPLES_PASSED of up to numCounters draws per frame, e.g. one per light.
+// Like GpuTimer, the queries of a frame are read when they are reused
+// GPU_TIMER_FRAMES frames later. Counters must not overlap.
+struct GpuSampleCounters {
+    // GPU_TIMER_FRAMES rows of numCounters queries
+    u32 *queries;
+    // counters begun in each row
+    u32 numUsed[GPU_TIMER_FRAMES];
+    u32 numCounters;
+    u32 next;
+    // latest results that were read, one per counter begun in their frame
+    u32 *samples;
+    u32 numResults;
+};
+
+void GpuSampleCounters_Init(struct GpuSampleCounters *c, u32 numCounters);
+void GpuSampleCounters_Deinit(struct GpuSampleCounters *c);
+// Reads the results of the row the frame reuses
+void GpuSampleCounters_BeginFrame(struct GpuSampleCounters *c);
+void GpuSampleCounters_Begin(struct GpuSampleCounters *c, u32 counter);
+void GpuSampleCounters_End(struct GpuSampleCounters *c);
+void GpuSampleCounters_EndFrame(struct GpuSampleCounters *c);
+
+/// ClusterGrid
+// Must match CLUSTER_* defines of the shaders
+#define CLUSTER_TILE_SIZE 64
+#define CLUSTER_DEPTH_SLICES 16
+
+// Clusters touched by an item, bounds are inclusive
+struct ClusterRange {
+    u16 minX;
+    u16 maxX;
+    u16 minY;
+    u16 maxY;
+    u16 minZ;
+    u16 maxZ;
+};
+
+// Screen tiles of CLUSTER_TILE_SIZE pixels times CLUSTER_DEPTH_SLICES slices
+// of view depth, spaced exponentially between zNear and zFar. Every cluster
+// lists the items whose ranges touch it. Shaders find the (first, count)
+// pair of their cluster in clusterTexture and the item indices in
+// indexTexture. Cluster index is (z * numTilesY + y) * numTilesX + x.
+struct ClusterGrid {
+    u32 width;
+    u32 height;
+    u32 numTilesX;
+    u32 numTilesY;
+    u32 numClusters;
+    f32 zNear;
+    f32 zFar;
+    // slice = log(viewZ) * sliceScale + sliceBias
+    f32 sliceScale;
+    f32 sliceBias;
+    // first index and number of indices of every cluster
+    u32 *clusters;
+    u32 clusterCapacity;
+    u32 *indices;
+    u32 numIndices;
+    u32 indexCapacity;
+    // GL_RG32UI
+    struct BufferTexture clusterTexture;
+    // GL_R32UI
+    struct BufferTexture indexTexture;
+};
+
+void ClusterGrid_Init(struct ClusterGrid *g, const i8 *name);
+void ClusterGrid_Deinit(struct ClusterGrid *g);
+
+// Sizes the grid to a viewport of width x height pixels and a depth range,
+// call before ranges of the frame are computed
+void ClusterGrid_Begin(struct ClusterGrid *g, u32 width, u32 height,
+                       f32 zNear, f32 zFar);
+
+// Range of clusters touched by the convex hull of world space points
+void ClusterGrid_GetRange(const struct ClusterGrid *g, const Vec3D *points,
+                          u32 numPoints, const Mat4X4 *view,
+                          const Mat4X4 *proj, struct ClusterRange *out);
+
+// Range of clusters touched by a normalized device coordinates rectangle
+// (minX, minY, maxX, maxY) between view depths minZ and maxZ, e.g. bounds
+// of MathProjectSpheres
+void ClusterGrid_GetRangeFromBounds(const struct ClusterGrid *g,
+                                    const Vec4D *ndcRect, f32 minZ, f32 maxZ,
+                                    struct ClusterRange *out);
+
+// Lists item i in every cluster of ranges[i] and uploads the lists
+void ClusterGrid_Build(struct ClusterGrid *g,
+                       const struct ClusterRange *ranges, u32 numItems);
+
+// numTilesX, numTilesY, sliceScale and sliceBias for the shaders
+Vec4D ClusterGrid_GetShaderParams(const struct ClusterGrid *g);
 
 // TODO Make private
 